@@ -0,0 +1,196 @@
+/* mp4 box parser vs libavformat probing.
+
+For every file under a dir, get the stream info twice:
+
+  boxes  mp4_info_read (example-util/mp4info.c), only the moov header
+  lavf   avformat_open_input + avformat_find_stream_info, no stream cache
+
+and print both times, how many header bytes the box walk parsed and
+whether the two agree on codec, resolution, sample rate and channels per
+stream.  Files the box parser can't handle say "fallback", that's where
+the players go the libavformat way.
+
+  wiiload stream_info.rpx mp4 [-n rounds] [dir]
+
+-n repeats each measurement and keeps the fastest, default 3.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "exutil.h"
+#include "mp4bench.h"
+#include "mp4info.h"
+#include "whbcompat.h"
+
+struct Mp4Bench {
+    const char *dir;
+    int rounds;
+    int files;
+    int parsed;        /* box parser handled it */
+    int differs;       /* ... but disagreed with libavformat */
+    uint64_t boxes_ns; /* parsed files only, both of them */
+    uint64_t lavf_ns;
+};
+
+/* Fastest of rounds runs, info from the last one */
+static uint64_t time_boxes(const char *path, int rounds, struct Mp4Info *info,
+                           int *ret) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < rounds; i++) {
+        uint64_t t0 = util_clock_ns();
+        *ret = mp4_info_read(path, info);
+        uint64_t ns = util_clock_ns() - t0;
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+static uint64_t time_lavf(const char *path, int rounds,
+                          AVFormatContext **fmt_ctx) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < rounds; i++) {
+        avformat_close_input(fmt_ctx);
+        uint64_t t0 = util_clock_ns();
+        if (avformat_open_input(fmt_ctx, path, NULL, NULL) < 0) {
+            return 0;
+        }
+        if (avformat_find_stream_info(*fmt_ctx, NULL) < 0) {
+            avformat_close_input(fmt_ctx);
+            return 0;
+        }
+        uint64_t ns = util_clock_ns() - t0;
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+/* Do the tracks match libavformat's streams, in order? */
+static int same_streams(const struct Mp4Info *info,
+                        const AVFormatContext *fmt_ctx) {
+    int nb_streams = (int)fmt_ctx->nb_streams;
+
+    /* the parser stops counting at MP4_MAX_TRACKS */
+    if (info->nb_tracks != nb_streams &&
+        !(info->nb_tracks == MP4_MAX_TRACKS && nb_streams > MP4_MAX_TRACKS)) {
+        return 0;
+    }
+    for (int i = 0; i < info->nb_tracks; i++) {
+        const struct Mp4Track *t = &info->tracks[i];
+        const AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if (t->type != par->codec_type) {
+            return 0;
+        }
+        if ((t->type == AVMEDIA_TYPE_VIDEO || t->type == AVMEDIA_TYPE_AUDIO) &&
+            t->codec_id != par->codec_id) {
+            return 0;
+        }
+        if (t->type == AVMEDIA_TYPE_VIDEO &&
+            (t->width != par->width || t->height != par->height)) {
+            return 0;
+        }
+        if (t->type == AVMEDIA_TYPE_AUDIO &&
+            (t->sample_rate != par->sample_rate ||
+             t->channels != par->ch_layout.nb_channels)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int bench_file(const char *path, void *opaque) {
+    struct Mp4Bench *b = opaque;
+    AVFormatContext *fmt_ctx = NULL;
+    struct Mp4Info info;
+    const char *name = path;
+    const char *verdict;
+    int ret;
+
+    if (strncmp(name, b->dir, strlen(b->dir)) == 0 &&
+        name[strlen(b->dir)] == '/') {
+        name += strlen(b->dir) + 1;
+    }
+    uint64_t boxes_ns = time_boxes(path, b->rounds, &info, &ret);
+    uint64_t lavf_ns = time_lavf(path, b->rounds, &fmt_ctx);
+    if (fmt_ctx == NULL) {
+        WHBLogPrintf("%8s %8s %7s %8s  %s", "-", "-", "-", "no lavf", name);
+        WHBLogConsoleDraw();
+        return 0;
+    }
+
+    b->files++;
+    if (ret < 0) {
+        verdict = "fallback";
+        boxes_ns = 0;
+    } else {
+        b->parsed++;
+        b->boxes_ns += boxes_ns;
+        b->lavf_ns += lavf_ns;
+        verdict = "match";
+        if (!same_streams(&info, fmt_ctx)) {
+            b->differs++;
+            verdict = "DIFFERS";
+        }
+    }
+    WHBLogPrintf("%8.2f %8.2f %7lld %8s  %s", boxes_ns / 1e6, lavf_ns / 1e6,
+                 ret < 0 ? 0LL : (long long)info.bytes_read, verdict, name);
+    WHBLogConsoleDraw();
+    avformat_close_input(&fmt_ctx);
+    return 0;
+}
+
+int mp4_bench_main(int argc, char **argv) {
+    char dir[256];
+    struct Mp4Bench b;
+    int opt;
+
+    memset(&b, 0, sizeof(b));
+    b.rounds = 3;
+    optind = 1;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                b.rounds = atoi(optarg);
+                break;
+            default:
+                b.rounds = 0;
+                break;
+        }
+    }
+    if (b.rounds < 1) {
+        WHBLogPrint("usage: mp4 [-n rounds] [dir]");
+        return 1;
+    }
+    if (optind < argc) {
+        snprintf(dir, sizeof(dir), "%s", argv[optind]);
+    } else if (util_get_media_dir(dir, sizeof(dir)) < 0) {
+        WHBLogPrint("failed to find sd:/media");
+        return 1;
+    }
+    b.dir = dir;
+
+    WHBLogPrintf("== mp4 box parser vs libavformat, %s, best of %d", dir,
+                 b.rounds);
+    WHBLogPrint("boxes ms  lavf ms   bytes  streams  file");
+    WHBLogConsoleDraw();
+    if (util_walk_media_files(dir, bench_file, &b) < 0) {
+        WHBLogPrintf("cannot open %s", dir);
+        return 1;
+    }
+
+    WHBLogPrintf("%d files, %d parsed from the boxes (%d differ), "
+                 "%d fell back",
+                 b.files, b.parsed, b.differs, b.files - b.parsed);
+    if (b.parsed > 0) {
+        WHBLogPrintf("parsed files: boxes %.2f ms, lavf %.2f ms, %.0fx",
+                     b.boxes_ns / 1e6 / b.parsed, b.lavf_ns / 1e6 / b.parsed,
+                     b.boxes_ns ? (double)b.lavf_ns / b.boxes_ns : 0.0);
+    }
+    WHBLogConsoleDraw();
+    return 0;
+}
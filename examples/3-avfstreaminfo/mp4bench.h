@@ -0,0 +1,7 @@
+#ifndef MP4BENCH_H
+#define MP4BENCH_H
+
+/* mp4 [-n rounds] [dir], see mp4bench.c */
+int mp4_bench_main(int argc, char **argv);
+
+#endif  // MP4BENCH_H
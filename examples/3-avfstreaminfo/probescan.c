@@ -0,0 +1,217 @@
+/* Probe a whole directory through a worker pool.
+
+print_avformat_stream_info probes one file.  Probing is mostly waiting on
+the SD card (avformat_open_input, the reads in find_stream_info) with bits
+of demuxer work in between, so several probes in flight should overlap
+well.  Scan every file under a dir with 1..-j workers, each worker pulls
+the next file, opens its own AVFormatContext, probes and closes it.
+Results land in walk order whatever the finishing order was.
+
+  wiiload stream_info.rpx scan [-j max workers] [dir]
+
+Prints files/sec, speedup and efficiency (speedup / workers) per worker
+count, then the per-file results of the last pass.  The first pass also
+warms whatever caching there is, run it twice if the 1 worker row looks
+slow.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "exutil.h"
+#include "probescan.h"
+#include "whbcompat.h"
+
+#define PROBE_MAX_WORKERS 8
+#define PROBE_DEFAULT_WORKERS 3 /* Espresso, 3 cores */
+
+struct ProbeResult {
+    char path[512];
+    int ret; /* < 0 ffmpeg error */
+    char container[32];
+    char video[24];
+    char audio[24];
+    int width;
+    int height;
+    int64_t duration_ms;
+    uint64_t ns; /* open + find_stream_info + close */
+};
+
+struct ProbePool {
+    struct ProbeResult *results;
+    int count;
+    int capacity;
+    int next; /* next file to hand out, under lock */
+    pthread_mutex_t lock;
+};
+
+static int add_file(const char *path, void *opaque) {
+    struct ProbePool *pool = opaque;
+    if (pool->count == pool->capacity) {
+        int capacity = pool->capacity ? pool->capacity * 2 : 64;
+        struct ProbeResult *results =
+            realloc(pool->results, capacity * sizeof(*results));
+        if (results == NULL) {
+            return 1;
+        }
+        pool->results = results;
+        pool->capacity = capacity;
+    }
+    struct ProbeResult *r = &pool->results[pool->count++];
+    memset(r, 0, sizeof(*r));
+    snprintf(r->path, sizeof(r->path), "%s", path);
+    return 0;
+}
+
+static void probe_one(struct ProbeResult *r) {
+    AVFormatContext *fmt_ctx = NULL;
+    uint64_t t0 = util_clock_ns();
+
+    r->container[0] = r->video[0] = r->audio[0] = '\0';
+    r->width = r->height = 0;
+    r->duration_ms = -1;
+    if ((r->ret = avformat_open_input(&fmt_ctx, r->path, NULL, NULL)) == 0 &&
+        (r->ret = avformat_find_stream_info(fmt_ctx, NULL)) >= 0) {
+        snprintf(r->container, sizeof(r->container), "%s",
+                 fmt_ctx->iformat->name);
+        for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+            AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO && !r->video[0]) {
+                snprintf(r->video, sizeof(r->video), "%s",
+                         avcodec_get_name(par->codec_id));
+                r->width = par->width;
+                r->height = par->height;
+            } else if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+                       !r->audio[0]) {
+                snprintf(r->audio, sizeof(r->audio), "%s",
+                         avcodec_get_name(par->codec_id));
+            }
+        }
+        if (fmt_ctx->duration != AV_NOPTS_VALUE) {
+            r->duration_ms = fmt_ctx->duration / (AV_TIME_BASE / 1000);
+        }
+    }
+    avformat_close_input(&fmt_ctx);
+    r->ns = util_clock_ns() - t0;
+}
+
+static void *probe_worker(void *arg) {
+    struct ProbePool *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count) {
+            return NULL;
+        }
+        probe_one(&pool->results[i]);
+    }
+}
+
+/* One pass over every file, return wall seconds */
+static double run_pass(struct ProbePool *pool, int workers) {
+    pthread_t threads[PROBE_MAX_WORKERS];
+    int started[PROBE_MAX_WORKERS];
+
+    pool->next = 0;
+    uint64_t t0 = util_clock_ns();
+    for (int w = 0; w < workers; w++) {
+        started[w] =
+            pthread_create(&threads[w], NULL, probe_worker, pool) == 0;
+    }
+    /* if no thread could start, probe everything here */
+    probe_worker(pool);
+    for (int w = 0; w < workers; w++) {
+        if (started[w]) pthread_join(threads[w], NULL);
+    }
+    return (util_clock_ns() - t0) / 1e9;
+}
+
+static void print_results(const struct ProbePool *pool, const char *dir) {
+    size_t dir_len = strlen(dir);
+
+    WHBLogPrint("    ms container      video  res        audio  length  file");
+    for (int i = 0; i < pool->count; i++) {
+        const struct ProbeResult *r = &pool->results[i];
+        const char *name = r->path;
+        if (strncmp(name, dir, dir_len) == 0 && name[dir_len] == '/') {
+            name += dir_len + 1;
+        }
+        if (r->ret < 0) {
+            WHBLogPrintf("%6d %-14s %s", (int)(r->ns / 1000000), "-", name);
+            continue;
+        }
+        int secs = r->duration_ms >= 0 ? (int)(r->duration_ms / 1000) : 0;
+        WHBLogPrintf("%6d %-14.14s %-6s %4dx%-4d %-6s %3d:%02d  %s",
+                     (int)(r->ns / 1000000), r->container,
+                     r->video[0] ? r->video : "-", r->width, r->height,
+                     r->audio[0] ? r->audio : "-", secs / 60, secs % 60,
+                     name);
+    }
+    WHBLogConsoleDraw();
+}
+
+int probe_scan_main(int argc, char **argv) {
+    char dir[256];
+    int max_workers = PROBE_DEFAULT_WORKERS;
+    struct ProbePool pool;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        switch (opt) {
+            case 'j':
+                max_workers = atoi(optarg);
+                break;
+            default:
+                max_workers = 0;
+                break;
+        }
+    }
+    if (max_workers < 1 || max_workers > PROBE_MAX_WORKERS) {
+        WHBLogPrintf("usage: scan [-j 1..%d workers] [dir]",
+                     PROBE_MAX_WORKERS);
+        return 1;
+    }
+    if (optind < argc) {
+        snprintf(dir, sizeof(dir), "%s", argv[optind]);
+    } else if (util_get_media_dir(dir, sizeof(dir)) < 0) {
+        WHBLogPrint("failed to find sd:/media");
+        return 1;
+    }
+
+    memset(&pool, 0, sizeof(pool));
+    if (util_walk_media_files(dir, add_file, &pool) < 0 || pool.count == 0) {
+        WHBLogPrintf("no files in %s", dir);
+        free(pool.results);
+        return 1;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+
+    WHBLogPrintf("== probe scan, %s, %d files", dir, pool.count);
+    WHBLogPrint("workers    secs  files/s  speedup   eff");
+    WHBLogConsoleDraw();
+    double base_secs = 0;
+    for (int workers = 1; workers <= max_workers; workers++) {
+        /* the calling thread is one of the workers */
+        double secs = run_pass(&pool, workers - 1);
+        if (workers == 1) base_secs = secs;
+        double speedup = secs > 0 ? base_secs / secs : 0;
+        WHBLogPrintf("%7d %7.2f %8.1f %7.2fx %4.0f%%", workers, secs,
+                     secs > 0 ? pool.count / secs : 0, speedup,
+                     100.0 * speedup / workers);
+        WHBLogConsoleDraw();
+    }
+    print_results(&pool, dir);
+
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.results);
+    return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef PROBESCAN_H
+#define PROBESCAN_H
+
+/* scan [-j max workers] [dir], see probescan.c */
+int probe_scan_main(int argc, char **argv);
+
+#endif  // PROBESCAN_H
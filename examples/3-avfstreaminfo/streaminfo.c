@@ -16,16 +16,23 @@ UPDATE: this works on the WIIU, but crashes on CEMU.  TBD: debug
  */
 
 #include <coreinit/thread.h>
+#include <coreinit/time.h>
 #include <dirent.h>
 #include <libavformat/avformat.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <whb/log.h>
 #include <whb/log_console.h>
 #include <whb/proc.h>
 
 #include "exutil.h"
+#include "medialib.h"
+#include "mp4bench.h"
+#include "mp4info.h"
+#include "probescan.h"
+#include "streamcache.h"
 
 const char *SD_WIIU = "/vol/external01/media";
 const char *SD_CEMU = "/vol/storage_mlc01/media";
@@ -51,6 +58,35 @@ long get_file_size(char *filename) {
     return f_stat.st_size;
 }
 
+/* mp4 / mov: read the moov box and nothing else.  < 0 if the file isn't
+   one the box parser handles, then libavformat has to probe it */
+int print_mp4_stream_info(const char *path) {
+    struct Mp4Info info;
+
+    OSTime start = OSGetTime();
+    if (mp4_info_read(path, &info) < 0) {
+        return -1;
+    }
+    WHBLogPrintf("= mp4 header: %d streams in %d ms, %d header bytes read",
+                 info.nb_tracks,
+                 (int)OSTicksToMilliseconds(OSGetTime() - start),
+                 (int)info.bytes_read);
+    for (int i = 0; i < info.nb_tracks; i++) {
+        const struct Mp4Track *t = &info.tracks[i];
+        WHBLogPrint("");
+        WHBLogPrintf("Stream #%d:", i);
+        WHBLogPrintf("  Codec: %s", avcodec_get_name(t->codec_id));
+        WHBLogPrintf("  Type: %s", av_get_media_type_string(t->type));
+        if (t->type == AVMEDIA_TYPE_VIDEO) {
+            WHBLogPrintf("  Resolution: %d x %d", t->width, t->height);
+        } else if (t->type == AVMEDIA_TYPE_AUDIO) {
+            WHBLogPrintf("  Sample rate: %d Hz", t->sample_rate);
+        }
+    }
+    WHBLogConsoleDraw();
+    return 0;
+}
+
 int print_avformat_stream_info() {
     char path_buffer[1024];
     bool found = false;
@@ -65,6 +101,13 @@ int print_avformat_stream_info() {
     WHBLogPrint("");
     WHBLogConsoleDraw();
 
+    /* mp4 doesn't need the demuxer at all */
+    if (print_mp4_stream_info(path_buffer) == 0) {
+        return 0;
+    }
+    WHBLogPrint("= not an mp4 the box parser reads, probing with libavformat");
+    WHBLogConsoleDraw();
+
     /* av_log_set_callback(custom_av_log);   // for debugging   */
 
     /* per api docs, avformat_open_input shouldn't need this, but CEMU crashes
@@ -80,11 +123,15 @@ int print_avformat_stream_info() {
     WHBLogPrint("= opened input, finding stream info");
     WHBLogConsoleDraw();
 
-    if ((ret = avformat_find_stream_info(fmt_ctx, NULL)) < 0) {
+    OSTime info_start = OSGetTime();
+    ret = stream_cache_find_stream_info(fmt_ctx, path_buffer, NULL);
+    if (ret < 0) {
         WHBLogPrint("avformat_find_stream_info Cannot find stream info");
         return ret;
     }
-    WHBLogPrint("= found stream info, detecting streams");
+    WHBLogPrintf("= found stream info in %d ms%s, detecting streams",
+                 (int)OSTicksToMilliseconds(OSGetTime() - info_start),
+                 ret == 1 ? " (cached)" : "");
     WHBLogConsoleDraw();
     WHBLogPrintf("= number of streams %d", fmt_ctx->nb_streams);
     WHBLogConsoleDraw();
@@ -144,6 +191,44 @@ int print_avformat_stream_info() {
     return 0;
 }
 
+/* Bring the sd:/media index up to date and list it.  Only new or changed
+   files get probed, so the second run should take next to no time. */
+int print_media_library() {
+    char media_dir[256];
+    struct MediaLibrary *lib = NULL;
+    struct MediaLibStats stats;
+
+    if (util_get_media_dir(media_dir, sizeof(media_dir)) < 0 ||
+        media_lib_open(&lib, media_dir) < 0) {
+        return -1;
+    }
+    WHBLogPrintf("= media library, %d files indexed", media_lib_count(lib));
+    WHBLogConsoleDraw();
+    if (media_lib_update(lib, &stats) < 0) {
+        media_lib_close(&lib);
+        return -1;
+    }
+    WHBLogPrintf("= updated in %d ms: %d files, %d probed (%d failed), "
+                 "%d removed",
+                 (int)(stats.ns / 1000000), stats.files, stats.probed,
+                 stats.failed, stats.removed);
+    for (int i = 0; i < media_lib_count(lib); i++) {
+        const struct MediaEntry *e = media_lib_entry(lib, i);
+        if (!e->container[0]) {
+            continue;
+        }
+        WHBLogPrintf("  %-5s %-5s %4dx%-4d %4d:%02d %s",
+                     e->video_codec[0] ? e->video_codec : "-",
+                     e->audio_codec[0] ? e->audio_codec : "-", e->width,
+                     e->height, (int)(e->duration_ms / 60000),
+                     (int)(e->duration_ms / 1000 % 60),
+                     e->path + strlen(media_dir) + 1);
+    }
+    WHBLogConsoleDraw();
+    media_lib_close(&lib);
+    return 0;
+}
+
 int main(int argc, char **argv) {
     WHBProcInit();
 
@@ -151,9 +236,26 @@ int main(int argc, char **argv) {
         Don't mix with other graphics code! */
     WHBLogConsoleInit();
 
-    int ret = print_avformat_stream_info();
-    WHBLogPrintf("print_avformat_stream_info() exited with code %d", ret);
-    WHBLogConsoleDraw();
+    /* wiiload stream_info.rpx scan [-j workers] [dir] probes a whole dir,
+       mp4 [-n rounds] [dir] times the box parser against libavformat */
+    int ret;
+    if (argc > 1 && strcmp(argv[1], "scan") == 0) {
+        ret = probe_scan_main(argc - 1, argv + 1);
+        WHBLogPrintf("probe_scan_main() exited with code %d", ret);
+        WHBLogConsoleDraw();
+    } else if (argc > 1 && strcmp(argv[1], "mp4") == 0) {
+        ret = mp4_bench_main(argc - 1, argv + 1);
+        WHBLogPrintf("mp4_bench_main() exited with code %d", ret);
+        WHBLogConsoleDraw();
+    } else {
+        ret = print_avformat_stream_info();
+        WHBLogPrintf("print_avformat_stream_info() exited with code %d", ret);
+        WHBLogConsoleDraw();
+
+        ret = print_media_library();
+        WHBLogPrintf("print_media_library() exited with code %d", ret);
+        WHBLogConsoleDraw();
+    }
 
     int times_left = 10;
     while (WHBProcIsRunning() && times_left > 0) {
@@ -0,0 +1,42 @@
+# Makefile for building the readspeed benchmark on a Linux (or Mac) host
+# Install ffmpeg development packages first, ex.
+#   apt-get install libavformat-dev libavcodec-dev libswscale-dev \
+#       libswresample-dev libavutil-dev pkg-config
+#   brew install ffmpeg pkgconf
+#
+#  Usage: make -f Makefile.host.mk; ./readspeed-host <media file>
+#         ./readspeed-host corpus -n 5 -f csv -o results.csv ~/media
+
+TARGET = readspeed-host
+
+CC = gcc
+PKGCONF ?= pkg-config
+
+CFLAGS = -Wall -O2 -g -pthread -I. -I../example-util
+FFMPEG_CFLAGS = $(shell $(PKGCONF) --cflags libavformat libavcodec libavutil \
+                  libswresample libswscale)
+FFMPEG_LDFLAGS = $(shell $(PKGCONF) --libs libavformat libavcodec libavutil \
+                  libswresample libswscale)
+
+CFLAGS += $(FFMPEG_CFLAGS)
+LDFLAGS += $(FFMPEG_LDFLAGS) -lm -pthread
+
+SRC = readspeed.c avdecode.c corpus.c threads.c readahead_bench.c \
+      iopattern.c mmap_bench.c tiers.c audio_bench.c seekindex_bench.c \
+      ../example-util/avutil.c \
+      ../example-util/file.c \
+      ../example-util/latencyhist.c \
+      ../example-util/meminfo.c \
+      ../example-util/mmapio.c \
+      ../example-util/readahead.c \
+      ../example-util/seekindex.c \
+      ../example-util/stagetimer.c \
+      ../example-util/streamcache.c
+
+$(TARGET): $(SRC)
+	$(CC) $(CFLAGS) $(SRC) -o $(TARGET) $(LDFLAGS)
+
+clean:
+	rm -f $(TARGET)
+
+.PHONY: clean
@@ -0,0 +1,216 @@
+/* Audio decode throughput.
+
+av_decode_test only decodes video, but every player has to decode audio in
+real time too, on the same 3 cores.  Decode the best audio stream of each
+file (aac, ac3, mp3 are what configure_wiiu enables) twice:
+
+  decode      avcodec_send_packet / receive_frame only
+  +s16        the same, plus swresample to S16 stereo at the source rate,
+              what the SDL players hand to the audio device
+
+and report samples/sec, real-time factor (seconds of audio per second of
+CPU), the share of one core that is (cpu%), and per-packet latency
+percentiles.  Only the decode (+ resample) calls are timed, not the demuxer.
+
+  readspeed audio [-s seconds] [media file or dir]
+
+-s stops after that many seconds of audio, default is the whole stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+
+#include "readspeed.h"
+
+struct AudioResult {
+    char codec[32];
+    int sample_rate;
+    int channels;
+    int64_t packets;
+    int64_t samples; /* per channel */
+    uint64_t ns;     /* in decode (+ resample) calls */
+    struct StageTimer packet;
+};
+
+static int audio_pass(const char *path, int resample, double max_secs,
+                      struct AudioResult *ar) {
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *ctx = NULL;
+    struct SwrContext *swr = NULL;
+    AVChannelLayout stereo;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    uint8_t *out = NULL;
+    int out_samples = 0;
+    int ret = -1;
+
+    av_channel_layout_default(&stereo, 2);
+    if (pkt == NULL || frame == NULL) {
+        goto end;
+    }
+    if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0 ||
+        avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+        goto end;
+    }
+    int aidx =
+        av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (aidx < 0) {
+        goto end;
+    }
+    AVStream *st = fmt_ctx->streams[aidx];
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    if (codec == NULL || (ctx = avcodec_alloc_context3(codec)) == NULL ||
+        avcodec_parameters_to_context(ctx, st->codecpar) < 0 ||
+        avcodec_open2(ctx, codec, NULL) < 0) {
+        goto end;
+    }
+    snprintf(ar->codec, sizeof(ar->codec), "%s", codec->name);
+    ar->sample_rate = ctx->sample_rate;
+    ar->channels = ctx->ch_layout.nb_channels;
+    if (resample &&
+        (swr_alloc_set_opts2(&swr, &stereo, AV_SAMPLE_FMT_S16,
+                             ctx->sample_rate, &ctx->ch_layout,
+                             ctx->sample_fmt, ctx->sample_rate, 0,
+                             NULL) < 0 ||
+         swr_init(swr) < 0)) {
+        goto end;
+    }
+
+    int64_t max_samples =
+        max_secs > 0 ? (int64_t)(max_secs * ctx->sample_rate) : INT64_MAX;
+    while (ar->samples < max_samples && av_read_frame(fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index != aidx) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        uint64_t t0 = util_clock_ns();
+        if (avcodec_send_packet(ctx, pkt) >= 0) {
+            while (avcodec_receive_frame(ctx, frame) >= 0) {
+                ar->samples += frame->nb_samples;
+                if (swr) {
+                    int need = swr_get_out_samples(swr, frame->nb_samples);
+                    if (need > out_samples) {
+                        av_freep(&out);
+                        if (av_samples_alloc(&out, NULL, 2, need,
+                                             AV_SAMPLE_FMT_S16, 0) < 0) {
+                            av_frame_unref(frame);
+                            break;
+                        }
+                        out_samples = need;
+                    }
+                    swr_convert(swr, &out, out_samples,
+                                (const uint8_t **)frame->extended_data,
+                                frame->nb_samples);
+                }
+                av_frame_unref(frame);
+            }
+        }
+        uint64_t elapsed = util_clock_ns() - t0;
+        ar->ns += elapsed;
+        stage_timer_add(&ar->packet, elapsed);
+        ar->packets++;
+        av_packet_unref(pkt);
+    }
+    ret = ar->packets > 0 ? 0 : -1;
+
+end:
+    av_freep(&out);
+    swr_free(&swr);
+    av_channel_layout_uninit(&stereo);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&ctx);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+static void print_pass(const char *name, struct AudioResult *ar) {
+    double cpu_secs = ar->ns / 1e9;
+    double audio_secs =
+        ar->sample_rate > 0 ? (double)ar->samples / ar->sample_rate : 0;
+    double rtf = cpu_secs > 0 ? audio_secs / cpu_secs : 0;
+    struct StageTimer *st = &ar->packet;
+
+    WHBLogPrintf("%-7s %7lld %11.0f %8.1fx %5.2f%% %7.1f %7.1f %8.1f", name,
+                 (long long)ar->packets,
+                 cpu_secs > 0 ? ar->samples / cpu_secs : 0, rtf,
+                 rtf > 0 ? 100.0 / rtf : 0,
+                 stage_timer_percentile(st, 50) / 1e3,
+                 stage_timer_percentile(st, 99) / 1e3, st->max_ns / 1e3);
+    WHBLogConsoleDraw();
+}
+
+static int audio_file(const char *path, void *opaque) {
+    double max_secs = *(double *)opaque;
+    struct AudioResult ar;
+
+    for (int resample = 0; resample < 2; resample++) {
+        memset(&ar, 0, sizeof(ar));
+        if (stage_timer_init(&ar.packet, "packet") < 0) {
+            return 1;
+        }
+        int ret = audio_pass(path, resample, max_secs, &ar);
+        if (ret == 0 && resample == 0) {
+            WHBLogPrintf("== audio, %s", path);
+            WHBLogPrintf("   %s, %d Hz, %d ch, %.1f s", ar.codec,
+                         ar.sample_rate, ar.channels,
+                         ar.sample_rate ? (double)ar.samples / ar.sample_rate
+                                        : 0);
+            WHBLogPrint("pass    packets   samples/s realtime  cpu%"
+                        "  p50 us  p99 us   max us");
+        }
+        if (ret == 0) {
+            print_pass(resample ? "+s16" : "decode", &ar);
+        }
+        stage_timer_free(&ar.packet);
+        if (ret != 0) {
+            break; /* no audio stream, skip the file */
+        }
+    }
+    return 0;
+}
+
+int audio_main(int argc, char **argv) {
+    char path[1024];
+    double max_secs = 0;
+    struct stat f_stat;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+            case 's':
+                max_secs = atof(optarg);
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s audio [-s seconds] [media file or dir]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_first_media_file(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find a file in sd:/media");
+        return 1;
+    }
+
+    if (stat(path, &f_stat) == 0 && S_ISDIR(f_stat.st_mode)) {
+        if (util_walk_media_files(path, audio_file, &max_secs) < 0) {
+            WHBLogPrintf("cannot open media dir %s", path);
+            return 1;
+        }
+        return 0;
+    }
+    return audio_file(path, &max_secs);
+}
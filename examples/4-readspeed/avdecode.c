@@ -10,19 +10,20 @@ File  size  res.    codecs     data read   MBps  fps (ops/sec)
 Sometimes the avformat_find_stream_info takes 10 sec, sometimes hangs :( 
  */
 
-#include <coreinit/thread.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/samplefmt.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <whb/log.h>
-#include <whb/log_console.h>
 
+#include "mmapio.h"
+#include "readahead.h"
 #include "readspeed.h"
+#include "streamcache.h"
 
 #define INBUF_SIZE 4096
 #define AUDIO_INBUF_SIZE 20480
@@ -32,22 +33,189 @@ Sometimes the avformat_find_stream_info takes 10 sec, sometimes hangs :(
    Nothing will be written to the screen without WHBLogConsoleDraw
 */
 int WHBLogPrintfDraw(const char *format, ...) {
+    char buffer[256];
     va_list args;
     va_start(args, format);
-    int result = WHBLogPrintf(format, args);
+    int result = vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
+    WHBLogPrint(buffer);
     WHBLogConsoleDraw();
     return result;
 }
 int print_test_results2(struct TestResults res) {
     double datamb = res.data_read / 1024.0 / 1024;
-    long duration = 1 * OSTicksToSeconds(res.end_time - res.start_time);
-    WHBLogPrintf("  %.1f MB / %ld secs = %.3f MBps ", datamb, duration,
+    double duration =
+        OSTicksToMilliseconds(res.end_time - res.start_time) / 1000.0;
+    if (duration <= 0) duration = 0.001;
+    WHBLogPrintf("  %.1f MB / %.1f secs = %.3f MBps ", datamb, duration,
                  (double)(datamb / duration));
-    WHBLogPrintf("  ops: %lld, data: %lld, ops/sec: %ld", res.ops,
-                 (long long)res.data_read, (long)(res.ops / duration));
+    WHBLogPrintf("  ops: %lld, data: %lld, ops/sec: %.1f",
+                 (long long)res.ops, (long long)res.data_read,
+                 res.ops / duration);
     WHBLogConsoleDraw();
+    return 0;
+}
+
+static const char *stage_names[NB_DECODE_STAGES] = {
+    "read_frame", "send_packet", "receive_frame", "frame_unref",
+    "packet_unref",
+};
+
+/* stages must have room for NB_DECODE_STAGES timers */
+int decode_stages_init(struct TestResults *res, struct StageTimer *stages) {
+    for (int i = 0; i < NB_DECODE_STAGES; i++) {
+        if (stage_timer_init(&stages[i], stage_names[i]) < 0) {
+            while (i-- > 0) stage_timer_free(&stages[i]);
+            return -1;
+        }
+    }
+    res->stages = stages;
+    res->nb_stages = NB_DECODE_STAGES;
+    return 0;
+}
+
+void decode_stages_free(struct TestResults *res) {
+    for (int i = 0; i < res->nb_stages; i++) {
+        stage_timer_free(&res->stages[i]);
+    }
+    res->stages = NULL;
+    res->nb_stages = 0;
+}
+
+/* Where did the time go?  One line of totals and one line of per-call
+   latencies (microseconds) per stage.  "wall%" is the share of the whole
+   test duration, the remainder is loop overhead + progress printing. */
+void print_stage_results(struct TestResults *res) {
+    if (res->stages == NULL) {
+        return;
+    }
+    double wall_ns = (double)OSTicksToNanoseconds(res->end_time -
+                                                  res->start_time);
+    WHBLogPrint("  stage          calls     total s  wall%");
+    WHBLogPrint("                 min/mean/p50/p95/p99/max usec");
+    for (int i = 0; i < res->nb_stages; i++) {
+        struct StageTimer *st = &res->stages[i];
+        if (st->calls == 0) {
+            continue;
+        }
+        WHBLogPrintf("  %-13s %9llu %9.3f %5.1f%%", st->name,
+                     (unsigned long long)st->calls, st->total_ns / 1e9,
+                     wall_ns > 0 ? 100.0 * st->total_ns / wall_ns : 0.0);
+        WHBLogPrintf("    %.1f / %.1f / %.1f / %.1f / %.1f / %.1f",
+                     st->min_ns / 1e3, stage_timer_mean_ns(st) / 1e3,
+                     stage_timer_percentile(st, 50) / 1e3,
+                     stage_timer_percentile(st, 95) / 1e3,
+                     stage_timer_percentile(st, 99) / 1e3, st->max_ns / 1e3);
+    }
+    WHBLogConsoleDraw();
+}
+
+#define STAGE(res, s) ((res)->stages ? &(res)->stages[s] : NULL)
+
+static const char *frame_type_names[NB_FRAME_TYPES] = {"I", "P", "B", "?"};
+static const char *frame_size_names[NB_FRAME_SIZES] = {
+    "<4K", "<16K", "<64K", "<256K", ">=256K",
+};
+
+struct FrameLatency *frame_latency_alloc() {
+    return calloc(1, sizeof(struct FrameLatency));
+}
+
+static enum FrameType frame_type(int pict_type) {
+    switch (pict_type) {
+        case AV_PICTURE_TYPE_I:
+            return FRAME_I;
+        case AV_PICTURE_TYPE_P:
+            return FRAME_P;
+        case AV_PICTURE_TYPE_B:
+            return FRAME_B;
+        default:
+            return FRAME_OTHER;
+    }
+}
+
+static int frame_size_class(int size) {
+    int c = 0;
+    for (int limit = 4096; c < NB_FRAME_SIZES - 1 && size >= limit;
+         limit *= 4) {
+        c++;
+    }
+    return c;
 }
+
+void frame_latency_add(struct FrameLatency *fl, int64_t frame, int pict_type,
+                       int size, uint64_t ns) {
+    enum FrameType type = frame_type(pict_type);
+    latency_hist_add(&fl->hist[type][frame_size_class(size)], ns);
+
+    /* insertion into the short worst list */
+    int i = fl->nb_worst < FRAME_WORST ? fl->nb_worst++ : FRAME_WORST;
+    while (i > 0 && fl->worst[i - 1].ns < ns) {
+        if (i < FRAME_WORST) fl->worst[i] = fl->worst[i - 1];
+        i--;
+    }
+    if (i < FRAME_WORST) {
+        fl->worst[i].frame = frame;
+        fl->worst[i].type = type;
+        fl->worst[i].size = size;
+        fl->worst[i].ns = ns;
+    }
+}
+
+static void print_hist_row(const char *type, const char *size,
+                           const struct LatencyHist *h) {
+    WHBLogPrintf("  %-2s %-7s %7llu %6.2f %6.2f %6.2f %6.2f %6.2f %7.2f", type,
+                 size, (unsigned long long)h->count,
+                 latency_hist_mean_ns(h) / 1e6,
+                 latency_hist_percentile(h, 50) / 1e6,
+                 latency_hist_percentile(h, 90) / 1e6,
+                 latency_hist_percentile(h, 99) / 1e6,
+                 latency_hist_percentile(h, 99.9) / 1e6, h->max_ns / 1e6);
+}
+
+/* Tail latency per frame type, then per size within the type, then the
+   slowest frames.  Milliseconds. */
+void print_frame_latency(struct TestResults *res) {
+    struct FrameLatency *fl = res->frame_latency;
+    if (fl == NULL) {
+        return;
+    }
+    WHBLogPrint("  per-frame decode latency, ms");
+    WHBLogPrint("  ty size     frames   mean    p50    p90    p99  p99.9"
+                "     max");
+    for (int t = 0; t < NB_FRAME_TYPES; t++) {
+        struct LatencyHist all;
+        latency_hist_reset(&all);
+        for (int c = 0; c < NB_FRAME_SIZES; c++) {
+            latency_hist_merge(&all, &fl->hist[t][c]);
+        }
+        if (all.count == 0) {
+            continue;
+        }
+        print_hist_row(frame_type_names[t], "all", &all);
+        for (int c = 0; c < NB_FRAME_SIZES; c++) {
+            if (fl->hist[t][c].count > 0) {
+                print_hist_row("", frame_size_names[c], &fl->hist[t][c]);
+            }
+        }
+    }
+    WHBLogPrint("  slowest frames: frame type bytes ms");
+    for (int i = 0; i < fl->nb_worst; i++) {
+        WHBLogPrintf("    %7lld %s %7d %7.2f", (long long)fl->worst[i].frame,
+                     frame_type_names[fl->worst[i].type], fl->worst[i].size,
+                     fl->worst[i].ns / 1e6);
+    }
+    WHBLogConsoleDraw();
+}
+
+/* size + send_packet time of recent packets, indexed by the sequence
+   number we pass through AVPacket.opaque.  Has to cover the decoder's
+   reorder delay + frame threading, both far below this. */
+#define PKT_INFO_RING 64
+struct PktInfo {
+    int size;
+    uint64_t send_ns;
+};
 /*
 To compile this example, you would typically use a command like:
 
@@ -57,7 +225,41 @@ Make sure you have FFmpeg development headers and libraries installed.
 */
 
 int av_decode_test(char *input_filename, struct TestResults *res) {
+    struct DecodeOptions opts = {0};
+    return av_decode_test_opts(input_filename, &opts, res);
+}
+
+/* avformat_close_input + tear down the read-ahead thread / mapping, if any */
+static void close_input(AVFormatContext **fmt_ctx, struct ReadaheadIO **rio,
+                        struct MmapIO **mio, struct TestResults *res) {
+    avformat_close_input(fmt_ctx);
+    mmap_io_close(mio);
+    if (*rio) {
+        struct ReadaheadStats stats;
+        readahead_io_get_stats(*rio, &stats);
+        res->io_stalls = stats.stalls;
+        res->io_stall_ns = stats.stall_ns;
+        res->io_file_ns = stats.file_ns;
+        readahead_io_close(rio);
+    }
+}
+
+/* Setup failed after the stream info came from the sidecar: drop it, the
+   caller tries once more with a real probe.  1 when it should */
+static int drop_cached_info(const char *path, int cached) {
+    if (cached) {
+        WHBLogPrintfDraw("Retrying without the stream info cache\n");
+        stream_cache_remove(path);
+    }
+    return cached;
+}
+
+static int decode_test_once(char *input_filename,
+                            const struct DecodeOptions *opts,
+                            struct TestResults *res, int *retry) {
     AVFormatContext *fmt_ctx = NULL;
+    struct ReadaheadIO *rio = NULL;
+    struct MmapIO *mio = NULL;
     AVCodec *codec = NULL;
     AVCodecContext *codec_ctx = NULL;
     int video_stream_index = -1;
@@ -78,7 +280,14 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
     av_dict_set(&options, "fpsprobesize", "10000", 0);     // no effect ?
     av_dict_set(&options, "formatprobesize", "10000", 0);  // no effect ?
 
-    ret = avformat_open_input(&fmt_ctx, input_filename, NULL, &options);
+    if (opts->mmap_input) {
+        ret = mmap_open_input(&fmt_ctx, &mio, input_filename, &options);
+    } else if (opts->readahead) {
+        ret = readahead_open_input(&fmt_ctx, &rio, input_filename, &options,
+                                   opts->ra_chunk_size, opts->ra_chunks);
+    } else {
+        ret = avformat_open_input(&fmt_ctx, input_filename, NULL, &options);
+    }
     //  1. Open the input file using avformat_open_input.
     //  ret = avformat_open_input(&fmt_ctx, input_filename, NULL, NULL);
 
@@ -89,12 +298,19 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
     WHBLogConsoleDraw();
 
     WHBLogPrintfDraw("calling avformat_find_stream_info\n");
-    // 2. Find the stream information with avformat_find_stream_info.
-    if (avformat_find_stream_info(fmt_ctx, &options) < 0) {
+    // 2. Find the stream information with avformat_find_stream_info,
+    //    or the sidecar it left last time (example-util/streamcache.c)
+    uint64_t info_t0 = util_clock_ns();
+    if ((ret = stream_cache_find_stream_info(fmt_ctx, input_filename,
+                                             &options)) < 0) {
         WHBLogPrintfDraw("Could not find stream information\n");
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
         return 1;
     }
+    WHBLogPrintfDraw("stream info in %.1f ms%s\n",
+                     (util_clock_ns() - info_t0) / 1e6,
+                     ret == 1 ? " (cached)" : "");
+    int cached = ret == 1;
     av_dict_free(&options);  // Free the options dictionary
 
     // 3. Find the video stream.
@@ -116,16 +332,23 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
     }
     if (video_stream_index == -1) {
         WHBLogPrintfDraw("Could not find a video stream\n");
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
+        *retry = drop_cached_info(input_filename, cached);
         return 1;
     }
+    AVCodecParameters *video_par =
+        fmt_ctx->streams[video_stream_index]->codecpar;
+    res->codec = avcodec_get_name(video_par->codec_id);
+    res->width = video_par->width;
+    res->height = video_par->height;
 
     // 4. Find the decoder for the video stream.
     codec = avcodec_find_decoder(
         fmt_ctx->streams[video_stream_index]->codecpar->codec_id);
     if (codec == NULL) {
         WHBLogPrintfDraw("Could not find decoder\n");
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
+        *retry = drop_cached_info(input_filename, cached);
         return 1;
     }
 
@@ -133,7 +356,7 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
     codec_ctx = avcodec_alloc_context3(codec);
     if (codec_ctx == NULL) {
         WHBLogPrintfDraw("Could not allocate codec context\n");
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
         return 1;
     }
 
@@ -141,24 +364,40 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
             codec_ctx, fmt_ctx->streams[video_stream_index]->codecpar) < 0) {
         WHBLogPrintfDraw("Could not copy codec parameters to context\n");
         avcodec_free_context(&codec_ctx);
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
+        *retry = drop_cached_info(input_filename, cached);
         return 1;
     }
 
+    // Threading is off unless asked for.  thread_count 0 = one per core
+    if (opts->thread_type != 0) {
+        codec_ctx->thread_count = opts->thread_count;
+        codec_ctx->thread_type = opts->thread_type;
+    }
+
+    // Hand our packet numbers through to the frames they decode into
+    if (res->frame_latency) {
+        codec_ctx->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+    }
+
     // 6. Open the decoder.
+    int64_t heap_before = util_heap_in_use();
     if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
         WHBLogPrintfDraw("Could not open codec\n");
         avcodec_free_context(&codec_ctx);
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
+        *retry = drop_cached_info(input_filename, cached);
         return 1;
     }
+    res->thread_count = codec_ctx->thread_count;
+    res->active_thread_type = codec_ctx->active_thread_type;
 
     // 7. Allocate an AVPacket for reading the compressed data.
     pkt = av_packet_alloc();
     if (pkt == NULL) {
         WHBLogPrintfDraw("Could not allocate packet\n");
         avcodec_free_context(&codec_ctx);
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
         return 1;
     }
 
@@ -168,22 +407,46 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
         WHBLogPrintfDraw("Could not allocate frame\n");
         av_packet_free(&pkt);
         avcodec_free_context(&codec_ctx);
-        avformat_close_input(&fmt_ctx);
+        close_input(&fmt_ctx, &rio, &mio, res);
         return 1;
     }
 
     WHBLogPrintfDraw("Decoding VIDEO stream\n");
     int64_t ops = 0;
     int64_t data_sz = 0;
-    OSTime now;
-    long duration = 0;
-    OSCalendarTime tm;
+    struct StageTimer *st_read = STAGE(res, STAGE_READ_FRAME);
+    struct StageTimer *st_send = STAGE(res, STAGE_SEND_PACKET);
+    struct StageTimer *st_recv = STAGE(res, STAGE_RECEIVE_FRAME);
+    struct StageTimer *st_frame_unref = STAGE(res, STAGE_FRAME_UNREF);
+    struct StageTimer *st_pkt_unref = STAGE(res, STAGE_PACKET_UNREF);
+    int64_t packets_sent = 0;
+    uint64_t first_send_ns = 0;
+    struct FrameLatency *fl = res->frame_latency;
+    struct PktInfo pkt_info[PKT_INFO_RING] = {{0}};
+    int done = 0;
+    res->first_frame_ns = 0;
+    res->decode_delay = 0;
     res->start_time = OSGetTime();
     // 9. Read packets from the input file and decode them.
-    while (av_read_frame(fmt_ctx, pkt) >= 0) {
+    while (!done) {
+        STAGE_TIME(st_read, ret = av_read_frame(fmt_ctx, pkt));
+        if (ret < 0) {
+            break;
+        }
         if (pkt->stream_index == video_stream_index) {
             // 10. Decode the video frame.
-            ret = avcodec_send_packet(codec_ctx, pkt);
+            if (packets_sent++ == 0) {
+                first_send_ns = util_clock_ns();
+            }
+            uint64_t send_t0 = fl ? util_clock_ns() : 0;
+            pkt->opaque = (void *)(intptr_t)packets_sent;
+            STAGE_TIME(st_send, ret = avcodec_send_packet(codec_ctx, pkt));
+            if (fl) {
+                struct PktInfo *info =
+                    &pkt_info[packets_sent % PKT_INFO_RING];
+                info->size = pkt->size;
+                info->send_ns = util_clock_ns() - send_t0;
+            }
             if (ret < 0) {
                 WHBLogPrintfDraw("Error sending packet for decoding: %s\n",
                                  av_err2str(ret));
@@ -192,8 +455,11 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
                            // decoding.
             }
             data_sz += pkt->size;
-            while ((ret = avcodec_receive_frame(codec_ctx, frame)) >= 0) {
-                ops++;
+            while (1) {
+                uint64_t recv_t0 = fl ? util_clock_ns() : 0;
+                STAGE_TIME(st_recv,
+                           ret = avcodec_receive_frame(codec_ctx, frame));
+                uint64_t recv_ns = fl ? util_clock_ns() - recv_t0 : 0;
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                     break;  // Need more data or decoder finished.
                 } else if (ret < 0) {
@@ -201,9 +467,20 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
                                      av_err2str(ret));
                     return 1;
                 }
+                if (ops++ == 0) {
+                    /* frame threading holds back thread_count - 1 frames */
+                    res->first_frame_ns = util_clock_ns() - first_send_ns;
+                    res->decode_delay = (int)(packets_sent - 1);
+                }
+                if (fl) {
+                    struct PktInfo *info =
+                        &pkt_info[(intptr_t)frame->opaque % PKT_INFO_RING];
+                    frame_latency_add(fl, ops, frame->pict_type, info->size,
+                                      info->send_ns + recv_ns);
+                }
 
                 // 11. Process the decoded frame.
-                if (ops > 1000 && ops % 1000 == 0) {
+                if (!opts->quiet && ops > 1000 && ops % 1000 == 0) {
                     res->end_time = OSGetTime();
                     res->ops = ops;
                     res->data_read = data_sz;
@@ -212,14 +489,26 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
 
                 // Important:  av_frame_unref is crucial to release
                 // resources
-                av_frame_unref(frame);
+                STAGE_TIME(st_frame_unref, av_frame_unref(frame));
+
+                // Stop at exactly max_frames, the frames still in the
+                // decoder aren't counted
+                if (opts->max_frames > 0 && ops >= opts->max_frames) {
+                    done = 1;
+                    break;
+                }
             }
         }
-        av_packet_unref(pkt);  // Unreference the packet after it's used
+        // Unreference the packet after it's used
+        STAGE_TIME(st_pkt_unref, av_packet_unref(pkt));
     }
     res->end_time = OSGetTime();
     res->ops = ops;
     res->data_read = data_sz;
+    /* pooled frame buffers + per thread contexts are still allocated here */
+    int64_t heap_after = util_heap_in_use();
+    res->heap_bytes =
+        heap_before >= 0 && heap_after >= 0 ? heap_after - heap_before : -1;
 
     // 12. Flush the decoder (important for some codecs).
     pkt->data = NULL;
@@ -228,11 +517,13 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
         ret = avcodec_receive_frame(codec_ctx, frame);
 
         if (ret == 0) {
-            WHBLogPrintfDraw(
-                "Flush. Frame number: %lld, width: %d, height: %d, "
-                "format: %s\n",
-                codec_ctx->frame_num, frame->width, frame->height,
-                av_get_pix_fmt_name(codec_ctx->pix_fmt));
+            if (!opts->quiet) {
+                WHBLogPrintfDraw(
+                    "Flush. Frame number: %lld, width: %d, height: %d, "
+                    "format: %s\n",
+                    codec_ctx->frame_num, frame->width, frame->height,
+                    av_get_pix_fmt_name(codec_ctx->pix_fmt));
+            }
             av_frame_unref(frame);
         } else if (ret == AVERROR_EOF)
             break;
@@ -248,7 +539,17 @@ int av_decode_test(char *input_filename, struct TestResults *res) {
     av_frame_free(&frame);
     av_packet_free(&pkt);
     avcodec_free_context(&codec_ctx);
-    avformat_close_input(&fmt_ctx);
+    close_input(&fmt_ctx, &rio, &mio, res);
 
     return 0;
 }
+
+int av_decode_test_opts(char *input_filename, const struct DecodeOptions *opts,
+                        struct TestResults *res) {
+    int retry = 0;
+    int ret = decode_test_once(input_filename, opts, res, &retry);
+    if (retry) {
+        ret = decode_test_once(input_filename, opts, res, &retry);
+    }
+    return ret;
+}
@@ -0,0 +1,270 @@
+/* Headless corpus runner.
+
+Instead of one screenshot of one file, walk a whole media directory, run the
+fread() and decode tests on every file N times and write the numbers to a
+JSON or CSV file we can diff between builds.
+
+  readspeed corpus [-n reps] [-b fread block size] [-f json|csv] [-o out]
+                   [media dir]
+
+On the WiiU the media dir defaults to sd:/media and the results land in
+sd:/media/.readspeed-results.json, a dot file so the next corpus run and the
+media pickers skip it.
+
+One row per file and test:
+  file, test (fread|decode), codec, width, height, bytes (file size),
+  data_read, reps, ops (reads or frames), seconds + stddev, fps (ops/sec),
+  MBps + stddev
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "readspeed.h"
+
+enum CorpusFormat { CORPUS_JSON, CORPUS_CSV };
+
+struct CorpusRun {
+    int reps;
+    int blk_sz;
+    enum CorpusFormat format;
+    FILE *out;
+    int rows;
+    int files;
+};
+
+/* mean and (sample) standard deviation of n values */
+static void mean_stddev(const double *v, int n, double *mean, double *sd) {
+    double sum = 0, sq = 0;
+    for (int i = 0; i < n; i++) sum += v[i];
+    *mean = n ? sum / n : 0;
+    for (int i = 0; i < n; i++) sq += (v[i] - *mean) * (v[i] - *mean);
+    *sd = n > 1 ? sqrt(sq / (n - 1)) : 0;
+}
+
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+            fputc(*s, out);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_csv_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"') fputc('"', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void write_row(struct CorpusRun *run, const char *path,
+                      const char *test, struct TestResults *res, int reps,
+                      const double *secs, const double *mbps) {
+    double secs_mean, secs_sd, mbps_mean, mbps_sd;
+    mean_stddev(secs, reps, &secs_mean, &secs_sd);
+    mean_stddev(mbps, reps, &mbps_mean, &mbps_sd);
+    double fps = secs_mean > 0 ? res->ops / secs_mean : 0;
+    const char *codec = res->codec ? res->codec : "";
+
+    if (run->format == CORPUS_CSV) {
+        write_csv_string(run->out, path);
+        fprintf(run->out, ",%s,%s,%d,%d,%lld,%llu,%d,%llu,%.6f,%.6f,%.3f,"
+                          "%.3f,%.3f\n",
+                test, codec, res->width, res->height,
+                (long long)res->st_size, (unsigned long long)res->data_read,
+                reps, (unsigned long long)res->ops, secs_mean, secs_sd, fps,
+                mbps_mean, mbps_sd);
+    } else {
+        fprintf(run->out, "%s\n  {\"file\": ", run->rows ? "," : "");
+        write_json_string(run->out, path);
+        fprintf(run->out,
+                ", \"test\": \"%s\", \"codec\": \"%s\", \"width\": %d, "
+                "\"height\": %d, \"bytes\": %lld, \"data_read\": %llu, "
+                "\"reps\": %d, \"ops\": %llu, \"seconds\": %.6f, "
+                "\"seconds_stddev\": %.6f, \"fps\": %.3f, \"mbps\": %.3f, "
+                "\"mbps_stddev\": %.3f}",
+                test, codec, res->width, res->height, (long long)res->st_size,
+                (unsigned long long)res->data_read, reps,
+                (unsigned long long)res->ops, secs_mean, secs_sd, fps,
+                mbps_mean, mbps_sd);
+    }
+    fflush(run->out);
+    run->rows++;
+}
+
+static double test_seconds(struct TestResults *res) {
+    return OSTicksToNanoseconds(res->end_time - res->start_time) / 1e9;
+}
+
+/* run one test reps times, keeping the last TestResults for the row */
+static int run_reps(struct CorpusRun *run, char *path, int test_type,
+                    struct TestResults *res, double *secs, double *mbps) {
+    int done = 0;
+    for (int r = 0; r < run->reps; r++) {
+        struct TestResults one = {
+            .st_size = util_get_file_size(path),
+            .test_type = test_type,
+        };
+        int ret = test_type == 0 ? fread_test(path, run->blk_sz, &one)
+                                 : av_decode_test(path, &one);
+        if (ret != 0) {
+            break;
+        }
+        secs[done] = test_seconds(&one);
+        mbps[done] = secs[done] > 0
+                         ? one.data_read / 1024.0 / 1024 / secs[done]
+                         : 0;
+        *res = one;
+        done++;
+    }
+    return done;
+}
+
+static int corpus_file(const char *cpath, void *opaque) {
+    struct CorpusRun *run = opaque;
+    char path[1024];
+    double *secs = malloc(run->reps * sizeof(double));
+    double *mbps = malloc(run->reps * sizeof(double));
+    struct TestResults fread_res = {0}, decode_res = {0};
+    int done;
+
+    if (secs == NULL || mbps == NULL) {
+        free(secs);
+        free(mbps);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s", cpath);
+    run->files++;
+    WHBLogPrintf("== [%d] %s", run->files, path);
+    WHBLogConsoleDraw();
+
+    done = run_reps(run, path, 1, &decode_res, secs, mbps);
+    if (done == 0) {
+        /* not something we can decode, ex. a .txt or audio only file */
+        WHBLogPrintf("  skipping, no decodable video stream");
+        free(secs);
+        free(mbps);
+        return 0;
+    }
+    write_row(run, path, "decode", &decode_res, done, secs, mbps);
+
+    done = run_reps(run, path, 0, &fread_res, secs, mbps);
+    if (done > 0) {
+        fread_res.codec = decode_res.codec;
+        fread_res.width = decode_res.width;
+        fread_res.height = decode_res.height;
+        write_row(run, path, "fread", &fread_res, done, secs, mbps);
+    }
+
+    free(secs);
+    free(mbps);
+    return 0;
+}
+
+static void corpus_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s corpus [-n reps] [-b block size] [-f json|csv] "
+            "[-o out] [media dir]\n",
+            prog);
+}
+
+int corpus_main(int argc, char **argv) {
+    char media_dir[256] = "";
+    const char *out_path = NULL;
+    char default_out[300];
+    struct CorpusRun run = {
+        .reps = 3,
+        .blk_sz = 32768,
+        .format = CORPUS_JSON,
+    };
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "n:b:f:o:")) != -1) {
+        switch (opt) {
+            case 'n':
+                run.reps = atoi(optarg);
+                break;
+            case 'b':
+                run.blk_sz = atoi(optarg);
+                break;
+            case 'f':
+                if (strcmp(optarg, "json") == 0) {
+                    run.format = CORPUS_JSON;
+                } else if (strcmp(optarg, "csv") == 0) {
+                    run.format = CORPUS_CSV;
+                } else {
+                    corpus_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                corpus_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (run.reps < 1 || run.blk_sz < 1) {
+        corpus_usage(argv[0]);
+        return 1;
+    }
+    if (optind < argc) {
+        snprintf(media_dir, sizeof(media_dir), "%s", argv[optind]);
+    } else if (util_get_media_dir(media_dir, sizeof(media_dir)) < 0) {
+        WHBLogPrint("no media dir given and sd:/media not found");
+        corpus_usage(argv[0]);
+        return 1;
+    }
+    if (out_path == NULL) {
+        /* a dot file, util_walk_media_files skips it */
+        snprintf(default_out, sizeof(default_out), "%s/.readspeed-results.%s",
+                 media_dir, run.format == CORPUS_CSV ? "csv" : "json");
+        out_path = default_out;
+    }
+
+    run.out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "w");
+    if (run.out == NULL) {
+        WHBLogPrintf("cannot open %s for writing", out_path);
+        return 1;
+    }
+    if (run.format == CORPUS_CSV) {
+        fprintf(run.out,
+                "file,test,codec,width,height,bytes,data_read,reps,ops,"
+                "seconds,seconds_stddev,fps,mbps,mbps_stddev\n");
+    } else {
+        fprintf(run.out, "[");
+    }
+
+    WHBLogPrintf("== corpus %s, %d reps -> %s", media_dir, run.reps,
+                 out_path);
+    WHBLogConsoleDraw();
+    int ret = util_walk_media_files(media_dir, corpus_file, &run);
+
+    if (run.format == CORPUS_JSON) {
+        fprintf(run.out, "\n]\n");
+    }
+    if (run.out != stdout) {
+        fclose(run.out);
+    }
+    if (ret < 0) {
+        WHBLogPrintf("cannot open media dir %s", media_dir);
+        return 1;
+    }
+    WHBLogPrintf("== corpus done: %d files, %d rows", run.files, run.rows);
+    WHBLogConsoleDraw();
+    return 0;
+}
@@ -0,0 +1,340 @@
+/* I/O access-pattern explorer.
+
+fread_test does one sequential pass with a 32k buffer, and 8k vs 32k made
+no difference.  Is there buffering underneath we can't see, and where is the
+block size / queue depth sweet spot?  Sweep
+
+  block size   4KB .. 4MB (doubling)
+  method       fread (default stdio buffer), nobuf (setvbuf _IONBF, every
+               fread goes to the device), read (raw read())
+  pattern      seq, rand (block aligned random offsets), stride (every
+               -k'th block, then the next phase)
+  readers      -j threads each with their own handle, seq splits the file
+               between them, rand/stride run independently
+
+and print MBps, reads/sec and per-read latency p50 / p90 / p99 / max in
+microseconds for every combination.
+
+  readspeed iopattern [-m fread,nobuf,read] [-p seq,rand,stride] [-j 1,2,3]
+                      [-s min KB] [-S max KB] [-k stride] [-L MB]
+                      [media file]
+
+-L caps the bytes read per setting (default 32MB) so a full sweep of a
+large file doesn't take all day.  On a PC the page cache will serve most
+of this after the first setting, pick a file bigger than RAM.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "readspeed.h"
+
+enum IoMethod { IO_FREAD, IO_NOBUF, IO_READ, NB_IO_METHODS };
+enum IoPattern { IO_SEQ, IO_RAND, IO_STRIDE, NB_IO_PATTERNS };
+
+static const char *io_method_names[NB_IO_METHODS] = {"fread", "nobuf",
+                                                     "read"};
+static const char *io_pattern_names[NB_IO_PATTERNS] = {"seq", "rand",
+                                                       "stride"};
+
+#define MAX_READERS 16
+
+struct IoSetting {
+    const char *path;
+    int64_t file_size;
+    enum IoMethod method;
+    enum IoPattern pattern;
+    int blk_sz;
+    int stride;
+    int readers;
+    int64_t limit;
+};
+
+/* latencies from all readers go into one timer */
+struct IoShared {
+    pthread_mutex_t lock;
+    struct StageTimer latency;
+    int errors;
+};
+
+struct IoReader {
+    const struct IoSetting *set;
+    struct IoShared *shared;
+    int index;
+    uint64_t bytes;
+    uint64_t ops;
+};
+
+/* xorshift64 */
+static uint64_t io_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* file offset of this reader's i'th block */
+static int64_t block_offset(const struct IoSetting *set, int index,
+                            uint64_t i, int64_t nb_blocks, uint64_t *rng) {
+    switch (set->pattern) {
+        case IO_RAND:
+            return (int64_t)(io_rand(rng) % nb_blocks) * set->blk_sz;
+        case IO_STRIDE: {
+            /* blocks phase, phase + stride, ... then phase + 1, ... */
+            int64_t per_phase = (nb_blocks + set->stride - 1) / set->stride;
+            int64_t phase = ((int64_t)i / per_phase + index) % set->stride;
+            int64_t blk = phase + ((int64_t)i % per_phase) * set->stride;
+            if (blk >= nb_blocks) blk = phase;
+            return blk * set->blk_sz;
+        }
+        default: {
+            int64_t part = nb_blocks / set->readers;
+            return ((index * part + (int64_t)i) % nb_blocks) * set->blk_sz;
+        }
+    }
+}
+
+static void *io_reader_thread(void *arg) {
+    struct IoReader *rd = arg;
+    const struct IoSetting *set = rd->set;
+    int64_t nb_blocks = set->file_size / set->blk_sz;
+    uint64_t rng = 0x9e3779b97f4a7c15ULL * (rd->index + 1);
+    uint64_t budget = set->limit / set->readers;
+    uint8_t *buffer = malloc(set->blk_sz);
+    FILE *fp = NULL;
+    int fd = -1;
+
+    if (nb_blocks < 1) nb_blocks = 1;
+    if (buffer == NULL) goto fail;
+    if (set->method == IO_READ) {
+        fd = open(set->path, O_RDONLY);
+        if (fd < 0) goto fail;
+    } else {
+        fp = fopen(set->path, "rb");
+        if (fp == NULL) goto fail;
+        if (set->method == IO_NOBUF) setvbuf(fp, NULL, _IONBF, 0);
+    }
+
+    int64_t pos = -1;
+    for (uint64_t i = 0; rd->bytes < budget; i++) {
+        int64_t off = block_offset(set, rd->index, i, nb_blocks, &rng);
+        int64_t n;
+
+        uint64_t t0 = util_clock_ns();
+        if (fd >= 0) {
+            if (off != pos) lseek(fd, off, SEEK_SET);
+            n = read(fd, buffer, set->blk_sz);
+        } else {
+            if (off != pos) fseek(fp, off, SEEK_SET);
+            n = fread(buffer, 1, set->blk_sz, fp);
+        }
+        uint64_t elapsed = util_clock_ns() - t0;
+
+        if (n <= 0) break;
+        pos = off + n;
+        rd->bytes += n;
+        rd->ops++;
+        pthread_mutex_lock(&rd->shared->lock);
+        stage_timer_add(&rd->shared->latency, elapsed);
+        pthread_mutex_unlock(&rd->shared->lock);
+    }
+    if (fp) fclose(fp);
+    if (fd >= 0) close(fd);
+    free(buffer);
+    return NULL;
+
+fail:
+    pthread_mutex_lock(&rd->shared->lock);
+    rd->shared->errors++;
+    pthread_mutex_unlock(&rd->shared->lock);
+    free(buffer);
+    return NULL;
+}
+
+static int run_setting(const struct IoSetting *set, struct IoShared *shared) {
+    struct IoReader readers[MAX_READERS];
+    pthread_t threads[MAX_READERS];
+    int started[MAX_READERS];
+    uint64_t bytes = 0, ops = 0;
+
+    stage_timer_reset(&shared->latency);
+    shared->errors = 0;
+    memset(readers, 0, sizeof(readers));
+
+    uint64_t t0 = util_clock_ns();
+    for (int r = 0; r < set->readers; r++) {
+        readers[r].set = set;
+        readers[r].shared = shared;
+        readers[r].index = r;
+        started[r] = pthread_create(&threads[r], NULL, io_reader_thread,
+                                    &readers[r]) == 0;
+        if (!started[r]) {
+            io_reader_thread(&readers[r]); /* no threads, run inline */
+        }
+    }
+    for (int r = 0; r < set->readers; r++) {
+        if (started[r]) pthread_join(threads[r], NULL);
+        bytes += readers[r].bytes;
+        ops += readers[r].ops;
+    }
+    double secs = (util_clock_ns() - t0) / 1e9;
+
+    if (shared->errors || ops == 0) {
+        WHBLogPrintf("%-5s %-6s %5dK %2d  failed", io_method_names[set->method],
+                     io_pattern_names[set->pattern], set->blk_sz / 1024,
+                     set->readers);
+        return -1;
+    }
+    struct StageTimer *lat = &shared->latency;
+    WHBLogPrintf("%-5s %-6s %5dK %2d %8.2f %8.0f %8.0f %8.0f %8.0f %9.0f",
+                 io_method_names[set->method], io_pattern_names[set->pattern],
+                 set->blk_sz / 1024, set->readers,
+                 secs > 0 ? bytes / 1024.0 / 1024 / secs : 0,
+                 secs > 0 ? ops / secs : 0,
+                 stage_timer_percentile(lat, 50) / 1e3,
+                 stage_timer_percentile(lat, 90) / 1e3,
+                 stage_timer_percentile(lat, 99) / 1e3, lat->max_ns / 1e3);
+    WHBLogConsoleDraw();
+    return 0;
+}
+
+/* "fread,read" -> bitmask of the matching names, 0 on a bad name */
+static unsigned parse_names(char *list, const char **names, int nb_names) {
+    unsigned mask = 0;
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        int i;
+        for (i = 0; i < nb_names; i++) {
+            if (strcmp(tok, names[i]) == 0) break;
+        }
+        if (i == nb_names) return 0;
+        mask |= 1u << i;
+    }
+    return mask;
+}
+
+/* "1,2,4" -> counts[], returns how many */
+static int parse_counts(char *list, int *counts, int max) {
+    int n = 0;
+    for (char *tok = strtok(list, ","); tok && n < max;
+         tok = strtok(NULL, ",")) {
+        int c = atoi(tok);
+        if (c < 1 || c > MAX_READERS) return 0;
+        counts[n++] = c;
+    }
+    return n;
+}
+
+static void iopattern_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s iopattern [-m fread,nobuf,read] [-p seq,rand,stride] "
+            "[-j 1,2,3]\n"
+            "                 [-s min KB] [-S max KB] [-k stride] [-L MB] "
+            "[media file]\n",
+            prog);
+}
+
+int iopattern_main(int argc, char **argv) {
+    char path[1024];
+    unsigned methods = (1u << NB_IO_METHODS) - 1;
+    unsigned patterns = (1u << NB_IO_PATTERNS) - 1;
+    int readers[MAX_READERS] = {1};
+    int nb_readers = 1;
+    int min_kb = 4, max_kb = 4096;
+    int stride = 4;
+    int64_t limit_mb = 32;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "m:p:j:s:S:k:L:")) != -1) {
+        switch (opt) {
+            case 'm':
+                methods = parse_names(optarg, io_method_names, NB_IO_METHODS);
+                break;
+            case 'p':
+                patterns =
+                    parse_names(optarg, io_pattern_names, NB_IO_PATTERNS);
+                break;
+            case 'j':
+                nb_readers = parse_counts(optarg, readers, MAX_READERS);
+                break;
+            case 's':
+                min_kb = atoi(optarg);
+                break;
+            case 'S':
+                max_kb = atoi(optarg);
+                break;
+            case 'k':
+                stride = atoi(optarg);
+                break;
+            case 'L':
+                limit_mb = atoll(optarg);
+                break;
+            default:
+                iopattern_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (!methods || !patterns || !nb_readers || min_kb < 1 ||
+        max_kb < min_kb || stride < 1 || limit_mb < 1) {
+        iopattern_usage(argv[0]);
+        return 1;
+    }
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_first_media_file(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find a file in sd:/media");
+        return 1;
+    }
+
+    if (util_get_file_size(path) <= 0) {
+        WHBLogPrintf("cannot read %s", path);
+        return 1;
+    }
+
+    struct IoShared shared;
+    pthread_mutex_init(&shared.lock, NULL);
+    if (stage_timer_init(&shared.latency, "read") < 0) {
+        WHBLogPrint("no memory for the latency reservoir");
+        return 1;
+    }
+    struct IoSetting set = {
+        .path = path,
+        .file_size = util_get_file_size(path),
+        .stride = stride,
+        .limit = limit_mb * 1024 * 1024,
+    };
+    if (set.limit > set.file_size) set.limit = set.file_size;
+
+    WHBLogPrintf("== access patterns, %s (%lld MB), %lld MB per setting", path,
+                 (long long)(set.file_size / 1024 / 1024),
+                 (long long)(set.limit / 1024 / 1024));
+    WHBLogPrint("meth  patt    block  j     MBps  reads/s   p50 us   p90 us"
+                "   p99 us    max us");
+    WHBLogConsoleDraw();
+
+    for (int m = 0; m < NB_IO_METHODS; m++) {
+        if (!(methods & (1u << m))) continue;
+        for (int p = 0; p < NB_IO_PATTERNS; p++) {
+            if (!(patterns & (1u << p))) continue;
+            for (int j = 0; j < nb_readers; j++) {
+                for (int kb = min_kb; kb <= max_kb; kb *= 2) {
+                    set.method = m;
+                    set.pattern = p;
+                    set.readers = readers[j];
+                    set.blk_sz = kb * 1024;
+                    run_setting(&set, &shared);
+                }
+            }
+        }
+    }
+
+    stage_timer_free(&shared.latency);
+    pthread_mutex_destroy(&shared.lock);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/* What does copying the file through stdio / the file: protocol cost us?
+
+Host builds only, the WiiU has no mmap.  Runs, on the same file
+
+  fread        fread() into a blk_sz buffer, what fread_test does
+  mmap+copy    memcpy blk_sz blocks out of a mapping, no syscalls per block
+  mmap         touch every page of the mapping, no copy at all: the
+               zero-copy baseline
+  decode file: av_decode_test with the stock file: protocol
+  decode mmap  av_decode_test demuxing straight from the mapping
+
+  readspeed mmap [-b block size] [-F frames] [media file]
+
+Run it twice, the first pass pulls the file into the page cache and the
+fread/mmap numbers are mostly the disk.
+ */
+
+#ifndef __WIIU__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmapio.h"
+#include "readspeed.h"
+
+int mmap_read_test(char *fname, int blk_sz, int copy, struct TestResults *res) {
+    struct MmapIO *mio = mmap_io_open(fname);
+    const uint8_t *base;
+    int64_t size;
+    long page = sysconf(_SC_PAGESIZE);
+    volatile uint8_t sink = 0;
+    uint64_t data = 0;
+    uint64_t ops = 0;
+
+    if (mio == NULL) {
+        WHBLogPrint("Error mapping file");
+        return 1;
+    }
+    uint8_t *buffer = copy ? malloc(blk_sz) : NULL;
+    if (copy && buffer == NULL) {
+        mmap_io_close(&mio);
+        return 1;
+    }
+    base = mmap_io_data(mio, &size);
+    WHBLogPrintf("Starting mmap%s test with block size %d...",
+                 copy ? "+copy" : "", blk_sz);
+
+    res->start_time = OSGetTime();
+    for (int64_t off = 0; off < size; off += blk_sz) {
+        int n = size - off < blk_sz ? (int)(size - off) : blk_sz;
+        if (copy) {
+            memcpy(buffer, base + off, n);
+            sink ^= buffer[n - 1];
+        } else {
+            for (int i = 0; i < n; i += page) sink ^= base[off + i];
+        }
+        ops++;
+        data += n;
+    }
+    res->end_time = OSGetTime();
+
+    free(buffer);
+    mmap_io_close(&mio);
+    res->ops = ops;
+    res->data_read = data;
+    print_test_results(*res);
+    return 0;
+}
+
+static int run_decode(char *path, int use_mmap, int64_t frames,
+                      struct TestResults *res) {
+    struct DecodeOptions opts = {
+        .max_frames = frames,
+        .quiet = 1,
+        .mmap_input = use_mmap,
+    };
+    memset(res, 0, sizeof(*res));
+    res->st_size = util_get_file_size(path);
+    res->test_type = 1;
+    return av_decode_test_opts(path, &opts, res);
+}
+
+int mmap_main(int argc, char **argv) {
+    char path[1024];
+    int blk_sz = 32768;
+    int64_t frames = 0;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "b:F:")) != -1) {
+        switch (opt) {
+            case 'b':
+                blk_sz = atoi(optarg);
+                break;
+            case 'F':
+                frames = atoll(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s mmap [-b block size] "
+                                "[-F frames] [media file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (blk_sz < 1) blk_sz = 32768;
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_first_media_file(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find a file in sd:/media");
+        return 1;
+    }
+
+    struct TestResults res = {
+        .st_size = util_get_file_size(path),
+    };
+    WHBLogPrintf("== copy overhead, %s", path);
+    WHBLogPrint("== fread");
+    if (fread_test(path, blk_sz, &res) != 0) {
+        return 1;
+    }
+    WHBLogPrint("== mmap+copy");
+    mmap_read_test(path, blk_sz, 1, &res);
+    WHBLogPrint("== mmap, zero copy");
+    mmap_read_test(path, blk_sz, 0, &res);
+
+    WHBLogPrint("== decode file:");
+    if (run_decode(path, 0, frames, &res) == 0) {
+        print_test_results(res);
+    }
+    WHBLogPrint("== decode mmap");
+    if (run_decode(path, 1, frames, &res) == 0) {
+        print_test_results(res);
+    }
+    return 0;
+}
+
+#endif  // __WIIU__
@@ -0,0 +1,118 @@
+/* Stock file: protocol vs the read-ahead AVIOContext.
+
+With the file: protocol every time the avio buffer runs dry av_read_frame
+blocks on a synchronous SD card read, on the decode thread.  ReadaheadIO
+(example-util/readahead.c) moves those reads to a reader thread that keeps a
+ring of large chunks filled.  Decode the same file (first N frames) with
+both and report
+
+  fps, stalls (demuxer reads that had to wait for the reader thread), total
+  stall time, and time the reader thread spent in read().
+
+  readspeed readahead [-c chunk KB] [-k chunks] [-F frames] [media file]
+
+Without -k both double (2) and triple (3) buffering are run.  On a PC the
+second run comes out of the page cache, so the stock row looks better than
+it will on the WiiU.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "readahead.h"
+#include "readspeed.h"
+
+static int run_setting(char *path, int chunk_size, int chunks, int64_t frames,
+                       struct TestResults *res) {
+    struct DecodeOptions opts = {
+        .max_frames = frames,
+        .quiet = 1,
+        .readahead = chunks > 0,
+        .ra_chunk_size = chunk_size,
+        .ra_chunks = chunks,
+    };
+    memset(res, 0, sizeof(*res));
+    res->st_size = util_get_file_size(path);
+    res->test_type = 1;
+    return av_decode_test_opts(path, &opts, res);
+}
+
+static void print_row(int chunk_size, int chunks, struct TestResults *res) {
+    double secs = OSTicksToNanoseconds(res->end_time - res->start_time) / 1e9;
+    double fps = secs > 0 ? res->ops / secs : 0;
+    double mbps = secs > 0 ? res->data_read / 1024.0 / 1024 / secs : 0;
+
+    if (chunks == 0) {
+        WHBLogPrintf("file:        - %7.1f %6.2f      -        -        -",
+                     fps, mbps);
+    } else {
+        WHBLogPrintf("readahead %4dK%2d %7.1f %6.2f %6llu %8.1f %8.1f",
+                     chunk_size / 1024, chunks, fps, mbps,
+                     (unsigned long long)res->io_stalls,
+                     res->io_stall_ns / 1e6, res->io_file_ns / 1e6);
+    }
+    WHBLogConsoleDraw();
+}
+
+int readahead_main(int argc, char **argv) {
+    char path[1024];
+    int chunk_size = READAHEAD_CHUNK_SIZE;
+    int chunks = 0;
+    int64_t frames = 0;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "c:k:F:")) != -1) {
+        switch (opt) {
+            case 'c':
+                chunk_size = atoi(optarg) * 1024;
+                break;
+            case 'k':
+                chunks = atoi(optarg);
+                break;
+            case 'F':
+                frames = atoll(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s readahead [-c chunk KB] "
+                                "[-k chunks] [-F frames] [media file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (chunk_size < 4096) chunk_size = 4096;
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_first_media_file(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find a file in sd:/media");
+        return 1;
+    }
+
+    WHBLogPrintf("== read-ahead vs file:, %s", path);
+    if (frames > 0) {
+        WHBLogPrintf("   first %lld frames", (long long)frames);
+    }
+    WHBLogPrint("io       chunk  n     fps   MBps stalls stall ms  read ms");
+    WHBLogConsoleDraw();
+
+    struct TestResults res;
+    if (run_setting(path, 0, 0, frames, &res) != 0) {
+        WHBLogPrint("decode failed");
+        return 1;
+    }
+    print_row(0, 0, &res);
+
+    int first = chunks > 1 ? chunks : 2;
+    int last = chunks > 1 ? chunks : 3;
+    for (int k = first; k <= last; k++) {
+        if (run_setting(path, chunk_size, k, frames, &res) != 0) {
+            WHBLogPrintf("readahead %4dK%2d decode failed", chunk_size / 1024,
+                         k);
+            continue;
+        }
+        print_row(chunk_size, k, &res);
+    }
+    return 0;
+}
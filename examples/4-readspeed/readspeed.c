@@ -81,25 +81,31 @@ didn't output the frames to any display/audio device.
 
 #include "readspeed.h"
 
-#include <coreinit/thread.h>
 #include <dirent.h>
 #include <libavformat/avformat.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
-#include <whb/log.h>
-#include <whb/log_console.h>
+#ifdef __WIIU__
 #include <whb/proc.h>
+#endif
 
 #include "exutil.h"
 
 int print_test_results(struct TestResults res) {
     double datamb = res.data_read / 1024.0 / 1024;
-    long duration = 1 * OSTicksToSeconds(res.end_time - res.start_time);
-    WHBLogPrintf("  %.1f MB / %ld secs = %.3f MBps ", datamb, duration,
+    double duration =
+        OSTicksToMilliseconds(res.end_time - res.start_time) / 1000.0;
+    if (duration <= 0) duration = 0.001;
+    WHBLogPrintf("  %.1f MB / %.1f secs = %.3f MBps ", datamb, duration,
                  (double)(datamb / duration));
-    WHBLogPrintf("  ops: %lld, data: %lld, ops/sec: %ld", res.ops,
-                 (long long)res.data_read, (long)(res.ops / duration));
+    WHBLogPrintf("  ops: %lld, data: %lld, ops/sec: %.1f",
+                 (long long)res.ops, (long long)res.data_read,
+                 res.ops / duration);
+    print_stage_results(&res);
+    print_frame_latency(&res);
+    return 0;
 }
 
 int fread_test(char *fname, int blk_sz, struct TestResults *res) {
@@ -133,6 +139,7 @@ int fread_test(char *fname, int blk_sz, struct TestResults *res) {
     return 0;
 }
 
+#ifdef __WIIU__
 void print_times(struct TestResults res) {
     OSCalendarTime tm;
     OSTicksToCalendarTime(res.start_time, &tm);
@@ -141,6 +148,7 @@ void print_times(struct TestResults res) {
     WHBLogPrintf("end time   %2d:%2d:%2d", tm.tm_hour, tm.tm_min, tm.tm_sec);
     WHBLogConsoleDraw();
 }
+#endif  // __WIIU__
 
 void print_header(char *path_buffer, int64_t st_size) {
     WHBLogPrint("== Compare fread() speeds to media decode speeds  ");
@@ -151,12 +159,14 @@ void print_header(char *path_buffer, int64_t st_size) {
     OSSleepTicks(OSMillisecondsToTicks(1000));
 }
 
-int runtests() {
+/* path NULL = first file found in sd:/media */
+int runtests(const char *path) {
     char path_buffer[1024];
     int ret;
 
-    ret = util_get_first_media_file(path_buffer, 1024);
-    if (ret != 0) {
+    if (path != NULL) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s", path);
+    } else if ((ret = util_get_first_media_file(path_buffer, 1024)) != 0) {
         WHBLogPrint("failed to find a file in sd:/media");
         WHBLogConsoleDraw();
         return ret;
@@ -182,18 +192,80 @@ int runtests() {
         .st_size = util_get_file_size(path_buffer),
         .test_type = 1,
     };
+    struct StageTimer stages[NB_DECODE_STAGES];
+    if (decode_stages_init(&avdecode_res, stages) < 0) {
+        WHBLogPrint("no memory for stage timers, skipping breakdown");
+    }
+    avdecode_res.frame_latency = frame_latency_alloc();
     av_decode_test(path_buffer, &avdecode_res);
 
     WHBLogPrint("== Final decode results  ");
     print_test_results(avdecode_res);
     WHBLogPrint("== Final fread() results  ");
     print_test_results(fread_res);
+    decode_stages_free(&avdecode_res);
+    free(avdecode_res.frame_latency);
 
+#ifdef __WIIU__
     OSSleepTicks(OSMillisecondsToTicks(10000));
+#endif
 
     return 0;
 }
 
+/* Extra benchmark modes, selected by the first argument */
+struct BenchMode {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *help;
+};
+
+static const struct BenchMode bench_modes[] = {
+    {"corpus", corpus_main, "fread + decode every file, write JSON/CSV"},
+    {"threads", threads_main, "decode fps vs frame/slice thread count"},
+    {"readahead", readahead_main, "decode fps, file: vs read-ahead thread"},
+    {"iopattern", iopattern_main, "block size / method / pattern sweep"},
+    {"tiers", tiers_main, "fps vs PSNR/SSIM for skip_* / fast / lowres"},
+    {"audio", audio_main, "audio decode (+ S16 resample) throughput"},
+    {"seekindex", seekindex_main, "build keyframe index, time random seeks"},
+#ifndef __WIIU__
+    {"mmap", mmap_main, "fread / decode vs a memory mapped file"},
+#endif
+};
+#define NB_BENCH_MODES (int)(sizeof(bench_modes) / sizeof(bench_modes[0]))
+
+static const struct BenchMode *find_bench_mode(const char *name) {
+    for (int i = 0; i < NB_BENCH_MODES; i++) {
+        if (strcmp(bench_modes[i].name, name) == 0) {
+            return &bench_modes[i];
+        }
+    }
+    return NULL;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <media file>\n", prog);
+    fprintf(stderr, "       %s <mode> [args...]\n", prog);
+    for (int i = 0; i < NB_BENCH_MODES; i++) {
+        fprintf(stderr, "  %-10s %s\n", bench_modes[i].name,
+                bench_modes[i].help);
+    }
+}
+
+#ifndef __WIIU__
+/* Host build: readspeed <media file> | readspeed <mode> [args...] */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const struct BenchMode *mode = find_bench_mode(argv[1]);
+    if (mode != NULL) {
+        return mode->run(argc - 1, argv + 1);
+    }
+    return runtests(argv[1]);
+}
+#else
 int main(int argc, char **argv) {
     WHBProcInit();
 
@@ -201,7 +273,14 @@ int main(int argc, char **argv) {
         Don't mix with other graphics code! */
     WHBLogConsoleInit();
 
-    runtests();
+    /* wiiload can pass arguments, ex. wiiload readspeed.rpx corpus -n 5 */
+    const struct BenchMode *mode =
+        argc > 1 ? find_bench_mode(argv[1]) : NULL;
+    if (mode != NULL) {
+        mode->run(argc - 1, argv + 1);
+    } else {
+        runtests(NULL);
+    }
 
     int times_left = 10;
     while (WHBProcIsRunning() && times_left > 0) {
@@ -225,3 +304,4 @@ int main(int argc, char **argv) {
 
     return 0;
 }
+#endif  // __WIIU__
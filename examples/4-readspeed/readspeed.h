@@ -1,5 +1,78 @@
 #ifndef READSPEED_H
 #define READSPEED_H
 #include "exutil.h"
+#include "latencyhist.h"
+#include "stagetimer.h"
+#include "whbcompat.h"
+
+/* av_decode_test() pipeline stages, timed per call when
+   TestResults.stages points at NB_DECODE_STAGES timers */
+enum DecodeStage {
+    STAGE_READ_FRAME,
+    STAGE_SEND_PACKET,
+    STAGE_RECEIVE_FRAME,
+    STAGE_FRAME_UNREF,
+    STAGE_PACKET_UNREF,
+    NB_DECODE_STAGES
+};
+
+/* Per-frame decode latency, TestResults.frame_latency.  A frame's latency
+   is the avcodec_send_packet() of its own packet (matched up through
+   AVFrame.opaque, so B-frame reordering doesn't mix them up) plus the
+   avcodec_receive_frame() that returned it.  Bucketed by picture type and
+   by compressed size. */
+enum FrameType { FRAME_I, FRAME_P, FRAME_B, FRAME_OTHER, NB_FRAME_TYPES };
+#define NB_FRAME_SIZES 5 /* <4K, <16K, <64K, <256K, bigger */
+#define FRAME_WORST 8
+
+struct FrameLatency {
+    struct LatencyHist hist[NB_FRAME_TYPES][NB_FRAME_SIZES];
+    struct {
+        int64_t frame;
+        enum FrameType type;
+        int size;
+        uint64_t ns;
+    } worst[FRAME_WORST]; /* slowest frames, slowest first */
+    int nb_worst;
+};
+
+/* Knobs for av_decode_test_opts(), zero initialized = stock decoder */
+struct DecodeOptions {
+    int thread_type;  /* FF_THREAD_FRAME / FF_THREAD_SLICE, 0 = no threads */
+    int thread_count; /* with thread_type set, 0 = one per core */
+    int64_t max_frames; /* stop after this many frames, 0 = whole file */
+    int quiet;          /* skip the progress + flush prints */
+    int readahead;      /* demux through a ReadaheadIO instead of file: */
+    int ra_chunk_size;  /* with readahead set, 0 = READAHEAD_CHUNK_SIZE */
+    int ra_chunks;      /* with readahead set, 0 = READAHEAD_CHUNKS */
+    int mmap_input;     /* demux from a memory mapped file, host only */
+};
+
 int av_decode_test(char *input_filename, struct TestResults *results);
+int av_decode_test_opts(char *input_filename, const struct DecodeOptions *opts,
+                        struct TestResults *results);
+int fread_test(char *fname, int blk_sz, struct TestResults *res);
+/* fread_test over a memory mapped file.  copy = memcpy blk_sz blocks out of
+   the mapping like fread would, otherwise only touch every page */
+int mmap_read_test(char *fname, int blk_sz, int copy, struct TestResults *res);
+int print_test_results(struct TestResults res);
+
+/* benchmark modes, readspeed <mode> [args...] */
+int corpus_main(int argc, char **argv);
+int threads_main(int argc, char **argv);
+int readahead_main(int argc, char **argv);
+int mmap_main(int argc, char **argv);
+int iopattern_main(int argc, char **argv);
+int tiers_main(int argc, char **argv);
+int audio_main(int argc, char **argv);
+int seekindex_main(int argc, char **argv);
+
+int decode_stages_init(struct TestResults *res, struct StageTimer *stages);
+void decode_stages_free(struct TestResults *res);
+void print_stage_results(struct TestResults *res);
+
+struct FrameLatency *frame_latency_alloc();
+void frame_latency_add(struct FrameLatency *fl, int64_t frame, int pict_type,
+                       int size, uint64_t ns);
+void print_frame_latency(struct TestResults *res);
 #endif  // READSPEED_H
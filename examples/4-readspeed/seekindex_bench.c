@@ -0,0 +1,230 @@
+/* Keyframe seek index builder + seek benchmark.
+
+Builds the .<name>.kfi keyframe sidecar (example-util/seekindex.c) for a
+file, or every file in a dir, then times -n random seeks two ways, same
+targets for both:
+
+  demuxer   av_seek_frame(AVSEEK_FLAG_BACKWARD), what the players do now
+  index     seek_index_seek, straight to the indexed keyframe
+
+Each seek is timed up to the first video packet coming out of
+av_read_frame.  "behind" is how far before the target that packet is, the
+video a frame accurate seek has to decode and throw away.
+
+  readspeed seekindex [-n seeks] [-b] [-r] [media file or dir]
+
+-b only builds the sidecars, -r rebuilds them even when they are current.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavformat/avformat.h>
+
+#include "readspeed.h"
+#include "seekindex.h"
+
+struct SeekSettings {
+    int seeks;
+    int build_only;
+    int rebuild;
+};
+
+/* xorshift64 */
+static uint64_t seek_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* Seek to each target, time it up to the first packet of stream and add up
+   how far that packet is behind the target (stream time base) */
+static int time_seeks(AVFormatContext *fmt_ctx, const struct SeekIndex *idx,
+                      int stream, const int64_t *targets, int nb_targets,
+                      struct StageTimer *timer, int64_t *behind) {
+    AVPacket *pkt = av_packet_alloc();
+    int done = 0;
+
+    *behind = 0;
+    if (pkt == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < nb_targets; i++) {
+        uint64_t t0 = util_clock_ns();
+        if (seek_index_seek(fmt_ctx, idx, stream, targets[i]) ==
+            AV_NOPTS_VALUE) {
+            continue;
+        }
+        int ret;
+        while ((ret = av_read_frame(fmt_ctx, pkt)) >= 0 &&
+               pkt->stream_index != stream) {
+            av_packet_unref(pkt);
+        }
+        if (ret < 0) {
+            continue;
+        }
+        stage_timer_add(timer, util_clock_ns() - t0);
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (pts != AV_NOPTS_VALUE && pts < targets[i]) {
+            *behind += targets[i] - pts;
+        }
+        av_packet_unref(pkt);
+        done++;
+    }
+    av_packet_free(&pkt);
+    return done;
+}
+
+static void print_seeks(const char *name, struct StageTimer *timer, int done,
+                        int64_t behind, AVRational tb) {
+    if (done == 0) {
+        WHBLogPrintf("%-8s failed", name);
+        return;
+    }
+    WHBLogPrintf("%-8s %5d %8.2f %8.2f %8.2f %8.2f %9.2f", name, done,
+                 stage_timer_mean_ns(timer) / 1e6,
+                 stage_timer_percentile(timer, 50) / 1e6,
+                 stage_timer_percentile(timer, 99) / 1e6, timer->max_ns / 1e6,
+                 behind * av_q2d(tb) / done);
+}
+
+static int bench_file(const char *path, const struct SeekIndex *idx,
+                      int nb_seeks) {
+    AVFormatContext *fmt_ctx = NULL;
+    struct StageTimer timer;
+    struct SeekIndexEntry first, last;
+    int64_t *targets = NULL;
+    int64_t behind;
+    int stream = seek_index_stream(idx);
+
+    if (seek_index_count(idx) < 2 ||
+        avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0) {
+        return -1;
+    }
+    if (avformat_find_stream_info(fmt_ctx, NULL) < 0 ||
+        stream >= (int)fmt_ctx->nb_streams ||
+        (targets = malloc(nb_seeks * sizeof(*targets))) == NULL ||
+        stage_timer_init(&timer, "seek") < 0) {
+        free(targets);
+        avformat_close_input(&fmt_ctx);
+        return -1;
+    }
+
+    /* random targets between the first and the last keyframe */
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    seek_index_entry(idx, 0, &first);
+    seek_index_entry(idx, seek_index_count(idx) - 1, &last);
+    if (last.pts <= first.pts) {
+        stage_timer_free(&timer);
+        free(targets);
+        avformat_close_input(&fmt_ctx);
+        return -1;
+    }
+    for (int i = 0; i < nb_seeks; i++) {
+        targets[i] = first.pts + (int64_t)(seek_rand(&rng) %
+                                           (uint64_t)(last.pts - first.pts));
+    }
+
+    AVRational tb = fmt_ctx->streams[stream]->time_base;
+    WHBLogPrint("method   seeks  mean ms   p50 ms   p99 ms   max ms  "
+                "behind s");
+    int done = time_seeks(fmt_ctx, NULL, stream, targets, nb_seeks, &timer,
+                          &behind);
+    print_seeks("demuxer", &timer, done, behind, tb);
+    stage_timer_reset(&timer);
+    done = time_seeks(fmt_ctx, idx, stream, targets, nb_seeks, &timer,
+                      &behind);
+    print_seeks("index", &timer, done, behind, tb);
+    WHBLogConsoleDraw();
+
+    stage_timer_free(&timer);
+    free(targets);
+    avformat_close_input(&fmt_ctx);
+    return 0;
+}
+
+static int seekindex_file(const char *path, void *opaque) {
+    const struct SeekSettings *set = opaque;
+    struct SeekIndex *idx = set->rebuild ? NULL : seek_index_load(path);
+
+    WHBLogPrintf("== seek index, %s", path);
+    if (idx == NULL) {
+        uint64_t t0 = util_clock_ns();
+        int count = seek_index_build(path, -1);
+        if (count < 0) {
+            WHBLogPrint("   no video stream / cannot read, skipped");
+            WHBLogConsoleDraw();
+            return 0;
+        }
+        WHBLogPrintf("   built, %d keyframes in %.2f s", count,
+                     (util_clock_ns() - t0) / 1e9);
+        idx = seek_index_load(path);
+        if (idx == NULL) {
+            WHBLogPrint("   cannot load the sidecar (read only card?)");
+            WHBLogConsoleDraw();
+            return 0;
+        }
+    } else {
+        WHBLogPrintf("   current, %d keyframes", seek_index_count(idx));
+    }
+    WHBLogConsoleDraw();
+
+    if (!set->build_only && bench_file(path, idx, set->seeks) < 0) {
+        WHBLogPrint("   not enough keyframes to seek between");
+    }
+    seek_index_close(&idx);
+    return 0;
+}
+
+int seekindex_main(int argc, char **argv) {
+    char path[1024];
+    struct SeekSettings set = {.seeks = 200};
+    struct stat f_stat;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "n:br")) != -1) {
+        switch (opt) {
+            case 'n':
+                set.seeks = atoi(optarg);
+                break;
+            case 'b':
+                set.build_only = 1;
+                break;
+            case 'r':
+                set.rebuild = 1;
+                break;
+            default:
+                set.seeks = 0;
+                break;
+        }
+    }
+    if (set.seeks < 1) {
+        fprintf(stderr,
+                "Usage: %s seekindex [-n seeks] [-b] [-r] "
+                "[media file or dir]\n",
+                argv[0]);
+        return 1;
+    }
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_media_dir(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find sd:/media");
+        return 1;
+    }
+
+    if (stat(path, &f_stat) == 0 && S_ISDIR(f_stat.st_mode)) {
+        if (util_walk_media_files(path, seekindex_file, &set) < 0) {
+            WHBLogPrintf("cannot open media dir %s", path);
+            return 1;
+        }
+        return 0;
+    }
+    return seekindex_file(path, &set);
+}
@@ -0,0 +1,133 @@
+/* Threaded decoding sweep.
+
+1080p decodes at ~10 fps single threaded.  Does frame or slice threading get
+us to real time, and what does it cost?  Decode the same file (first N
+frames) with thread_count 1..max for frame and slice threading and report
+
+  fps, speedup over the unthreaded decoder, parallel efficiency
+  (speedup / threads), time from the first packet to the first frame,
+  decode delay (packets in before a frame comes out) and heap growth.
+
+  readspeed threads [-t max threads] [-F frames] [media file]
+
+"act" is the threading the decoder actually used.  If ffmpeg was built
+without pthreads it stays "none" and every row measures the same decoder.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "readspeed.h"
+
+#ifdef __WIIU__
+#define DEFAULT_MAX_THREADS 3 /* Espresso, 3 cores */
+#else
+#define DEFAULT_MAX_THREADS ((int)sysconf(_SC_NPROCESSORS_ONLN))
+#endif
+
+static const char *thread_type_name(int type) {
+    switch (type) {
+        case FF_THREAD_FRAME:
+            return "frame";
+        case FF_THREAD_SLICE:
+            return "slice";
+        case FF_THREAD_FRAME | FF_THREAD_SLICE:
+            return "both";
+        default:
+            return "none";
+    }
+}
+
+static double decode_fps(struct TestResults *res) {
+    double secs = OSTicksToNanoseconds(res->end_time - res->start_time) / 1e9;
+    return secs > 0 ? res->ops / secs : 0;
+}
+
+static void print_row(int type, struct TestResults *res, double base_fps) {
+    double fps = decode_fps(res);
+    double speedup = base_fps > 0 ? fps / base_fps : 0;
+    int threads = res->thread_count > 0 ? res->thread_count : 1;
+    WHBLogPrintf("%-5s %3d %-5s %7.1f %6.2fx %5.0f%% %8.1f %5d %7.1f",
+                 thread_type_name(type), res->thread_count,
+                 thread_type_name(res->active_thread_type), fps, speedup,
+                 100.0 * speedup / threads, res->first_frame_ns / 1e6,
+                 res->decode_delay,
+                 res->heap_bytes >= 0 ? res->heap_bytes / 1024.0 / 1024 : -1);
+    WHBLogConsoleDraw();
+}
+
+static int run_setting(char *path, int type, int threads, int64_t frames,
+                       struct TestResults *res) {
+    struct DecodeOptions opts = {
+        .thread_type = type,
+        .thread_count = threads,
+        .max_frames = frames,
+        .quiet = 1,
+    };
+    memset(res, 0, sizeof(*res));
+    res->st_size = util_get_file_size(path);
+    res->test_type = 1;
+    return av_decode_test_opts(path, &opts, res);
+}
+
+int threads_main(int argc, char **argv) {
+    char path[1024];
+    int max_threads = DEFAULT_MAX_THREADS;
+    int64_t frames = 600;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "t:F:")) != -1) {
+        switch (opt) {
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            case 'F':
+                frames = atoll(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s threads [-t max threads] "
+                                "[-F frames] [media file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (max_threads < 1) max_threads = 1;
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_first_media_file(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find a file in sd:/media");
+        return 1;
+    }
+
+    WHBLogPrintf("== thread scaling, %s", path);
+    WHBLogPrintf("   first %lld frames, 1..%d threads", (long long)frames,
+                 max_threads);
+    WHBLogPrint("type  thr act       fps speedup  eff  1st ms delay heap MB");
+    WHBLogConsoleDraw();
+
+    struct TestResults res;
+    if (run_setting(path, 0, 1, frames, &res) != 0) {
+        WHBLogPrint("decode failed");
+        return 1;
+    }
+    double base_fps = decode_fps(&res);
+    print_row(0, &res, base_fps);
+
+    int types[] = {FF_THREAD_FRAME, FF_THREAD_SLICE};
+    for (int t = 0; t < 2; t++) {
+        for (int n = 1; n <= max_threads; n++) {
+            if (run_setting(path, types[t], n, frames, &res) != 0) {
+                WHBLogPrintf("%-5s %3d decode failed",
+                             thread_type_name(types[t]), n);
+                continue;
+            }
+            print_row(types[t], &res, base_fps);
+        }
+    }
+    return 0;
+}
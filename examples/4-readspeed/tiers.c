@@ -0,0 +1,452 @@
+/* Decode quality / speed tiers.
+
+How much speed do the decoder's lossy shortcuts buy on our content, and
+what do they cost in picture quality?  For every file, decode the first N
+frames once per tier below, next to a full quality reference decoder fed the
+same packets, and report
+
+  fps       source frames per second of *candidate* decode time (the
+            reference decoder and the scoring aren't counted)
+  speedup   over the "full" tier
+  out       frames the candidate actually produced (skip_frame drops some,
+            a player would keep showing the previous one)
+  PSNR      luma PSNR over all frames (from the mean MSE), and the worst
+            single frame
+  SSIM      mean luma SSIM, 8x8 windows
+
+lowres frames are scaled back up to the reference size before scoring, the
+way the player would show them.  Most H.264 builds don't do lowres, those
+rows say so.
+
+  readspeed tiers [-F frames] [-t threads] [media file or dir]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include "readspeed.h"
+
+struct Tier {
+    const char *name;
+    enum AVDiscard skip_loop_filter;
+    enum AVDiscard skip_idct;
+    enum AVDiscard skip_frame;
+    int fast;
+    int lowres;
+};
+
+static const struct Tier tiers[] = {
+    {"full", AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 0, 0},
+    {"fast", AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 1, 0},
+    {"noloop-nonref", AVDISCARD_NONREF, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT,
+     0, 0},
+    {"noloop-all", AVDISCARD_ALL, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 0, 0},
+    {"noidct-nonref", AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_DEFAULT,
+     0, 0},
+    {"skip-nonref", AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_NONREF, 0,
+     0},
+    {"skip-nonkey", AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_NONKEY, 0,
+     0},
+    {"lowres1", AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 0, 1},
+    {"lowres2", AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 0, 2},
+    {"fast+noloop", AVDISCARD_ALL, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 1, 0},
+};
+#define NB_TIERS (int)(sizeof(tiers) / sizeof(tiers[0]))
+
+/* reference frames waiting for the candidate to catch up */
+#define REF_QUEUE 16
+
+struct TierRun {
+    int64_t max_frames;
+    int threads;
+    double full_fps;
+};
+
+/* Luma of both frames, converted to GRAY8 at the reference size */
+struct Scorer {
+    struct SwsContext *ref_sws;
+    struct SwsContext *cand_sws;
+    uint8_t *ref_y;
+    uint8_t *cand_y;
+    int width;
+    int height;
+    double mse_sum;
+    double worst_mse;
+    double ssim_sum;
+    int64_t frames;
+};
+
+static int to_gray(struct SwsContext **sws, const AVFrame *frame, uint8_t *dst,
+                   int width, int height) {
+    *sws = sws_getCachedContext(*sws, frame->width, frame->height,
+                                frame->format, width, height,
+                                AV_PIX_FMT_GRAY8, SWS_BILINEAR, NULL, NULL,
+                                NULL);
+    if (*sws == NULL) {
+        return -1;
+    }
+    uint8_t *planes[4] = {dst};
+    int strides[4] = {width};
+    sws_scale(*sws, (const uint8_t *const *)frame->data, frame->linesize, 0,
+              frame->height, planes, strides);
+    return 0;
+}
+
+/* mean SSIM over non overlapping 8x8 windows */
+static double ssim_plane(const uint8_t *a, const uint8_t *b, int width,
+                         int height) {
+    const double c1 = 6.5025, c2 = 58.5225; /* (0.01*255)^2, (0.03*255)^2 */
+    double sum = 0;
+    int windows = 0;
+
+    for (int y = 0; y + 8 <= height; y += 8) {
+        for (int x = 0; x + 8 <= width; x += 8) {
+            int sa = 0, sb = 0;
+            int64_t saa = 0, sbb = 0, sab = 0;
+            for (int j = 0; j < 8; j++) {
+                const uint8_t *pa = a + (y + j) * width + x;
+                const uint8_t *pb = b + (y + j) * width + x;
+                for (int i = 0; i < 8; i++) {
+                    sa += pa[i];
+                    sb += pb[i];
+                    saa += pa[i] * pa[i];
+                    sbb += pb[i] * pb[i];
+                    sab += pa[i] * pb[i];
+                }
+            }
+            double ma = sa / 64.0, mb = sb / 64.0;
+            double va = saa / 64.0 - ma * ma;
+            double vb = sbb / 64.0 - mb * mb;
+            double cov = sab / 64.0 - ma * mb;
+            sum += ((2 * ma * mb + c1) * (2 * cov + c2)) /
+                   ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            windows++;
+        }
+    }
+    return windows ? sum / windows : 1.0;
+}
+
+static int score_frame(struct Scorer *sc, const AVFrame *ref,
+                       const AVFrame *cand) {
+    int n = sc->width * sc->height;
+    if (to_gray(&sc->ref_sws, ref, sc->ref_y, sc->width, sc->height) < 0 ||
+        to_gray(&sc->cand_sws, cand, sc->cand_y, sc->width, sc->height) < 0) {
+        return -1;
+    }
+    int64_t sse = 0;
+    for (int i = 0; i < n; i++) {
+        int d = sc->ref_y[i] - sc->cand_y[i];
+        sse += d * d;
+    }
+    double mse = (double)sse / n;
+    sc->mse_sum += mse;
+    if (mse > sc->worst_mse) sc->worst_mse = mse;
+    sc->ssim_sum += ssim_plane(sc->ref_y, sc->cand_y, sc->width, sc->height);
+    sc->frames++;
+    return 0;
+}
+
+static double mse_to_psnr(double mse) {
+    return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+static AVCodecContext *open_decoder(const AVStream *st, const struct Tier *tier,
+                                    int threads) {
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    AVCodecContext *ctx;
+
+    if (codec == NULL || (ctx = avcodec_alloc_context3(codec)) == NULL) {
+        return NULL;
+    }
+    if (avcodec_parameters_to_context(ctx, st->codecpar) < 0) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    if (threads > 1) {
+        ctx->thread_count = threads;
+        ctx->thread_type = FF_THREAD_FRAME;
+    }
+    if (tier) {
+        ctx->skip_loop_filter = tier->skip_loop_filter;
+        ctx->skip_idct = tier->skip_idct;
+        ctx->skip_frame = tier->skip_frame;
+        if (tier->fast) ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+        ctx->lowres = tier->lowres;
+    }
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+struct TierResult {
+    int64_t ref_frames;
+    int64_t cand_frames;
+    uint64_t cand_ns;
+    struct Scorer sc;
+};
+
+struct FrameQueue {
+    AVFrame *frames[REF_QUEUE];
+    int head;
+    int count;
+};
+
+/* Compare queued reference frames with the candidate frame on screen at
+   their pts: the newest candidate frame with pts <= the reference pts.  A
+   reference frame is only scored once the candidate has moved past it (or
+   we're flushing, or the queue is full, ex. skip-nonkey). */
+static void match_frames(struct FrameQueue *refq, struct FrameQueue *candq,
+                         AVFrame *shown, struct TierResult *tr, int flush) {
+    while (refq->count > 0) {
+        AVFrame *ref = refq->frames[refq->head];
+        while (candq->count > 0 &&
+               candq->frames[candq->head]->best_effort_timestamp <=
+                   ref->best_effort_timestamp) {
+            av_frame_unref(shown);
+            av_frame_move_ref(shown, candq->frames[candq->head]);
+            av_frame_free(&candq->frames[candq->head]);
+            candq->head = (candq->head + 1) % REF_QUEUE;
+            candq->count--;
+        }
+        if (candq->count == 0 && !flush && refq->count < REF_QUEUE) {
+            break;
+        }
+        if (shown->data[0]) {
+            score_frame(&tr->sc, ref, shown);
+        }
+        av_frame_free(&refq->frames[refq->head]);
+        refq->head = (refq->head + 1) % REF_QUEUE;
+        refq->count--;
+    }
+}
+
+static void queue_clear(struct FrameQueue *q) {
+    while (q->count > 0) {
+        av_frame_free(&q->frames[q->head]);
+        q->head = (q->head + 1) % REF_QUEUE;
+        q->count--;
+    }
+}
+
+/* receive everything the decoder has, into q.  Returns frames received */
+static int drain(AVCodecContext *ctx, AVFrame *frame, struct FrameQueue *q,
+                 uint64_t *ns) {
+    int got = 0;
+    while (1) {
+        uint64_t t0 = ns ? util_clock_ns() : 0;
+        int ret = avcodec_receive_frame(ctx, frame);
+        if (ns) *ns += util_clock_ns() - t0;
+        if (ret < 0) {
+            break;
+        }
+        if (q->count == REF_QUEUE) {
+            /* caller didn't match in time, drop the oldest */
+            av_frame_free(&q->frames[q->head]);
+            q->head = (q->head + 1) % REF_QUEUE;
+            q->count--;
+        }
+        q->frames[(q->head + q->count) % REF_QUEUE] = av_frame_clone(frame);
+        q->count++;
+        av_frame_unref(frame);
+        got++;
+    }
+    return got;
+}
+
+static int run_tier(const char *path, const struct Tier *tier,
+                    struct TierRun *run, struct TierResult *tr) {
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *ref_ctx = NULL, *cand_ctx = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVFrame *shown = av_frame_alloc();
+    struct FrameQueue refq = {{0}}, candq = {{0}};
+    int ret = -1;
+
+    memset(tr, 0, sizeof(*tr));
+    if (pkt == NULL || frame == NULL || shown == NULL) {
+        goto end;
+    }
+    if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0 ||
+        avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+        goto end;
+    }
+    int vidx =
+        av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (vidx < 0) {
+        goto end;
+    }
+    AVStream *st = fmt_ctx->streams[vidx];
+    ref_ctx = open_decoder(st, NULL, run->threads);
+    cand_ctx = open_decoder(st, tier, run->threads);
+    if (ref_ctx == NULL || cand_ctx == NULL) {
+        goto end;
+    }
+    tr->sc.width = st->codecpar->width;
+    tr->sc.height = st->codecpar->height;
+    tr->sc.ref_y = malloc(tr->sc.width * tr->sc.height);
+    tr->sc.cand_y = malloc(tr->sc.width * tr->sc.height);
+    if (tr->sc.ref_y == NULL || tr->sc.cand_y == NULL) {
+        goto end;
+    }
+
+    while (tr->ref_frames < run->max_frames &&
+           av_read_frame(fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index == vidx) {
+            avcodec_send_packet(ref_ctx, pkt);
+            tr->ref_frames += drain(ref_ctx, frame, &refq, NULL);
+
+            uint64_t t0 = util_clock_ns();
+            avcodec_send_packet(cand_ctx, pkt);
+            tr->cand_ns += util_clock_ns() - t0;
+            tr->cand_frames += drain(cand_ctx, frame, &candq, &tr->cand_ns);
+
+            match_frames(&refq, &candq, shown, tr, 0);
+        }
+        av_packet_unref(pkt);
+    }
+    /* flush both, the tail frames count too */
+    avcodec_send_packet(ref_ctx, NULL);
+    tr->ref_frames += drain(ref_ctx, frame, &refq, NULL);
+    uint64_t t0 = util_clock_ns();
+    avcodec_send_packet(cand_ctx, NULL);
+    tr->cand_ns += util_clock_ns() - t0;
+    tr->cand_frames += drain(cand_ctx, frame, &candq, &tr->cand_ns);
+    match_frames(&refq, &candq, shown, tr, 1);
+    ret = 0;
+
+end:
+    queue_clear(&refq);
+    queue_clear(&candq);
+    av_frame_free(&shown);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&cand_ctx);
+    avcodec_free_context(&ref_ctx);
+    avformat_close_input(&fmt_ctx);
+    sws_freeContext(tr->sc.ref_sws);
+    sws_freeContext(tr->sc.cand_sws);
+    free(tr->sc.ref_y);
+    free(tr->sc.cand_y);
+    tr->sc.ref_sws = tr->sc.cand_sws = NULL;
+    tr->sc.ref_y = tr->sc.cand_y = NULL;
+    return ret;
+}
+
+/* lowres needs decoder support, check before spending a decode on it */
+static int tier_supported(const char *path, const struct Tier *tier,
+                          const char **codec_name) {
+    AVFormatContext *fmt_ctx = NULL;
+    int ok = 0;
+
+    if (tier->lowres == 0) {
+        return 1;
+    }
+    if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0) {
+        return 0;
+    }
+    if (avformat_find_stream_info(fmt_ctx, NULL) >= 0) {
+        int vidx =
+            av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (vidx >= 0) {
+            const AVCodec *codec = avcodec_find_decoder(
+                fmt_ctx->streams[vidx]->codecpar->codec_id);
+            if (codec) {
+                *codec_name = codec->name;
+                ok = tier->lowres <= codec->max_lowres;
+            }
+        }
+    }
+    avformat_close_input(&fmt_ctx);
+    return ok;
+}
+
+static int tiers_file(const char *path, void *opaque) {
+    struct TierRun *run = opaque;
+    struct TierResult tr;
+
+    WHBLogPrintf("== tiers, %s", path);
+    WHBLogPrint("tier              fps speedup    out  PSNR dB  worst    SSIM");
+    WHBLogConsoleDraw();
+    run->full_fps = 0;
+    for (int i = 0; i < NB_TIERS; i++) {
+        const char *codec_name = "?";
+        if (!tier_supported(path, &tiers[i], &codec_name)) {
+            WHBLogPrintf("%-14s  not supported by %s", tiers[i].name,
+                         codec_name);
+            continue;
+        }
+        if (run_tier(path, &tiers[i], run, &tr) != 0 || tr.ref_frames == 0) {
+            WHBLogPrintf("%-14s  decode failed", tiers[i].name);
+            if (i == 0) return 0; /* not a video file, next one */
+            continue;
+        }
+        double secs = tr.cand_ns / 1e9;
+        double fps = secs > 0 ? tr.ref_frames / secs : 0;
+        if (i == 0) run->full_fps = fps;
+        double frames = tr.sc.frames ? (double)tr.sc.frames : 1;
+        WHBLogPrintf("%-14s %7.1f %6.2fx %6lld %8.2f %6.2f %7.4f",
+                     tiers[i].name, fps,
+                     run->full_fps > 0 ? fps / run->full_fps : 0,
+                     (long long)tr.cand_frames,
+                     mse_to_psnr(tr.sc.mse_sum / frames),
+                     mse_to_psnr(tr.sc.worst_mse), tr.sc.ssim_sum / frames);
+        WHBLogConsoleDraw();
+    }
+    return 0;
+}
+
+int tiers_main(int argc, char **argv) {
+    char path[1024];
+    struct TierRun run = {
+        .max_frames = 300,
+        .threads = 1,
+    };
+    struct stat f_stat;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "F:t:")) != -1) {
+        switch (opt) {
+            case 'F':
+                run.max_frames = atoll(optarg);
+                break;
+            case 't':
+                run.threads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s tiers [-F frames] [-t threads] "
+                                "[media file or dir]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (run.max_frames < 1) run.max_frames = 300;
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else if (util_get_first_media_file(path, sizeof(path)) != 0) {
+        WHBLogPrint("failed to find a file in sd:/media");
+        return 1;
+    }
+
+    WHBLogPrintf("first %lld frames per file, %d decoder thread(s)",
+                 (long long)run.max_frames, run.threads);
+    if (stat(path, &f_stat) == 0 && S_ISDIR(f_stat.st_mode)) {
+        if (util_walk_media_files(path, tiers_file, &run) < 0) {
+            WHBLogPrintf("cannot open media dir %s", path);
+            return 1;
+        }
+        return 0;
+    }
+    return tiers_file(path, &run);
+}
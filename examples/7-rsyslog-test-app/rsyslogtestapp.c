@@ -37,15 +37,19 @@ int WHBLogPrintfDraw(const char *format, ...) {
 }
 
 int main(int argc, char **argv) {
+    char syslog_ip[18] = "";
+
     WHBProcInit();
 
     /*  Use the Console backend for WHBLog - this one draws text with OSScreen
         Don't mix with other graphics code! */
     WHBLogConsoleInit();
 
-    // initialize logging - find syslog ip address
-    if (init_rsyslogger() == 0) {
-        WHBLogPrintfDraw("Found syslog IP %s", SYSLOG_IP);
+    // initialize logging - returns right away, the syslog ip address is
+    // found in the background
+    if (init_rsyslogger() == 0 &&
+        wait_syslog_ip(syslog_ip, sizeof(syslog_ip), 10000) == 0) {
+        WHBLogPrintfDraw("Found syslog IP %s", syslog_ip);
     } else {
         WHBLogPrintfDraw("No IP found, Shutting Down...");
         OSSleepTicks(OSMillisecondsToTicks(5000));
@@ -53,13 +57,13 @@ int main(int argc, char **argv) {
         WHBProcShutdown();
     }
 
-    WHBLogPrintfDraw("== Starting rsyslog test [%s]...", SYSLOG_IP);
+    WHBLogPrintfDraw("== Starting rsyslog test [%s]...", syslog_ip);
 
     int times_left = 5;
     while (WHBProcIsRunning() && times_left > 0) {
         WHBLogPrintfDraw("== Logging with rsyslog_send_tcp");
 
-        rsyslog_send_tcp(SYSLOG_IP, 9514, 14, "Wrote from  rsyslog_send_tcp()");
+        rsyslog_send_tcp(syslog_ip, 9514, 14, "Wrote from  rsyslog_send_tcp()");
         times_left--;
         WHBLogPrintf("== done. Running again (attempts = %d)", times_left);
         WHBLogPrintfDraw("");
@@ -21,15 +21,29 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "ratelog.h"
+#include "readahead.h"
+#include "seekindex.h"
+#include "streamcache.h"
+#include "telemetry.h"
+#include "trace.h"
+
 #ifdef __WIIU__
 #include <coreinit/thread.h>
 #endif
 
+// Sampled for rsyslog/tools/telemetry_view while a video plays
+#define TELEMETRY_HZ 4
+static int tm_decoded = -1, tm_shown = -1, tm_skipped = -1;
+static int tm_position_ms = -1;
+
 // Structure to hold video player context
 typedef struct {
     const char *filepath;
     AVFormatContext *format_context;
+    struct ReadaheadIO *rio;  // read-ahead thread behind format_context
     int video_stream_index;
+    int stream_info_cached;  // from the streamcache sidecar
     AVCodecContext *video_codec_context;
     AVFrame *frame;
     AVFrame *rgb_frame;
@@ -46,8 +60,38 @@ typedef struct {
     int frame_buffer_size;
     int quit;
     SDL_Thread *decode_thread;
+
+    // Seeking.  The main thread asks, the decode thread seeks; both under
+    // frame_mutex.  Keyframe positions come from the .kfi sidecar when
+    // there is one ("readspeed seekindex" builds them).
+    struct SeekIndex *seek_index;
+    int seek_request;     // 1 = seek to seek_target
+    double seek_target;   // seconds
+    int seek_accurate;    // 0 = show the keyframe, for scrubbing
+    double position;      // seconds, last frame shown
+    int64_t drop_until;   // skip frames before this pts after a seek
 } VideoPlayerContext;
 
+// Seek the demuxer to the keyframe at or before target and reset the
+// decoder.  For an accurate seek, frames between the keyframe and the
+// target are decoded but not shown.
+static void seek_video(VideoPlayerContext *ctx, double target, int accurate) {
+    AVStream *st = ctx->format_context->streams[ctx->video_stream_index];
+    int64_t ts = (int64_t)(target / av_q2d(st->time_base));
+
+    if (st->start_time != AV_NOPTS_VALUE) {
+        ts += st->start_time;
+    }
+    int64_t key = seek_index_seek(ctx->format_context, ctx->seek_index,
+                                  ctx->video_stream_index, ts);
+    if (key == AV_NOPTS_VALUE) {
+        fprintf(stderr, "seek to %.2f s failed\n", target);
+        return;
+    }
+    avcodec_flush_buffers(ctx->video_codec_context);
+    ctx->drop_until = accurate && key < ts ? ts : AV_NOPTS_VALUE;
+}
+
 // Decoding thread function
 // static void *decode_thread(void *arg) {
 static int decode_thread_func(void *arg) {
@@ -59,40 +103,66 @@ static int decode_thread_func(void *arg) {
         return 1;
         // return NULL;
     }
-    int printrate = 2000;
     long frames = 0;
     while (!ctx->quit) {
-        if (frames % printrate == 0) printf(" d ? av_read_frame\n");
+        SDL_LockMutex(ctx->frame_mutex);
+        int seek_request = ctx->seek_request;
+        double seek_target = ctx->seek_target;
+        int seek_accurate = ctx->seek_accurate;
+        ctx->seek_request = 0;
+        SDL_UnlockMutex(ctx->frame_mutex);
+        if (seek_request) {
+            seek_video(ctx, seek_target, seek_accurate);
+        }
+
+        TRACE(" d ? av_read_frame");
         if (av_read_frame(ctx->format_context, packet) < 0) {
             printf(" d ? av_read_frame - end of stream or error\n");
             break;  // End of stream or error
         }
 
         if (packet->stream_index == ctx->video_stream_index) {
-            if (frames % printrate == 0) printf(" d < avcodec_send_packet\n");
+            TRACE(" d < avcodec_send_packet");
             avcodec_send_packet(ctx->video_codec_context, packet);
-            if (frames % printrate == 0) printf(" d > avcodec_receive_frame\n");
+            TRACE(" d > avcodec_receive_frame");
             while (avcodec_receive_frame(ctx->video_codec_context,
                                          ctx->frame) == 0) {
-                if (frames % printrate == 0) printf(" d sws_scale\n");
+                int64_t pts = ctx->frame->best_effort_timestamp;
+                if (ctx->drop_until != AV_NOPTS_VALUE) {
+                    if (pts != AV_NOPTS_VALUE && pts < ctx->drop_until) {
+                        telemetry_add(tm_skipped, 1);
+                        continue;  // before the seek target, don't show it
+                    }
+                    ctx->drop_until = AV_NOPTS_VALUE;
+                }
+                TRACE(" d sws_scale");
                 // Convert frame to RGB
                 sws_scale(
                     ctx->sws_context, (const uint8_t *const *)ctx->frame->data,
                     ctx->frame->linesize, 0, ctx->video_codec_context->height,
                     ctx->rgb_frame->data, ctx->rgb_frame->linesize);
 
-                if (frames % printrate == 0) printf(" d SDL_LockMutex\n");
+                TRACE(" d SDL_LockMutex");
                 SDL_LockMutex(ctx->frame_mutex);
-                if (frames % printrate == 0)
-                    printf(" d memcpy(ctx->frame_buffer...\n");
+                TRACE(" d memcpy(ctx->frame_buffer...");
                 memcpy(ctx->frame_buffer, ctx->rgb_frame->data[0],
                        ctx->frame_buffer_size);
-                if (frames % printrate == 0) printf(" d SDL_UnlockMutex\n");
+                if (pts != AV_NOPTS_VALUE) {
+                    AVStream *st =
+                        ctx->format_context->streams[ctx->video_stream_index];
+                    if (st->start_time != AV_NOPTS_VALUE) {
+                        pts -= st->start_time;
+                    }
+                    ctx->position = pts * av_q2d(st->time_base);
+                }
+                TRACE(" d SDL_UnlockMutex");
                 SDL_UnlockMutex(ctx->frame_mutex);
+                telemetry_add(tm_decoded, 1);
+                telemetry_set(tm_position_ms, (int)(ctx->position * 1000));
 
                 // Introduce a delay based on the frame rate
                 if (ctx->frame_rate > 0) {
-                    if (frames % printrate == 0) printf(" d SDL_Delay\n");
+                    TRACE(" d SDL_Delay");
                     // usleep((int)(1000000.0 / ctx->frame_rate));
                     SDL_Delay((int)(1000.0 / ctx->frame_rate));
                 }
@@ -100,24 +170,40 @@ static int decode_thread_func(void *arg) {
         }
 
         av_packet_unref(packet);
-        // to slow down stdout.
-        if (frames % printrate == 0)
-            printf("decoding thread frames=%ld\n", frames);
+        RLOG_EVERY(RLOG_DEBUG, 2000, "decoding thread frames=%ld", frames);
         frames++;
         SDL_Delay(1);
     }
 
+    rlog_report();
     printf("decoder thread exiting\n");
+    trace_flush();
     av_packet_free(&packet);
     // return NULL;
     return 0;
 }
 
+// Close the input (and its seek index), then the read-ahead thread feeding it
+static void close_input(VideoPlayerContext *ctx) {
+    avformat_close_input(&ctx->format_context);
+    seek_index_close(&ctx->seek_index);
+    if (ctx->rio) {
+        struct ReadaheadStats stats;
+        readahead_io_get_stats(ctx->rio, &stats);
+        printf("Read-ahead: %llu reads, %llu stalls (%.1f ms waiting)\n",
+               (unsigned long long)stats.reads,
+               (unsigned long long)stats.stalls, stats.stall_ns / 1e6);
+        readahead_io_close(&ctx->rio);
+    }
+}
+
 // Function to initialize the video player
 int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
     ctx->filepath = filepath;
     ctx->format_context = NULL;
+    ctx->rio = NULL;
     ctx->video_stream_index = -1;
+    ctx->stream_info_cached = 0;
     ctx->video_codec_context = NULL;
     ctx->frame = NULL;
     ctx->rgb_frame = NULL;
@@ -129,6 +215,10 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
     ctx->frame_buffer = NULL;
     ctx->frame_buffer_size = 0;
     ctx->quit = 0;
+    ctx->seek_index = NULL;
+    ctx->seek_request = 0;
+    ctx->position = 0.0;
+    ctx->drop_until = AV_NOPTS_VALUE;
     ctx->width = 0;
     ctx->height = 0;
     ctx->frame_rate = 0.0;
@@ -138,19 +228,24 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
     // av_register_all();
     avformat_network_init();
 
-    // Open video file
-    if (avformat_open_input(&ctx->format_context, filepath, NULL, NULL) != 0) {
+    // Open video file, through the read-ahead thread if we can
+    if (readahead_open_input(&ctx->format_context, &ctx->rio, filepath, NULL,
+                             0, 0) != 0 &&
+        avformat_open_input(&ctx->format_context, filepath, NULL, NULL) != 0) {
         fprintf(stderr, "Error opening video file: %s\n", filepath);
         return -1;
     }
 
     printf("avformat_find_stream_info\n");
-    // Find video stream information
-    if (avformat_find_stream_info(ctx->format_context, NULL) < 0) {
+    // Find video stream information, cached after the first open
+    int info = stream_cache_find_stream_info(ctx->format_context, filepath,
+                                             NULL);
+    if (info < 0) {
         fprintf(stderr, "Error finding stream information\n");
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
+    ctx->stream_info_cached = info == 1;
 
     // Find the first video stream
     for (int i = 0; i < ctx->format_context->nb_streams; i++) {
@@ -163,10 +258,19 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
 
     if (ctx->video_stream_index == -1) {
         fprintf(stderr, "Error: No video stream found\n");
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
+    // Keyframe index for seeking, optional
+    ctx->seek_index = seek_index_load(filepath);
+    if (ctx->seek_index &&
+        seek_index_stream(ctx->seek_index) != ctx->video_stream_index) {
+        seek_index_close(&ctx->seek_index);
+    }
+    printf("seek index: %d keyframes\n",
+           ctx->seek_index ? seek_index_count(ctx->seek_index) : 0);
+
     // Get the codec parameters for the video stream
     AVCodecParameters *codec_params =
         ctx->format_context->streams[ctx->video_stream_index]->codecpar;
@@ -175,7 +279,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
     const AVCodec *video_codec = avcodec_find_decoder(codec_params->codec_id);
     if (!video_codec) {
         fprintf(stderr, "Error: Video codec not found\n");
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -183,7 +287,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
     ctx->video_codec_context = avcodec_alloc_context3(video_codec);
     if (!ctx->video_codec_context) {
         fprintf(stderr, "Error allocating video codec context\n");
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -192,7 +296,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         0) {
         fprintf(stderr, "Error copying codec parameters to context\n");
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -200,7 +304,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
     if (avcodec_open2(ctx->video_codec_context, video_codec, NULL) < 0) {
         fprintf(stderr, "Error opening video codec\n");
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -211,7 +315,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         fprintf(stderr, "Error allocating frame\n");
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -226,7 +330,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -240,7 +344,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
     printf("av_image_fill_arrays() \n");
@@ -261,7 +365,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -295,7 +399,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         return -1;
     }
 
@@ -312,7 +416,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         SDL_Quit();
         return -1;
     }
@@ -330,7 +434,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         SDL_Quit();
         return -1;
     }
@@ -351,7 +455,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         SDL_Quit();
         return -1;
     }
@@ -374,7 +478,7 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
         av_frame_free(&ctx->frame);
         // avcodec_close(ctx->video_codec_context);
         avcodec_free_context(&ctx->video_codec_context);
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
         SDL_Quit();
         return -1;
     }
@@ -384,6 +488,12 @@ int init_video_player(VideoPlayerContext *ctx, const char *filepath) {
 
 // Function to play the video
 int play_video(VideoPlayerContext *ctx) {
+    tm_decoded = telemetry_counter("decoded");
+    tm_shown = telemetry_counter("shown");
+    tm_skipped = telemetry_counter("seek_skipped");
+    tm_position_ms = telemetry_gauge("position_ms");
+    telemetry_start(TELEMETRY_HZ);
+
     // pthread_t decode_thread_id;
     // if (pthread_create(&decode_thread_id, NULL, decode_thread, ctx) != 0) {
     //     fprintf(stderr, "Error creating decode thread\n");
@@ -392,6 +502,7 @@ int play_video(VideoPlayerContext *ctx) {
         SDL_CreateThread(decode_thread_func, "DecodeThread", ctx);
     if (ctx->decode_thread == NULL) {
         fprintf(stderr, "Error creating decode thread: %s\n", SDL_GetError());
+        telemetry_stop();
         return -1;
     }
 #ifdef __WIIU__
@@ -403,12 +514,54 @@ int play_video(VideoPlayerContext *ctx) {
 
     printf("main loop SDL_PollEvent\n");
     long frames = 0;
-    int printrate = 2000;
     SDL_GameController *pad;
     SDL_Event e;
     while (!ctx->quit) {
         while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) {
+            double seek_by = 0;
+            if (e.type == SDL_KEYDOWN) {
+                switch (e.key.keysym.sym) {
+                    case SDLK_LEFT:
+                        seek_by = -10.0;
+                        break;
+                    case SDLK_RIGHT:
+                        seek_by = 10.0;
+                        break;
+                    case SDLK_DOWN:
+                        seek_by = -60.0;
+                        break;
+                    case SDLK_UP:
+                        seek_by = 60.0;
+                        break;
+                }
+            } else if (e.type == SDL_CONTROLLERBUTTONDOWN) {
+                switch (e.cbutton.button) {
+                    case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+                        seek_by = -10.0;
+                        break;
+                    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+                        seek_by = 10.0;
+                        break;
+                    case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+                        seek_by = -60.0;
+                        break;
+                    case SDL_CONTROLLER_BUTTON_DPAD_UP:
+                        seek_by = 60.0;
+                        break;
+                }
+            }
+            if (seek_by != 0) {
+                // A held key repeats: scrub keyframe to keyframe, the
+                // first press lands on the exact frame
+                SDL_LockMutex(ctx->frame_mutex);
+                double base =
+                    ctx->seek_request ? ctx->seek_target : ctx->position;
+                ctx->seek_target = base + seek_by > 0 ? base + seek_by : 0;
+                ctx->seek_accurate =
+                    !(e.type == SDL_KEYDOWN && e.key.repeat);
+                ctx->seek_request = 1;
+                SDL_UnlockMutex(ctx->frame_mutex);
+            } else if (e.type == SDL_QUIT) {
                 ctx->quit = SDL_TRUE;
             } else if (e.type == SDL_KEYDOWN || e.type == SDL_MOUSEBUTTONDOWN) {
                 printf("SDL_KEYDOWN or SDL_MOUSEBUTTONDOWN\n");
@@ -431,20 +584,20 @@ int play_video(VideoPlayerContext *ctx) {
 
         SDL_LockMutex(ctx->frame_mutex);
 
-        if (frames % printrate == 0)
-            printf("UpdateTexture frame %ld\n", frames);
+        TRACE("UpdateTexture frame %ld", frames);
         SDL_UpdateTexture(ctx->texture, NULL, ctx->frame_buffer,
                           ctx->width * 3);
         SDL_UnlockMutex(ctx->frame_mutex);
 
         SDL_RenderClear(ctx->renderer);
 
-        if (frames % printrate == 0) printf("RenderCopy %ld\n", frames);
+        TRACE("RenderCopy %ld", frames);
         SDL_RenderCopy(ctx->renderer, ctx->texture, NULL, NULL);
 
-        if (frames % printrate == 0) printf("RenderPresent %ld\n", frames);
+        TRACE("RenderPresent %ld", frames);
         SDL_RenderPresent(ctx->renderer);
-        if (frames % printrate == 0) printf("RenderPresent done %ld\n", frames);
+        TRACE("RenderPresent done %ld", frames);
+        telemetry_add(tm_shown, 1);
         // SDL_Delay(7);
         SDL_Delay(1);  // Small delay for the main loop (SDL_Delay)
 
@@ -455,6 +608,7 @@ int play_video(VideoPlayerContext *ctx) {
 
     SDL_WaitThread(ctx->decode_thread, NULL);  // Wait for the thread to finish
     ctx->decode_thread = NULL;                 // Clean up the thread pointer
+    telemetry_stop();
     // pthread_join(decode_thread_id, NULL);
     return 0;
 }
@@ -497,8 +651,9 @@ void stop_video_player(VideoPlayerContext *ctx) {
         avcodec_free_context(&ctx->video_codec_context);
     }
     if (ctx->format_context) {
-        avformat_close_input(&ctx->format_context);
+        close_input(ctx);
     }
+    seek_index_close(&ctx->seek_index);
     avformat_network_deinit();
     SDL_Quit();
 }
@@ -514,7 +669,14 @@ int main(int argc, char *argv[]) {
     }
 
     VideoPlayerContext player_ctx;
-    if (init_video_player(&player_ctx, argv[1]) != 0) {
+    int ret = init_video_player(&player_ctx, argv[1]);
+    if (ret != 0 && player_ctx.stream_info_cached) {
+        // The cached stream info may be stale, drop it and probe for real
+        fprintf(stderr, "Retrying without the stream info cache\n");
+        stream_cache_remove(argv[1]);
+        ret = init_video_player(&player_ctx, argv[1]);
+    }
+    if (ret != 0) {
         fprintf(stderr, "Failed to initialize video player\n");
         return 1;
     }
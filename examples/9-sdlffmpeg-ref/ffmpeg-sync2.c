@@ -7,6 +7,7 @@
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavutil/channel_layout.h>  // For new AVChannelLayout API
+#include <libavutil/fifo.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/samplefmt.h>  // Explicitly include for AVSampleFormat
@@ -14,15 +15,53 @@
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 
+#include "readahead.h"
+#include "streamcache.h"
+
 #ifdef __WIIU__
 #include <whb/log.h>
 #include <whb/log_console.h>
 #include <whb/proc.h>
 #endif
 
+// Decoded video frames wait in a queue until the audio clock reaches them.
+// ffplay keeps 3, more smooths over a slow decode but costs a frame buffer
+// each (~6MB at 1080p RGB24).  On the Mac the 2nd argument overrides it
+#ifndef VIDEO_QUEUE_DEPTH
+#define VIDEO_QUEUE_DEPTH 4
+#endif
+#define VIDEO_QUEUE_MAX 16
+// Video packets read while the queue is full wait here.  If this many pile
+// up the audio isn't moving (it ended, or a long stretch has none), so the
+// oldest frame is shown ahead of the clock to make room
+#define VIDEO_PENDING_MAX 64
+
+typedef struct QueuedFrame {
+    AVFrame *frame;  // RGB24, with its own buffer from av_image_alloc
+    double pts_sec;
+} QueuedFrame;
+
+// Ring of converted frames in PTS order, the oldest at rindex
+typedef struct VideoQueue {
+    QueuedFrame slots[VIDEO_QUEUE_MAX];
+    int depth;  // slots in use, 1..VIDEO_QUEUE_MAX
+    int rindex;
+    int size;
+    AVFifo *pending;  // AVPacket *, video read while the queue was full
+
+    // stats
+    int queued;
+    int reordered;    // came out of the decoder before an earlier PTS
+    int on_clock;     // shown when the audio clock got to it
+    int ahead;        // shown early to make room
+    int at_end;       // shown after the audio ran out
+    int max_pending;
+} VideoQueue;
+
 // --- Application Context Structure ---
 typedef struct AppContext {
     AVFormatContext *fmt_ctx;
+    struct ReadaheadIO *rio;  // reader thread feeding fmt_ctx, NULL = file:
     AVCodecContext *video_dec_ctx;
     AVCodecContext *audio_dec_ctx;
     struct SwsContext *sws_ctx;
@@ -30,10 +69,11 @@ typedef struct AppContext {
 
     int video_stream_idx;
     int audio_stream_idx;
+    int stream_info_cached;  // from the streamcache sidecar
 
-    // Target video frame (RGB24)
-    AVFrame *rgb_frame;
-    uint8_t *rgb_buffer;
+    // Target video frames (RGB24), waiting for the audio clock
+    VideoQueue vq;
+    int video_queue_depth;  // 0 = VIDEO_QUEUE_DEPTH
 
     // Target audio frame (resampled)
     AVFrame *resampled_audio_frame;
@@ -44,10 +84,6 @@ typedef struct AppContext {
 
     // Synchronization State
     double audio_clock;  // Current audio playback time in seconds
-    AVFrame
-        *held_video_frame;  // Holds the *converted* RGB frame if video is early
-    double held_video_pts_sec;  // PTS of the held video frame
-    int video_frame_held;       // Flag indicating if a video frame is held
 
 } AppContext;
 
@@ -129,6 +165,103 @@ void playit(AppContext *ctx, AVFrame *video_frame_rgb,
     }
 }
 
+// --- Video Frame Queue ---
+
+/**
+ * @brief Allocates depth RGB24 frames up front, so queueing a frame is only
+ * the sws_scale into a free one.
+ */
+static int video_queue_init(VideoQueue *q, int depth, int width, int height) {
+    if (depth < 1) depth = 1;
+    if (depth > VIDEO_QUEUE_MAX) depth = VIDEO_QUEUE_MAX;
+    q->depth = depth;
+    for (int i = 0; i < depth; i++) {
+        AVFrame *frame = av_frame_alloc();
+        if (!frame) return AVERROR(ENOMEM);
+        q->slots[i].frame = frame;
+        int ret = av_image_alloc(frame->data, frame->linesize, width, height,
+                                 AV_PIX_FMT_RGB24, 1);
+        if (ret < 0) {
+            fprintf(stderr, "ERROR: Could not allocate RGB video buffer: %d\n",
+                    ret);
+            return ret;
+        }
+        frame->format = AV_PIX_FMT_RGB24;
+        frame->width = width;
+        frame->height = height;
+    }
+    q->pending = av_fifo_alloc2(VIDEO_PENDING_MAX, sizeof(AVPacket *), 0);
+    if (!q->pending) return AVERROR(ENOMEM);
+    return 0;
+}
+
+static void video_queue_free(VideoQueue *q) {
+    AVPacket *pkt;
+
+    for (int i = 0; i < VIDEO_QUEUE_MAX; i++) {
+        if (q->slots[i].frame) {
+            av_freep(&q->slots[i].frame->data[0]);  // from av_image_alloc
+            av_frame_free(&q->slots[i].frame);
+        }
+    }
+    if (q->pending) {
+        while (av_fifo_read(q->pending, &pkt, 1) >= 0) av_packet_free(&pkt);
+        av_fifo_freep2(&q->pending);
+    }
+}
+
+// The i-th oldest queued frame
+static QueuedFrame *video_queue_at(VideoQueue *q, int i) {
+    return &q->slots[(q->rindex + i) % q->depth];
+}
+
+/**
+ * @brief The free frame to convert the next one into, NULL if the queue is
+ * full.
+ */
+static AVFrame *video_queue_peek_writable(VideoQueue *q) {
+    return q->size < q->depth ? video_queue_at(q, q->size)->frame : NULL;
+}
+
+/**
+ * @brief Queues the frame just written to video_queue_peek_writable. It
+ * moves up past any later PTS (B-frame reordering gone wrong, a bad
+ * timestamp) so the queue stays in presentation order.
+ */
+static void video_queue_push(VideoQueue *q, double pts_sec) {
+    int i = q->size;
+    video_queue_at(q, i)->pts_sec = pts_sec;
+    while (i > 0 && video_queue_at(q, i - 1)->pts_sec > pts_sec) {
+        QueuedFrame tmp = *video_queue_at(q, i - 1);
+        *video_queue_at(q, i - 1) = *video_queue_at(q, i);
+        *video_queue_at(q, i) = tmp;
+        i--;
+    }
+    if (i < q->size) q->reordered++;
+    q->size++;
+    q->queued++;
+}
+
+static void video_queue_show_oldest(AppContext *ctx, int *count) {
+    VideoQueue *q = &ctx->vq;
+    QueuedFrame *f = video_queue_at(q, 0);
+
+    playit(ctx, f->frame, NULL, f->pts_sec, -1.0);
+    q->rindex = (q->rindex + 1) % q->depth;
+    q->size--;
+    (*count)++;
+}
+
+/**
+ * @brief Shows every queued frame the audio clock has reached.
+ */
+static void video_queue_present_due(AppContext *ctx) {
+    VideoQueue *q = &ctx->vq;
+    while (q->size > 0 && video_queue_at(q, 0)->pts_sec <= ctx->audio_clock) {
+        video_queue_show_oldest(ctx, &q->on_clock);
+    }
+}
+
 // --- FFmpeg Initialization and Processing Functions ---
 
 /**
@@ -138,20 +271,29 @@ int open_media_file(AppContext *ctx, const char *filename) {
     int ret;
     ctx->fmt_ctx = NULL;  // Ensure it's NULL for avformat_open_input
 
-    // Open input file and read header
-    if ((ret = avformat_open_input(&ctx->fmt_ctx, filename, NULL, NULL)) < 0) {
+    // Open input file and read header.  Reads go through a read-ahead
+    // thread so av_read_frame doesn't wait on the SD card, fall back to the
+    // plain file: protocol if that can't be set up.
+    ret = readahead_open_input(&ctx->fmt_ctx, &ctx->rio, filename, NULL, 0, 0);
+    if (ret < 0) {
+        ret = avformat_open_input(&ctx->fmt_ctx, filename, NULL, NULL);
+    }
+    if (ret < 0) {
         fprintf(stderr, "ERROR: Cannot open input file '%s': %d\n", filename,
                 ret);
         return ret;
     }
 
-    // Retrieve stream information
-    if ((ret = avformat_find_stream_info(ctx->fmt_ctx, NULL)) < 0) {
+    // Retrieve stream information, from the sidecar cache if this file was
+    // opened before
+    if ((ret = stream_cache_find_stream_info(ctx->fmt_ctx, filename, NULL)) <
+        0) {
         fprintf(stderr, "ERROR: Cannot find stream information: %d\n", ret);
         // No need to close input here, cleanup() will handle it if fmt_ctx is
         // non-NULL
         return ret;
     }
+    ctx->stream_info_cached = ret == 1;
 
     // Find the best video and audio streams
     ctx->video_stream_idx =
@@ -259,28 +401,20 @@ int prepare_decoders_and_conversion(AppContext *ctx) {
     }
 
     // --- Prepare Video Conversion (to RGB24) ---
-    ctx->rgb_frame = av_frame_alloc();
-    if (!ctx->rgb_frame) return AVERROR(ENOMEM);
-
     int width = ctx->video_dec_ctx->width;
     int height = ctx->video_dec_ctx->height;
     enum AVPixelFormat pix_fmt = ctx->video_dec_ctx->pix_fmt;
     enum AVPixelFormat target_pix_fmt =
         AV_PIX_FMT_RGB24;  // Common display format
 
-    // Allocate buffer for the RGB frame
-    // Use av_image_alloc for proper alignment and buffer management
-    ret = av_image_alloc(ctx->rgb_frame->data, ctx->rgb_frame->linesize, width,
-                         height, target_pix_fmt, 1);  // Alignment 1
+    // Allocate the RGB frames of the queue, cleanup() frees them
+    ret = video_queue_init(&ctx->vq,
+                           ctx->video_queue_depth > 0 ? ctx->video_queue_depth
+                                                      : VIDEO_QUEUE_DEPTH,
+                           width, height);
     if (ret < 0) {
-        fprintf(stderr, "ERROR: Could not allocate RGB video buffer: %d\n",
-                ret);
-        av_frame_free(&ctx->rgb_frame);  // Free the frame struct itself
         return ret;
     }
-    // Store the buffer pointer separately for freeing with
-    // av_freep(&ctx->rgb_buffer)
-    ctx->rgb_buffer = ctx->rgb_frame->data[0];
 
     // Get SWS context for scaling/conversion
     ctx->sws_ctx = sws_getContext(width, height, pix_fmt,           // Input
@@ -289,14 +423,12 @@ int prepare_decoders_and_conversion(AppContext *ctx) {
     if (!ctx->sws_ctx) {
         fprintf(stderr,
                 "ERROR: Failed to get SwsContext for video conversion\n");
-        // No need to free rgb_buffer explicitly here, cleanup() handles it
+        // No need to free the queue's frames here, cleanup() handles it
         return AVERROR(EINVAL);
     }
-    ctx->rgb_frame->format = target_pix_fmt;
-    ctx->rgb_frame->width = width;
-    ctx->rgb_frame->height = height;
-    printf("Prepared video scaling context (%s -> %s)\n",
-           av_get_pix_fmt_name(pix_fmt), av_get_pix_fmt_name(target_pix_fmt));
+    printf("Prepared video scaling context (%s -> %s), %d frame queue\n",
+           av_get_pix_fmt_name(pix_fmt), av_get_pix_fmt_name(target_pix_fmt),
+           ctx->vq.depth);
 
     // --- Prepare Audio Resampling (Example: to Signed 16-bit Stereo) ---
     ctx->resampled_audio_frame = av_frame_alloc();
@@ -479,37 +611,24 @@ int decode_and_process_frame(AppContext *ctx, AVPacket *pkt, int flushing) {
 
         if (stream_index == ctx->video_stream_idx) {
             // --- Process Video Frame ---
+            // The main loop only sends a video packet when there's room, but
+            // one packet can give more than one frame (decoder delay, the
+            // flush).  Show the oldest early rather than lose a frame
+            AVFrame *rgb_frame = video_queue_peek_writable(&ctx->vq);
+            if (!rgb_frame) {
+                video_queue_show_oldest(ctx, &ctx->vq.ahead);
+                rgb_frame = video_queue_peek_writable(&ctx->vq);
+            }
+
             // Convert video frame to RGB format using sws_scale
             sws_scale(ctx->sws_ctx, (const uint8_t *const *)decoded_frame->data,
                       decoded_frame->linesize, 0, ctx->video_dec_ctx->height,
-                      ctx->rgb_frame->data, ctx->rgb_frame->linesize);
-
-            // Synchronization: Check if this video frame should be displayed
-            if (ctx->video_frame_held) {
-                // If we are already holding a frame, this new one is probably
-                // too early too. A real player would queue frames.
-                // Simplification: discard older held frame.
-                printf(
-                    "WARN: Discarding held video frame (PTS %f) to process new "
-                    "one (PTS %f)\n",
-                    ctx->held_video_pts_sec, pts_sec);
-                // No need to unref ctx->held_video_frame, it's just a pointer
-                // to ctx->rgb_frame
-            }
+                      rgb_frame->data, rgb_frame->linesize);
 
-            // Compare video PTS to audio clock
-            if (pts_sec <= ctx->audio_clock || ctx->audio_clock == 0.0) {
-                // Video is on time or audio hasn't started, play it
-                playit(ctx, ctx->rgb_frame, NULL, pts_sec, -1.0);
-                ctx->video_frame_held = 0;  // Ensure not marked as held
-            } else {
-                // Video is too early, hold this frame (its data is already in
-                // rgb_frame)
-                ctx->held_video_pts_sec = pts_sec;
-                ctx->video_frame_held = 1;
-                // printf("       Holding video frame (PTS %f > clock %f)\n",
-                // pts_sec, ctx->audio_clock);
-            }
+            // Queue it in PTS order, it's shown when the audio clock gets
+            // there (right away if it already has)
+            video_queue_push(&ctx->vq, pts_sec);
+            video_queue_present_due(ctx);
 
         } else if (stream_index == ctx->audio_stream_idx) {
             // --- Process Audio Frame ---
@@ -569,16 +688,8 @@ int decode_and_process_frame(AppContext *ctx, AVPacket *pkt, int flushing) {
                     ctx->resampled_audio_data = NULL;
                     ctx->resampled_audio_buf_size = 0;
 
-                    // --- Check if held video frame can now be played ---
-                    if (ctx->video_frame_held &&
-                        ctx->held_video_pts_sec <= ctx->audio_clock) {
-                        // printf("       Playing held video frame (PTS %f <=
-                        // clock %f)\n", ctx->held_video_pts_sec,
-                        // ctx->audio_clock);
-                        playit(ctx, ctx->rgb_frame, NULL,
-                               ctx->held_video_pts_sec, -1.0);
-                        ctx->video_frame_held = 0;  // Mark as played
-                    }
+                    // --- Show the queued video frames now due ---
+                    video_queue_present_due(ctx);
 
                 } else {
                     // 0 samples output, free buffer anyway
@@ -605,15 +716,69 @@ int decode_and_process_frame(AppContext *ctx, AVPacket *pkt, int flushing) {
                                              // finished, 0 otherwise
 }
 
+/**
+ * @brief Back-pressure: while the queue is full (or older video packets are
+ * still waiting) a video packet isn't decoded yet.
+ */
+static int video_must_wait(AppContext *ctx) {
+    return ctx->vq.size == ctx->vq.depth ||
+           av_fifo_can_read(ctx->vq.pending) > 0;
+}
+
+/**
+ * @brief Decodes the waiting video packets, oldest first, while there's
+ * room. With force, makes room by showing the oldest frame early (end of
+ * file, the audio won't move the clock anymore).
+ */
+static int feed_waiting_video(AppContext *ctx, int force) {
+    AVPacket *pkt;
+    int ret = 0;
+
+    while (av_fifo_can_read(ctx->vq.pending) > 0) {
+        if (ctx->vq.size == ctx->vq.depth) {
+            if (!force) break;
+            video_queue_show_oldest(ctx, &ctx->vq.ahead);
+        }
+        av_fifo_read(ctx->vq.pending, &pkt, 1);
+        ret = decode_and_process_frame(ctx, pkt, 0);
+        av_packet_free(&pkt);
+        if (ret < 0) break;
+    }
+    return ret;
+}
+
+/**
+ * @brief Keeps a video packet until the queue has room. Takes the packet's
+ * reference, pkt is blank after.
+ */
+static int wait_video_packet(AppContext *ctx, AVPacket *pkt) {
+    VideoQueue *q = &ctx->vq;
+
+    if (av_fifo_can_write(q->pending) == 0) {
+        // VIDEO_PENDING_MAX behind and the clock isn't moving, show a frame
+        // early so the oldest packet can go
+        video_queue_show_oldest(ctx, &q->ahead);
+        int ret = feed_waiting_video(ctx, 0);
+        if (ret < 0) return ret;
+    }
+    AVPacket *waiting = av_packet_alloc();
+    if (!waiting) return AVERROR(ENOMEM);
+    av_packet_move_ref(waiting, pkt);
+    av_fifo_write(q->pending, &waiting, 1);
+    if ((int)av_fifo_can_read(q->pending) > q->max_pending) {
+        q->max_pending = (int)av_fifo_can_read(q->pending);
+    }
+    return 0;
+}
+
 /**
  * @brief Frees all allocated FFmpeg resources and context data.
  */
 void cleanup(AppContext *ctx) {
     printf("Cleaning up resources...\n");
 
-    // Free synchronization state resources
-    // (held_video_frame just points to rgb_frame's data, no separate free
-    // needed)
+    // Free the video queue, its RGB frames and any packets still waiting
+    video_queue_free(&ctx->vq);
 
     // Free conversion/resampling resources
     if (ctx->resampled_audio_data) {  // Check if buffer was allocated and maybe
@@ -627,12 +792,6 @@ void cleanup(AppContext *ctx) {
         &ctx->target_audio_ch_layout);  // Uninit layout from
                                         // av_channel_layout_default
 
-    if (ctx->rgb_buffer) {  // Free the buffer allocated by av_image_alloc
-        av_freep(&ctx->rgb_buffer);  // Use av_freep for buffers from
-                                     // av_malloc/av_image_alloc
-        // Note: rgb_frame->data[0] pointed to this buffer, don't double free.
-    }
-    av_frame_free(&ctx->rgb_frame);
     sws_freeContext(ctx->sws_ctx);
 
     // Free decoder contexts
@@ -641,6 +800,14 @@ void cleanup(AppContext *ctx) {
 
     // Close input file
     avformat_close_input(&ctx->fmt_ctx);  // Handles NULL check internally
+    if (ctx->rio) {  // after fmt_ctx, it still points at our AVIOContext
+        struct ReadaheadStats stats;
+        readahead_io_get_stats(ctx->rio, &stats);
+        printf("Read-ahead: %llu reads, %llu stalls (%.1f ms waiting)\n",
+               (unsigned long long)stats.reads,
+               (unsigned long long)stats.stalls, stats.stall_ns / 1e6);
+        readahead_io_close(&ctx->rio);
+    }
 
     // Zero out the context struct (optional, good practice)
     memset(ctx, 0, sizeof(AppContext));
@@ -652,7 +819,8 @@ int ffmpeg_sync2_main(char *filename) {
 // --- Main Function ---
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <input_file> [video queue depth]\n",
+                argv[0]);
         return 1;
     }
     const char *filename = argv[1];
@@ -662,14 +830,29 @@ int main(int argc, char *argv[]) {
     AVPacket *pkt = NULL;
     int ret;
 
+#ifndef __WIIU__
+    if (argc > 2) {
+        app_ctx.video_queue_depth = atoi(argv[2]);  // frames, 1..16
+    }
+#endif
+
     // --- Initialization Phase ---
     ret = open_media_file(&app_ctx, filename);
-    if (ret < 0) {
-        cleanup(&app_ctx);
-        return 1;
+    if (ret >= 0) {
+        ret = prepare_decoders_and_conversion(&app_ctx);
+    }
+    if (ret < 0 && app_ctx.stream_info_cached) {
+        // The cached stream info may be stale, drop it and probe for real
+        fprintf(stderr, "Retrying without the stream info cache\n");
+        stream_cache_remove(filename);
+        int depth = app_ctx.video_queue_depth;
+        cleanup(&app_ctx);  // zeroes app_ctx
+        app_ctx.video_queue_depth = depth;
+        ret = open_media_file(&app_ctx, filename);
+        if (ret >= 0) {
+            ret = prepare_decoders_and_conversion(&app_ctx);
+        }
     }
-
-    ret = prepare_decoders_and_conversion(&app_ctx);
     if (ret < 0) {
         cleanup(&app_ctx);
         return 1;
@@ -685,8 +868,17 @@ int main(int argc, char *argv[]) {
     // --- Main Decoding Loop ---
     printf("\nStarting decoding loop...\n");
     while (av_read_frame(app_ctx.fmt_ctx, pkt) >= 0) {
-        ret = decode_and_process_frame(&app_ctx, pkt, 0);
-        av_packet_unref(pkt);  // Important: Release packet reference
+        if (pkt->stream_index == app_ctx.video_stream_idx &&
+            video_must_wait(&app_ctx)) {
+            // The queue is full of frames the audio hasn't reached, this
+            // one waits.  Audio packets keep going and move the clock
+            ret = wait_video_packet(&app_ctx, pkt);
+        } else {
+            ret = decode_and_process_frame(&app_ctx, pkt, 0);
+            av_packet_unref(pkt);  // Important: Release packet reference
+            // the audio may have made room for the waiting video
+            if (ret >= 0) ret = feed_waiting_video(&app_ctx, 0);
+        }
         if (ret < 0) {
             fprintf(stderr, "ERROR during decoding/processing. Aborting.\n");
             break;  // Exit loop on critical error
@@ -696,6 +888,9 @@ int main(int argc, char *argv[]) {
 
     // --- Flushing Phase ---
     printf("Flushing remaining frames...\n");
+    // Video still waiting for room goes first, nothing more is coming to
+    // move the audio clock along
+    feed_waiting_video(&app_ctx, 1);
     // Send NULL packet to each decoder to flush
     // decode_and_process_frame handles the NULL pkt logic internally when
     // flushing=1
@@ -712,7 +907,17 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // What's left in the queue, in PTS order, the audio is over
+    while (app_ctx.vq.size > 0) {
+        video_queue_show_oldest(&app_ctx, &app_ctx.vq.at_end);
+    }
     printf("Flushing complete.\n");
+    printf("Video queue (depth %d): %d frames, %d on the audio clock, %d "
+           "early to make room, %d at the end, %d reordered, up to %d "
+           "packets waiting\n",
+           app_ctx.vq.depth, app_ctx.vq.queued, app_ctx.vq.on_clock,
+           app_ctx.vq.ahead, app_ctx.vq.at_end, app_ctx.vq.reordered,
+           app_ctx.vq.max_pending);
 
     // --- Cleanup Phase ---
     av_packet_free(&pkt);
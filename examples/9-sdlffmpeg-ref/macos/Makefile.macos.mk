@@ -13,9 +13,17 @@ TARGET = sdl-ffmpeg-macos
 # Source file
 #SRC	=  sdl-display4.c
 #SRC	=  ffmpeg-decode5.c
-#SRC	=  ffmpeg-sync2.c
-#SRC	=  sdlfilepicker4.c
-#SRC	=  ffmpeg-playvid.c
+#SRC	=  ffmpeg-sync2.c ../../example-util/readahead.c \
+#        ../../example-util/stagetimer.c ../../example-util/streamcache.c
+#SRC	=  sdlfilepicker4.c ../../example-util/medialib.c \
+#        ../../example-util/file.c ../../example-util/stagetimer.c \
+#        ../../example-util/streamcache.c ../../example-util/thumbcache.c \
+#        ../../example-util/mp4info.c
+#SRC	=  ffmpeg-playvid.c ../../example-util/readahead.c \
+#        ../../example-util/stagetimer.c ../../example-util/streamcache.c \
+#        ../../example-util/seekindex.c ../../rsyslog/trace.c \
+#        ../../rsyslog/rsyslogq.c ../../rsyslog/lzlog.c ../../rsyslog/ratelog.c \
+#        ../../rsyslog/telemetry.c
 SRC	=  ffmpeg-playaud6.c
 
 # Compiler
@@ -36,7 +44,7 @@ SDL_LDFLAGS = $(shell $(PKGCONF_MAC) --libs SDL2_ttf sdl2) \
               $(shell $(PKGCONF_MAC) --libs harfbuzz freetype2)
 
 # Combine CFLAGS and LDFLAGS
-CFLAGS += $(FFMPEG_CFLAGS) $(SDL_CFLAGS)
+CFLAGS += $(FFMPEG_CFLAGS) $(SDL_CFLAGS) -I../../example-util -I../../rsyslog
 LDFLAGS += $(FFMPEG_LDFLAGS) $(SDL_LDFLAGS)
 
 
@@ -45,7 +53,9 @@ BUILD_DIR = build_mac
 
 # Output executable name
 # Object file
-OBJ = $(BUILD_DIR)/$(SRC:.c=.o)
+OBJ = $(addprefix $(BUILD_DIR)/,$(notdir $(SRC:.c=.o)))
+vpath %.c ../../example-util
+vpath %.c ../../rsyslog
 
 # Default rule: build the executable
 $(TARGET): $(OBJ)
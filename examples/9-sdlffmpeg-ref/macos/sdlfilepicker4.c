@@ -17,12 +17,18 @@
 #include <sys/stat.h>  // For stat
 #include <unistd.h>    // For getcwd
 
+#include "medialib.h"  // codec / resolution / duration next to file names
+#include "thumbcache.h"  // poster frames
+
 // --- Configuration ---
 #define SCREEN_WIDTH 600
 #define SCREEN_HEIGHT 400
-#define ITEM_HEIGHT 25
+#define ITEM_HEIGHT 40  // room for a THUMB_ROW_H poster frame
 #define FONT_SIZE 20
 #define PADDING 10
+#define THUMB_ROW_W 64  // poster frames are scaled to fit this box
+#define THUMB_ROW_H 36
+#define THUMB_SLOTS 64  // thumbnails kept in memory (and in textures)
 
 // Colors (SDL_Color)
 const SDL_Color COLOR_WHITE = {255, 255, 255, 255};
@@ -48,6 +54,8 @@ typedef enum {
 typedef struct {
     char name[NAME_MAX + 1];  // Max file name length
     ItemType type;
+    char info[64];  // "h264 1280x720 1:23:45" from the media library
+    bool has_video;  // worth asking for a thumbnail
 } DirItem;
 
 typedef struct {
@@ -68,6 +76,42 @@ typedef enum {
 
 const char* FONT_PATH = "romfs/res/Roboto-Regular.ttf";
 
+// Index of everything under the starting directory, so we can show what a
+// file is without opening it while browsing.  NULL if it couldn't be built.
+static struct MediaLibrary* media_lib = NULL;
+
+// --- Thumbnails ---
+// Poster frames are made by a worker thread (thumb_cache_get reads the
+// .thumb sidecar, or decodes the first keyframe and writes one).  The main
+// thread only looks at the slot table, under the mutex, and uploads
+// finished thumbnails to textures, so scrolling never waits on a decode.
+typedef enum {
+    THUMB_EMPTY,
+    THUMB_QUEUED,   // wants a worker
+    THUMB_WORKING,  // worker has it, slot can't be reused
+    THUMB_READY,    // pixels in thumb, or texture once uploaded
+    THUMB_NONE      // no picture in this file
+} ThumbState;
+
+typedef struct {
+    char path[PATH_MAX];
+    ThumbState state;
+    unsigned int last_used;  // frame it was last on screen
+    struct Thumb thumb;
+    SDL_Texture* texture;
+} ThumbSlot;
+
+typedef struct {
+    ThumbSlot slots[THUMB_SLOTS];
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+    SDL_Thread* thread;
+    bool quit;
+    unsigned int frame;
+} ThumbCache;
+
+static ThumbCache thumbs;
+
 // --- Helper Functions ---
 
 // Comparison function for sorting directory items
@@ -97,6 +141,31 @@ void free_item_list(ItemList* list) {
     list->capacity = 0;
 }
 
+// Fills item->info from the media library, empty if the file isn't media
+static void describe_item(const char* full_path, DirItem* item) {
+    const struct MediaEntry* e =
+        media_lib ? media_lib_find(media_lib, full_path) : NULL;
+
+    item->info[0] = '\0';
+    item->has_video = false;
+    if (e == NULL || e->container[0] == '\0') {
+        return;
+    }
+    item->has_video = e->video_codec[0] != '\0';
+    int len = 0;
+    if (e->video_codec[0]) {
+        len = snprintf(item->info, sizeof(item->info), "%s %dx%d",
+                       e->video_codec, e->width, e->height);
+    } else if (e->audio_codec[0]) {
+        len = snprintf(item->info, sizeof(item->info), "%s", e->audio_codec);
+    }
+    if (e->duration_ms >= 0 && len >= 0 && len < (int)sizeof(item->info)) {
+        int secs = (int)(e->duration_ms / 1000);
+        snprintf(item->info + len, sizeof(item->info) - len, " %d:%02d:%02d",
+                 secs / 3600, secs / 60 % 60, secs % 60);
+    }
+}
+
 // Populates the ItemList for a given directory
 int get_directory_items(const char* directory, ItemList* list) {
     DIR* d;
@@ -146,15 +215,17 @@ int get_directory_items(const char* directory, ItemList* list) {
         list->items[list->count].name[NAME_MAX] =
             '\0';  // Ensure null termination
         list->items[list->count].type = ITEM_TYPE_PARENT;
+        list->items[list->count].info[0] = '\0';
+        list->items[list->count].has_video = false;
         list->count++;
     }
 
     d = opendir(directory);
     if (d) {
         while ((dir = readdir(d)) != NULL) {
-            // Skip "." and the ".." we added manually
-            if (strcmp(dir->d_name, ".") == 0 ||
-                strcmp(dir->d_name, "..") == 0) {
+            // Skip "." and the ".." we added manually, and hidden files
+            // (the .sinfo / .thumb sidecars and such)
+            if (dir->d_name[0] == '.') {
                 continue;
             }
 
@@ -190,10 +261,13 @@ int get_directory_items(const char* directory, ItemList* list) {
                 list->items[list->count].name[NAME_MAX] =
                     '\0';  // Ensure null termination
 
+                list->items[list->count].info[0] = '\0';
+                list->items[list->count].has_video = false;
                 if (S_ISDIR(st.st_mode)) {
                     list->items[list->count].type = ITEM_TYPE_DIR;
                 } else if (S_ISREG(st.st_mode)) {
                     list->items[list->count].type = ITEM_TYPE_FILE;
+                    describe_item(full_path, &list->items[list->count]);
                 } else {
                     list->items[list->count].type = ITEM_TYPE_UNKNOWN;
                 }
@@ -238,6 +312,149 @@ SDL_Texture* renderText(SDL_Renderer* renderer, TTF_Font* font,
     return texture;
 }
 
+// Thumbnail worker.  Takes the queued slot that was on screen most
+// recently, so the rows you're looking at come first.
+static int thumb_worker(void* arg) {
+    ThumbCache* tc = (ThumbCache*)arg;
+    char path[PATH_MAX];
+
+    SDL_LockMutex(tc->mutex);
+    while (!tc->quit) {
+        ThumbSlot* job = NULL;
+        for (int i = 0; i < THUMB_SLOTS; i++) {
+            ThumbSlot* slot = &tc->slots[i];
+            if (slot->state == THUMB_QUEUED &&
+                (job == NULL || slot->last_used > job->last_used)) {
+                job = slot;
+            }
+        }
+        if (job == NULL) {
+            SDL_CondWait(tc->cond, tc->mutex);
+            continue;
+        }
+        job->state = THUMB_WORKING;
+        strcpy(path, job->path);
+        SDL_UnlockMutex(tc->mutex);
+
+        struct Thumb thumb;
+        int ret = thumb_cache_get(path, &thumb);
+
+        SDL_LockMutex(tc->mutex);
+        // WORKING slots are never reused, job is still ours
+        job->thumb = thumb;
+        job->state = ret >= 0 ? THUMB_READY : THUMB_NONE;
+    }
+    SDL_UnlockMutex(tc->mutex);
+    return 0;
+}
+
+static int start_thumbnails(void) {
+    memset(&thumbs, 0, sizeof(thumbs));
+    thumbs.mutex = SDL_CreateMutex();
+    thumbs.cond = SDL_CreateCond();
+    if (thumbs.mutex && thumbs.cond) {
+        thumbs.thread = SDL_CreateThread(thumb_worker, "thumbs", &thumbs);
+    }
+    if (!thumbs.thread) {
+        fprintf(stderr, "No thumbnail thread: %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_thumbnails(void) {
+    if (thumbs.thread) {
+        SDL_LockMutex(thumbs.mutex);
+        thumbs.quit = true;
+        SDL_CondSignal(thumbs.cond);
+        SDL_UnlockMutex(thumbs.mutex);
+        SDL_WaitThread(thumbs.thread, NULL);
+        thumbs.thread = NULL;
+    }
+    for (int i = 0; i < THUMB_SLOTS; i++) {
+        thumb_free(&thumbs.slots[i].thumb);
+        if (thumbs.slots[i].texture) {
+            SDL_DestroyTexture(thumbs.slots[i].texture);
+        }
+    }
+    if (thumbs.cond) SDL_DestroyCond(thumbs.cond);
+    if (thumbs.mutex) SDL_DestroyMutex(thumbs.mutex);
+    memset(&thumbs, 0, sizeof(thumbs));
+}
+
+// Texture for path's poster frame, NULL while it's still being made (or
+// there is none).  First call queues it for the worker, never blocks.
+static SDL_Texture* get_thumbnail(SDL_Renderer* renderer, const char* path) {
+    ThumbSlot* slot = NULL;
+    ThumbSlot* victim = NULL;
+    SDL_Texture* texture = NULL;
+
+    if (!thumbs.thread) {
+        return NULL;
+    }
+    SDL_LockMutex(thumbs.mutex);
+    for (int i = 0; i < THUMB_SLOTS; i++) {
+        ThumbSlot* s = &thumbs.slots[i];
+        if (s->state != THUMB_EMPTY && strcmp(s->path, path) == 0) {
+            slot = s;
+            break;
+        }
+        // reuse an empty slot, else the one off screen the longest
+        if (s->state == THUMB_WORKING || s->last_used == thumbs.frame) {
+            continue;
+        }
+        if (victim == NULL ||
+            (victim->state != THUMB_EMPTY &&
+             (s->state == THUMB_EMPTY || s->last_used < victim->last_used))) {
+            victim = s;
+        }
+    }
+    if (slot == NULL && victim != NULL) {
+        thumb_free(&victim->thumb);
+        if (victim->texture) {
+            SDL_DestroyTexture(victim->texture);
+            victim->texture = NULL;
+        }
+        snprintf(victim->path, sizeof(victim->path), "%s", path);
+        victim->state = THUMB_QUEUED;
+        SDL_CondSignal(thumbs.cond);
+        slot = victim;
+    }
+    if (slot != NULL) {
+        slot->last_used = thumbs.frame;
+        if (slot->state == THUMB_READY && slot->thumb.rgb) {
+            // finished since the last frame, upload it (main thread only)
+            slot->texture = SDL_CreateTexture(
+                renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STATIC,
+                slot->thumb.width, slot->thumb.height);
+            if (slot->texture) {
+                SDL_UpdateTexture(slot->texture, NULL, slot->thumb.rgb,
+                                  slot->thumb.width * 3);
+            }
+            thumb_free(&slot->thumb);
+        }
+        texture = slot->texture;
+    }
+    SDL_UnlockMutex(thumbs.mutex);
+    return texture;
+}
+
+// Draws the poster frame centered in the thumbnail box at x, y
+static void draw_thumbnail(SDL_Renderer* renderer, SDL_Texture* texture,
+                           int x, int y) {
+    int texW, texH;
+    SDL_QueryTexture(texture, NULL, NULL, &texW, &texH);
+    if (texW <= 0 || texH <= 0) return;
+    SDL_Rect dstrect = {0, 0, THUMB_ROW_W, texH * THUMB_ROW_W / texW};
+    if (dstrect.h > THUMB_ROW_H) {
+        dstrect.h = THUMB_ROW_H;
+        dstrect.w = texW * THUMB_ROW_H / texH;
+    }
+    dstrect.x = x + (THUMB_ROW_W - dstrect.w) / 2;
+    dstrect.y = y + (THUMB_ROW_H - dstrect.h) / 2;
+    SDL_RenderCopy(renderer, texture, NULL, &dstrect);
+}
+
 // --- Main Browser Function ---
 
 /**
@@ -309,6 +526,9 @@ int browse_files(const char* initial_dir, char* out_buffer,
         return -1;
     }
 
+    // Poster frames, the list still works without them
+    start_thumbnails();
+
     // --- Controller Setup ---
     SDL_GameController* game_controller = NULL;
     if (SDL_NumJoysticks() > 0) {
@@ -353,6 +573,16 @@ int browse_files(const char* initial_dir, char* out_buffer,
         }
     }
 
+    // Index the starting directory.  Only new or changed files get probed,
+    // the rest comes from .medialib.idx
+    if (running && media_lib_open(&media_lib, current_dir) == 0) {
+        struct MediaLibStats stats;
+        if (media_lib_update(media_lib, &stats) == 0) {
+            printf("Media library: %d files, %d probed in %.1f s\n",
+                   stats.files, stats.probed, stats.ns / 1e9);
+        }
+    }
+
     // Populate initial list
     if (running) {  // Only attempt if we have a valid starting directory
         if (get_directory_items(current_dir, &dir_list) != 0) {
@@ -637,6 +867,7 @@ int browse_files(const char* initial_dir, char* out_buffer,
         }
 
         // --- Drawing ---
+        thumbs.frame++;
         SDL_SetRenderDrawColor(renderer, COLOR_WHITE.r, COLOR_WHITE.g,
                                COLOR_WHITE.b, COLOR_WHITE.a);
         SDL_RenderClear(renderer);
@@ -685,10 +916,10 @@ int browse_files(const char* initial_dir, char* out_buffer,
                     break;
             }
 
-            char item_text[NAME_MAX +
-                           10];  // Room for prefix + name + null terminator
-            if (snprintf(item_text, sizeof(item_text), "%s%s", prefix,
-                         current_item->name) >= sizeof(item_text)) {
+            char item_text[NAME_MAX + 80];  // Room for prefix + name + info
+            if (snprintf(item_text, sizeof(item_text), "%s%s%s%s", prefix,
+                         current_item->name, current_item->info[0] ? "  " : "",
+                         current_item->info) >= sizeof(item_text)) {
                 // Should not happen with NAME_MAX + 10, but safety first
                 strncpy(item_text, "Name Too Long", sizeof(item_text) - 1);
                 item_text[sizeof(item_text) - 1] = '\0';
@@ -703,6 +934,21 @@ int browse_files(const char* initial_dir, char* out_buffer,
                 SDL_RenderFillRect(renderer, &highlight_rect);
             }
 
+            // Draw the poster frame, if it's ready
+            int row_y = start_y + i * ITEM_HEIGHT;
+            if (current_item->has_video) {
+                char item_path[PATH_MAX];
+                if (snprintf(item_path, sizeof(item_path), "%s/%s",
+                             current_dir,
+                             current_item->name) < sizeof(item_path)) {
+                    SDL_Texture* thumb = get_thumbnail(renderer, item_path);
+                    if (thumb) {
+                        draw_thumbnail(renderer, thumb, PADDING,
+                                       row_y + (ITEM_HEIGHT - THUMB_ROW_H) / 2);
+                    }
+                }
+            }
+
             // Draw item text
             SDL_Texture* item_texture =
                 renderText(renderer, font, item_text, item_color);
@@ -710,10 +956,9 @@ int browse_files(const char* initial_dir, char* out_buffer,
                 int texW, texH;
                 SDL_QueryTexture(item_texture, NULL, NULL, &texW,
                                  &texH);  // Corrected call
-                SDL_Rect dstrect = {
-                    PADDING,
-                    start_y + i * ITEM_HEIGHT + (ITEM_HEIGHT - texH) / 2, texW,
-                    texH};  // Center vertically in item height
+                SDL_Rect dstrect = {PADDING * 2 + THUMB_ROW_W,
+                                    row_y + (ITEM_HEIGHT - texH) / 2, texW,
+                                    texH};  // Center vertically in item height
                 SDL_RenderCopy(renderer, item_texture, NULL, &dstrect);
                 SDL_DestroyTexture(item_texture);  // Free texture
             }
@@ -723,7 +968,9 @@ int browse_files(const char* initial_dir, char* out_buffer,
     }  // End main loop
 
     // --- Cleanup ---
+    stop_thumbnails();  // before the renderer, it owns the textures
     free_item_list(&dir_list);
+    media_lib_close(&media_lib);
     if (game_controller) {
         SDL_GameControllerClose(game_controller);
     }
@@ -12,22 +12,57 @@
 #ifdef DEBUG
 #include "rsyslog-wiiu.h"
 #include "rsyslog.h"
+#include "trace.h"
 #endif  // DEBUG
 
 #endif
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <whb/proc.h>
 
 #include "exutil.h"
+#include "medialib.h"
 #include "sdlportables.h"
 
+/* First file in sd:/media that ffmpeg can open and that has audio, from
+   the media library index.  Only new or changed files get probed, so this
+   is quick after the first run.  Falls back to the first file we find. */
+static int find_media_file(char* buffer, int size) {
+    char media_dir[256];
+    struct MediaLibrary* lib = NULL;
+    struct MediaLibStats stats;
+    struct MediaQuery query = {.flags = MEDIA_PLAYABLE | MEDIA_HAS_AUDIO};
+    const struct MediaEntry* entry = NULL;
+    int found = 0;
+
+    if (util_get_media_dir(media_dir, sizeof(media_dir)) == 0 &&
+        media_lib_open(&lib, media_dir) == 0 &&
+        media_lib_update(lib, &stats) == 0) {
+        printf("media library: %d files, %d probed in %d ms\n", stats.files,
+               stats.probed, (int)(stats.ns / 1000000));
+        if (media_lib_query(lib, &query, &entry, 1) > 0) {
+            snprintf(buffer, size, "%s", entry->path);
+            found = 1;
+        }
+    }
+    media_lib_close(&lib);
+    if (found) {
+        return 0;
+    }
+    return util_get_first_media_file(buffer, size);
+}
+
 int main(int argc, char** argv) {
 #ifdef __WIIU__
     printf("initialized romfs");
 #ifdef DEBUG
     if (init_rsyslogger() != 0) {
         // setup udp or cafe logging
+    } else if (trace_open_syslog() == 0) {
+        // TRACE() lines go out as TRC1 packets, read them with
+        // rsyslog/tools/trace_decode.  Flushed ahead of the shipper at exit.
+        atexit(trace_close);
     }
 #endif  // DEBUG
 #endif  // __WIIU__
@@ -38,7 +73,7 @@ int main(int argc, char** argv) {
     printf("starting main\n");
     // Call your SDL routine here.
     char buffer[1024];
-    if (util_get_first_media_file(buffer, 1024) == 0) {
+    if (find_media_file(buffer, sizeof(buffer)) == 0) {
         printf("found media file %s\n", buffer);
         // ffmpeg_sync2_main(buffer);
         //  ffmpeg_decode4_main(buffer);
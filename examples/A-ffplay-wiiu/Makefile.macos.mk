@@ -7,12 +7,16 @@
 
 # ffplay is the same target built by the ffmpeg build scripts
 FFPLAY_TARGET = ffplay
-FFPLAY_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay.c
+FFPLAY_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay.c \
+             fftools/trace.c fftools/rsyslogq.c fftools/ratelog.c \
+             fftools/telemetry.c fftools/lzlog.c
 
 # ffplay_lib is a patched version of ffplay with main() renamed so it 
 #   can be built as a linkable static library 
 FFPLAY_LIB_TARGET = libffplay.a
-FFPLAY_LIB_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay_cli.c
+FFPLAY_LIB_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay_cli.c \
+                 fftools/trace.c fftools/rsyslogq.c fftools/ratelog.c \
+                 fftools/telemetry.c fftools/lzlog.c
 
 # a generic main, to call our library.  Only used on MacOS. On WiiU, we link the library into sdlmain.c
 FFPLAY_GENERIC_TARGET	= ffplay_generic 
@@ -6,11 +6,15 @@
 
 # ffplay is the same target built by the ffmpeg build scripts
 FFPLAY_TARGET = ffplay
-FFPLAY_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay.c
+FFPLAY_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay.c \
+             fftools/trace.c fftools/rsyslogq.c fftools/ratelog.c \
+             fftools/telemetry.c fftools/lzlog.c
 
 # ffplay_lib is a patched version of ffplay, with main() renamed so it
 #   can be built as a linkable static library
 FFPLAY_LIB_TARGET = libffplay.a
+# trace.c, rsyslogq.c, ratelog.c, telemetry.c and lzlog.c aren't in the
+#   library, the app builds them from ../rsyslog
 FFPLAY_LIB_SRC = fftools/ffplay_renderer.c fftools/cmdutils.c fftools/opt_common.c fftools/ffplay_cli.c
 
 # a generic main, to call our library.  Only used on MacOS. On WiiU, we link the library into sdlmain.c
@@ -58,6 +58,22 @@
 #include "cmdutils.h"
 #include "ffplay_renderer.h"
 #include "opt_common.h"
+#include "ratelog.h"
+#include "telemetry.h"
+#include "trace.h"
+
+/* the step by step prints in the packet / frame queues, decoders and
+   video_refresh run for every packet or frame.  A couple a second per call
+   site is enough to see where it is, the rest only costs a counter */
+#define RLOG_HOT(...) RLOG_RATE(RLOG_DEBUG, 2, 5, __VA_ARGS__)
+
+/* numbers for rsyslog/tools/telemetry_view, sampled TELEMETRY_HZ times a
+   second and sent along with the log.  Counters where it happens, the
+   queues, audio fill and A/V drift in telemetry_update */
+#define TELEMETRY_HZ 4
+static int tm_decoded = -1, tm_shown = -1, tm_drops = -1;
+static int tm_audioq = -1, tm_videoq = -1, tm_pictq = -1;
+static int tm_audio_ms = -1, tm_drift_ms = -1;
 
 #ifdef __WIIU__
 #include <coreinit/thread.h>
@@ -455,7 +471,7 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
     MyAVPacketList pkt1;
     int ret;
 
-    printf(" p packet_queue_put_private()\n");
+    RLOG_HOT(" p packet_queue_put_private()\n");
     if (q->abort_request)
         return -1;
 
@@ -469,7 +485,7 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
     q->size += pkt1.pkt->size + sizeof(pkt1);
     q->duration += pkt1.pkt->duration;
     /* XXX: should duplicate packet data in DV case */
-    printf(" p SDL_CondSignal\n");
+    RLOG_HOT(" p SDL_CondSignal\n");
     SDL_CondSignal(q->cond);
     return 0;
 }
@@ -479,7 +495,7 @@ static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
     AVPacket *pkt1;
     int ret;
 
-    printf(" p packet_queue_put()\n");
+    RLOG_HOT(" p packet_queue_put()\n");
 
     pkt1 = av_packet_alloc();
     if (!pkt1)
@@ -583,42 +599,42 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
 {
     MyAVPacketList pkt1;
     int ret;
-    printf(" p packet_queue_get()\n");
+    RLOG_HOT(" p packet_queue_get()\n");
     SDL_LockMutex(q->mutex);
 
     for (;;)
     {
         if (q->abort_request)
         {
-            printf(" p packet_queue_get abort_request\n");
+            RLOG_HOT(" p packet_queue_get abort_request\n");
             ret = -1;
             break;
         }
 
-        printf(" p packet_queue_get attempt av_fifo_read >= 0\n");
+        RLOG_HOT(" p packet_queue_get attempt av_fifo_read >= 0\n");
         if (av_fifo_read(q->pkt_list, &pkt1, 1) >= 0)
         {
             q->nb_packets--;
             q->size -= pkt1.pkt->size + sizeof(pkt1);
             q->duration -= pkt1.pkt->duration;
-            printf(" p packet_queue_get if (av_fifo_read(q->pkt_list, &pkt1, 1) >= 0)\n");
+            RLOG_HOT(" p packet_queue_get if (av_fifo_read(q->pkt_list, &pkt1, 1) >= 0)\n");
             av_packet_move_ref(pkt, pkt1.pkt);
             if (serial)
                 *serial = pkt1.serial;
             av_packet_free(&pkt1.pkt);
             ret = 1;
-            printf(" p packet_queue_get retrieved a packet\n");
+            RLOG_HOT(" p packet_queue_get retrieved a packet\n");
             break;
         }
         else if (!block)
         {
-            printf(" p packet_queue_get else if (!block)\n");
+            RLOG_HOT(" p packet_queue_get else if (!block)\n");
             ret = 0;
             break;
         }
         else
         {
-            printf(" p SDL_CondWait\n");
+            RLOG_HOT(" p SDL_CondWait\n");
             SDL_CondWait(q->cond, q->mutex);
         }
     }
@@ -657,7 +673,7 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub)
                 switch (d->avctx->codec_type)
                 {
                 case AVMEDIA_TYPE_VIDEO:
-                    printf("decoder_decode_frame() AVMEDIA_TYPE_VIDEO avcodec_recieve_frame() %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
+                    RLOG_HOT("decoder_decode_frame() AVMEDIA_TYPE_VIDEO avcodec_recieve_frame() %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
                     ret = avcodec_receive_frame(d->avctx, frame);
                     if (ret >= 0)
                     {
@@ -672,7 +688,7 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub)
                     }
                     break;
                 case AVMEDIA_TYPE_AUDIO:
-                    printf("decoder_decode_frame() AVMEDIA_TYPE_AUDIO avcodec_recieve_frame() %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
+                    RLOG_HOT("decoder_decode_frame() AVMEDIA_TYPE_AUDIO avcodec_recieve_frame() %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
                     ret = avcodec_receive_frame(d->avctx, frame);
                     if (ret >= 0)
                     {
@@ -711,7 +727,7 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub)
             else
             {
                 int old_serial = d->pkt_serial;
-                printf("decoder_decode_frame() packet_queue_get %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
+                RLOG_HOT("decoder_decode_frame() packet_queue_get %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
                 if (packet_queue_get(d->queue, d->pkt, 1, &d->pkt_serial) < 0)
                     return -1;
                 if (old_serial != d->pkt_serial)
@@ -757,7 +773,7 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub)
                 fd = (FrameData *)d->pkt->opaque_ref->data;
                 fd->pkt_pos = d->pkt->pos;
             }
-            printf("decoder_decode_frame() avcodec_send_packet() %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
+            RLOG_HOT("decoder_decode_frame() avcodec_send_packet() %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
             if (avcodec_send_packet(d->avctx, d->pkt) == AVERROR(EAGAIN))
             {
                 printf("Receive_frame and send_packet both returned EAGAIN, which is an API violation.\n");
@@ -766,10 +782,10 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub)
             }
             else
             {
-                printf("decoder_decode_frame() not error, avpacket_unref %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
+                RLOG_HOT("decoder_decode_frame() not error, avpacket_unref %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
                 av_packet_unref(d->pkt);
             }
-            printf("decoder_decode_frame() avcodec_send_packet() DONE %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
+            RLOG_HOT("decoder_decode_frame() avcodec_send_packet() DONE %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
         }
 
         // printf("decoder thread OSYieldThread %s, t%d\n", d->avctx->codec->name, d->decoder_tid);
@@ -835,31 +851,31 @@ static void frame_queue_signal(FrameQueue *f)
 
 static Frame *frame_queue_peek(FrameQueue *f)
 {
-    printf("frame_queue_peek()\n");
+    RLOG_HOT("frame_queue_peek()\n");
     return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
 }
 
 static Frame *frame_queue_peek_next(FrameQueue *f)
 {
-    printf("frame_queue_peek_next()\n");
+    RLOG_HOT("frame_queue_peek_next()\n");
     return &f->queue[(f->rindex + f->rindex_shown + 1) % f->max_size];
 }
 
 static Frame *frame_queue_peek_last(FrameQueue *f)
 {
-    printf("frame_queue_peek_last()\n");
+    RLOG_HOT("frame_queue_peek_last()\n");
     return &f->queue[f->rindex];
 }
 
 static Frame *frame_queue_peek_writable(FrameQueue *f)
 {
-    printf("frame_queue_peek_writeable()\n");
+    RLOG_HOT("frame_queue_peek_writeable()\n");
     /* wait until we have space to put a new frame */
     SDL_LockMutex(f->mutex);
     while (f->size >= f->max_size &&
            !f->pktq->abort_request)
     {
-        printf("fqpw SDL_CondWait\n");
+        RLOG_HOT("fqpw SDL_CondWait\n");
         SDL_CondWait(f->cond, f->mutex);
     }
     SDL_UnlockMutex(f->mutex);
@@ -872,13 +888,13 @@ static Frame *frame_queue_peek_writable(FrameQueue *f)
 
 static Frame *frame_queue_peek_readable(FrameQueue *f)
 {
-    printf("frame_queue_peek_readable()\n");
+    RLOG_HOT("frame_queue_peek_readable()\n");
     /* wait until we have a readable a new frame */
     SDL_LockMutex(f->mutex);
     while (f->size - f->rindex_shown <= 0 &&
            !f->pktq->abort_request)
     {
-        printf("fqpr SDL_CondWait\n");
+        RLOG_HOT("fqpr SDL_CondWait\n");
         SDL_CondWait(f->cond, f->mutex);
     }
     SDL_UnlockMutex(f->mutex);
@@ -891,7 +907,7 @@ static Frame *frame_queue_peek_readable(FrameQueue *f)
 
 static void frame_queue_push(FrameQueue *f)
 {
-    printf("frame_queue_push()\n");
+    RLOG_HOT("frame_queue_push()\n");
     if (++f->windex == f->max_size)
         f->windex = 0;
     SDL_LockMutex(f->mutex);
@@ -902,7 +918,7 @@ static void frame_queue_push(FrameQueue *f)
 
 static void frame_queue_next(FrameQueue *f)
 {
-    printf("frame_queue_peek_next()\n");
+    RLOG_HOT("frame_queue_peek_next()\n");
 
     if (f->keep_last && !f->rindex_shown)
     {
@@ -921,7 +937,7 @@ static void frame_queue_next(FrameQueue *f)
 /* return the number of undisplayed frames in the queue */
 static int frame_queue_nb_remaining(FrameQueue *f)
 {
-    printf("frame_queue_nb_remaining %d()\n", f->size - f->rindex_shown);
+    RLOG_HOT("frame_queue_nb_remaining %d()\n", f->size - f->rindex_shown);
 
     return f->size - f->rindex_shown;
 }
@@ -929,7 +945,7 @@ static int frame_queue_nb_remaining(FrameQueue *f)
 /* return last shown position */
 static int64_t frame_queue_last_pos(FrameQueue *f)
 {
-    printf("frame_queue_last_pos\n");
+    RLOG_HOT("frame_queue_last_pos\n");
     Frame *fp = &f->queue[f->rindex];
     if (f->rindex_shown && fp->serial == f->pktq->serial)
         return fp->pos;
@@ -1004,7 +1020,7 @@ static void calculate_display_rect(SDL_Rect *rect,
     AVRational aspect_ratio = pic_sar;
     int64_t width, height, x, y;
 
-    printf("calculate_display_rect()\n");
+    RLOG_HOT("calculate_display_rect()\n");
     if (av_cmp_q(aspect_ratio, av_make_q(0, 1)) <= 0)
         aspect_ratio = av_make_q(1, 1);
 
@@ -1028,7 +1044,7 @@ static void calculate_display_rect(SDL_Rect *rect,
 
 static void get_sdl_pix_fmt_and_blendmode(int format, Uint32 *sdl_pix_fmt, SDL_BlendMode *sdl_blendmode)
 {
-    printf("get_sdl_pix_fmt_and_blendmode\n");
+    RLOG_HOT("get_sdl_pix_fmt_and_blendmode\n");
     int i;
     *sdl_blendmode = SDL_BLENDMODE_NONE;
     *sdl_pix_fmt = SDL_PIXELFORMAT_UNKNOWN;
@@ -1049,7 +1065,7 @@ static void get_sdl_pix_fmt_and_blendmode(int format, Uint32 *sdl_pix_fmt, SDL_B
 
 static int upload_texture(SDL_Texture **tex, AVFrame *frame)
 {
-    printf("upload_texture() start\n");
+    TRACE("upload_texture() start");
     int ret = 0;
     Uint32 sdl_pix_fmt;
     SDL_BlendMode sdl_blendmode;
@@ -1057,20 +1073,20 @@ static int upload_texture(SDL_Texture **tex, AVFrame *frame)
     if (realloc_texture(tex, sdl_pix_fmt == SDL_PIXELFORMAT_UNKNOWN ? SDL_PIXELFORMAT_ARGB8888 : sdl_pix_fmt, frame->width, frame->height, sdl_blendmode, 0) < 0)
         return -1;
 
-    printf("upload_texture() switch %d\n", sdl_pix_fmt);
+    TRACE("upload_texture() switch %d", sdl_pix_fmt);
     switch (sdl_pix_fmt)
     {
     case SDL_PIXELFORMAT_IYUV:
         if (frame->linesize[0] > 0 && frame->linesize[1] > 0 && frame->linesize[2] > 0)
         {
-            printf("upload_texture() SDL_UpdateYUVTexture1 %d\n", sdl_pix_fmt);
+            TRACE("upload_texture() SDL_UpdateYUVTexture1 %d", sdl_pix_fmt);
             ret = SDL_UpdateYUVTexture(*tex, NULL, frame->data[0], frame->linesize[0],
                                        frame->data[1], frame->linesize[1],
                                        frame->data[2], frame->linesize[2]);
         }
         else if (frame->linesize[0] < 0 && frame->linesize[1] < 0 && frame->linesize[2] < 0)
         {
-            printf("upload_texture() SDL_UpdateYUVTexture2 %d\n", sdl_pix_fmt);
+            TRACE("upload_texture() SDL_UpdateYUVTexture2 %d", sdl_pix_fmt);
             ret = SDL_UpdateYUVTexture(*tex, NULL, frame->data[0] + frame->linesize[0] * (frame->height - 1), -frame->linesize[0],
                                        frame->data[1] + frame->linesize[1] * (AV_CEIL_RSHIFT(frame->height, 1) - 1), -frame->linesize[1],
                                        frame->data[2] + frame->linesize[2] * (AV_CEIL_RSHIFT(frame->height, 1) - 1), -frame->linesize[2]);
@@ -1085,17 +1101,17 @@ static int upload_texture(SDL_Texture **tex, AVFrame *frame)
     default:
         if (frame->linesize[0] < 0)
         {
-            printf("upload_texture() SDL_UpdateYUVTexture3 %d\n", sdl_pix_fmt);
+            TRACE("upload_texture() SDL_UpdateYUVTexture3 %d", sdl_pix_fmt);
             ret = SDL_UpdateTexture(*tex, NULL, frame->data[0] + frame->linesize[0] * (frame->height - 1), -frame->linesize[0]);
         }
         else
         {
-            printf("upload_texture() SDL_UpdateYUVTexture4 %d\n", sdl_pix_fmt);
+            TRACE("upload_texture() SDL_UpdateYUVTexture4 %d", sdl_pix_fmt);
             ret = SDL_UpdateTexture(*tex, NULL, frame->data[0], frame->linesize[0]);
         }
         break;
     }
-    printf("upload_texture() done\n");
+    TRACE("upload_texture() done");
     return ret;
 }
 
@@ -1118,9 +1134,9 @@ static void set_sdl_yuv_conversion_mode(AVFrame *frame)
         else if (frame->colorspace == AVCOL_SPC_BT470BG || frame->colorspace == AVCOL_SPC_SMPTE170M)
             mode = SDL_YUV_CONVERSION_BT601;
     }
-    printf("SDL_SetYUVConversionMode\n");
+    TRACE("SDL_SetYUVConversionMode");
     SDL_SetYUVConversionMode(mode); /* FIXME: no support for linear transfer */
-    printf("SDL_SetYUVConversionMode done\n");
+    TRACE("SDL_SetYUVConversionMode done");
 #endif
 }
 
@@ -1130,7 +1146,7 @@ static void video_image_display(VideoState *is)
     Frame *sp = NULL;
     SDL_Rect rect;
 
-    printf("Vid    start T%d\n", is->read_tid);
+    TRACE("Vid    start");
     vp = frame_queue_peek_last(&is->pictq);
     if (vk_renderer)
     {
@@ -1141,7 +1157,7 @@ static void video_image_display(VideoState *is)
     if (is->subtitle_st)
     {
 
-        printf("vid    is->subtitle T%d\n", is->read_tid);
+        TRACE("vid    is->subtitle");
         if (frame_queue_nb_remaining(&is->subpq) > 0)
         {
             sp = frame_queue_peek(&is->subpq);
@@ -1158,7 +1174,7 @@ static void video_image_display(VideoState *is)
                         sp->width = vp->width;
                         sp->height = vp->height;
                     }
-                    printf("vid    realloc_texture T%d\n", is->read_tid);
+                    TRACE("vid    realloc_texture");
                     if (realloc_texture(&is->sub_texture, SDL_PIXELFORMAT_ARGB8888, sp->width, sp->height, SDL_BLENDMODE_BLEND, 1) < 0)
                         return;
 
@@ -1183,7 +1199,7 @@ static void video_image_display(VideoState *is)
                         }
                         if (!SDL_LockTexture(is->sub_texture, (SDL_Rect *)sub_rect, (void **)pixels, pitch))
                         {
-                            printf("vid    sws_scale T%d\n", is->read_tid);
+                            TRACE("vid    sws_scale");
                             sws_scale(is->sub_convert_ctx, (const uint8_t *const *)sub_rect->data, sub_rect->linesize,
                                       0, sub_rect->h, pixels, pitch);
                             SDL_UnlockTexture(is->sub_texture);
@@ -1198,28 +1214,28 @@ static void video_image_display(VideoState *is)
     }
 
     calculate_display_rect(&rect, is->xleft, is->ytop, is->width, is->height, vp->width, vp->height, vp->sar);
-    printf("Vid    vp->frame T%d\n", is->read_tid);
+    TRACE("Vid    vp->frame");
     set_sdl_yuv_conversion_mode(vp->frame);
 
     if (!vp->uploaded)
     {
-        printf("Vid    if !uploaded upload_texture T%d\n", is->read_tid);
+        TRACE("Vid    if !uploaded upload_texture");
         if (upload_texture(&is->vid_texture, vp->frame) < 0)
         {
-            printf("Vid     upload_texture <0, set_sdl_yuv_conversion_mode(NULL), return\n");
+            TRACE("Vid     upload_texture <0, set_sdl_yuv_conversion_mode(NULL), return");
             set_sdl_yuv_conversion_mode(NULL);
             return;
         }
-        printf("Vid    upload_texture >=0  T%d\n", is->read_tid);
+        TRACE("Vid    upload_texture >=0");
         vp->uploaded = 1;
         vp->flip_v = vp->frame->linesize[0] < 0;
     }
 
-    printf("Vid    SDL_RenderCopyEx T%d\n", is->read_tid);
+    TRACE("Vid    SDL_RenderCopyEx");
     SDL_ClearError();
     SDL_RenderCopyEx(renderer, is->vid_texture, NULL, &rect, 0, NULL, vp->flip_v ? SDL_FLIP_VERTICAL : 0);
     SDL_GetError();
-    printf("Vid    SDL_RenderCopyEx set_sdl_yuv_conversion_mode(NULL)%s\n", SDL_GetError());
+    TRACE("Vid    SDL_RenderCopyEx set_sdl_yuv_conversion_mode(NULL)%s", SDL_GetError());
     set_sdl_yuv_conversion_mode(NULL);
     if (sp)
     {
@@ -1249,7 +1265,7 @@ static inline int compute_mod(int a, int b)
 
 static void video_audio_display(VideoState *s)
 {
-    printf("vad   video_audio_display()\n");
+    RLOG_HOT("vad   video_audio_display()\n");
     int i, i_start, x, y1, y, ys, delay, n, nb_display_channels;
     int ch, channels, h, h2;
     int64_t time_diff;
@@ -1548,6 +1564,8 @@ static void do_exit(VideoState *is)
         printf("\n");
     SDL_Quit();
     av_log(NULL, AV_LOG_QUIET, "%s", "");
+    telemetry_stop();
+    rlog_report();
     printf("exit(0)\n");
     // exit(0);
 }
@@ -1598,7 +1616,7 @@ static int video_open(VideoState *is)
 /* display the current picture, if any */
 static void video_display(VideoState *is)
 {
-    printf("video_display");
+    RLOG_HOT("video_display");
     if (!is->width)
         video_open(is);
 
@@ -1609,7 +1627,7 @@ static void video_display(VideoState *is)
     else if (is->video_st)
         video_image_display(is);
     SDL_RenderPresent(renderer);
-    printf("video_display SDL_SetRenderDrawColor/SDL_RenderClear/SDL_RenderPresent\n");
+    RLOG_HOT("video_display SDL_SetRenderDrawColor/SDL_RenderClear/SDL_RenderPresent\n");
 }
 
 static double get_clock(Clock *c)
@@ -1837,6 +1855,37 @@ static void update_video_pts(VideoState *is, double pts, int serial)
     sync_clock_to_slave(&is->extclk, &is->vidclk);
 }
 
+/* names the counters and gauges, once before the first stream opens */
+static void telemetry_register(void)
+{
+    tm_decoded = telemetry_counter("decoded");
+    tm_shown = telemetry_counter("shown");
+    tm_drops = telemetry_counter("dropped");
+    tm_audioq = telemetry_gauge("audioq_pkts");
+    tm_videoq = telemetry_gauge("videoq_pkts");
+    tm_pictq = telemetry_gauge("pictq");
+    tm_audio_ms = telemetry_gauge("audio_ms");
+    tm_drift_ms = telemetry_gauge("av_drift_ms");
+}
+
+/* the same A-V / M-V difference as the status line, in ms */
+static void telemetry_update(VideoState *is)
+{
+    double av_diff = 0;
+
+    if (is->audio_st && is->video_st)
+        av_diff = get_clock(&is->audclk) - get_clock(&is->vidclk);
+    else if (is->video_st)
+        av_diff = get_master_clock(is) - get_clock(&is->vidclk);
+    else if (is->audio_st)
+        av_diff = get_master_clock(is) - get_clock(&is->audclk);
+    telemetry_set(tm_audioq, is->audioq.nb_packets);
+    telemetry_set(tm_videoq, is->videoq.nb_packets);
+    telemetry_set(tm_pictq, is->pictq.size);
+    if (!isnan(av_diff))
+        telemetry_set(tm_drift_ms, (int)(av_diff * 1000));
+}
+
 /* called to display each frame */
 static void video_refresh(void *opaque, double *remaining_time)
 {
@@ -1862,15 +1911,15 @@ static void video_refresh(void *opaque, double *remaining_time)
     if (is->video_st)
     {
     retry:
-        printf("video refresh retry T%d\n", is->read_tid);
+        RLOG_HOT("video refresh retry T%d\n", is->read_tid);
         if (frame_queue_nb_remaining(&is->pictq) == 0)
         {
-            printf("video refresh frame_queue_nb_remaining==0 T%d\n", is->read_tid);
+            RLOG_HOT("video refresh frame_queue_nb_remaining==0 T%d\n", is->read_tid);
             // nothing to do, no picture to display in the queue
         }
         else
         {
-            printf("video refresh, frame_queue_nb_remaining >0 T%d\n", is->read_tid);
+            RLOG_HOT("video refresh, frame_queue_nb_remaining >0 T%d\n", is->read_tid);
             double last_duration, duration, delay;
             Frame *vp, *lastvp;
 
@@ -1898,7 +1947,7 @@ static void video_refresh(void *opaque, double *remaining_time)
             if (time < is->frame_timer + delay)
             {
                 *remaining_time = FFMIN(is->frame_timer + delay - time, *remaining_time);
-                printf("video_refresh: time< frame_timer+delay\n");
+                RLOG_HOT("video_refresh: time< frame_timer+delay\n");
                 goto display;
             }
 
@@ -1913,12 +1962,13 @@ static void video_refresh(void *opaque, double *remaining_time)
 
             if (frame_queue_nb_remaining(&is->pictq) > 1)
             {
-                printf("video_refresh frame_queue_nb_remaining() T%d\n", is->read_tid);
+                RLOG_HOT("video_refresh frame_queue_nb_remaining() T%d\n", is->read_tid);
                 Frame *nextvp = frame_queue_peek_next(&is->pictq);
                 duration = vp_duration(is, vp, nextvp);
                 if (!is->step && (framedrop > 0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->frame_timer + duration)
                 {
                     is->frame_drops_late++;
+                    telemetry_add(tm_drops, 1);
                     frame_queue_next(&is->pictq);
                     goto retry;
                 }
@@ -1963,7 +2013,7 @@ static void video_refresh(void *opaque, double *remaining_time)
                 }
             }
 
-            printf("video refresh, frame_queue_next T%d\n", is->read_tid);
+            RLOG_HOT("video refresh, frame_queue_next T%d\n", is->read_tid);
             frame_queue_next(&is->pictq);
             is->force_refresh = 1;
 
@@ -1972,16 +2022,20 @@ static void video_refresh(void *opaque, double *remaining_time)
         }
     display:
         /* display picture */
-        printf("video_refresh display: %d %d %d %d T%d\n",
+        RLOG_HOT("video_refresh display: %d %d %d %d T%d\n",
                display_disable,
                is->force_refresh,
                is->show_mode == SHOW_MODE_VIDEO,
                is->pictq.rindex_shown,
                is->read_tid);
         if (!display_disable && is->force_refresh && is->show_mode == SHOW_MODE_VIDEO && is->pictq.rindex_shown)
+        {
             video_display(is);
+            telemetry_add(tm_shown, 1);
+        }
     }
     is->force_refresh = 0;
+    telemetry_update(is);
     if (show_status)
     {
         AVBPrint buf;
@@ -2068,7 +2122,7 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double
 static int get_video_frame(VideoState *is, AVFrame *frame)
 {
     int got_picture;
-    printf("get_video_frame() start T%d\n", is->read_tid);
+    RLOG_HOT("get_video_frame() start T%d\n", is->read_tid);
     if ((got_picture = decoder_decode_frame(&is->viddec, frame, NULL)) < 0)
         return -1;
 
@@ -2076,6 +2130,8 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
     {
         double dpts = NAN;
 
+        telemetry_add(tm_decoded, 1);
+
         if (frame->pts != AV_NOPTS_VALUE)
             dpts = av_q2d(is->video_st->time_base) * frame->pts;
 
@@ -2092,6 +2148,7 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
                     is->videoq.nb_packets)
                 {
                     is->frame_drops_early++;
+                    telemetry_add(tm_drops, 1);
                     av_frame_unref(frame);
                     got_picture = 0;
                 }
@@ -2421,13 +2478,13 @@ static int audio_thread(void *arg)
 
     do
     {
-        printf("audio_thread attempt decoder_decode_frame()T%d\n", is->read_tid);
+        RLOG_HOT("audio_thread attempt decoder_decode_frame()T%d\n", is->read_tid);
         if ((got_frame = decoder_decode_frame(&is->auddec, frame, NULL)) < 0)
             goto the_end;
 
         if (got_frame)
         {
-            printf("audio_thread got_frame() T%d\n", is->read_tid);
+            RLOG_HOT("audio_thread got_frame() T%d\n", is->read_tid);
             tb = (AVRational){1, frame->sample_rate};
 
             reconfigure =
@@ -2463,7 +2520,7 @@ static int audio_thread(void *arg)
             }
 
             ret = av_buffersrc_add_frame(is->in_audio_filter, frame);
-            printf("audio_thread av_buffersrc_add_frame %d()\n", ret);
+            RLOG_HOT("audio_thread av_buffersrc_add_frame %d()\n", ret);
             if (ret < 0)
                 goto the_end;
 
@@ -2485,7 +2542,7 @@ static int audio_thread(void *arg)
                 if (is->audioq.serial != is->auddec.pkt_serial)
                     break;
             }
-            printf("audio_thread endwhile (ret == AVERROR_EOF) %d()\n", (ret == AVERROR_EOF));
+            RLOG_HOT("audio_thread endwhile (ret == AVERROR_EOF) %d()\n", (ret == AVERROR_EOF));
             if (ret == AVERROR_EOF)
                 is->auddec.finished = is->auddec.pkt_serial;
         }
@@ -2539,7 +2596,7 @@ static int video_thread(void *arg)
     for (;;)
     {
         ret = get_video_frame(is, frame);
-        printf("video_thread() get_video_frame %d \n", ret);
+        RLOG_HOT("video_thread() get_video_frame %d \n", ret);
         if (ret < 0)
             goto the_end;
         if (!ret)
@@ -2587,7 +2644,7 @@ static int video_thread(void *arg)
         }
 
         ret = av_buffersrc_add_frame(filt_in, frame);
-        printf("video_thread() av_buffersrc_add_frame %d \n", ret);
+        RLOG_HOT("video_thread() av_buffersrc_add_frame %d \n", ret);
         if (ret < 0)
             goto the_end;
 
@@ -2753,7 +2810,7 @@ static int audio_decode_frame(VideoState *is)
     int wanted_nb_samples;
     Frame *af;
 
-    printf("audio_decode_frame start T%d\n", is->read_tid);
+    RLOG_HOT("audio_decode_frame start T%d\n", is->read_tid);
     if (is->paused)
         return -1;
 
@@ -2874,7 +2931,7 @@ static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
     VideoState *is = opaque;
     int audio_size, len1;
 
-    printf("sdl_audio_callback start T%d\n", is->read_tid);
+    RLOG_HOT("sdl_audio_callback start T%d\n", is->read_tid);
     audio_callback_time = av_gettime_relative();
 
     while (len > 0)
@@ -2912,6 +2969,8 @@ static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
         is->audio_buf_index += len1;
     }
     is->audio_write_buf_size = is->audio_buf_size - is->audio_buf_index;
+    /* decoded audio not played yet, what a stall has to drain */
+    telemetry_set(tm_audio_ms, (int)((2LL * is->audio_hw_buf_size + is->audio_write_buf_size) * 1000 / is->audio_tgt.bytes_per_sec));
     /* Let's assume the audio driver that is used by SDL has two periods. */
     if (!isnan(is->audio_clock))
     {
@@ -3574,7 +3633,7 @@ static int read_thread(void *arg)
                                                                                          stream_has_enough_packets(is->video_st, is->video_stream, &is->videoq) &&
                                                                                          stream_has_enough_packets(is->subtitle_st, is->subtitle_stream, &is->subtitleq))))
         {
-            printf("read_thread if no infinite_buffer T%d\n", is->read_tid);
+            RLOG_HOT("read_thread if no infinite_buffer T%d\n", is->read_tid);
             /* wait 10 ms */
             SDL_LockMutex(wait_mutex);
             SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
@@ -3599,7 +3658,7 @@ static int read_thread(void *arg)
         ret = av_read_frame(ic, pkt);
         if (ret < 0)
         {
-            printf("read_thread av_read_frame <0 T%d\n", is->read_tid);
+            RLOG_HOT("read_thread av_read_frame <0 T%d\n", is->read_tid);
             if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && !is->eof)
             {
                 if (is->video_stream >= 0)
@@ -3621,7 +3680,7 @@ static int read_thread(void *arg)
                 else
                     break;
             }
-            printf("SDL_LockMutex, SDL_CondWaitTimeout SDL_UnlockMutex continue T%d\n", is->read_tid);
+            RLOG_HOT("SDL_LockMutex, SDL_CondWaitTimeout SDL_UnlockMutex continue T%d\n", is->read_tid);
             SDL_LockMutex(wait_mutex);
             SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
             SDL_UnlockMutex(wait_mutex);
@@ -3631,8 +3690,7 @@ static int read_thread(void *arg)
         {
             is->eof = 0;
         }
-        char strbuffer[1024];
-        snprintf(strbuffer, 1024, "read_thread av_read_frame >=0 ");
+        const char *what;
         /* check if packet is in play range specified by user, then queue, otherwise discard */
         stream_start_time = ic->streams[pkt->stream_index]->start_time;
         pkt_ts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
@@ -3643,25 +3701,25 @@ static int read_thread(void *arg)
                                 ((double)duration / 1000000);
         if (pkt->stream_index == is->audio_stream && pkt_in_play_range)
         {
-            strncat(strbuffer, "put audio ", 12);
+            what = "put audio";
             packet_queue_put(&is->audioq, pkt);
         }
         else if (pkt->stream_index == is->video_stream && pkt_in_play_range && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC))
         {
             packet_queue_put(&is->videoq, pkt);
-            strncat(strbuffer, "put video ", 12);
+            what = "put video";
         }
         else if (pkt->stream_index == is->subtitle_stream && pkt_in_play_range)
         {
             packet_queue_put(&is->subtitleq, pkt);
-            strncat(strbuffer, "put subs ", 12);
+            what = "put subs";
         }
         else
         {
             av_packet_unref(pkt);
-            strncat(strbuffer, "unref ", 12);
+            what = "unref";
         }
-        printf("%s T%d\n", strbuffer, is->read_tid);
+        RLOG_HOT("read_thread av_read_frame >=0 %s T%d\n", what, is->read_tid);
         // printf("read thread OSYieldThread\n");
         // OSYieldThread();
     }
@@ -4548,6 +4606,8 @@ int main(int argc, char **argv)
         printf("custom create window/renderer , do first SDL_SetRenderDrawColor.. SDL_RenderPresent\n");
     }
 
+    telemetry_register();
+    telemetry_start(TELEMETRY_HZ);
     is = stream_open(input_filename, file_iformat);
     if (!is)
     {
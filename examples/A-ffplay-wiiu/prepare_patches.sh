@@ -83,6 +83,10 @@ echo "= copy over custom configure_xxx_ffplay"
 cp configure_*_ffplay $FFMPEG_SRC
 cp Makefile.*.mk $FFMPEG_SRC
 
+echo "= copy the trace log, rate limited logging and telemetry (TRACE, RLOG, telemetry_add in ffplay.c) next to ffplay.c"
+cp ../rsyslog/trace.[ch] ../rsyslog/rsyslogq.[ch] ../rsyslog/ratelog.[ch] \
+   ../rsyslog/telemetry.[ch] ../rsyslog/lzlog.[ch] $FFMPEG_SRC/fftools
+
 
 echo '= generating copy of ffplay.c as ffplay_cli.c'
 echo 'copy ffplay.c to ffplay_cli.c'
@@ -12,10 +12,12 @@
 #ifdef DEBUG
 #include "rsyslog-wiiu.h"
 #include "rsyslog.h"
+#include "trace.h"
 #endif  // DEBUG
 
 #endif
 #include <stdio.h>
+#include <stdlib.h>
 #include <whb/log.h>
 #include <whb/log_console.h>
 #include <whb/proc.h>
@@ -32,6 +34,10 @@ int main(int argc, char **argv) {
     // code will block util syslog service Docker is up
     if (init_rsyslogger() != 0) {
         // setup udp or cafe logging
+    } else if (trace_open_syslog() == 0) {
+        // TRACE() lines go out as TRC1 packets, read them with
+        // rsyslog/tools/trace_decode.  Flushed ahead of the shipper at exit.
+        atexit(trace_close);
     }
 #endif  // DEBUG
 #endif  // __WIIU__
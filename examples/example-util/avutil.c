@@ -1,6 +1,6 @@
 #include <libavcodec/avcodec.h>
-#include <whb/log.h>
-#include <whb/log_console.h>
+
+#include "whbcompat.h"
 
 /* list available codecs compiled into ffmpeg */
 int av_print_codecs() {
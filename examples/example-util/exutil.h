@@ -4,19 +4,43 @@
 #include <stdint.h>
 
 /* file */
+int util_get_media_dir(char *buffer, int size);
 int util_get_first_media_file(char *buffer, int size);
+int util_walk_media_files(const char *dir,
+                          int (*cb)(const char *path, void *opaque),
+                          void *opaque);
 int64_t util_get_file_size(char *filename);
 
+/* memory */
+int64_t util_heap_in_use();
+
 /* ffmpeg av */
 int av_print_codecs();
 
+struct StageTimer;
+struct FrameLatency;
+
 struct TestResults {
-    int32_t st_size;
+    int64_t st_size;
     int test_type; /* 0 file, 1 decode */
     uint64_t ops;  /* freads vs packet decodes */
     uint64_t data_read;
     uint64_t start_time;
     uint64_t end_time;
+    struct StageTimer *stages; /* optional per-stage timings, NULL = off */
+    int nb_stages;
+    const char *codec; /* filled in by av_decode_test */
+    int width;
+    int height;
+    int thread_count;        /* as reported by the opened decoder */
+    int active_thread_type;  /* 0 if ffmpeg was built without threads */
+    uint64_t first_frame_ns; /* first send_packet to first frame out */
+    int decode_delay;        /* packets in before the first frame out */
+    int64_t heap_bytes;      /* heap growth from opening the decoder, or -1 */
+    uint64_t io_stalls;      /* read-ahead only: demuxer reads that waited */
+    uint64_t io_stall_ns;
+    uint64_t io_file_ns;     /* read-ahead only: reader time in read() */
+    struct FrameLatency *frame_latency; /* optional, NULL = off */
 };
 
 #endif  // EXUTIL_H
@@ -5,31 +5,43 @@
 
 #include "exutil.h"
 
-/*  Check in sd:/media for the first non-directory and fill the buffer
-    with the fully qualified path + filename.
+/*  Find the /media folder on the WIIU SD mount, then the CEMU SD mount
+    and copy its path into buffer.
     return 0 on success, <0 for errors
 */
-int util_get_first_media_file(char *buffer, int size) {
-    /* try to find /media in the WIIU SD mount, then the CEMU SD mount */
+int util_get_media_dir(char *buffer, int size) {
     char *sdmounts[] = {
         "/vol/external01/media",
         "/vol/storage_mlc01/media",
     };
-    int sd_idx = (access(sdmounts[0], F_OK) == 0)   ? 0
-                 : (access(sdmounts[1], F_OK) == 0) ? 1
-                                                    : -1;
-    if (sd_idx < 0) {
+    for (int i = 0; i < 2; i++) {
+        if (access(sdmounts[i], F_OK) == 0) {
+            snprintf(buffer, size, "%s", sdmounts[i]);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*  Check in sd:/media for the first non-directory and fill the buffer
+    with the fully qualified path + filename.
+    return 0 on success, <0 for errors
+*/
+int util_get_first_media_file(char *buffer, int size) {
+    char media_dir[256];
+    if (util_get_media_dir(media_dir, sizeof(media_dir)) < 0) {
         return -1;
     }
 
     DIR *dp = NULL;
     struct dirent *ep = NULL;
 
-    dp = opendir(sdmounts[sd_idx]);
+    dp = opendir(media_dir);
     if (dp != NULL) {
-        while (ep = readdir(dp)) {
+        while ((ep = readdir(dp))) {
             if (ep->d_type == DT_REG) {
-                snprintf(buffer, size, "%s/%s", sdmounts[sd_idx], ep->d_name);
+                snprintf(buffer, size, "%s/%s", media_dir, ep->d_name);
+                closedir(dp);
                 return 0;
             }
         }
@@ -38,6 +50,49 @@ int util_get_first_media_file(char *buffer, int size) {
     return -2;
 }
 
+/*  Call cb(path, opaque) for every regular file under dir, descending into
+    sub directories.  Hidden files (".foo", ex. our own sidecars and macOS
+    "._" droppings) are skipped.  A non zero return from cb stops the walk.
+    return the number of files visited, <0 if dir can't be opened
+*/
+int util_walk_media_files(const char *dir,
+                          int (*cb)(const char *path, void *opaque),
+                          void *opaque) {
+    DIR *dp = opendir(dir);
+    struct dirent *ep = NULL;
+    char path[1024];
+    struct stat f_stat;
+    int count = 0;
+
+    if (dp == NULL) {
+        return -1;
+    }
+    while ((ep = readdir(dp)) != NULL) {
+        if (ep->d_name[0] == '.') {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", dir, ep->d_name) >=
+            (int)sizeof(path)) {
+            continue;
+        }
+        /* d_type is DT_UNKNOWN on some host filesystems, stat to be sure */
+        if (stat(path, &f_stat) < 0) {
+            continue;
+        }
+        if (S_ISDIR(f_stat.st_mode)) {
+            int sub = util_walk_media_files(path, cb, opaque);
+            if (sub > 0) count += sub;
+        } else if (S_ISREG(f_stat.st_mode)) {
+            count++;
+            if (cb(path, opaque) != 0) {
+                break;
+            }
+        }
+    }
+    closedir(dp);
+    return count;
+}
+
 int64_t util_get_file_size(char *filename) {
     struct stat f_stat;
     if (stat(filename, &f_stat) < 0) {
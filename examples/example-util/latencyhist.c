@@ -0,0 +1,68 @@
+#include "latencyhist.h"
+
+#include <string.h>
+
+#define SUB_COUNT (1 << LATENCY_HIST_SUB_BITS)
+
+static int bucket_index(uint64_t v) {
+    if (v < SUB_COUNT) {
+        return (int)v;
+    }
+    int k = 63 - __builtin_clzll(v); /* highest set bit, >= SUB_BITS */
+    int sub = (int)(v >> (k - LATENCY_HIST_SUB_BITS)) & (SUB_COUNT - 1);
+    return ((k - LATENCY_HIST_SUB_BITS + 1) << LATENCY_HIST_SUB_BITS) + sub;
+}
+
+/* largest value that lands in bucket i */
+static uint64_t bucket_top(int i) {
+    if (i < SUB_COUNT) {
+        return i;
+    }
+    int k = (i >> LATENCY_HIST_SUB_BITS) + LATENCY_HIST_SUB_BITS - 1;
+    int shift = k - LATENCY_HIST_SUB_BITS;
+    uint64_t low = (uint64_t)(SUB_COUNT + (i & (SUB_COUNT - 1))) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+void latency_hist_reset(struct LatencyHist *h) { memset(h, 0, sizeof(*h)); }
+
+void latency_hist_add(struct LatencyHist *h, uint64_t ns) {
+    h->counts[bucket_index(ns)]++;
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+void latency_hist_merge(struct LatencyHist *dst,
+                        const struct LatencyHist *src) {
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->count += src->count;
+    dst->total_ns += src->total_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+}
+
+uint64_t latency_hist_percentile(const struct LatencyHist *h, double pct) {
+    if (h->count == 0) {
+        return 0;
+    }
+    /* nearest rank, like stage_timer_percentile */
+    uint64_t rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->count) rank = h->count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t top = bucket_top(i);
+            return top < h->max_ns ? top : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+double latency_hist_mean_ns(const struct LatencyHist *h) {
+    return h->count ? (double)h->total_ns / h->count : 0.0;
+}
@@ -0,0 +1,32 @@
+#ifndef LATENCYHIST_H
+#define LATENCYHIST_H
+
+#include <stdint.h>
+
+/* HDR-style log-linear latency histogram.  Every power of two range is
+   split into 2^LATENCY_HIST_SUB_BITS equal buckets, so any recorded value
+   is known to within 1 / 2^LATENCY_HIST_SUB_BITS (6%) of itself, from 1ns
+   up to the full uint64_t range, in a fixed ~4KB of counters.  Unlike the
+   StageTimer reservoir nothing is sampled away, the p99.9 of a 100k frame
+   run is exact to the bucket. */
+
+#define LATENCY_HIST_SUB_BITS 4
+#define LATENCY_HIST_BUCKETS \
+    ((64 - LATENCY_HIST_SUB_BITS + 1) << LATENCY_HIST_SUB_BITS)
+
+struct LatencyHist {
+    uint32_t counts[LATENCY_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+void latency_hist_reset(struct LatencyHist *h);
+void latency_hist_add(struct LatencyHist *h, uint64_t ns);
+void latency_hist_merge(struct LatencyHist *dst, const struct LatencyHist *src);
+
+/* pct in [0, 100], returns the top of the bucket holding that rank */
+uint64_t latency_hist_percentile(const struct LatencyHist *h, double pct);
+double latency_hist_mean_ns(const struct LatencyHist *h);
+
+#endif  // LATENCYHIST_H
@@ -0,0 +1,362 @@
+#include "medialib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "exutil.h"
+#include "mp4info.h"
+#include "stagetimer.h"
+#include "streamcache.h"
+
+#define MEDIA_LIB_VERSION 2 /* 2: no container without a known codec */
+
+struct MediaLibrary {
+    char root[256];
+    struct MediaEntry *entries; /* sorted by path */
+    int count;
+};
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const struct MediaEntry *)a)->path,
+                  ((const struct MediaEntry *)b)->path);
+}
+
+static void index_path(const struct MediaLibrary *lib, char *out,
+                       size_t out_sz) {
+    snprintf(out, out_sz, "%s/%s", lib->root, MEDIA_LIB_INDEX);
+}
+
+/* "-" stands in for empty names so the fields stay sscanf friendly */
+static const char *field_out(const char *s) { return s[0] ? s : "-"; }
+
+static void field_in(char *s) {
+    if (strcmp(s, "-") == 0) s[0] = '\0';
+}
+
+/*  One line per file, the path relative to root goes last so it can have
+    spaces in it:
+    size mtime duration_ms width height container video audio path
+*/
+static int load_index(struct MediaLibrary *lib) {
+    char path[300];
+    char line[1024];
+    int capacity = 0;
+    int version = 0;
+
+    index_path(lib, path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fgets(line, sizeof(line), fp) == NULL ||
+        sscanf(line, "medialib %d", &version) != 1 ||
+        version != MEDIA_LIB_VERSION) {
+        fclose(fp);
+        return 0; /* unknown format, rebuild it */
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        struct MediaEntry e;
+        long long size, mtime, duration_ms;
+        int name_at = 0;
+
+        memset(&e, 0, sizeof(e));
+        line[strcspn(line, "\r\n")] = '\0';
+        if (sscanf(line, "%lld\t%lld\t%lld\t%d\t%d\t%31s\t%31s\t%31s\t%n",
+                   &size, &mtime, &duration_ms, &e.width, &e.height,
+                   e.container, e.video_codec, e.audio_codec,
+                   &name_at) != 8 ||
+            name_at == 0 || line[name_at] == '\0') {
+            continue;
+        }
+        if (snprintf(e.path, sizeof(e.path), "%s/%s", lib->root,
+                     line + name_at) >= (int)sizeof(e.path)) {
+            continue;
+        }
+        e.size = size;
+        e.mtime = mtime;
+        e.duration_ms = duration_ms;
+        field_in(e.container);
+        field_in(e.video_codec);
+        field_in(e.audio_codec);
+
+        if (lib->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct MediaEntry *entries =
+                realloc(lib->entries, capacity * sizeof(*entries));
+            if (entries == NULL) {
+                break;
+            }
+            lib->entries = entries;
+        }
+        lib->entries[lib->count++] = e;
+    }
+    fclose(fp);
+    qsort(lib->entries, lib->count, sizeof(*lib->entries), compare_entries);
+    return 0;
+}
+
+static int save_index(const struct MediaLibrary *lib) {
+    char path[300], tmp[310];
+    size_t root_len = strlen(lib->root);
+
+    index_path(lib, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        return -1; /* read only card, we'll just probe again next time */
+    }
+    fprintf(fp, "medialib %d\n", MEDIA_LIB_VERSION);
+    for (int i = 0; i < lib->count; i++) {
+        const struct MediaEntry *e = &lib->entries[i];
+        fprintf(fp, "%lld\t%lld\t%lld\t%d\t%d\t%s\t%s\t%s\t%s\n",
+                (long long)e->size, (long long)e->mtime,
+                (long long)e->duration_ms, e->width, e->height,
+                field_out(e->container), field_out(e->video_codec),
+                field_out(e->audio_codec), e->path + root_len + 1);
+    }
+    int ok = !ferror(fp);
+    ok = fclose(fp) == 0 && ok;
+    remove(path); /* FAT rename won't replace */
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* mp4 / mov straight from the moov box, no demuxer.  0 if it worked */
+static int probe_mp4(const char *path, struct MediaEntry *e) {
+    struct Mp4Info info;
+
+    if (mp4_info_read(path, &info) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < info.nb_tracks; i++) {
+        const struct Mp4Track *t = &info.tracks[i];
+        if (t->codec_id == AV_CODEC_ID_NONE) {
+            continue; /* a sample entry we don't know */
+        }
+        if (t->type == AVMEDIA_TYPE_VIDEO && !e->video_codec[0]) {
+            snprintf(e->video_codec, sizeof(e->video_codec), "%s",
+                     avcodec_get_name(t->codec_id));
+            e->width = t->width;
+            e->height = t->height;
+        } else if (t->type == AVMEDIA_TYPE_AUDIO && !e->audio_codec[0]) {
+            snprintf(e->audio_codec, sizeof(e->audio_codec), "%s",
+                     avcodec_get_name(t->codec_id));
+        }
+    }
+    /* no codec we know, let ffmpeg decide if it's playable */
+    if (!e->video_codec[0] && !e->audio_codec[0]) {
+        return -1;
+    }
+    /* same name libavformat reports for the mov demuxer */
+    snprintf(e->container, sizeof(e->container), "mov,mp4,m4a,3gp,3g2,mj2");
+    e->duration_ms = info.duration_ms;
+    return 0;
+}
+
+/* Fill in everything past size / mtime, container stays "" when ffmpeg
+   can't open the file or has no decoder for any of its streams */
+static void probe_file(const char *path, struct MediaEntry *e) {
+    AVFormatContext *fmt_ctx = NULL;
+
+    e->duration_ms = -1;
+    if (probe_mp4(path, e) == 0) {
+        return;
+    }
+    if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0) {
+        return;
+    }
+    if (stream_cache_find_stream_info(fmt_ctx, path, NULL) >= 0) {
+        for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+            AVStream *st = fmt_ctx->streams[i];
+            AVCodecParameters *par = st->codecpar;
+            if (par->codec_id == AV_CODEC_ID_NONE) {
+                continue;
+            }
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+                !e->video_codec[0] &&
+                !(st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+                snprintf(e->video_codec, sizeof(e->video_codec), "%s",
+                         avcodec_get_name(par->codec_id));
+                e->width = par->width;
+                e->height = par->height;
+            } else if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+                       !e->audio_codec[0]) {
+                snprintf(e->audio_codec, sizeof(e->audio_codec), "%s",
+                         avcodec_get_name(par->codec_id));
+            }
+        }
+        if (e->video_codec[0] || e->audio_codec[0]) {
+            snprintf(e->container, sizeof(e->container), "%s",
+                     fmt_ctx->iformat->name);
+        }
+        if (fmt_ctx->duration != AV_NOPTS_VALUE) {
+            e->duration_ms = fmt_ctx->duration / (AV_TIME_BASE / 1000);
+        }
+    }
+    avformat_close_input(&fmt_ctx);
+}
+
+int media_lib_open(struct MediaLibrary **lib, const char *root) {
+    *lib = calloc(1, sizeof(**lib));
+    if (*lib == NULL) {
+        return -1;
+    }
+    snprintf((*lib)->root, sizeof((*lib)->root), "%s", root);
+    size_t len = strlen((*lib)->root);
+    while (len > 1 && (*lib)->root[len - 1] == '/') {
+        (*lib)->root[--len] = '\0';
+    }
+    return load_index(*lib);
+}
+
+struct UpdateWalk {
+    const struct MediaLibrary *lib;
+    struct MediaEntry *entries;
+    int count;
+    int capacity;
+    int matched; /* walked files that were already in the index */
+    struct MediaLibStats *stats;
+};
+
+static int update_file(const char *path, void *opaque) {
+    struct UpdateWalk *w = opaque;
+    struct stat f_stat;
+
+    if (stat(path, &f_stat) < 0 || strlen(path) >= sizeof(w->entries->path)) {
+        return 0;
+    }
+    if (w->count == w->capacity) {
+        int capacity = w->capacity ? w->capacity * 2 : 64;
+        struct MediaEntry *entries =
+            realloc(w->entries, capacity * sizeof(*entries));
+        if (entries == NULL) {
+            return 1; /* stop, keep what we have */
+        }
+        w->entries = entries;
+        w->capacity = capacity;
+    }
+
+    struct MediaEntry *e = &w->entries[w->count++];
+    const struct MediaEntry *old = media_lib_find(w->lib, path);
+    if (old != NULL) {
+        w->matched++;
+        if (old->size == f_stat.st_size && old->mtime == f_stat.st_mtime) {
+            *e = *old;
+            return 0;
+        }
+    }
+    memset(e, 0, sizeof(*e));
+    snprintf(e->path, sizeof(e->path), "%s", path);
+    e->size = f_stat.st_size;
+    e->mtime = f_stat.st_mtime;
+    probe_file(path, e);
+    w->stats->probed++;
+    if (!e->container[0]) {
+        w->stats->failed++;
+    }
+    return 0;
+}
+
+int media_lib_update(struct MediaLibrary *lib, struct MediaLibStats *stats) {
+    struct MediaLibStats local;
+    struct UpdateWalk w;
+    uint64_t t0 = util_clock_ns();
+
+    if (stats == NULL) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(*stats));
+    memset(&w, 0, sizeof(w));
+    w.lib = lib;
+    w.stats = stats;
+    if (util_walk_media_files(lib->root, update_file, &w) < 0) {
+        free(w.entries);
+        return -1;
+    }
+
+    stats->removed = lib->count - w.matched;
+    stats->files = w.count;
+    free(lib->entries);
+    lib->entries = w.entries;
+    lib->count = w.count;
+    qsort(lib->entries, lib->count, sizeof(*lib->entries), compare_entries);
+    if (stats->probed > 0 || stats->removed > 0) {
+        save_index(lib);
+    }
+    stats->ns = util_clock_ns() - t0;
+    return 0;
+}
+
+void media_lib_close(struct MediaLibrary **lib) {
+    if (*lib == NULL) {
+        return;
+    }
+    free((*lib)->entries);
+    free(*lib);
+    *lib = NULL;
+}
+
+int media_lib_count(const struct MediaLibrary *lib) { return lib->count; }
+
+const struct MediaEntry *media_lib_entry(const struct MediaLibrary *lib,
+                                         int i) {
+    return i >= 0 && i < lib->count ? &lib->entries[i] : NULL;
+}
+
+const struct MediaEntry *media_lib_find(const struct MediaLibrary *lib,
+                                        const char *path) {
+    struct MediaEntry key;
+
+    if (lib->count == 0 ||
+        snprintf(key.path, sizeof(key.path), "%s", path) >=
+            (int)sizeof(key.path)) {
+        return NULL;
+    }
+    return bsearch(&key, lib->entries, lib->count, sizeof(*lib->entries),
+                   compare_entries);
+}
+
+static int in_dir(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/') len--;
+    return strncmp(path, dir, len) == 0 && path[len] == '/' &&
+           strchr(path + len + 1, '/') == NULL;
+}
+
+static int matches(const struct MediaEntry *e, const struct MediaQuery *q) {
+    unsigned flags = (e->container[0] ? MEDIA_PLAYABLE : 0) |
+                     (e->video_codec[0] ? MEDIA_HAS_VIDEO : 0) |
+                     (e->audio_codec[0] ? MEDIA_HAS_AUDIO : 0);
+
+    if ((flags & q->flags) != q->flags) return 0;
+    if (q->dir && !in_dir(e->path, q->dir)) return 0;
+    if (q->codec && strcmp(q->codec, e->video_codec) != 0 &&
+        strcmp(q->codec, e->audio_codec) != 0) {
+        return 0;
+    }
+    if (q->max_height > 0 && e->height > q->max_height) return 0;
+    return 1;
+}
+
+int media_lib_query(const struct MediaLibrary *lib, const struct MediaQuery *q,
+                    const struct MediaEntry **out, int max) {
+    int found = 0;
+    for (int i = 0; i < lib->count; i++) {
+        if (q != NULL && !matches(&lib->entries[i], q)) {
+            continue;
+        }
+        if (found < max) {
+            out[found] = &lib->entries[i];
+        }
+        found++;
+    }
+    return found;
+}
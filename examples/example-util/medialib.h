@@ -0,0 +1,84 @@
+#ifndef MEDIALIB_H
+#define MEDIALIB_H
+
+#include <stdint.h>
+
+/* Media library index.  Instead of every example doing readdir on
+   sd:/media and probing whatever it finds, keep one index of everything
+   under the media dir in a hidden file,
+
+     sd:/media/.medialib.idx
+
+   with size, mtime, container, codecs, resolution and duration per file.
+   media_lib_update() walks the dir but only stat()s files, and only
+   re-probes the ones that are new or whose size / mtime changed.  Files
+   ffmpeg can't open, or with no codec it knows, stay in the index too
+   (container ""), so they aren't probed again on every start.
+
+   struct MediaLibrary *lib = NULL;
+   media_lib_open(&lib, media_dir);     // loads the index, no probing
+   media_lib_update(lib, &stats);       // incremental rescan + save
+   n = media_lib_query(lib, &query, found, 32);
+   media_lib_close(&lib);
+*/
+
+#define MEDIA_LIB_INDEX ".medialib.idx"
+
+struct MediaEntry {
+    char path[512]; /* full path, root + the path in the index */
+    int64_t size;
+    int64_t mtime;
+    char container[32]; /* iformat name, "" = ffmpeg can't open it */
+    char video_codec[32]; /* "" = no video stream */
+    char audio_codec[32]; /* "" = no audio stream */
+    int width;
+    int height;
+    int64_t duration_ms; /* -1 = unknown */
+};
+
+struct MediaLibStats {
+    int files;   /* files in the index after the update */
+    int probed;  /* new or changed files we had to open */
+    int failed;  /* of those, ones ffmpeg couldn't open */
+    int removed; /* index entries whose file is gone */
+    uint64_t ns; /* time spent in media_lib_update */
+};
+
+#define MEDIA_HAS_VIDEO 1
+#define MEDIA_HAS_AUDIO 2
+#define MEDIA_PLAYABLE 4 /* ffmpeg could open it */
+
+struct MediaQuery {
+    unsigned flags;    /* MEDIA_* bits that must all be set, 0 = any */
+    const char *dir;   /* only files directly in dir, NULL = anywhere */
+    const char *codec; /* video or audio codec name, NULL = any */
+    int max_height;    /* 0 = any, ex. 720 to skip what we can't decode */
+};
+
+struct MediaLibrary;
+
+/* Load root/.medialib.idx if there is one.  A missing or stale index is not
+   an error, the library is just empty until media_lib_update.
+   return 0 on success, <0 for errors */
+int media_lib_open(struct MediaLibrary **lib, const char *root);
+
+/* Rescan root, probing only new / changed files, and save the index if
+   anything changed.  stats may be NULL.
+   return 0 on success, <0 if root can't be read */
+int media_lib_update(struct MediaLibrary *lib, struct MediaLibStats *stats);
+
+void media_lib_close(struct MediaLibrary **lib);
+
+/* Entries are sorted by path */
+int media_lib_count(const struct MediaLibrary *lib);
+const struct MediaEntry *media_lib_entry(const struct MediaLibrary *lib,
+                                         int i);
+const struct MediaEntry *media_lib_find(const struct MediaLibrary *lib,
+                                        const char *path);
+
+/* Fill out[] with up to max entries matching q (NULL = everything), in path
+   order.  return the number of matches, which can be more than max */
+int media_lib_query(const struct MediaLibrary *lib, const struct MediaQuery *q,
+                    const struct MediaEntry **out, int max);
+
+#endif  // MEDIALIB_H
@@ -0,0 +1,29 @@
+#include <stdint.h>
+
+#ifdef __WIIU__
+#include <coreinit/memexpheap.h>
+#include <coreinit/memheap.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "exutil.h"
+
+/*  Bytes of heap currently in use, or -1 where we have no way to tell.
+    Compare two readings to see what something allocated, ex. a decoder.
+    WiiU: size - free space of the MEM2 expanded heap that malloc draws from.
+    Host: glibc mallinfo2().
+*/
+int64_t util_heap_in_use() {
+#ifdef __WIIU__
+    MEMHeapHandle heap = MEMGetBaseHeapHandle(MEM_BASE_HEAP_MEM2);
+    MEMHeapHeader *header = (MEMHeapHeader *)heap;
+    int64_t size = (uint8_t *)header->dataEnd - (uint8_t *)header->dataStart;
+    return size - (int64_t)MEMGetTotalFreeSizeForExpHeap(heap);
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    return (int64_t)(mi.uordblks + mi.hblkhd);
+#else
+    return -1;
+#endif
+}
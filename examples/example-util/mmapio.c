@@ -0,0 +1,174 @@
+#include "mmapio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __WIIU__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MMAPIO_AVIO_BUFFER (32 * 1024)
+
+struct MmapIO {
+    const uint8_t *base;
+    int64_t size;
+    int64_t pos;
+    AVIOContext *avio;
+};
+
+#ifdef __WIIU__
+
+struct MmapIO *mmap_io_open(const char *path) {
+    (void)path;
+    return NULL;
+}
+
+#else
+
+static int mmap_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+    struct MmapIO *mio = opaque;
+    int64_t left = mio->size - mio->pos;
+    int n = left < buf_size ? (int)left : buf_size;
+
+    if (n <= 0) {
+        return AVERROR_EOF;
+    }
+    memcpy(buf, mio->base + mio->pos, n);
+    mio->pos += n;
+    return n;
+}
+
+static int64_t mmap_seek(void *opaque, int64_t offset, int whence) {
+    struct MmapIO *mio = opaque;
+    int64_t target;
+
+    if (whence & AVSEEK_SIZE) {
+        return mio->size;
+    }
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = mio->pos + offset;
+            break;
+        case SEEK_END:
+            target = mio->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+    /* past the end is allowed, the next read returns EOF */
+    mio->pos = target;
+    return target;
+}
+
+struct MmapIO *mmap_io_open(const char *path) {
+    struct MmapIO *mio;
+    struct stat f_stat;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "mmapio: cannot open %s\n", path);
+        return NULL;
+    }
+    if (fstat(fd, &f_stat) < 0 || f_stat.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, f_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* the mapping keeps the file referenced */
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "mmapio: cannot map %s\n", path);
+        return NULL;
+    }
+    /* demuxing is mostly one pass front to back, let the kernel read ahead
+       aggressively and start on it now */
+    madvise(base, f_stat.st_size, MADV_SEQUENTIAL);
+    madvise(base, f_stat.st_size, MADV_WILLNEED);
+
+    mio = calloc(1, sizeof(*mio));
+    if (mio == NULL) {
+        munmap(base, f_stat.st_size);
+        return NULL;
+    }
+    mio->base = base;
+    mio->size = f_stat.st_size;
+
+    uint8_t *avio_buffer = av_malloc(MMAPIO_AVIO_BUFFER);
+    if (avio_buffer == NULL) {
+        mmap_io_close(&mio);
+        return NULL;
+    }
+    mio->avio = avio_alloc_context(avio_buffer, MMAPIO_AVIO_BUFFER, 0, mio,
+                                   mmap_read_packet, NULL, mmap_seek);
+    if (mio->avio == NULL) {
+        av_free(avio_buffer);
+        mmap_io_close(&mio);
+        return NULL;
+    }
+    /* seeks are free, skip the avio buffer for big reads */
+    mio->avio->direct = 1;
+    return mio;
+}
+
+#endif  // __WIIU__
+
+AVIOContext *mmap_io_avio(struct MmapIO *mio) { return mio->avio; }
+
+const uint8_t *mmap_io_data(struct MmapIO *mio, int64_t *size) {
+    *size = mio->size;
+    return mio->base;
+}
+
+void mmap_io_close(struct MmapIO **pmio) {
+    struct MmapIO *mio = *pmio;
+    if (mio == NULL) {
+        return;
+    }
+    if (mio->avio) {
+        av_freep(&mio->avio->buffer);
+        avio_context_free(&mio->avio);
+    }
+#ifndef __WIIU__
+    if (mio->base) {
+        munmap((void *)mio->base, mio->size);
+    }
+#endif
+    free(mio);
+    *pmio = NULL;
+}
+
+int mmap_open_input(AVFormatContext **fmt_ctx, struct MmapIO **mio,
+                    const char *path, AVDictionary **options) {
+    int ret;
+
+    *fmt_ctx = NULL;
+    *mio = mmap_io_open(path);
+    if (*mio == NULL) {
+        return AVERROR(EIO);
+    }
+    *fmt_ctx = avformat_alloc_context();
+    if (*fmt_ctx == NULL) {
+        mmap_io_close(mio);
+        return AVERROR(ENOMEM);
+    }
+    (*fmt_ctx)->pb = mmap_io_avio(*mio);
+    (*fmt_ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    /* on failure avformat_open_input frees the context, but not our pb */
+    if ((ret = avformat_open_input(fmt_ctx, path, NULL, options)) < 0) {
+        mmap_io_close(mio);
+        return ret;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef MMAPIO_H
+#define MMAPIO_H
+
+#include <libavformat/avformat.h>
+#include <stdint.h>
+
+/* An AVIOContext reading straight out of a memory mapped file, host builds
+   only (no mmap on the WiiU, mmap_io_open returns NULL there).  read and
+   seek are a memcpy and a pointer move, no read() syscalls and no stdio or
+   file: protocol buffer in between.  The context is opened "direct", so
+   large avio_read()s (packet payloads) are copied from the mapping into the
+   packet in one go.
+
+   AVFormatContext *fmt_ctx = NULL;
+   struct MmapIO *mio = NULL;
+   mmap_open_input(&fmt_ctx, &mio, path, NULL);
+   ...
+   avformat_close_input(&fmt_ctx);
+   mmap_io_close(&mio);        // after the format context is closed
+*/
+
+struct MmapIO;
+
+struct MmapIO *mmap_io_open(const char *path);
+AVIOContext *mmap_io_avio(struct MmapIO *mio);
+/* the mapping itself, for zero-copy readers */
+const uint8_t *mmap_io_data(struct MmapIO *mio, int64_t *size);
+void mmap_io_close(struct MmapIO **mio);
+
+/* avformat_open_input() on top of an MmapIO.  On failure everything is
+   freed and *fmt_ctx / *mio are left NULL. */
+int mmap_open_input(AVFormatContext **fmt_ctx, struct MmapIO **mio,
+                    const char *path, AVDictionary **options);
+
+#endif  // MMAPIO_H
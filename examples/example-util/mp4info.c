@@ -0,0 +1,329 @@
+#include "mp4info.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libavformat/avformat.h>
+
+/* first stsd entry, enough for the sample entry fields and an esds */
+#define MP4_ENTRY_MAX 256
+
+struct BoxReader {
+    FILE *fp;
+    struct Mp4Info *info;
+    struct Mp4Track *track; /* trak being walked, NULL = none / skipped */
+    int found_moov;
+};
+
+static uint32_t be16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t be64(const uint8_t *p) {
+    return ((uint64_t)be32(p) << 32) | be32(p + 4);
+}
+
+/* box types compare against MKTAG, same order as libavformat's tag tables */
+static uint32_t tag(const uint8_t *p) {
+    return MKTAG(p[0], p[1], p[2], p[3]);
+}
+
+static int read_exact(struct BoxReader *r, void *buf, size_t n) {
+    size_t got = fread(buf, 1, n, r->fp);
+    r->info->bytes_read += got;
+    return got == n ? 0 : -1;
+}
+
+/* Box header at the current position.  On return the file is at the
+   payload and *end is where the next box starts. */
+static int read_box_header(struct BoxReader *r, int64_t parent_end,
+                           uint32_t *type, int64_t *end) {
+    uint8_t h[16];
+    int64_t start = ftello(r->fp);
+
+    if (start < 0 || start + 8 > parent_end || read_exact(r, h, 8) < 0) {
+        return -1;
+    }
+    uint64_t size = be32(h);
+    *type = tag(h + 4);
+    if (size == 1) { /* 64 bit size follows */
+        if (read_exact(r, h + 8, 8) < 0) return -1;
+        size = be64(h + 8);
+        if (size < 16) return -1;
+    } else if (size == 0) { /* runs to the end */
+        size = parent_end - start;
+    } else if (size < 8) {
+        return -1;
+    }
+    if (size > (uint64_t)(parent_end - start)) {
+        return -1;
+    }
+    *end = start + (int64_t)size;
+    return 0;
+}
+
+/* mvhd and mdhd share the layout up to the duration */
+static int read_timing(struct BoxReader *r, int64_t end, uint32_t *timescale,
+                       int64_t *duration) {
+    uint8_t b[32];
+    int64_t avail = end - ftello(r->fp);
+
+    if (avail < 20 || read_exact(r, b, avail < 32 ? 20 : 32) < 0) {
+        return -1;
+    }
+    if (b[0] == 1) { /* version 1, 64 bit times */
+        if (avail < 32) return -1;
+        *timescale = be32(b + 20);
+        *duration = be64(b + 24) == UINT64_MAX ? -1 : (int64_t)be64(b + 24);
+    } else {
+        *timescale = be32(b + 12);
+        *duration = be32(b + 16) == UINT32_MAX ? -1 : (int64_t)be32(b + 16);
+    }
+    return 0;
+}
+
+static int read_mvhd(struct BoxReader *r, int64_t end) {
+    uint32_t timescale;
+    int64_t duration;
+
+    if (read_timing(r, end, &timescale, &duration) < 0) {
+        return -1;
+    }
+    r->info->duration_ms = timescale > 0 && duration > 0
+                               ? av_rescale(duration, 1000, timescale)
+                               : -1;
+    return 0;
+}
+
+static int read_hdlr(struct BoxReader *r, int64_t end) {
+    uint8_t b[12];
+
+    if (end - ftello(r->fp) < 12 || read_exact(r, b, 12) < 0) {
+        return -1;
+    }
+    switch (tag(b + 8)) {
+        case MKTAG('v', 'i', 'd', 'e'):
+            r->track->type = AVMEDIA_TYPE_VIDEO;
+            break;
+        case MKTAG('s', 'o', 'u', 'n'):
+            r->track->type = AVMEDIA_TYPE_AUDIO;
+            break;
+        case MKTAG('s', 'u', 'b', 't'):
+        case MKTAG('s', 'b', 't', 'l'):
+        case MKTAG('t', 'e', 'x', 't'):
+            r->track->type = AVMEDIA_TYPE_SUBTITLE;
+            break;
+        default:
+            r->track->type = AVMEDIA_TYPE_DATA;
+            break;
+    }
+    return 0;
+}
+
+/* MPEG-4 descriptor length, 7 bits a byte */
+static int desc_len(const uint8_t **p, const uint8_t *end) {
+    int len = 0;
+    for (int i = 0; i < 4 && *p < end; i++) {
+        uint8_t c = *(*p)++;
+        len = (len << 7) | (c & 0x7f);
+        if (!(c & 0x80)) return len;
+    }
+    return -1;
+}
+
+/* objectTypeIndication out of an esds payload, -1 if it's not there */
+static int esds_object_type(const uint8_t *p, const uint8_t *end) {
+    p += 4; /* version, flags */
+    if (p >= end || *p++ != 0x03 || desc_len(&p, end) < 0 || end - p < 3) {
+        return -1;
+    }
+    uint8_t flags = p[2];
+    p += 3;
+    if (flags & 0x80) p += 2;                 /* dependsOn_ES_ID */
+    if (flags & 0x40 && p < end) p += 1 + *p; /* URL */
+    if (flags & 0x20) p += 2;                 /* OCR_ES_Id */
+    if (p >= end || *p++ != 0x04 || desc_len(&p, end) < 0 || p >= end) {
+        return -1;
+    }
+    return *p;
+}
+
+/* Audio sample entry children start after the version dependent fields,
+   look for an esds to tell mp3 from aac inside mp4a */
+static void read_audio_entry(struct Mp4Track *t, const uint8_t *e, int len) {
+    int version = be16(e + 16);
+    int children = 36;
+
+    t->channels = be16(e + 24);
+    t->sample_rate = be32(e + 32) >> 16;
+    if (version == 1) {
+        children = 52;
+    } else if (version == 2 && len >= 72) {
+        /* QuickTime v2, the real values are further on */
+        union {
+            uint64_t u;
+            double d;
+        } rate = {.u = be64(e + 40)};
+        t->sample_rate = (int)rate.d;
+        t->channels = be32(e + 48);
+        children = 72;
+    }
+    for (int pos = children; pos + 8 <= len;) {
+        uint32_t size = be32(e + pos);
+        if (size < 8 || size > (uint32_t)(len - pos)) break;
+        if (tag(e + pos + 4) == MKTAG('e', 's', 'd', 's')) {
+            int oti = esds_object_type(e + pos + 8, e + pos + size);
+            if (oti == 0x69 || oti == 0x6b) {
+                t->codec_id = AV_CODEC_ID_MP3;
+            }
+            break;
+        }
+        pos += size;
+    }
+}
+
+static int read_stsd(struct BoxReader *r, int64_t end) {
+    uint8_t e[MP4_ENTRY_MAX];
+    struct Mp4Track *t = r->track;
+    int64_t avail = end - ftello(r->fp);
+
+    /* version, flags, entry count, then the first entry */
+    if (avail < 8 + 36 || read_exact(r, e, 8) < 0 || be32(e + 4) == 0) {
+        return -1;
+    }
+    avail -= 8;
+    int len = avail < MP4_ENTRY_MAX ? (int)avail : MP4_ENTRY_MAX;
+    if (read_exact(r, e, len) < 0) {
+        return -1;
+    }
+    if (be32(e) < 36) {
+        return -1;
+    }
+    if ((int64_t)be32(e) < len) {
+        len = be32(e);
+    }
+    t->fourcc = tag(e + 4);
+
+    const struct AVCodecTag *tags[2] = {NULL, NULL};
+    if (t->type == AVMEDIA_TYPE_VIDEO) {
+        t->width = be16(e + 32);
+        t->height = be16(e + 34);
+        tags[0] = avformat_get_mov_video_tags();
+    } else if (t->type == AVMEDIA_TYPE_AUDIO) {
+        tags[0] = avformat_get_mov_audio_tags();
+    }
+    if (tags[0] != NULL) {
+        t->codec_id = av_codec_get_id(tags, t->fourcc);
+    }
+    if (t->type == AVMEDIA_TYPE_AUDIO) {
+        read_audio_entry(t, e, len);
+    }
+    return 0;
+}
+
+static int walk_boxes(struct BoxReader *r, int64_t end, int depth) {
+    while (ftello(r->fp) < end) {
+        uint32_t type;
+        int64_t box_end;
+        int ret = 0;
+
+        if (read_box_header(r, end, &type, &box_end) < 0) {
+            return -1;
+        }
+        switch (type) {
+            case MKTAG('m', 'o', 'o', 'v'):
+                if (depth == 0 && (ret = walk_boxes(r, box_end, 1)) == 0) {
+                    r->found_moov = 1;
+                }
+                break;
+            case MKTAG('c', 'm', 'o', 'v'):
+                return -1; /* compressed moov, leave it to libavformat */
+            case MKTAG('m', 'v', 'h', 'd'):
+                ret = read_mvhd(r, box_end);
+                break;
+            case MKTAG('t', 'r', 'a', 'k'):
+                if (depth == 1 && r->info->nb_tracks < MP4_MAX_TRACKS) {
+                    r->track = &r->info->tracks[r->info->nb_tracks++];
+                    r->track->type = AVMEDIA_TYPE_UNKNOWN;
+                    r->track->duration = -1;
+                    ret = walk_boxes(r, box_end, depth + 1);
+                    r->track = NULL;
+                }
+                break;
+            case MKTAG('m', 'd', 'i', 'a'):
+            case MKTAG('m', 'i', 'n', 'f'):
+            case MKTAG('s', 't', 'b', 'l'):
+                if (r->track) ret = walk_boxes(r, box_end, depth + 1);
+                break;
+            case MKTAG('m', 'd', 'h', 'd'):
+                if (r->track) {
+                    ret = read_timing(r, box_end, &r->track->timescale,
+                                      &r->track->duration);
+                }
+                break;
+            case MKTAG('h', 'd', 'l', 'r'):
+                /* minf has a hdlr too (data handler), only mdia's counts */
+                if (r->track && r->track->type == AVMEDIA_TYPE_UNKNOWN) {
+                    ret = read_hdlr(r, box_end);
+                }
+                break;
+            case MKTAG('s', 't', 's', 'd'):
+                if (r->track) ret = read_stsd(r, box_end);
+                break;
+            default:
+                break; /* mdat, sample tables, ... never read */
+        }
+        if (ret < 0) {
+            return -1;
+        }
+        if (r->found_moov && depth == 0) {
+            return 0; /* got it, whatever follows (mdat) doesn't matter */
+        }
+        if (fseeko(r->fp, box_end, SEEK_SET) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int mp4_info_read(const char *path, struct Mp4Info *info) {
+    struct BoxReader r;
+    struct stat f_stat;
+    uint8_t h[8];
+
+    memset(info, 0, sizeof(*info));
+    info->duration_ms = -1;
+    if (stat(path, &f_stat) < 0) {
+        return AVERROR(ENOENT);
+    }
+    memset(&r, 0, sizeof(r));
+    r.info = info;
+    r.fp = fopen(path, "rb");
+    if (r.fp == NULL) {
+        return AVERROR(ENOENT);
+    }
+    /* quick reject for anything that doesn't start like an mp4 */
+    int ret = AVERROR_INVALIDDATA;
+    if (read_exact(&r, h, 8) == 0) {
+        switch (tag(h + 4)) {
+            case MKTAG('f', 't', 'y', 'p'):
+            case MKTAG('m', 'o', 'o', 'v'):
+            case MKTAG('m', 'd', 'a', 't'):
+            case MKTAG('f', 'r', 'e', 'e'):
+            case MKTAG('s', 'k', 'i', 'p'):
+            case MKTAG('w', 'i', 'd', 'e'):
+                if (fseeko(r.fp, 0, SEEK_SET) == 0 &&
+                    walk_boxes(&r, f_stat.st_size, 0) == 0 && r.found_moov &&
+                    info->nb_tracks > 0) {
+                    ret = 0;
+                }
+                break;
+        }
+    }
+    fclose(r.fp);
+    return ret;
+}
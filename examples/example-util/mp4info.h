@@ -0,0 +1,48 @@
+#ifndef MP4INFO_H
+#define MP4INFO_H
+
+#include <libavcodec/avcodec.h>
+#include <stdint.h>
+
+/* Stream info for mov / mp4 straight from the boxes.  Everything
+   avformat_find_stream_info would tell us about a plain mp4 (codec,
+   resolution, sample rate, duration) is in the moov header, so walk
+   moov/trak/mdia/minf/stbl and read just mvhd, mdhd, hdlr and the first
+   stsd entry.  mdat and the sample tables (stts, stsz, stco, ...) are
+   skipped with a seek, a few KB of reads for a file of any size.
+
+     struct Mp4Info info;
+     if (mp4_info_read(path, &info) < 0) {
+         ... not an mp4 we understand, avformat_open_input +
+             avformat_find_stream_info like before
+     }
+
+   Anything unusual (compressed moov, truncated or broken boxes) fails and
+   the caller falls back.  Tracks past MP4_MAX_TRACKS are ignored.
+*/
+
+#define MP4_MAX_TRACKS 8
+
+struct Mp4Track {
+    enum AVMediaType type; /* from hdlr */
+    enum AVCodecID codec_id;
+    uint32_t fourcc; /* stsd sample entry, MKTAG order, ex. avc1 */
+    int width;
+    int height;
+    int channels;
+    int sample_rate;
+    uint32_t timescale; /* mdhd */
+    int64_t duration;   /* mdhd, in timescale units, -1 unknown */
+};
+
+struct Mp4Info {
+    int64_t duration_ms; /* mvhd, -1 unknown */
+    int nb_tracks;
+    struct Mp4Track tracks[MP4_MAX_TRACKS];
+    int64_t bytes_read; /* header bytes parsed, stdio reads a buffer around */
+};
+
+/* 0 on success, <0 if path isn't an mp4 / mov we can read this way */
+int mp4_info_read(const char *path, struct Mp4Info *info);
+
+#endif  // MP4INFO_H
@@ -0,0 +1,328 @@
+#include "readahead.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stagetimer.h"
+
+#define READAHEAD_AVIO_BUFFER (64 * 1024)
+
+struct ReadaheadChunk {
+    uint8_t *data;
+    int len;
+    int64_t offset; /* file offset of data[0] */
+};
+
+/*  Ring of chunks[head .. head + count) holds file data in order, starting
+    at read_pos (head_off bytes into the head chunk).  The reader thread is
+    the only one touching fd, and only ever fills the slot after the last
+    one.  A seek outside the buffered data bumps generation, so a read that
+    was in flight when the ring got flushed is thrown away.
+*/
+struct ReadaheadIO {
+    int fd;
+    int64_t file_size;
+    int chunk_size;
+    int nb_chunks;
+    struct ReadaheadChunk *chunks;
+    int head;
+    int count;
+    int head_off;
+    int64_t read_pos; /* consumer position */
+    int64_t fill_pos; /* next file offset the reader thread reads */
+    int eof;
+    int error;
+    unsigned generation;
+    int quit;
+
+    pthread_t thread;
+    int thread_started;
+    pthread_mutex_t lock;
+    pthread_cond_t can_fill;
+    pthread_cond_t can_read;
+
+    AVIOContext *avio;
+    struct ReadaheadStats stats;
+};
+
+static void *reader_thread(void *arg) {
+    struct ReadaheadIO *rio = arg;
+
+    pthread_mutex_lock(&rio->lock);
+    while (!rio->quit) {
+        if (rio->count == rio->nb_chunks || rio->eof || rio->error) {
+            pthread_cond_wait(&rio->can_fill, &rio->lock);
+            continue;
+        }
+        int slot = (rio->head + rio->count) % rio->nb_chunks;
+        unsigned generation = rio->generation;
+        int64_t offset = rio->fill_pos;
+        pthread_mutex_unlock(&rio->lock);
+
+        uint64_t t0 = util_clock_ns();
+        ssize_t n = -1;
+        if (lseek(rio->fd, offset, SEEK_SET) == offset) {
+            n = read(rio->fd, rio->chunks[slot].data, rio->chunk_size);
+        }
+        uint64_t elapsed = util_clock_ns() - t0;
+
+        pthread_mutex_lock(&rio->lock);
+        rio->stats.file_ns += elapsed;
+        if (generation != rio->generation) {
+            continue; /* seek flushed the ring while we were reading */
+        }
+        if (n < 0) {
+            rio->error = 1;
+        } else if (n == 0) {
+            rio->eof = 1;
+        } else {
+            rio->chunks[slot].len = (int)n;
+            rio->chunks[slot].offset = offset;
+            rio->count++;
+            rio->fill_pos += n;
+            rio->stats.chunks++;
+        }
+        pthread_cond_signal(&rio->can_read);
+    }
+    pthread_mutex_unlock(&rio->lock);
+    return NULL;
+}
+
+static int readahead_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+    struct ReadaheadIO *rio = opaque;
+
+    pthread_mutex_lock(&rio->lock);
+    rio->stats.reads++;
+    if (rio->count == 0 && !rio->eof && !rio->error) {
+        uint64_t t0 = util_clock_ns();
+        rio->stats.stalls++;
+        while (rio->count == 0 && !rio->eof && !rio->error) {
+            pthread_cond_wait(&rio->can_read, &rio->lock);
+        }
+        rio->stats.stall_ns += util_clock_ns() - t0;
+    }
+    if (rio->count == 0) {
+        int ret = rio->error ? AVERROR(EIO) : AVERROR_EOF;
+        pthread_mutex_unlock(&rio->lock);
+        return ret;
+    }
+
+    struct ReadaheadChunk *chunk = &rio->chunks[rio->head];
+    int n = chunk->len - rio->head_off;
+    if (n > buf_size) n = buf_size;
+    memcpy(buf, chunk->data + rio->head_off, n);
+    rio->head_off += n;
+    rio->read_pos += n;
+    rio->stats.bytes += n;
+    if (rio->head_off == chunk->len) {
+        rio->head = (rio->head + 1) % rio->nb_chunks;
+        rio->count--;
+        rio->head_off = 0;
+        pthread_cond_signal(&rio->can_fill);
+    }
+    pthread_mutex_unlock(&rio->lock);
+    return n;
+}
+
+/* Try to move the read position to target without throwing away the ring.
+   Forward: drop whole chunks in front of it.  Backward: only within the
+   head chunk, earlier chunks are already recycled. */
+static int seek_in_buffer(struct ReadaheadIO *rio, int64_t target) {
+    if (rio->count == 0) {
+        return 0;
+    }
+    struct ReadaheadChunk *chunk = &rio->chunks[rio->head];
+    if (target >= chunk->offset && target < rio->read_pos) {
+        rio->head_off = (int)(target - chunk->offset);
+        rio->read_pos = target;
+        return 1;
+    }
+    if (target < rio->read_pos || target >= rio->fill_pos) {
+        return 0;
+    }
+    while (target >= chunk->offset + chunk->len) {
+        rio->head = (rio->head + 1) % rio->nb_chunks;
+        rio->count--;
+        chunk = &rio->chunks[rio->head];
+    }
+    rio->head_off = (int)(target - chunk->offset);
+    rio->read_pos = target;
+    pthread_cond_signal(&rio->can_fill);
+    return 1;
+}
+
+static int64_t readahead_seek(void *opaque, int64_t offset, int whence) {
+    struct ReadaheadIO *rio = opaque;
+    int64_t target;
+
+    if (whence & AVSEEK_SIZE) {
+        return rio->file_size;
+    }
+    whence &= ~AVSEEK_FORCE;
+
+    pthread_mutex_lock(&rio->lock);
+    switch (whence) {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = rio->read_pos + offset;
+            break;
+        case SEEK_END:
+            target = rio->file_size + offset;
+            break;
+        default:
+            pthread_mutex_unlock(&rio->lock);
+            return AVERROR(EINVAL);
+    }
+    if (target < 0) {
+        pthread_mutex_unlock(&rio->lock);
+        return AVERROR(EINVAL);
+    }
+
+    if (target == rio->read_pos || seek_in_buffer(rio, target)) {
+        rio->stats.seeks_kept++;
+    } else {
+        rio->generation++;
+        rio->head = 0;
+        rio->count = 0;
+        rio->head_off = 0;
+        rio->read_pos = target;
+        rio->fill_pos = target;
+        rio->eof = 0;
+        rio->error = 0;
+        rio->stats.seeks++;
+        pthread_cond_signal(&rio->can_fill);
+    }
+    pthread_mutex_unlock(&rio->lock);
+    return target;
+}
+
+struct ReadaheadIO *readahead_io_open(const char *path, int chunk_size,
+                                      int nb_chunks) {
+    struct ReadaheadIO *rio = calloc(1, sizeof(*rio));
+    struct stat f_stat;
+
+    if (rio == NULL) {
+        return NULL;
+    }
+    rio->fd = -1;
+    rio->chunk_size = chunk_size > 0 ? chunk_size : READAHEAD_CHUNK_SIZE;
+    rio->nb_chunks = nb_chunks > 1 ? nb_chunks : READAHEAD_CHUNKS;
+    pthread_mutex_init(&rio->lock, NULL);
+    pthread_cond_init(&rio->can_fill, NULL);
+    pthread_cond_init(&rio->can_read, NULL);
+
+    rio->fd = open(path, O_RDONLY);
+    if (rio->fd < 0 || fstat(rio->fd, &f_stat) < 0) {
+        fprintf(stderr, "readahead: cannot open %s\n", path);
+        goto fail;
+    }
+    rio->file_size = f_stat.st_size;
+
+    rio->chunks = calloc(rio->nb_chunks, sizeof(*rio->chunks));
+    if (rio->chunks == NULL) {
+        goto fail;
+    }
+    for (int i = 0; i < rio->nb_chunks; i++) {
+        rio->chunks[i].data = malloc(rio->chunk_size);
+        if (rio->chunks[i].data == NULL) {
+            goto fail;
+        }
+    }
+
+    uint8_t *avio_buffer = av_malloc(READAHEAD_AVIO_BUFFER);
+    if (avio_buffer == NULL) {
+        goto fail;
+    }
+    rio->avio = avio_alloc_context(avio_buffer, READAHEAD_AVIO_BUFFER, 0, rio,
+                                   readahead_read_packet, NULL,
+                                   readahead_seek);
+    if (rio->avio == NULL) {
+        av_free(avio_buffer);
+        goto fail;
+    }
+
+    if (pthread_create(&rio->thread, NULL, reader_thread, rio) != 0) {
+        fprintf(stderr, "readahead: cannot start reader thread\n");
+        goto fail;
+    }
+    rio->thread_started = 1;
+    return rio;
+
+fail:
+    readahead_io_close(&rio);
+    return NULL;
+}
+
+AVIOContext *readahead_io_avio(struct ReadaheadIO *rio) { return rio->avio; }
+
+void readahead_io_get_stats(struct ReadaheadIO *rio,
+                            struct ReadaheadStats *stats) {
+    pthread_mutex_lock(&rio->lock);
+    *stats = rio->stats;
+    pthread_mutex_unlock(&rio->lock);
+}
+
+void readahead_io_close(struct ReadaheadIO **prio) {
+    struct ReadaheadIO *rio = *prio;
+    if (rio == NULL) {
+        return;
+    }
+    if (rio->thread_started) {
+        pthread_mutex_lock(&rio->lock);
+        rio->quit = 1;
+        pthread_cond_signal(&rio->can_fill);
+        pthread_mutex_unlock(&rio->lock);
+        pthread_join(rio->thread, NULL);
+    }
+    if (rio->avio) {
+        av_freep(&rio->avio->buffer);
+        avio_context_free(&rio->avio);
+    }
+    if (rio->chunks) {
+        for (int i = 0; i < rio->nb_chunks; i++) {
+            free(rio->chunks[i].data);
+        }
+        free(rio->chunks);
+    }
+    if (rio->fd >= 0) {
+        close(rio->fd);
+    }
+    pthread_cond_destroy(&rio->can_read);
+    pthread_cond_destroy(&rio->can_fill);
+    pthread_mutex_destroy(&rio->lock);
+    free(rio);
+    *prio = NULL;
+}
+
+int readahead_open_input(AVFormatContext **fmt_ctx, struct ReadaheadIO **rio,
+                         const char *path, AVDictionary **options,
+                         int chunk_size, int nb_chunks) {
+    int ret;
+
+    *fmt_ctx = NULL;
+    *rio = readahead_io_open(path, chunk_size, nb_chunks);
+    if (*rio == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    *fmt_ctx = avformat_alloc_context();
+    if (*fmt_ctx == NULL) {
+        readahead_io_close(rio);
+        return AVERROR(ENOMEM);
+    }
+    (*fmt_ctx)->pb = readahead_io_avio(*rio);
+    (*fmt_ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    /* on failure avformat_open_input frees the context, but not our pb */
+    if ((ret = avformat_open_input(fmt_ctx, path, NULL, options)) < 0) {
+        readahead_io_close(rio);
+        return ret;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <libavformat/avformat.h>
+#include <stdint.h>
+
+/* A read-ahead AVIOContext.  A dedicated reader thread fills a small ring of
+   large chunks from the file while the demuxer/decoder work on the previous
+   ones, so av_read_frame doesn't block on the SD card every time the avio
+   buffer runs dry.  2 chunks = double buffering, 3 = triple buffering.
+
+   AVFormatContext *fmt_ctx = NULL;
+   struct ReadaheadIO *rio = NULL;
+   readahead_open_input(&fmt_ctx, &rio, path, NULL, 0, 0);
+   ... av_read_frame(fmt_ctx, pkt) ...
+   avformat_close_input(&fmt_ctx);
+   readahead_io_close(&rio);   // after the format context is closed
+*/
+
+#define READAHEAD_CHUNK_SIZE (1024 * 1024)
+#define READAHEAD_CHUNKS 3
+
+struct ReadaheadStats {
+    uint64_t bytes;       /* delivered to the demuxer */
+    uint64_t reads;       /* read_packet calls from avio */
+    uint64_t stalls;      /* reads that had to wait for the reader thread */
+    uint64_t stall_ns;    /* total time spent waiting */
+    uint64_t chunks;      /* chunks filled by the reader thread */
+    uint64_t file_ns;     /* time the reader thread spent in read() */
+    uint64_t seeks;       /* seeks that flushed the ring */
+    uint64_t seeks_kept;  /* seeks satisfied from data already buffered */
+};
+
+struct ReadaheadIO;
+
+/* chunk_size / nb_chunks 0 = defaults above */
+struct ReadaheadIO *readahead_io_open(const char *path, int chunk_size,
+                                      int nb_chunks);
+AVIOContext *readahead_io_avio(struct ReadaheadIO *rio);
+void readahead_io_get_stats(struct ReadaheadIO *rio,
+                            struct ReadaheadStats *stats);
+void readahead_io_close(struct ReadaheadIO **rio);
+
+/* avformat_open_input() on top of a ReadaheadIO.  On failure everything is
+   freed and *fmt_ctx / *rio are left NULL. */
+int readahead_open_input(AVFormatContext **fmt_ctx, struct ReadaheadIO **rio,
+                         const char *path, AVDictionary **options,
+                         int chunk_size, int nb_chunks);
+
+#endif  // READAHEAD_H
@@ -1,57 +1,118 @@
 #include "rsyslog-wiiu.h"
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/iosupport.h>  // devoptab_list, devoptab_t
+#include <time.h>
 
-#include "announce.h"
+#include "discover.h"
+#include "linebuf.h"
 #include "rsyslog.h"
+#include "rsyslogq.h"
 
-// Global variable definition
-char SYSLOG_IP[18];
-
-// Static instance of devoptab
-static devoptab_t devoptab;
-
-int find_syslog_ip(char *server_ip_buffer) {
-    int port = 9515;
-    int i = 0;
-    int res = -1;
-    for (int i = 0; i < 10; i++) {
-        res = client_announce(server_ip_buffer, port);
-        if (res == 0) {
-            return 0;
-        }
+// The last server that answered, tried first on the next start
+#define SYSLOG_CACHE_PATH "/vol/external01/wiiu/syslog_server.txt"
+
+// -DSYSLOG_TRANSPORT=RSYSLOG_TCP_LZ compresses the stream, for verbose
+// logging over Wi-Fi.  Only rsyslog/tools/log_sink reads it
+#ifndef SYSLOG_TRANSPORT
+#define SYSLOG_TRANSPORT RSYSLOG_TCP
+#endif
+
+// Set once by the discovery thread, read with get_syslog_ip from any thread
+static char SYSLOG_IP[18];
+static pthread_mutex_t syslog_ip_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t syslog_ip_found = PTHREAD_COND_INITIALIZER;
+
+// Static instances of devoptab, stdout and stderr get their own priority
+static devoptab_t stdout_devoptab;
+static devoptab_t stderr_devoptab;
+
+int get_syslog_ip(char *buf, size_t size) {
+    pthread_mutex_lock(&syslog_ip_lock);
+    snprintf(buf, size, "%s", SYSLOG_IP);
+    pthread_mutex_unlock(&syslog_ip_lock);
+    return buf[0] != '\0' ? 0 : 1;
+}
+
+int wait_syslog_ip(char *buf, size_t size, int timeout_ms) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&syslog_ip_lock);
+    while (SYSLOG_IP[0] == '\0' &&
+           pthread_cond_timedwait(&syslog_ip_found, &syslog_ip_lock, &ts) ==
+               0) {
     }
-    return 1;
+    pthread_mutex_unlock(&syslog_ip_lock);
+    return get_syslog_ip(buf, size);
 }
 
+// On the discovery thread, whatever was printed so far goes out now
+static void found_server(const char *server_ip) {
+    pthread_mutex_lock(&syslog_ip_lock);
+    strncpy(SYSLOG_IP, server_ip, sizeof(SYSLOG_IP) - 1);
+    SYSLOG_IP[sizeof(SYSLOG_IP) - 1] = '\0';
+    pthread_cond_broadcast(&syslog_ip_found);
+    pthread_mutex_unlock(&syslog_ip_lock);
+    rsyslog_queue_set_server(server_ip);
+    printf("syslog server %s\n", server_ip);
+}
+
+// Whole lines per thread go to the shipper's queue, a printf no longer
+// waits on a TCP connect + send + close, and partial writes from different
+// threads don't end up mixed in one message
 ssize_t write_msg_to_syslog(struct _reent *r, void *fd, const char *ptr,
                             size_t len) {
-    char buffer[1024];
-    snprintf(buffer, 1024, "%*.*s", len, len, ptr);
-    rsyslog_send_tcp(SYSLOG_IP, 9514, 14, buffer);
-    return len;
+    return linebuf_write(LINEBUF_STDOUT, ptr, len);
+}
+
+static ssize_t write_err_to_syslog(struct _reent *r, void *fd,
+                                   const char *ptr, size_t len) {
+    return linebuf_write(LINEBUF_STDERR, ptr, len);
 }
 
 void init_stdout() {
-    devoptab.name = "STDOUT";
-    devoptab.structSize = sizeof devoptab;
-    devoptab.write_r = &write_msg_to_syslog;
+    stdout_devoptab.name = "STDOUT";
+    stdout_devoptab.structSize = sizeof stdout_devoptab;
+    stdout_devoptab.write_r = &write_msg_to_syslog;
 
-    devoptab_list[STD_OUT] = &devoptab;
-    devoptab_list[STD_ERR] = &devoptab;
+    stderr_devoptab.name = "STDERR";
+    stderr_devoptab.structSize = sizeof stderr_devoptab;
+    stderr_devoptab.write_r = &write_err_to_syslog;
+
+    devoptab_list[STD_OUT] = &stdout_devoptab;
+    devoptab_list[STD_ERR] = &stderr_devoptab;
 }
 
+// Unfinished lines and whatever is still queued at exit get half a second
+// to go out
+static void stop_rsyslogger(void) {
+    discover_stop();
+    fflush(stdout);
+    linebuf_flush_all();
+    rsyslog_queue_stop(500);
+}
+
+// Doesn't wait for the network.  stdout is queued from here on, and goes
+// out once the discovery thread finds a server (cached one first, then
+// broadcasts with backoff)
 int init_rsyslogger() {
-    char server_ip_buffer[18];
-    if (find_syslog_ip(server_ip_buffer) != 0) {
+    if (rsyslog_queue_start_transport(NULL, 9514, SYSLOG_TRANSPORT) != 0) {
         return 1;
     }
-    // tbd - figure out WIIU api for pthread_mutex_lock
-    strncpy(SYSLOG_IP, server_ip_buffer, sizeof(SYSLOG_IP) - 1);
-    SYSLOG_IP[sizeof(SYSLOG_IP) - 1] = '\0';
-    // pthread_mutex_unlock
+    atexit(stop_rsyslogger);
     init_stdout();
+    if (discover_start(9515, SYSLOG_CACHE_PATH, found_server) != 0) {
+        return 1;
+    }
     return 0;
 }
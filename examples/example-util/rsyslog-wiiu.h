@@ -4,8 +4,15 @@
 #include <stddef.h>
 #include <sys/iosupport.h>  // devoptab_list, devoptab_t
 
-extern char SYSLOG_IP[18];
+// Copy of the server IP discovery found ("" before that), from any thread.
+// 0 found, 1 not yet
+int get_syslog_ip(char *buf, size_t size);
 
+// Same, waiting up to timeout_ms for it
+int wait_syslog_ip(char *buf, size_t size, int timeout_ms);
+
+// Redirect stdout / stderr to syslog and start looking for the server.
+// Returns right away, lines are held until a server answers.  0 ok
 int init_rsyslogger();
 
 #endif  // RSYSLOG_WIIU
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "seekindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef __WIIU__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "streamcache.h"
+
+#define KFI_MAGIC 0x3149464b /* "KFI1" */
+#define KFI_VERSION 1
+#define KFI_HEADER_SIZE 48
+#define KFI_ENTRY_SIZE 20
+
+/*  Sidecar layout, little endian:
+    header   magic, version, file size, mtime, stream, time base num/den,
+             count, 8 bytes reserved
+    entries  pts i64, pos i64, size u32, sorted by pts
+    Entries are decoded on access, so the same mapping works on the
+    (big endian) WiiU and the host.
+*/
+struct SeekIndex {
+    const uint8_t *data; /* whole sidecar */
+    size_t size;
+    int mapped;
+    int stream;
+    AVRational time_base;
+    int count;
+};
+
+static void put_le(uint8_t *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static void sidecar_path(const char *path, char *out, size_t out_sz) {
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        snprintf(out, out_sz, "%.*s/.%s.kfi", (int)(slash - path), path,
+                 slash + 1);
+    } else {
+        snprintf(out, out_sz, ".%s.kfi", path);
+    }
+}
+
+static int compare_pts(const void *a, const void *b) {
+    int64_t pa = ((const struct SeekIndexEntry *)a)->pts;
+    int64_t pb = ((const struct SeekIndexEntry *)b)->pts;
+    return pa < pb ? -1 : pa > pb;
+}
+
+static int write_sidecar(const char *path, const struct stat *f_stat,
+                         int stream, AVRational time_base,
+                         const struct SeekIndexEntry *entries, int count) {
+    char side[1024], tmp[1040];
+    size_t size = KFI_HEADER_SIZE + (size_t)count * KFI_ENTRY_SIZE;
+    uint8_t *buf = calloc(1, size);
+    int ret = -1;
+
+    if (buf == NULL) {
+        return -1;
+    }
+    put_le(buf, KFI_MAGIC, 4);
+    put_le(buf + 4, KFI_VERSION, 4);
+    put_le(buf + 8, (uint64_t)f_stat->st_size, 8);
+    put_le(buf + 16, (uint64_t)f_stat->st_mtime, 8);
+    put_le(buf + 24, (uint32_t)stream, 4);
+    put_le(buf + 28, (uint32_t)time_base.num, 4);
+    put_le(buf + 32, (uint32_t)time_base.den, 4);
+    put_le(buf + 36, (uint32_t)count, 4);
+    for (int i = 0; i < count; i++) {
+        uint8_t *p = buf + KFI_HEADER_SIZE + (size_t)i * KFI_ENTRY_SIZE;
+        put_le(p, (uint64_t)entries[i].pts, 8);
+        put_le(p + 8, (uint64_t)entries[i].pos, 8);
+        put_le(p + 16, entries[i].size, 4);
+    }
+
+    sidecar_path(path, side, sizeof(side));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", side);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp != NULL) {
+        int ok = fwrite(buf, 1, size, fp) == size;
+        ok = fclose(fp) == 0 && ok;
+        remove(side); /* FAT rename won't replace */
+        if (ok && rename(tmp, side) == 0) {
+            ret = 0;
+        } else {
+            remove(tmp);
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+int seek_index_build(const char *path, int stream_index) {
+    AVFormatContext *fmt_ctx = NULL;
+    AVPacket *pkt = NULL;
+    struct SeekIndexEntry *entries = NULL;
+    int count = 0, capacity = 0, sorted = 1;
+    struct stat f_stat;
+    int ret;
+
+    if (stat(path, &f_stat) < 0) {
+        return AVERROR(ENOENT);
+    }
+    if ((ret = avformat_open_input(&fmt_ctx, path, NULL, NULL)) < 0) {
+        return ret;
+    }
+    if ((ret = stream_cache_find_stream_info(fmt_ctx, path, NULL)) < 0) {
+        goto end;
+    }
+    if (stream_index < 0) {
+        stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1,
+                                           -1, NULL, 0);
+    }
+    if (stream_index < 0 || stream_index >= (int)fmt_ctx->nb_streams) {
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto end;
+    }
+    /* only the packet headers of one stream matter, let the demuxer skip
+       the rest */
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int)i != stream_index) {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    if ((pkt = av_packet_alloc()) == NULL) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while ((ret = av_read_frame(fmt_ctx, pkt)) >= 0) {
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (pkt->stream_index == stream_index &&
+            (pkt->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                struct SeekIndexEntry *grown =
+                    realloc(entries, capacity * sizeof(*entries));
+                if (grown == NULL) {
+                    av_packet_unref(pkt);
+                    ret = AVERROR(ENOMEM);
+                    goto end;
+                }
+                entries = grown;
+            }
+            if (count > 0 && pts < entries[count - 1].pts) {
+                sorted = 0;
+            }
+            entries[count].pts = pts;
+            entries[count].pos = pkt->pos;
+            entries[count].size = pkt->size;
+            count++;
+        }
+        av_packet_unref(pkt);
+    }
+    if (ret != AVERROR_EOF) {
+        goto end;
+    }
+    if (!sorted) {
+        qsort(entries, count, sizeof(*entries), compare_pts);
+    }
+    ret = write_sidecar(path, &f_stat, stream_index,
+                        fmt_ctx->streams[stream_index]->time_base, entries,
+                        count) < 0
+              ? AVERROR(EIO)
+              : count;
+
+end:
+    free(entries);
+    av_packet_free(&pkt);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+/* Map (host) or read (WiiU) the whole sidecar */
+static int load_data(const char *side, struct SeekIndex *idx) {
+#ifndef __WIIU__
+    struct stat s_stat;
+    int fd = open(side, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &s_stat) == 0 && s_stat.st_size >= KFI_HEADER_SIZE) {
+        void *base =
+            mmap(NULL, s_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED) {
+            madvise(base, s_stat.st_size, MADV_RANDOM); /* binary search */
+            idx->data = base;
+            idx->size = s_stat.st_size;
+            idx->mapped = 1;
+        }
+    }
+    close(fd);
+    return idx->data ? 0 : -1;
+#else
+    FILE *fp = fopen(side, "rb");
+    long size;
+    uint8_t *data;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < KFI_HEADER_SIZE ||
+        fseek(fp, 0, SEEK_SET) != 0 || (data = malloc(size)) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    if (fread(data, 1, size, fp) != (size_t)size) {
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    idx->data = data;
+    idx->size = size;
+    return 0;
+#endif
+}
+
+struct SeekIndex *seek_index_load(const char *path) {
+    struct SeekIndex *idx;
+    struct stat f_stat;
+    char side[1024];
+
+    if (stat(path, &f_stat) < 0 || (idx = calloc(1, sizeof(*idx))) == NULL) {
+        return NULL;
+    }
+    sidecar_path(path, side, sizeof(side));
+    if (load_data(side, idx) < 0) {
+        free(idx);
+        return NULL;
+    }
+    const uint8_t *h = idx->data;
+    idx->stream = (int)get_le(h + 24, 4);
+    idx->time_base.num = (int)get_le(h + 28, 4);
+    idx->time_base.den = (int)get_le(h + 32, 4);
+    idx->count = (int)get_le(h + 36, 4);
+    if (get_le(h, 4) != KFI_MAGIC || get_le(h + 4, 4) != KFI_VERSION ||
+        get_le(h + 8, 8) != (uint64_t)f_stat.st_size ||
+        get_le(h + 16, 8) != (uint64_t)f_stat.st_mtime || idx->count < 0 ||
+        idx->size != KFI_HEADER_SIZE + (size_t)idx->count * KFI_ENTRY_SIZE) {
+        seek_index_close(&idx);
+        return NULL;
+    }
+    return idx;
+}
+
+void seek_index_close(struct SeekIndex **pidx) {
+    struct SeekIndex *idx = *pidx;
+    if (idx == NULL) {
+        return;
+    }
+#ifndef __WIIU__
+    if (idx->mapped) {
+        munmap((void *)idx->data, idx->size);
+    }
+#else
+    free((void *)idx->data);
+#endif
+    free(idx);
+    *pidx = NULL;
+}
+
+int seek_index_count(const struct SeekIndex *idx) { return idx->count; }
+
+int seek_index_stream(const struct SeekIndex *idx) { return idx->stream; }
+
+AVRational seek_index_time_base(const struct SeekIndex *idx) {
+    return idx->time_base;
+}
+
+static int64_t entry_pts(const struct SeekIndex *idx, int i) {
+    return (int64_t)get_le(
+        idx->data + KFI_HEADER_SIZE + (size_t)i * KFI_ENTRY_SIZE, 8);
+}
+
+void seek_index_entry(const struct SeekIndex *idx, int i,
+                      struct SeekIndexEntry *entry) {
+    const uint8_t *p =
+        idx->data + KFI_HEADER_SIZE + (size_t)i * KFI_ENTRY_SIZE;
+    entry->pts = (int64_t)get_le(p, 8);
+    entry->pos = (int64_t)get_le(p + 8, 8);
+    entry->size = (uint32_t)get_le(p + 16, 4);
+}
+
+int seek_index_find(const struct SeekIndex *idx, int64_t ts) {
+    int lo = 0, hi = idx->count - 1, found = -1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (entry_pts(idx, mid) <= ts) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+/* Demuxers without their own index (raw h264 / hevc, ...) seek through
+   the one libavformat builds while reading, which starts out empty and has
+   the first seek read the file from the start.  Hand it our keyframes,
+   again if it has been thinned out since. */
+static void seed_generic_index(AVStream *st, const struct SeekIndex *idx) {
+    struct SeekIndexEntry e;
+
+    if (avformat_index_get_entries_count(st) >= idx->count) {
+        return;
+    }
+    for (int i = 0; i < idx->count; i++) {
+        seek_index_entry(idx, i, &e);
+        if (e.pos >= 0) {
+            av_add_index_entry(st, e.pos, e.pts, e.size, 0, AVINDEX_KEYFRAME);
+        }
+    }
+}
+
+int64_t seek_index_seek(AVFormatContext *fmt_ctx, const struct SeekIndex *idx,
+                        int stream_index, int64_t ts) {
+    struct SeekIndexEntry e;
+
+    /* an index for another stream has pts in another time base */
+    if (idx == NULL || idx->count == 0 || idx->stream != stream_index) {
+        return av_seek_frame(fmt_ctx, stream_index, ts, AVSEEK_FLAG_BACKWARD) <
+                       0
+                   ? AV_NOPTS_VALUE
+                   : ts;
+    }
+    int i = seek_index_find(idx, ts);
+    seek_index_entry(idx, i < 0 ? 0 : i, &e);
+
+    /* Formats with timestamp discontinuities (MPEG-TS / PS) have to bisect
+       the file to find a timestamp, jump to the byte offset instead (the
+       same test ffplay uses for seek_by_bytes).  The rest get the
+       keyframe's exact pts: mp4 / mkv look it up in their own index,
+       generic index formats in the one seeded from ours. */
+    const AVInputFormat *fmt = fmt_ctx->iformat;
+    if (e.pos >= 0 && (fmt->flags & AVFMT_TS_DISCONT) &&
+        !(fmt->flags & AVFMT_NO_BYTE_SEEK) && strcmp(fmt->name, "ogg") != 0 &&
+        av_seek_frame(fmt_ctx, stream_index, e.pos, AVSEEK_FLAG_BYTE) >= 0) {
+        return e.pts;
+    }
+    if (fmt->flags & AVFMT_GENERIC_INDEX) {
+        seed_generic_index(fmt_ctx->streams[stream_index], idx);
+    }
+    if (avformat_seek_file(fmt_ctx, stream_index, e.pts, e.pts, e.pts, 0) >=
+            0 ||
+        av_seek_frame(fmt_ctx, stream_index, e.pts, AVSEEK_FLAG_BACKWARD) >=
+            0) {
+        return e.pts;
+    }
+    return AV_NOPTS_VALUE;
+}
@@ -0,0 +1,61 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <libavformat/avformat.h>
+#include <stdint.h>
+
+/* Keyframe seek index.  Scan a file once, no decoding, and keep every
+   video keyframe's pts, byte offset and packet size in a sidecar next to
+   it,
+
+     sd:/media/movie.mp4  ->  sd:/media/.movie.mp4.kfi
+
+   20 bytes per keyframe, a 2 hour movie with a keyframe every 2 seconds is
+   about 70KB.  Players load it (mmap on the host, one read on the WiiU) and
+   binary search it, so a seek goes straight to the right keyframe instead of
+   the demuxer hunting for one.
+
+     struct SeekIndex *idx = seek_index_load(path);   // NULL = not built
+     int64_t key_pts = seek_index_seek(fmt_ctx, idx, stream, target);
+     avcodec_flush_buffers(dec_ctx);
+     ... decode, drop frames with pts < target for a frame accurate seek,
+         or show the keyframe right away when scrubbing
+     seek_index_close(&idx);
+
+   Build the sidecars with "readspeed seekindex".
+*/
+
+struct SeekIndexEntry {
+    int64_t pts; /* stream time base, dts if the packet had no pts */
+    int64_t pos; /* byte offset of the packet, -1 = unknown */
+    uint32_t size;
+};
+
+struct SeekIndex;
+
+/* Scan path and write its sidecar.  stream_index < 0 = best video stream.
+   return the number of keyframes, <0 on errors */
+int seek_index_build(const char *path, int stream_index);
+
+/* NULL if there is no sidecar or it's out of date (file size / mtime) */
+struct SeekIndex *seek_index_load(const char *path);
+void seek_index_close(struct SeekIndex **idx);
+
+int seek_index_count(const struct SeekIndex *idx);
+int seek_index_stream(const struct SeekIndex *idx);
+AVRational seek_index_time_base(const struct SeekIndex *idx);
+void seek_index_entry(const struct SeekIndex *idx, int i,
+                      struct SeekIndexEntry *entry);
+
+/* Last keyframe with pts <= ts, -1 if ts is before the first one */
+int seek_index_find(const struct SeekIndex *idx, int64_t ts);
+
+/* Seek fmt_ctx so the next packet of stream_index is the keyframe at or
+   before ts (stream time base).  Without an index (idx NULL), or with one
+   built for another stream, it's a plain av_seek_frame(AVSEEK_FLAG_BACKWARD).
+   return the keyframe's pts (ts when there is no index),
+   AV_NOPTS_VALUE if the seek failed */
+int64_t seek_index_seek(AVFormatContext *fmt_ctx, const struct SeekIndex *idx,
+                        int stream_index, int64_t ts);
+
+#endif  // SEEKINDEX_H
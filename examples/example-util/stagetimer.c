@@ -0,0 +1,103 @@
+#include "stagetimer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __WIIU__
+#include <coreinit/time.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t util_clock_ns() {
+#ifdef __WIIU__
+    /* OSGetSystemTime is monotonic (time since boot), OSGetTime is the
+       wall clock and can jump */
+    return (uint64_t)OSTicksToNanoseconds(OSGetSystemTime());
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+int stage_timer_init(struct StageTimer *st, const char *name) {
+    memset(st, 0, sizeof(*st));
+    st->name = name;
+    st->min_ns = UINT64_MAX;
+    st->rng = 0x9e3779b9;
+    st->samples = malloc(STAGE_TIMER_RESERVOIR * sizeof(uint32_t));
+    if (st->samples == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+void stage_timer_free(struct StageTimer *st) {
+    free(st->samples);
+    st->samples = NULL;
+    st->nb_samples = 0;
+}
+
+void stage_timer_reset(struct StageTimer *st) {
+    st->calls = 0;
+    st->total_ns = 0;
+    st->min_ns = UINT64_MAX;
+    st->max_ns = 0;
+    st->nb_samples = 0;
+}
+
+/* xorshift32, good enough to pick reservoir slots */
+static uint32_t next_rand(struct StageTimer *st) {
+    uint32_t x = st->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    st->rng = x;
+    return x;
+}
+
+void stage_timer_add(struct StageTimer *st, uint64_t ns) {
+    st->calls++;
+    st->total_ns += ns;
+    if (ns < st->min_ns) st->min_ns = ns;
+    if (ns > st->max_ns) st->max_ns = ns;
+
+    if (st->samples == NULL) {
+        return;
+    }
+    uint32_t sample = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    if (st->nb_samples < STAGE_TIMER_RESERVOIR) {
+        st->samples[st->nb_samples++] = sample;
+    } else {
+        /* Algorithm R: keep each of the n calls with probability k/n */
+        uint64_t slot = next_rand(st) % st->calls;
+        if (slot < STAGE_TIMER_RESERVOIR) {
+            st->samples[slot] = sample;
+        }
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+uint64_t stage_timer_percentile(struct StageTimer *st, double pct) {
+    if (st->nb_samples == 0) {
+        return 0;
+    }
+    qsort(st->samples, st->nb_samples, sizeof(uint32_t), cmp_u32);
+    if (pct <= 0) return st->samples[0];
+    if (pct >= 100) return st->samples[st->nb_samples - 1];
+    /* nearest rank */
+    uint32_t rank = (uint32_t)(pct / 100.0 * st->nb_samples + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > st->nb_samples) rank = st->nb_samples;
+    return st->samples[rank - 1];
+}
+
+double stage_timer_mean_ns(const struct StageTimer *st) {
+    return st->calls ? (double)st->total_ns / st->calls : 0.0;
+}
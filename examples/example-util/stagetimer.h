@@ -0,0 +1,50 @@
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#include <stdint.h>
+
+/* Monotonic, high resolution clock in nanoseconds.
+   WiiU: OSGetSystemTime() ticks.  Host: clock_gettime(CLOCK_MONOTONIC) */
+uint64_t util_clock_ns();
+
+/* Number of per-call samples kept for percentiles.  Past this we switch to
+   reservoir sampling, so memory stays fixed no matter how long the run is. */
+#define STAGE_TIMER_RESERVOIR 16384
+
+/* Cumulative + per-call timings for one stage of a pipeline,
+   ex. av_read_frame or avcodec_send_packet */
+struct StageTimer {
+    const char *name;
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint32_t *samples; /* reservoir of per-call times, nanoseconds */
+    uint32_t nb_samples;
+    uint32_t rng;
+};
+
+int stage_timer_init(struct StageTimer *st, const char *name);
+void stage_timer_free(struct StageTimer *st);
+void stage_timer_reset(struct StageTimer *st);
+void stage_timer_add(struct StageTimer *st, uint64_t ns);
+
+/* pct in [0, 100].  Sorts the reservoir in place, so call after the run */
+uint64_t stage_timer_percentile(struct StageTimer *st, double pct);
+double stage_timer_mean_ns(const struct StageTimer *st);
+
+/* Time a single expression, ex.
+     STAGE_TIME(&stages[0], ret = av_read_frame(fmt_ctx, pkt));
+   Skipped entirely when the timer is NULL */
+#define STAGE_TIME(st, expr)                                  \
+    do {                                                      \
+        if (st) {                                             \
+            uint64_t stage_t0_ = util_clock_ns();             \
+            expr;                                             \
+            stage_timer_add(st, util_clock_ns() - stage_t0_); \
+        } else {                                              \
+            expr;                                             \
+        }                                                     \
+    } while (0)
+
+#endif  // STAGETIMER_H
@@ -0,0 +1,379 @@
+#include "streamcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavcodec/avcodec.h>
+
+#define SINFO_MAGIC 0x53494331 /* "SIC1" */
+#define SINFO_VERSION 1
+#define SINFO_MAX_EXTRADATA (1 << 20)
+#define SINFO_FULL_PROBESIZE 5000000 /* avformat's default probesize */
+
+/* Fields are written little endian one at a time, so a sidecar written by
+   the host build reads fine on the (big endian) WiiU and back. */
+struct SinfoBuf {
+    uint8_t *data;
+    size_t size;
+    size_t pos;
+    int error;
+};
+
+static void put_bytes(struct SinfoBuf *b, const void *src, size_t n) {
+    if (b->error || n == 0) return;
+    if (b->pos + n > b->size) {
+        size_t size = b->size ? b->size * 2 : 4096;
+        while (size < b->pos + n) size *= 2;
+        uint8_t *data = realloc(b->data, size);
+        if (data == NULL) {
+            b->error = 1;
+            return;
+        }
+        b->data = data;
+        b->size = size;
+    }
+    memcpy(b->data + b->pos, src, n);
+    b->pos += n;
+}
+
+static void put_u64(struct SinfoBuf *b, uint64_t v) {
+    uint8_t le[8];
+    for (int i = 0; i < 8; i++) le[i] = (uint8_t)(v >> (8 * i));
+    put_bytes(b, le, 8);
+}
+
+static void put_i32(struct SinfoBuf *b, int32_t v) {
+    uint8_t le[4];
+    for (int i = 0; i < 4; i++) le[i] = (uint8_t)((uint32_t)v >> (8 * i));
+    put_bytes(b, le, 4);
+}
+
+static void put_str(struct SinfoBuf *b, const char *s) {
+    int32_t n = s ? (int32_t)strlen(s) : 0;
+    put_i32(b, n);
+    put_bytes(b, s, n);
+}
+
+static const uint8_t *get_bytes(struct SinfoBuf *b, size_t n) {
+    if (b->error || b->pos + n > b->size) {
+        b->error = 1;
+        return NULL;
+    }
+    const uint8_t *p = b->data + b->pos;
+    b->pos += n;
+    return p;
+}
+
+static uint64_t get_u64(struct SinfoBuf *b) {
+    const uint8_t *le = get_bytes(b, 8);
+    uint64_t v = 0;
+    if (le == NULL) return 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)le[i] << (8 * i);
+    return v;
+}
+
+static int32_t get_i32(struct SinfoBuf *b) {
+    const uint8_t *le = get_bytes(b, 4);
+    uint32_t v = 0;
+    if (le == NULL) return 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)le[i] << (8 * i);
+    return (int32_t)v;
+}
+
+/* string compare against the buffer, no copy */
+static int get_str_equals(struct SinfoBuf *b, const char *s) {
+    int32_t n = get_i32(b);
+    const uint8_t *p = n >= 0 ? get_bytes(b, n) : NULL;
+    return p != NULL && (size_t)n == strlen(s) && memcmp(p, s, n) == 0;
+}
+
+static void put_rational(struct SinfoBuf *b, AVRational r) {
+    put_i32(b, r.num);
+    put_i32(b, r.den);
+}
+
+static AVRational get_rational(struct SinfoBuf *b) {
+    AVRational r;
+    r.num = get_i32(b);
+    r.den = get_i32(b);
+    return r;
+}
+
+static void sidecar_path(const char *path, char *out, size_t out_sz) {
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        snprintf(out, out_sz, "%.*s/.%s.sinfo", (int)(slash - path), path,
+                 slash + 1);
+    } else {
+        snprintf(out, out_sz, ".%s.sinfo", path);
+    }
+}
+
+static void put_codecpar(struct SinfoBuf *b, const AVCodecParameters *par) {
+    put_i32(b, par->codec_type);
+    put_i32(b, par->codec_id);
+    put_i32(b, (int32_t)par->codec_tag);
+    put_i32(b, par->format);
+    put_u64(b, (uint64_t)par->bit_rate);
+    put_i32(b, par->bits_per_coded_sample);
+    put_i32(b, par->bits_per_raw_sample);
+    put_i32(b, par->profile);
+    put_i32(b, par->level);
+    put_i32(b, par->width);
+    put_i32(b, par->height);
+    put_rational(b, par->sample_aspect_ratio);
+    put_rational(b, par->framerate);
+    put_i32(b, par->field_order);
+    put_i32(b, par->color_range);
+    put_i32(b, par->color_primaries);
+    put_i32(b, par->color_trc);
+    put_i32(b, par->color_space);
+    put_i32(b, par->chroma_location);
+    put_i32(b, par->video_delay);
+    put_i32(b, par->ch_layout.order);
+    put_i32(b, par->ch_layout.nb_channels);
+    put_u64(b, par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE
+                   ? par->ch_layout.u.mask
+                   : 0);
+    put_i32(b, par->sample_rate);
+    put_i32(b, par->block_align);
+    put_i32(b, par->frame_size);
+    put_i32(b, par->initial_padding);
+    put_i32(b, par->trailing_padding);
+    put_i32(b, par->seek_preroll);
+    put_i32(b, par->extradata_size);
+    put_bytes(b, par->extradata, par->extradata_size);
+}
+
+static int get_codecpar(struct SinfoBuf *b, AVCodecParameters *par) {
+    par->codec_type = get_i32(b);
+    par->codec_id = get_i32(b);
+    par->codec_tag = (uint32_t)get_i32(b);
+    par->format = get_i32(b);
+    par->bit_rate = (int64_t)get_u64(b);
+    par->bits_per_coded_sample = get_i32(b);
+    par->bits_per_raw_sample = get_i32(b);
+    par->profile = get_i32(b);
+    par->level = get_i32(b);
+    par->width = get_i32(b);
+    par->height = get_i32(b);
+    par->sample_aspect_ratio = get_rational(b);
+    par->framerate = get_rational(b);
+    par->field_order = get_i32(b);
+    par->color_range = get_i32(b);
+    par->color_primaries = get_i32(b);
+    par->color_trc = get_i32(b);
+    par->color_space = get_i32(b);
+    par->chroma_location = get_i32(b);
+    par->video_delay = get_i32(b);
+    int order = get_i32(b);
+    int nb_channels = get_i32(b);
+    uint64_t mask = get_u64(b);
+    av_channel_layout_uninit(&par->ch_layout);
+    if (order == AV_CHANNEL_ORDER_NATIVE && mask) {
+        av_channel_layout_from_mask(&par->ch_layout, mask);
+    } else if (nb_channels > 0) {
+        av_channel_layout_default(&par->ch_layout, nb_channels);
+    }
+    par->sample_rate = get_i32(b);
+    par->block_align = get_i32(b);
+    par->frame_size = get_i32(b);
+    par->initial_padding = get_i32(b);
+    par->trailing_padding = get_i32(b);
+    par->seek_preroll = get_i32(b);
+
+    int32_t extradata_size = get_i32(b);
+    if (extradata_size < 0 || extradata_size > SINFO_MAX_EXTRADATA) {
+        return -1;
+    }
+    const uint8_t *extradata = get_bytes(b, extradata_size);
+    if (b->error) {
+        return -1;
+    }
+    av_freep(&par->extradata);
+    par->extradata_size = 0;
+    if (extradata_size > 0) {
+        par->extradata =
+            av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (par->extradata == NULL) {
+            return -1;
+        }
+        memcpy(par->extradata, extradata, extradata_size);
+        par->extradata_size = extradata_size;
+    }
+    return 0;
+}
+
+static void write_sidecar(AVFormatContext *fmt_ctx, const char *path,
+                          const struct stat *f_stat) {
+    struct SinfoBuf b = {0};
+    char side[1024], tmp[1040];
+
+    put_i32(&b, SINFO_MAGIC);
+    put_i32(&b, SINFO_VERSION);
+    put_str(&b, path);
+    put_u64(&b, (uint64_t)f_stat->st_size);
+    put_u64(&b, (uint64_t)f_stat->st_mtime);
+    put_u64(&b, (uint64_t)fmt_ctx->duration);
+    put_u64(&b, (uint64_t)fmt_ctx->start_time);
+    put_u64(&b, (uint64_t)fmt_ctx->bit_rate);
+    put_i32(&b, fmt_ctx->nb_streams);
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        AVStream *st = fmt_ctx->streams[i];
+        put_rational(&b, st->time_base);
+        put_u64(&b, (uint64_t)st->start_time);
+        put_u64(&b, (uint64_t)st->duration);
+        put_u64(&b, (uint64_t)st->nb_frames);
+        put_rational(&b, st->avg_frame_rate);
+        put_rational(&b, st->r_frame_rate);
+        put_rational(&b, st->sample_aspect_ratio);
+        put_codecpar(&b, st->codecpar);
+    }
+    if (b.error) {
+        free(b.data);
+        return;
+    }
+
+    /* write + rename, so a pulled SD card never leaves half a sidecar */
+    sidecar_path(path, side, sizeof(side));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", side);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp != NULL) {
+        int ok = fwrite(b.data, 1, b.pos, fp) == b.pos;
+        ok = fclose(fp) == 0 && ok;
+        remove(side); /* FAT rename won't replace */
+        if (!ok || rename(tmp, side) != 0) {
+            remove(tmp);
+        }
+    }
+    free(b.data);
+}
+
+static int read_file(const char *path, struct SinfoBuf *b) {
+    FILE *fp = fopen(path, "rb");
+    long size;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0 ||
+        fseek(fp, 0, SEEK_SET) != 0 || (b->data = malloc(size)) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    b->size = fread(b->data, 1, size, fp);
+    fclose(fp);
+    return b->size == (size_t)size ? 0 : -1;
+}
+
+/* 0 when the sidecar matched and was copied into fmt_ctx */
+static int apply_sidecar(AVFormatContext *fmt_ctx, const char *path,
+                         const struct stat *f_stat) {
+    struct SinfoBuf b = {0};
+    char side[1024];
+    int ret = -1;
+
+    sidecar_path(path, side, sizeof(side));
+    if (read_file(side, &b) < 0) {
+        goto end;
+    }
+    if (get_i32(&b) != SINFO_MAGIC || get_i32(&b) != SINFO_VERSION ||
+        !get_str_equals(&b, path) ||
+        get_u64(&b) != (uint64_t)f_stat->st_size ||
+        get_u64(&b) != (uint64_t)f_stat->st_mtime) {
+        goto end;
+    }
+    int64_t duration = (int64_t)get_u64(&b);
+    int64_t start_time = (int64_t)get_u64(&b);
+    int64_t bit_rate = (int64_t)get_u64(&b);
+    if (get_i32(&b) != (int32_t)fmt_ctx->nb_streams || b.error) {
+        goto end;
+    }
+
+    /* parse everything into scratch parameters first, so a bad sidecar
+       can't leave fmt_ctx half overwritten */
+    AVCodecParameters **pars =
+        calloc(fmt_ctx->nb_streams, sizeof(AVCodecParameters *));
+    AVRational *rats = calloc(fmt_ctx->nb_streams * 4, sizeof(AVRational));
+    int64_t *times = calloc(fmt_ctx->nb_streams * 3, sizeof(int64_t));
+    unsigned int i;
+    for (i = 0; pars && rats && times && i < fmt_ctx->nb_streams; i++) {
+        rats[4 * i] = get_rational(&b);
+        times[3 * i] = (int64_t)get_u64(&b);
+        times[3 * i + 1] = (int64_t)get_u64(&b);
+        times[3 * i + 2] = (int64_t)get_u64(&b);
+        rats[4 * i + 1] = get_rational(&b);
+        rats[4 * i + 2] = get_rational(&b);
+        rats[4 * i + 3] = get_rational(&b);
+        pars[i] = avcodec_parameters_alloc();
+        if (pars[i] == NULL || get_codecpar(&b, pars[i]) < 0 ||
+            pars[i]->codec_id != fmt_ctx->streams[i]->codecpar->codec_id) {
+            break;
+        }
+    }
+    if (pars && rats && times && i == fmt_ctx->nb_streams && !b.error) {
+        for (i = 0; i < fmt_ctx->nb_streams; i++) {
+            AVStream *st = fmt_ctx->streams[i];
+            avcodec_parameters_copy(st->codecpar, pars[i]);
+            st->time_base = rats[4 * i];
+            st->start_time = times[3 * i];
+            st->duration = times[3 * i + 1];
+            st->nb_frames = times[3 * i + 2];
+            st->avg_frame_rate = rats[4 * i + 1];
+            st->r_frame_rate = rats[4 * i + 2];
+            st->sample_aspect_ratio = rats[4 * i + 3];
+        }
+        fmt_ctx->duration = duration;
+        fmt_ctx->start_time = start_time;
+        fmt_ctx->bit_rate = bit_rate;
+        ret = 0;
+    }
+    for (i = 0; pars && i < fmt_ctx->nb_streams; i++) {
+        avcodec_parameters_free(&pars[i]);
+    }
+    free(pars);
+    free(rats);
+    free(times);
+
+end:
+    free(b.data);
+    return ret;
+}
+
+/* Only a probe with avformat's defaults is worth keeping.  A caller that
+   shortened it (ex. avdecode's probesize=10000) can get streams without
+   extradata or codec parameters, and every other app would reuse that */
+static int full_probe(AVFormatContext *fmt_ctx, AVDictionary **options) {
+    return (options == NULL || *options == NULL) &&
+           fmt_ctx->probesize >= SINFO_FULL_PROBESIZE &&
+           fmt_ctx->max_analyze_duration == 0 &&
+           fmt_ctx->fps_probe_size < 0;
+}
+
+int stream_cache_find_stream_info(AVFormatContext *fmt_ctx, const char *path,
+                                  AVDictionary **options) {
+    struct stat f_stat;
+    int ret;
+
+    if (stat(path, &f_stat) < 0) {
+        return avformat_find_stream_info(fmt_ctx, options);
+    }
+    if (fmt_ctx->nb_streams > 0 && apply_sidecar(fmt_ctx, path, &f_stat) == 0) {
+        return 1;
+    }
+    if ((ret = avformat_find_stream_info(fmt_ctx, options)) < 0) {
+        return ret;
+    }
+    if (full_probe(fmt_ctx, options)) {
+        write_sidecar(fmt_ctx, path, &f_stat);
+    }
+    return 0;
+}
+
+void stream_cache_remove(const char *path) {
+    char side[1024];
+    sidecar_path(path, side, sizeof(side));
+    remove(side);
+}
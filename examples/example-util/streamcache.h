@@ -0,0 +1,38 @@
+#ifndef STREAMCACHE_H
+#define STREAMCACHE_H
+
+#include <libavformat/avformat.h>
+
+/* Stream info cache.  avformat_find_stream_info decodes the start of every
+   stream to fill in what the container header leaves out, and on the SD
+   card that can take seconds.  The first time a file is opened we keep the
+   result (codec parameters + extradata, time bases, frame rates, durations)
+   in a sidecar next to it,
+
+     sd:/media/movie.mp4  ->  sd:/media/.movie.mp4.sinfo
+
+   keyed by path, size and mtime.  Later opens copy it into the streams
+   instead of probing.  Dot files are skipped by util_walk_media_files, so
+   the sidecars don't show up as media.
+
+     avformat_open_input(&fmt_ctx, path, NULL, NULL);
+     stream_cache_find_stream_info(fmt_ctx, path, NULL);   // instead of
+                                                           // avformat_find_
+                                                           // stream_info
+*/
+
+/* Returns 1 when the cache was used, 0 when we probed (and wrote the
+   sidecar, unless options were passed or probesize / analyzeduration /
+   fpsprobesize were lowered, a short probe isn't cached), < 0 on an
+   avformat_find_stream_info error.  The cache is
+   ignored when the file changed or the demuxer found a different set of
+   streams than last time (ex. MPEG-TS, where streams only appear while
+   probing). */
+int stream_cache_find_stream_info(AVFormatContext *fmt_ctx, const char *path,
+                                  AVDictionary **options);
+
+/* Drop the sidecar for path.  When opening the decoder fails on cached
+   info, call this and open again, the next open probes for real */
+void stream_cache_remove(const char *path);
+
+#endif  // STREAMCACHE_H
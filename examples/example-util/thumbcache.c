@@ -0,0 +1,318 @@
+#include "thumbcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include "streamcache.h"
+
+#define THUMB_MAGIC 0x314d4854 /* "THM1" */
+#define THUMB_VERSION 1
+#define THUMB_HEADER_SIZE 32
+/* give up when the first keyframe isn't out after this many packets */
+#define THUMB_MAX_PACKETS 500
+/* the decode ran its course without a picture, unlike the AVERRORs it
+   can also fail with (out of memory, read errors) this one is cached */
+#define THUMB_NO_PICTURE FFERRTAG('N', 'P', 'I', 'C')
+
+/*  Sidecar layout, little endian:
+    magic, version, file size i64, mtime i64, width u32, height u32
+    then width * height * 3 bytes of RGB24.  0x0 = no picture.
+*/
+
+static void put_le(uint8_t *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static void sidecar_path(const char *path, char *out, size_t out_sz) {
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        snprintf(out, out_sz, "%.*s/.%s.thumb", (int)(slash - path), path,
+                 slash + 1);
+    } else {
+        snprintf(out, out_sz, ".%s.thumb", path);
+    }
+}
+
+/* 0 = loaded, 1 = current sidecar saying there's no picture,
+   -1 = no sidecar or out of date */
+static int read_sidecar(const char *path, const struct stat *f_stat,
+                        struct Thumb *thumb) {
+    uint8_t h[THUMB_HEADER_SIZE];
+    char side[1024];
+
+    sidecar_path(path, side, sizeof(side));
+    FILE *fp = fopen(side, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fread(h, 1, sizeof(h), fp) != sizeof(h) ||
+        get_le(h, 4) != THUMB_MAGIC || get_le(h + 4, 4) != THUMB_VERSION ||
+        get_le(h + 8, 8) != (uint64_t)f_stat->st_size ||
+        get_le(h + 16, 8) != (uint64_t)f_stat->st_mtime) {
+        fclose(fp);
+        return -1;
+    }
+    uint32_t width = (uint32_t)get_le(h + 24, 4);
+    uint32_t height = (uint32_t)get_le(h + 28, 4);
+    if (width == 0 || height == 0) {
+        fclose(fp);
+        return 1;
+    }
+    if (width > THUMB_MAX_W || height > THUMB_MAX_H) {
+        fclose(fp);
+        return -1;
+    }
+    size_t size = (size_t)width * height * 3;
+    thumb->rgb = malloc(size);
+    if (thumb->rgb == NULL || fread(thumb->rgb, 1, size, fp) != size) {
+        fclose(fp);
+        thumb_free(thumb);
+        return -1;
+    }
+    fclose(fp);
+    thumb->width = width;
+    thumb->height = height;
+    return 0;
+}
+
+/* thumb NULL writes the "no picture" marker */
+static int write_sidecar(const char *path, const struct stat *f_stat,
+                         const struct Thumb *thumb) {
+    uint8_t h[THUMB_HEADER_SIZE];
+    char side[1024], tmp[1040];
+    size_t size = thumb ? (size_t)thumb->width * thumb->height * 3 : 0;
+
+    memset(h, 0, sizeof(h));
+    put_le(h, THUMB_MAGIC, 4);
+    put_le(h + 4, THUMB_VERSION, 4);
+    put_le(h + 8, (uint64_t)f_stat->st_size, 8);
+    put_le(h + 16, (uint64_t)f_stat->st_mtime, 8);
+    put_le(h + 24, thumb ? (uint32_t)thumb->width : 0, 4);
+    put_le(h + 28, thumb ? (uint32_t)thumb->height : 0, 4);
+
+    sidecar_path(path, side, sizeof(side));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", side);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        return -1; /* read only card, we'll decode again next time */
+    }
+    int ok = fwrite(h, 1, sizeof(h), fp) == sizeof(h) &&
+             (size == 0 || fwrite(thumb->rgb, 1, size, fp) == size);
+    ok = fclose(fp) == 0 && ok;
+    remove(side); /* FAT rename won't replace */
+    if (!ok || rename(tmp, side) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* Biggest lowres shift that still leaves more pixels than the thumbnail */
+static int pick_lowres(const AVCodec *codec, int width, int height) {
+    int lowres = 0;
+    while (lowres < codec->max_lowres &&
+           (width >> (lowres + 1)) >= THUMB_MAX_W &&
+           (height >> (lowres + 1)) >= THUMB_MAX_H) {
+        lowres++;
+    }
+    return lowres;
+}
+
+/* Fit the frame, sample aspect ratio included, into the thumbnail box */
+static int scale_frame(const AVFrame *frame, struct Thumb *thumb) {
+    int64_t dw = frame->width;
+    int64_t dh = frame->height;
+    struct SwsContext *sws;
+
+    if (frame->sample_aspect_ratio.num > 0 &&
+        frame->sample_aspect_ratio.den > 0) {
+        dw = dw * frame->sample_aspect_ratio.num /
+             frame->sample_aspect_ratio.den;
+    }
+    if (dw <= 0 || dh <= 0) {
+        return AVERROR_INVALIDDATA;
+    }
+    if (dw * THUMB_MAX_H > dh * THUMB_MAX_W) {
+        thumb->width = THUMB_MAX_W;
+        thumb->height = (int)(dh * THUMB_MAX_W / dw);
+    } else {
+        thumb->height = THUMB_MAX_H;
+        thumb->width = (int)(dw * THUMB_MAX_H / dh);
+    }
+    if (thumb->width < 1) thumb->width = 1;
+    if (thumb->height < 1) thumb->height = 1;
+
+    sws = sws_getContext(frame->width, frame->height, frame->format,
+                         thumb->width, thumb->height, AV_PIX_FMT_RGB24,
+                         SWS_AREA, NULL, NULL, NULL);
+    thumb->rgb = malloc((size_t)thumb->width * thumb->height * 3);
+    if (sws == NULL || thumb->rgb == NULL) {
+        sws_freeContext(sws);
+        thumb_free(thumb);
+        return AVERROR(ENOMEM);
+    }
+    uint8_t *dst[4] = {thumb->rgb, NULL, NULL, NULL};
+    int dst_linesize[4] = {thumb->width * 3, 0, 0, 0};
+    sws_scale(sws, (const uint8_t *const *)frame->data, frame->linesize, 0,
+              frame->height, dst, dst_linesize);
+    sws_freeContext(sws);
+    return 0;
+}
+
+/* Decode the first keyframe of the best video stream into thumb.  *cached
+   is set when the stream info came from the streamcache sidecar.
+   return THUMB_NO_PICTURE for files without one */
+static int decode_poster_once(const char *path, struct Thumb *thumb,
+                              int *cached) {
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *dec_ctx = NULL;
+    const AVCodec *codec = NULL;
+    AVPacket *pkt = NULL;
+    AVFrame *frame = NULL;
+    int stream, ret, packets = 0;
+
+    if ((ret = avformat_open_input(&fmt_ctx, path, NULL, NULL)) < 0) {
+        return ret;
+    }
+    if ((ret = stream_cache_find_stream_info(fmt_ctx, path, NULL)) < 0) {
+        goto end;
+    }
+    *cached = ret == 1;
+    stream = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec,
+                                 0);
+    if (stream < 0) {
+        /* no video, or nothing to decode it with */
+        ret = stream == AVERROR_STREAM_NOT_FOUND ||
+                      stream == AVERROR_DECODER_NOT_FOUND
+                  ? THUMB_NO_PICTURE
+                  : stream;
+        goto end;
+    }
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int)i != stream) {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    AVCodecParameters *par = fmt_ctx->streams[stream]->codecpar;
+    if ((dec_ctx = avcodec_alloc_context3(codec)) == NULL ||
+        (pkt = av_packet_alloc()) == NULL ||
+        (frame = av_frame_alloc()) == NULL) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avcodec_parameters_to_context(dec_ctx, par)) < 0) {
+        goto end;
+    }
+    /* cheapest picture we can get, it ends up 96 pixels wide anyway */
+    dec_ctx->lowres = pick_lowres(codec, par->width, par->height);
+    dec_ctx->skip_frame = AVDISCARD_NONKEY;
+    dec_ctx->skip_loop_filter = AVDISCARD_ALL;
+    dec_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    dec_ctx->thread_count = 1; /* one frame, threads only add latency */
+    if ((ret = avcodec_open2(dec_ctx, codec, NULL)) < 0) {
+        goto end;
+    }
+
+    int eof = 0;
+    while ((ret = avcodec_receive_frame(dec_ctx, frame)) == AVERROR(EAGAIN)) {
+        if (eof || packets >= THUMB_MAX_PACKETS) {
+            ret = THUMB_NO_PICTURE;
+            break;
+        }
+        if ((ret = av_read_frame(fmt_ctx, pkt)) < 0) {
+            if (ret != AVERROR_EOF) {
+                break;
+            }
+            eof = 1;
+            avcodec_send_packet(dec_ctx, NULL); /* drain what's buffered */
+            continue;
+        }
+        /* the decoder would drop non-key frames, don't even send them */
+        if (pkt->stream_index == stream && (pkt->flags & AV_PKT_FLAG_KEY)) {
+            avcodec_send_packet(dec_ctx, pkt);
+        }
+        if (pkt->stream_index == stream) {
+            packets++;
+        }
+        av_packet_unref(pkt);
+    }
+    if (ret == AVERROR_EOF) {
+        ret = THUMB_NO_PICTURE; /* drained, nothing came out */
+    } else if (ret == 0) {
+        ret = scale_frame(frame, thumb);
+    }
+
+end:
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&dec_ctx);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+static int decode_poster(const char *path, struct Thumb *thumb) {
+    int cached = 0;
+    int ret = decode_poster_once(path, thumb, &cached);
+
+    if (ret < 0 && cached) {
+        /* the sidecar may be stale or bad, probe for real this time */
+        stream_cache_remove(path);
+        cached = 0;
+        ret = decode_poster_once(path, thumb, &cached);
+    }
+    return ret;
+}
+
+int thumb_cache_load(const char *path, struct Thumb *thumb) {
+    struct stat f_stat;
+
+    memset(thumb, 0, sizeof(*thumb));
+    if (stat(path, &f_stat) < 0) {
+        return -1;
+    }
+    return read_sidecar(path, &f_stat, thumb) == 0 ? 0 : -1;
+}
+
+int thumb_cache_get(const char *path, struct Thumb *thumb) {
+    struct stat f_stat;
+
+    memset(thumb, 0, sizeof(*thumb));
+    if (stat(path, &f_stat) < 0) {
+        return -1;
+    }
+    switch (read_sidecar(path, &f_stat, thumb)) {
+        case 0:
+            return 1;
+        case 1:
+            return -1; /* known to have no picture */
+    }
+    int ret = decode_poster(path, thumb);
+    if (ret == THUMB_NO_PICTURE) {
+        write_sidecar(path, &f_stat, NULL);
+    }
+    if (ret < 0) {
+        return -1; /* anything else is tried again next time */
+    }
+    write_sidecar(path, &f_stat, thumb);
+    return 0;
+}
+
+void thumb_free(struct Thumb *thumb) {
+    free(thumb->rgb);
+    thumb->rgb = NULL;
+    thumb->width = 0;
+    thumb->height = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef THUMBCACHE_H
+#define THUMBCACHE_H
+
+#include <stdint.h>
+
+/* Poster frame thumbnails.  Decode just the first keyframe of the video
+   stream (lowres where the decoder has it, non-key frames skipped, no
+   loop filter), scale it down to fit THUMB_MAX_W x THUMB_MAX_H and keep
+   the RGB24 pixels in a sidecar next to the file,
+
+     sd:/media/movie.mp4  ->  sd:/media/.movie.mp4.thumb
+
+   keyed by file size and mtime.  Files without a video stream ffmpeg can
+   decode, or whose first keyframe doesn't come out, get a 0x0 sidecar, so
+   they're not tried again until they change.  Errors (out of memory, read
+   errors) aren't cached.
+
+     struct Thumb t;
+     if (thumb_cache_get(path, &t) >= 0) {
+         ... t.width x t.height RGB24, t.width * 3 bytes a row
+         thumb_free(&t);
+     }
+
+   Decoding takes a while, call thumb_cache_get from a worker thread.
+*/
+
+#define THUMB_MAX_W 96
+#define THUMB_MAX_H 54
+
+struct Thumb {
+    int width;
+    int height;
+    uint8_t *rgb;
+};
+
+/* Sidecar only, never decodes.  0 = loaded, <0 = no current sidecar or the
+   file has no picture */
+int thumb_cache_load(const char *path, struct Thumb *thumb);
+
+/* Sidecar if it's current, otherwise decode and write one.
+   return 1 from the sidecar, 0 freshly decoded, <0 no picture or an
+   error */
+int thumb_cache_get(const char *path, struct Thumb *thumb);
+
+void thumb_free(struct Thumb *thumb);
+
+#endif  // THUMBCACHE_H
@@ -0,0 +1,39 @@
+#ifndef WHBCOMPAT_H
+#define WHBCOMPAT_H
+
+/* The console examples log with WHBLog and time with OSGetTime.  On a
+   Linux/Mac host build, map the handful of calls they use onto stdio and
+   the monotonic clock so the same benchmark code runs unchanged.
+   OSTime "ticks" are nanoseconds on the host. */
+
+#ifdef __WIIU__
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+#else
+#include <stdio.h>
+#include <time.h>
+
+#include "stagetimer.h"
+
+typedef int64_t OSTime;
+
+#define WHBLogPrint(s) puts(s)
+#define WHBLogPrintf(...) (printf(__VA_ARGS__), putchar('\n'))
+#define WHBLogConsoleDraw() fflush(stdout)
+
+#define OSGetTime() ((OSTime)util_clock_ns())
+#define OSGetSystemTime() ((OSTime)util_clock_ns())
+#define OSTicksToSeconds(t) ((t) / 1000000000LL)
+#define OSTicksToMilliseconds(t) ((t) / 1000000LL)
+#define OSTicksToNanoseconds(t) (t)
+#define OSMillisecondsToTicks(ms) ((OSTime)(ms) * 1000000LL)
+
+static inline void OSSleepTicks(OSTime t) {
+    struct timespec ts = {t / 1000000000LL, t % 1000000000LL};
+    nanosleep(&ts, NULL);
+}
+#endif  // __WIIU__
+
+#endif  // WHBCOMPAT_H
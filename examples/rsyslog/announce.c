@@ -1,4 +1,7 @@
+#include "announce.h"
+
 #include <arpa/inet.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,10 +24,17 @@ void error(const char *msg) { perror(msg); }
 
 // Client code
 int client_announce(char *server_ip_buffer, int server_port) {
+    return client_announce_timeout(server_ip_buffer, server_port, NULL,
+                                   ANNOUNCE_TIMEOUT_MS);
+}
+
+int client_announce_timeout(char *server_ip_buffer, int server_port,
+                            const char *target_ip, int timeout_ms) {
     int sockfd;
     struct sockaddr_in server_addr;
     char buffer[BUFFER_SIZE];
     const char *message = "Hello, Any Servers? Please send your IP.";
+    const char *target = target_ip != NULL ? target_ip : BROADCAST_IP;
     int broadcastEnable = 1;
 
     // Create socket
@@ -34,18 +44,12 @@ int client_announce(char *server_ip_buffer, int server_port) {
         return 1;
     }
 
-    /* TBD - figure out if SO_RCVTIMEO exists within wiiU homebrew
-    struct timeval read_timeout;
-    read_timeout.tv_sec = 1;
-    read_timeout.tv_usec = 0;
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout,
-               sizeof read_timeout);
-    */
-
     // Set socket option for broadcasting
-    if (setsockopt(sockfd, SOL_SOCKET, SO_BROADCAST, &broadcastEnable,
+    if (target_ip == NULL &&
+        setsockopt(sockfd, SOL_SOCKET, SO_BROADCAST, &broadcastEnable,
                    sizeof(broadcastEnable)) < 0) {
         error("Error setting socket option for broadcast");
+        close(sockfd);
         return 1;
     }
 
@@ -53,27 +57,33 @@ int client_announce(char *server_ip_buffer, int server_port) {
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(server_port);
-    if (inet_pton(AF_INET, BROADCAST_IP, &server_addr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, target, &server_addr.sin_addr) <= 0) {
         error("inet_pton failed");
+        close(sockfd);
         return 1;
     }
 
-    // Send message to the broadcast address
-    printf("Client sending to %s:%d: \"%s\"\n", BROADCAST_IP, server_port,
-           message);
+    // Send message to the broadcast (or cached server) address
     if (sendto(sockfd, message, strlen(message), 0,
                (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         error("Error sending message");
+        close(sockfd);
         return 1;
     }
 
-    // Receive response from server
+    // Wait for the response.  poll instead of SO_RCVTIMEO, so nobody
+    // hangs in recvfrom when no server is up
+    struct pollfd pfd = {sockfd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        close(sockfd);
+        return 1;
+    }
     socklen_t server_len = sizeof(server_addr);
     memset(buffer, 0, BUFFER_SIZE);
-    if (recvfrom(sockfd, buffer, BUFFER_SIZE, 0,
+    if (recvfrom(sockfd, buffer, BUFFER_SIZE - 1, 0,
                  (struct sockaddr *)&server_addr, &server_len) < 0) {
-        error("Error receiving response");  // Changed to error, client expects
-                                            // a response.
+        error("Error receiving response");
+        close(sockfd);
         return 1;
     }
 
@@ -81,8 +91,6 @@ int client_announce(char *server_ip_buffer, int server_port) {
     // can pull it's IP address from the response packet
     inet_ntop(AF_INET, &server_addr.sin_addr, server_ip_buffer,
               INET_ADDRSTRLEN);
-    printf("Client received from %s:%d: \"%s\"\n", server_ip_buffer,
-           ntohs(server_addr.sin_port), buffer);
 
     close(sockfd);
     return 0;
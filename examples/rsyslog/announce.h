@@ -1,7 +1,16 @@
 #ifndef ANNOUNCE_H
 #define ANNOUNCE_H
 
+#define ANNOUNCE_TIMEOUT_MS 1000
+
+/* Broadcast on port, the first server to answer is written to
+   server_ip_buffer (INET_ADDRSTRLEN bytes).  0 found, 1 nothing within
+   ANNOUNCE_TIMEOUT_MS or an error */
 int client_announce(char *server_ip_buffer, int port);
+
+/* Same, to target_ip (NULL for broadcast) and waiting timeout_ms */
+int client_announce_timeout(char *server_ip_buffer, int port,
+                            const char *target_ip, int timeout_ms);
 int server_acknowledge(int server_port);
 
 #endif  // ANNOUNCE_H
\ No newline at end of file
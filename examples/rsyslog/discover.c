@@ -0,0 +1,135 @@
+#include "discover.h"
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "announce.h"
+
+static struct {
+    pthread_mutex_t lock; /* stop, for the retry wait */
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    int stop;
+    int port;
+    char cache_path[256];
+    DiscoverFound found;
+} d = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static int read_cache(char *ip, size_t size) {
+    FILE *fp = d.cache_path[0] ? fopen(d.cache_path, "r") : NULL;
+    struct in_addr addr;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    int ok = fgets(ip, size, fp) != NULL;
+    fclose(fp);
+    if (!ok) {
+        return -1;
+    }
+    ip[strcspn(ip, "\r\n")] = '\0';
+    return inet_pton(AF_INET, ip, &addr) == 1 ? 0 : -1;
+}
+
+static void write_cache(const char *ip) {
+    FILE *fp = d.cache_path[0] ? fopen(d.cache_path, "w") : NULL;
+
+    if (fp != NULL) {
+        fprintf(fp, "%s\n", ip);
+        fclose(fp);
+    }
+}
+
+/* 1 when it's time to stop */
+static int wait_ms(int ms) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&d.lock);
+    while (!d.stop &&
+           pthread_cond_timedwait(&d.wake, &d.lock, &ts) == 0) {
+    }
+    int stop = d.stop;
+    pthread_mutex_unlock(&d.lock);
+    return stop;
+}
+
+static int stopping(void) {
+    pthread_mutex_lock(&d.lock);
+    int stop = d.stop;
+    pthread_mutex_unlock(&d.lock);
+    return stop;
+}
+
+static void *discover_thread(void *arg) {
+    char cached[INET_ADDRSTRLEN + 2];
+    char ip[INET_ADDRSTRLEN];
+    int retry_ms = DISCOVER_RETRY_MIN_MS;
+
+    (void)arg;
+    if (read_cache(cached, sizeof(cached)) == 0 &&
+        client_announce_timeout(ip, d.port, cached, DISCOVER_PROBE_MS) == 0) {
+        if (strcmp(ip, cached) != 0) {
+            write_cache(ip);
+        }
+        d.found(ip);
+        return NULL;
+    }
+    while (!stopping()) {
+        if (client_announce_timeout(ip, d.port, NULL, DISCOVER_PROBE_MS) ==
+            0) {
+            write_cache(ip);
+            d.found(ip);
+            return NULL;
+        }
+        if (wait_ms(retry_ms)) {
+            break;
+        }
+        retry_ms *= 2;
+        if (retry_ms > DISCOVER_RETRY_MAX_MS) {
+            retry_ms = DISCOVER_RETRY_MAX_MS;
+        }
+    }
+    return NULL;
+}
+
+int discover_start(int port, const char *cache_path, DiscoverFound found) {
+    if (d.running) {
+        return -1;
+    }
+    d.port = port;
+    d.found = found;
+    d.stop = 0;
+    snprintf(d.cache_path, sizeof(d.cache_path), "%s",
+             cache_path != NULL ? cache_path : "");
+    if (pthread_create(&d.thread, NULL, discover_thread, NULL) != 0) {
+        return -1;
+    }
+    d.running = 1;
+    return 0;
+}
+
+void discover_stop(void) {
+    if (!d.running) {
+        return;
+    }
+    pthread_mutex_lock(&d.lock);
+    d.stop = 1;
+    pthread_cond_signal(&d.wake);
+    pthread_mutex_unlock(&d.lock);
+    pthread_join(d.thread, NULL);
+    d.running = 0;
+}
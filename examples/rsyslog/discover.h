@@ -0,0 +1,34 @@
+#ifndef DISCOVER_H
+#define DISCOVER_H
+
+/* Finds the syslog server in the background, so startup never waits on the
+   network.  A thread tries the server in cache_path first (one unicast
+   announce), then broadcasts with client_announce_timeout, waiting
+   DISCOVER_RETRY_MIN_MS after a miss and doubling up to
+   DISCOVER_RETRY_MAX_MS, until someone answers or discover_stop.
+
+     rsyslog_queue_start(NULL, 9514);    // buffer from the start
+     discover_start(9515, "/vol/external01/wiiu/syslog_server.txt",
+                    found_server);
+     ...
+     static void found_server(const char *ip) {
+         rsyslog_queue_set_server(ip);
+     }
+
+   found runs once, on the discovery thread.  The address that answered is
+   written to cache_path (one line) for the next start.
+*/
+
+#define DISCOVER_PROBE_MS 500 /* wait for an answer */
+#define DISCOVER_RETRY_MIN_MS 250
+#define DISCOVER_RETRY_MAX_MS 8000
+
+typedef void (*DiscoverFound)(const char *server_ip);
+
+/* 0 started, -1 already running / no thread.  cache_path may be NULL */
+int discover_start(int port, const char *cache_path, DiscoverFound found);
+
+/* Stop looking and wait for the thread, at most about DISCOVER_PROBE_MS */
+void discover_stop(void);
+
+#endif  // DISCOVER_H
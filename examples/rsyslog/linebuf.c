@@ -0,0 +1,152 @@
+#include "linebuf.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "rsyslogq.h"
+
+/* One thread's unfinished lines, a RSYSLOG_SLOT_TEXT each so a full buffer
+   is exactly one ring slot. */
+struct LineBuf {
+    int used;
+    size_t len[LINEBUF_STREAMS];
+    char text[LINEBUF_STREAMS][RSYSLOG_SLOT_TEXT];
+};
+
+static const int priorities[LINEBUF_STREAMS] = {14, 11};
+
+static struct {
+    pthread_mutex_t lock; /* used flags, flush_all */
+    pthread_once_t once;
+    pthread_key_t key;
+    int have_key;
+    struct LineBuf bufs[LINEBUF_THREADS];
+} lb = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+};
+
+/* the key's value for threads that didn't get a buffer, so they don't
+   look for one on every write */
+static char no_buffer;
+
+static void send_line(struct LineBuf *b, int stream) {
+    if (b->len[stream] > 0) {
+        rsyslog_queue_push(priorities[stream], b->text[stream],
+                           b->len[stream]);
+        b->len[stream] = 0;
+    }
+}
+
+static void thread_exit(void *arg) {
+    struct LineBuf *b = arg;
+
+    if (arg == &no_buffer) {
+        return;
+    }
+    pthread_mutex_lock(&lb.lock);
+    for (int s = 0; s < LINEBUF_STREAMS; s++) {
+        send_line(b, s);
+    }
+    b->used = 0;
+    pthread_mutex_unlock(&lb.lock);
+}
+
+static void make_key(void) {
+    lb.have_key = pthread_key_create(&lb.key, thread_exit) == 0;
+}
+
+static struct LineBuf *get_buffer(void) {
+    pthread_once(&lb.once, make_key);
+    if (!lb.have_key) {
+        return NULL;
+    }
+    void *p = pthread_getspecific(lb.key);
+    if (p != NULL) {
+        return p == &no_buffer ? NULL : p;
+    }
+    struct LineBuf *b = NULL;
+    pthread_mutex_lock(&lb.lock);
+    for (int i = 0; i < LINEBUF_THREADS; i++) {
+        if (!lb.bufs[i].used) {
+            b = &lb.bufs[i];
+            memset(b->len, 0, sizeof(b->len));
+            b->used = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lb.lock);
+    pthread_setspecific(lb.key, b != NULL ? (void *)b : &no_buffer);
+    return b;
+}
+
+size_t linebuf_write(int stream, const char *ptr, size_t len) {
+    struct LineBuf *b = get_buffer();
+    size_t left = len;
+
+    if (stream < 0 || stream >= LINEBUF_STREAMS) {
+        stream = LINEBUF_STDOUT;
+    }
+    if (b == NULL) {
+        rsyslog_queue_push(priorities[stream], ptr, len);
+        return len;
+    }
+    char *text = b->text[stream];
+    size_t *n = &b->len[stream];
+    while (left > 0) {
+        const char *nl = memchr(ptr, '\n', left);
+        size_t part = nl != NULL ? (size_t)(nl - ptr) : left;
+        if (nl != NULL && *n == 0) {
+            /* a whole line, straight from the caller's buffer (the push
+               cuts it into RSYSLOG_SLOT_TEXT chunks, same as below) */
+            if (part > 0) {
+                rsyslog_queue_push(priorities[stream], ptr, part);
+            }
+        } else {
+            const char *p = ptr;
+            size_t rest = part;
+            while (rest > 0) {
+                size_t room = RSYSLOG_SLOT_TEXT - *n;
+                size_t c = rest < room ? rest : room;
+                memcpy(text + *n, p, c);
+                *n += c;
+                p += c;
+                rest -= c;
+                if (*n == RSYSLOG_SLOT_TEXT) {
+                    send_line(b, stream);
+                }
+            }
+            if (nl != NULL) {
+                send_line(b, stream);
+            }
+        }
+        if (nl != NULL) {
+            part++;
+        }
+        ptr += part;
+        left -= part;
+    }
+    return len;
+}
+
+void linebuf_flush(void) {
+    struct LineBuf *b = get_buffer();
+
+    if (b != NULL) {
+        for (int s = 0; s < LINEBUF_STREAMS; s++) {
+            send_line(b, s);
+        }
+    }
+}
+
+void linebuf_flush_all(void) {
+    pthread_mutex_lock(&lb.lock);
+    for (int i = 0; i < LINEBUF_THREADS; i++) {
+        if (lb.bufs[i].used) {
+            for (int s = 0; s < LINEBUF_STREAMS; s++) {
+                send_line(&lb.bufs[i], s);
+            }
+        }
+    }
+    pthread_mutex_unlock(&lb.lock);
+}
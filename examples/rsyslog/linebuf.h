@@ -0,0 +1,40 @@
+#ifndef LINEBUF_H
+#define LINEBUF_H
+
+#include <stddef.h>
+
+/* Line assembly for redirected stdout / stderr.  printf hands the devoptab
+   whatever it has, a piece of a line, several lines, or a 5 KB dump, and
+   other threads' pieces arrive in between.  linebuf_write keeps a line per
+   thread (and stream) until its newline shows up, then queues it with
+   rsyslog_queue_push, so each syslog message is one whole line from one
+   thread.
+
+     devoptab.write_r -> linebuf_write(LINEBUF_STDOUT, ptr, len)
+     ...
+     linebuf_flush_all();        // at exit, before rsyslog_queue_stop
+
+   A line longer than RSYSLOG_SLOT_TEXT goes out in RSYSLOG_SLOT_TEXT
+   chunks as it fills.  Buffers come from a static pool of LINEBUF_THREADS,
+   nothing is allocated on the write path; threads past that get each write
+   as its own message, like before.  A thread's partial line is sent when
+   the thread exits.
+*/
+
+#define LINEBUF_THREADS 32
+
+#define LINEBUF_STDOUT 0 /* priority 14, user.info */
+#define LINEBUF_STDERR 1 /* priority 11, user.err */
+#define LINEBUF_STREAMS 2
+
+/* Add output for the calling thread.  Always takes all of it, returns len */
+size_t linebuf_write(int stream, const char *ptr, size_t len);
+
+/* Send the calling thread's partial lines now */
+void linebuf_flush(void);
+
+/* Send every thread's partial lines.  Only call it once the other writing
+   threads are done (atexit). */
+void linebuf_flush_all(void);
+
+#endif  // LINEBUF_H
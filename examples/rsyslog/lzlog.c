@@ -0,0 +1,232 @@
+#include "lzlog.h"
+
+#include <string.h>
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 /* the end of a block is always literals */
+#define MAX_OFFSET 65535
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static unsigned int hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZLOG_HASH_BITS);
+}
+
+void lzlog_reset(struct LzlogStream *z) {
+    z->history = 0;
+    memset(z->hash, 0, sizeof(z->hash));
+}
+
+/* Make room for a len byte block, keeping the last LZLOG_WINDOW bytes as
+   history.  Both ends do this at the same points.  The shift for the hash
+   table, 0 when nothing moved */
+static size_t make_room(struct LzlogStream *z, size_t len) {
+    if (z->history + len <= sizeof(z->window)) {
+        return 0;
+    }
+    size_t d = z->history - LZLOG_WINDOW;
+    memmove(z->window, z->window + d, LZLOG_WINDOW);
+    z->history = LZLOG_WINDOW;
+    return d;
+}
+
+static uint8_t *put_length(uint8_t *op, size_t n) {
+    for (; n >= 255; n -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+/* A sequence: literals, then a match unless it's the last one */
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len,
+                             size_t offset, size_t match_len) {
+    uint8_t *token = op++;
+    size_t m = match_len ? match_len - MIN_MATCH : 0;
+
+    *token = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4 |
+                       (m < 15 ? m : 15));
+    if (lit_len >= 15) {
+        op = put_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if (m >= 15) {
+            op = put_length(op, m - 15);
+        }
+    }
+    return op;
+}
+
+size_t lzlog_compress_frame(struct LzlogStream *z, const void *raw,
+                            size_t len, uint8_t *out) {
+    if (len > LZLOG_BLOCK_MAX) {
+        return 0;
+    }
+    size_t d = make_room(z, len);
+    if (d > 0) {
+        for (size_t i = 0; i < sizeof(z->hash) / sizeof(z->hash[0]); i++) {
+            z->hash[i] = z->hash[i] > d ? (uint16_t)(z->hash[i] - d) : 0;
+        }
+    }
+    uint8_t *w = z->window;
+    size_t start = z->history;
+    size_t end = start + len;
+    memcpy(w + start, raw, len);
+
+    uint8_t *op = out + LZLOG_HEADER;
+    size_t anchor = start;
+    size_t ip = start;
+    size_t limit = len > LAST_LITERALS ? end - LAST_LITERALS : start;
+    while (ip + MIN_MATCH <= limit) {
+        uint32_t v = read32(w + ip);
+        unsigned int h = hash4(v);
+        size_t ref = z->hash[h];
+        z->hash[h] = (uint16_t)(ip + 1);
+        if (ref == 0 || ip - (ref - 1) > MAX_OFFSET ||
+            read32(w + ref - 1) != v) {
+            /* skip faster through what doesn't compress */
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        ref--;
+        size_t n = MIN_MATCH;
+        while (ip + n < limit && w[ref + n] == w[ip + n]) {
+            n++;
+        }
+        op = put_sequence(op, w + anchor, ip - anchor, ip - ref, n);
+        ip += n;
+        anchor = ip;
+        /* a position inside the match, for the next line like it */
+        if (ip - 2 > start) {
+            z->hash[hash4(read32(w + ip - 2))] = (uint16_t)(ip - 2 + 1);
+        }
+    }
+    op = put_sequence(op, w + anchor, end - anchor, 0, 0);
+
+    size_t payload = op - (out + LZLOG_HEADER);
+    uint32_t word = (uint32_t)payload;
+    if (payload >= len) {
+        /* didn't help, send it as is */
+        memcpy(out + LZLOG_HEADER, raw, len);
+        payload = len;
+        word = (uint32_t)len | LZLOG_STORED;
+    }
+    put32(out, word);
+    put32(out + 4, (uint32_t)len);
+    z->history = end;
+    return LZLOG_HEADER + payload;
+}
+
+int lzlog_frame_header(const uint8_t *in, size_t avail, size_t *payload_len,
+                       size_t *raw_len, int *stored) {
+    if (avail < LZLOG_HEADER) {
+        return 0;
+    }
+    uint32_t word = get32(in);
+    *stored = (word & LZLOG_STORED) != 0;
+    *payload_len = word & ~LZLOG_STORED;
+    *raw_len = get32(in + 4);
+    if (*raw_len > LZLOG_BLOCK_MAX ||
+        *payload_len > LZLOG_BOUND(LZLOG_BLOCK_MAX) ||
+        (*stored && *payload_len != *raw_len)) {
+        return -1;
+    }
+    return LZLOG_HEADER;
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *iend, size_t *n) {
+    unsigned int b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+const char *lzlog_decompress_frame(struct LzlogStream *z,
+                                   const uint8_t *payload,
+                                   size_t payload_len, size_t raw_len,
+                                   int stored) {
+    if (raw_len > LZLOG_BLOCK_MAX) {
+        return NULL;
+    }
+    make_room(z, raw_len);
+    uint8_t *w = z->window;
+    uint8_t *op = w + z->history;
+    uint8_t *oend = op + raw_len;
+
+    if (stored) {
+        if (payload_len != raw_len) {
+            return NULL;
+        }
+        memcpy(op, payload, raw_len);
+        z->history += raw_len;
+        return (const char *)op;
+    }
+    const uint8_t *ip = payload;
+    const uint8_t *iend = payload + payload_len;
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && get_length(&ip, iend, &lit) < 0) {
+            return NULL;
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) {
+            return NULL;
+        }
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) {
+            break; /* the last literals */
+        }
+        if (iend - ip < 2) {
+            return NULL;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t m = token & 15;
+        if (m == 15 && get_length(&ip, iend, &m) < 0) {
+            return NULL;
+        }
+        m += MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - w) ||
+            m > (size_t)(oend - op)) {
+            return NULL;
+        }
+        /* may overlap itself, a run */
+        const uint8_t *ref = op - offset;
+        for (size_t i = 0; i < m; i++) {
+            op[i] = ref[i];
+        }
+        op += m;
+    }
+    if (op != oend) {
+        return NULL;
+    }
+    z->history += raw_len;
+    return (const char *)oend - raw_len;
+}
@@ -0,0 +1,71 @@
+#ifndef LZLOG_H
+#define LZLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A small LZ77 codec for the log stream (the LZ4 block format, greedy,
+   one hash probe), so verbose logging takes less of the Wi-Fi link.
+
+   The stream is LZLOG_MAGIC and then one frame per batch:
+
+     u32 little endian  payload length, LZLOG_STORED set when the payload
+                        is the batch as is (it didn't get smaller)
+     u32 little endian  batch length, at most LZLOG_BLOCK_MAX
+     payload
+
+   Matches reach back at least LZLOG_WINDOW bytes into the batches before
+   (up to the whole 48 KB window between slides), which is where a log's
+   repetition is, so small batches compress nearly as well as big ones.
+   Both ends keep that history in a struct LzlogStream, so frames have to
+   be decoded in order and a new connection starts a new stream
+   (lzlog_reset on both sides).
+
+     struct LzlogStream *z = ...;   // ~57 KB, static or malloc
+     lzlog_reset(z);
+     send(fd, LZLOG_MAGIC, LZLOG_MAGIC_LEN, 0);
+     n = lzlog_compress_frame(z, batch, len, frame);   // LZLOG_BOUND(len)
+     send(fd, frame, n, 0);
+
+   and on the host
+
+     n = lzlog_frame_header(buf, avail, &payload_len, &raw_len, &stored);
+     text = lzlog_decompress_frame(z, buf + n, payload_len, raw_len, stored);
+*/
+
+#define LZLOG_MAGIC "LZL1"
+#define LZLOG_MAGIC_LEN 4
+#define LZLOG_WINDOW 16384
+#define LZLOG_BLOCK_MAX 32768 /* the window stays under 64 KB offsets */
+#define LZLOG_HASH_BITS 12
+#define LZLOG_HEADER 8
+#define LZLOG_STORED 0x80000000u
+/* worst case frame for len bytes, literals only */
+#define LZLOG_BOUND(len) (LZLOG_HEADER + (len) + (len) / 255 + 16)
+
+struct LzlogStream {
+    size_t history; /* window bytes in use, the next block goes here */
+    uint16_t hash[1 << LZLOG_HASH_BITS]; /* window position + 1, 0 none */
+    uint8_t window[LZLOG_WINDOW + LZLOG_BLOCK_MAX];
+};
+
+void lzlog_reset(struct LzlogStream *z);
+
+/* One batch (len <= LZLOG_BLOCK_MAX) into a frame at out, which has room
+   for LZLOG_BOUND(len).  Returns the frame length, 0 when len is too big */
+size_t lzlog_compress_frame(struct LzlogStream *z, const void *raw,
+                            size_t len, uint8_t *out);
+
+/* Parse a frame header from avail bytes.  LZLOG_HEADER when it's there,
+   0 need more, -1 not a frame */
+int lzlog_frame_header(const uint8_t *in, size_t avail, size_t *payload_len,
+                       size_t *raw_len, int *stored);
+
+/* Decode a frame's payload.  The batch, inside z's window (good until the
+   next call), or NULL when the payload is corrupt */
+const char *lzlog_decompress_frame(struct LzlogStream *z,
+                                   const uint8_t *payload,
+                                   size_t payload_len, size_t raw_len,
+                                   int stored);
+
+#endif  // LZLOG_H
@@ -0,0 +1,109 @@
+#include "ratelog.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __WIIU__
+#include <coreinit/time.h>
+#endif
+
+/* a line of text, longer ones are cut */
+#define RLOG_LINE_MAX 512
+
+atomic_int rlog_level = RLOG_LEVEL;
+
+/* sites that held something back, pushed on the front, never removed */
+static _Atomic(struct RlogSite *) listed_sites;
+
+/* milliseconds, wrapping.  Only differences matter */
+static uint32_t rlog_ms(void) {
+#ifdef __WIIU__
+    return (uint32_t)OSTicksToMilliseconds(OSGetSystemTime());
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000u + (uint32_t)(ts.tv_nsec / 1000000);
+#endif
+}
+
+static void hold_back(struct RlogSite *site) {
+    atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+    if (!atomic_load_explicit(&site->listed, memory_order_relaxed) &&
+        !atomic_exchange_explicit(&site->listed, 1, memory_order_relaxed)) {
+        struct RlogSite *head =
+            atomic_load_explicit(&listed_sites, memory_order_relaxed);
+        do {
+            site->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(
+            &listed_sites, &head, site, memory_order_release,
+            memory_order_relaxed));
+    }
+}
+
+int rlog_allow(struct RlogSite *site) {
+    /* GCRA: tat is when the bucket would be empty again.  A message may go
+       if that's no more than slack_ms ahead of now, and pushes it on by
+       interval_ms.  0 is "never used", so skip it when now wraps to 0. */
+    uint32_t now = rlog_ms() | 1;
+    uint32_t tat = atomic_load_explicit(&site->tat, memory_order_relaxed);
+    for (;;) {
+        uint32_t from = tat == 0 || (int32_t)(now - tat) > 0 ? now : tat;
+        if ((int32_t)(from - now) > (int32_t)site->slack_ms) {
+            hold_back(site);
+            return 0;
+        }
+        uint32_t next = (from + site->interval_ms) | 1;
+        if (atomic_compare_exchange_weak_explicit(&site->tat, &tat, next,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            return 1;
+        }
+    }
+}
+
+static void print_line(int level, const char *text) {
+    FILE *fp = level <= RLOG_WARN ? stderr : stdout;
+    size_t len = strlen(text);
+
+    /* one write for the line, so threads don't split it */
+    if (len > 0 && text[len - 1] == '\n') {
+        fputs(text, fp);
+    } else {
+        fprintf(fp, "%s\n", text);
+    }
+}
+
+static void print_held_back(struct RlogSite *site, int level) {
+    unsigned int n =
+        atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    if (n > 0) {
+        char text[RLOG_LINE_MAX];
+        int len = (int)strcspn(site->fmt, "\n");
+        snprintf(text, sizeof(text), "\"%.*s\" repeated %u times", len,
+                 site->fmt, n);
+        print_line(level, text);
+    }
+}
+
+void rlog_print(struct RlogSite *site, int level, const char *fmt, ...) {
+    char text[RLOG_LINE_MAX];
+    va_list ap;
+
+    if (site != NULL) {
+        print_held_back(site, level);
+    }
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    print_line(level, text);
+}
+
+void rlog_report(void) {
+    struct RlogSite *site =
+        atomic_load_explicit(&listed_sites, memory_order_acquire);
+    for (; site != NULL; site = site->next) {
+        print_held_back(site, RLOG_INFO);
+    }
+}
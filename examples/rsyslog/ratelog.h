@@ -0,0 +1,117 @@
+#ifndef RATELOG_H
+#define RATELOG_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Logging you can leave in a hot loop.  Each call site keeps its own
+   limit, so a per-frame message can't crowd out the rest or eat the frame
+   time, and what was held back is counted and reported.
+
+     RLOG(RLOG_INFO, "opened %s", name);
+     RLOG_RATE(RLOG_DEBUG, 2, 5, "frame %ld", n);    // 2 / s, bursts of 5
+     RLOG_EVERY(RLOG_DEBUG, 1000, "frames=%ld", n);  // 1st, 1001st, ...
+     ...
+     rlog_report();    // held back counts of every site, at teardown
+
+   RLOG_RATE is a token bucket per site (GCRA, one 32 bit atomic, no lock):
+   per_sec messages a second on average, up to burst at once.  The next
+   message a site prints after holding some back is preceded by
+
+     "frame %ld" repeated 4211 times
+
+   Lines go to stdout, RLOG_WARN and RLOG_ERR to stderr, so with
+   init_rsyslogger they end up in syslog like any printf.  A held back
+   message costs a clock read and an atomic, it's never formatted.
+
+   Levels are the syslog severities.  Anything above RLOG_LEVEL (compile
+   time, -DRLOG_LEVEL=RLOG_INFO say) is a constant false if, with -O1 and
+   up the compiler drops the call, its site and the format string.
+   rlog_level filters the rest at run time.
+*/
+
+#define RLOG_ERR 3
+#define RLOG_WARN 4
+#define RLOG_INFO 6
+#define RLOG_DEBUG 7
+
+#ifndef RLOG_LEVEL
+#define RLOG_LEVEL RLOG_DEBUG
+#endif
+
+/* One call site.  interval_ms and slack_ms are the bucket, 0 for the
+   plain and sampled macros. */
+struct RlogSite {
+    const char *fmt;
+    uint32_t interval_ms;
+    uint32_t slack_ms;
+    atomic_uint tat;        /* GCRA theoretical arrival time, 0 never */
+    atomic_uint count;      /* RLOG_EVERY */
+    atomic_uint suppressed; /* held back since the last one printed */
+    atomic_int listed;      /* on the rlog_report list */
+    struct RlogSite *next;
+};
+
+extern atomic_int rlog_level;
+
+/* ms between messages at per_sec a second, 0 for no limit */
+#define RLOG_INTERVAL_MS_(per_sec) \
+    ((per_sec) <= 0      ? 0u      \
+     : (per_sec) >= 1000 ? 1u      \
+                         : (uint32_t)(1000 / (per_sec)))
+
+#define RLOG_SITE_(format, per_sec, burst)                         \
+    {                                                              \
+        .fmt = (format),                                           \
+        .interval_ms = RLOG_INTERVAL_MS_(per_sec),                 \
+        .slack_ms = ((burst) > 1 ? (burst) - 1 : 0) *              \
+                    RLOG_INTERVAL_MS_(per_sec),                    \
+    }
+
+#define RLOG_ON_(level)       \
+    ((level) <= RLOG_LEVEL && \
+     (level) <= atomic_load_explicit(&rlog_level, memory_order_relaxed))
+
+#define RLOG(level, fmt, ...)                                  \
+    do {                                                       \
+        if (RLOG_ON_(level)) {                                 \
+            rlog_print(NULL, (level), fmt, ##__VA_ARGS__);     \
+        }                                                      \
+    } while (0)
+
+#define RLOG_RATE(level, per_sec, burst, fmt, ...)                      \
+    do {                                                                \
+        if (RLOG_ON_(level)) {                                          \
+            static struct RlogSite rlog_site_ =                         \
+                RLOG_SITE_(fmt, per_sec, burst);                        \
+            if (rlog_allow(&rlog_site_)) {                              \
+                rlog_print(&rlog_site_, (level), fmt, ##__VA_ARGS__);   \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+#define RLOG_EVERY(level, n, fmt, ...)                                  \
+    do {                                                                \
+        if (RLOG_ON_(level)) {                                          \
+            static struct RlogSite rlog_site_ = RLOG_SITE_(fmt, 0, 0);  \
+            if (atomic_fetch_add_explicit(&rlog_site_.count, 1,         \
+                                          memory_order_relaxed) %       \
+                    (unsigned)(n) ==                                    \
+                0) {                                                    \
+                rlog_print(NULL, (level), fmt, ##__VA_ARGS__);          \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+/* 1 print this one, 0 it's over the site's rate (and counted) */
+int rlog_allow(struct RlogSite *site);
+
+/* Format and print, with the site's held back count first if it has one */
+void rlog_print(struct RlogSite *site, int level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/* Print the held back counts no later message has reported yet */
+void rlog_report(void);
+
+#endif  // RATELOG_H
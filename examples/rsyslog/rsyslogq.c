@@ -0,0 +1,436 @@
+#include "rsyslogq.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lzlog.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* WiiU, no SIGPIPE to worry about */
+#endif
+
+#define RSYSLOG_BATCH_BYTES 8192
+#define RSYSLOG_IDLE_US 5000 /* ring empty, look again in 5 ms */
+#define RSYSLOG_BACKOFF_MIN_MS 100
+#define RSYSLOG_BACKOFF_MAX_MS 5000
+/* '<14>1 2025-04-28T17:28:38Z WIIU - - - [meta sequenceId="2147483647"] '
+   with a "1472 " length in front, the RFC 3164 header is shorter */
+#define RSYSLOG_HEADER_MAX 80
+
+/* One message (or a piece of a long one).  seq is the ring's handshake:
+   slot i is free for the producer that claimed position p when seq == p,
+   and holds a message for the shipper when seq == p + 1 (a bounded MPMC
+   queue with only one consumer). */
+struct Slot {
+    atomic_uint seq;
+    int priority;
+    uint32_t sequence_id; /* RFC 5424 meta, given out at push */
+    time_t when;
+    unsigned int len;
+    char text[RSYSLOG_SLOT_TEXT];
+};
+
+static struct {
+    struct Slot slots[RSYSLOG_QUEUE_SLOTS];
+    atomic_uint head; /* next position to claim, producers */
+    atomic_uint tail; /* next position to ship, only the shipper moves it */
+    atomic_uint next_id; /* sequence ids, dropped messages leave a gap */
+    atomic_int running;
+    int started;
+    pthread_t thread;
+    atomic_uint server; /* IPv4, network order, 0 until it's known */
+    int port;
+    int transport;
+    size_t batch_max; /* a datagram for UDP */
+    uint64_t deadline_ms; /* stop: give up flushing at this time */
+
+    atomic_uint queued;
+    atomic_uint sent;
+    atomic_uint dropped;
+    atomic_uint batches;
+    atomic_uint reconnects;
+    atomic_uint max_depth;
+    atomic_uint bytes;
+    atomic_uint wire_bytes;
+
+    /* shipper thread only */
+    char batch[RSYSLOG_BATCH_BYTES];
+    size_t batch_len;
+    size_t batch_off; /* already on the wire, of wire for RSYSLOG_TCP_LZ */
+    unsigned int batch_msgs;
+    /* RSYSLOG_TCP_LZ: the batch as a frame, the magic in front when it's
+       the first on a connection.  The batch stays until the frame is all
+       sent, so a new connection can start a new stream with it */
+    uint8_t wire[LZLOG_MAGIC_LEN + LZLOG_BOUND(RSYSLOG_BATCH_BYTES)];
+    size_t wire_len;
+    int new_stream;
+    struct LzlogStream lz;
+} q;
+
+static int stream_transport(int transport) {
+    return transport == RSYSLOG_TCP || transport == RSYSLOG_TCP_LZ;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int push_slot(int priority, time_t when, uint32_t sequence_id,
+                     const char *text, size_t len) {
+    unsigned int pos = atomic_load_explicit(&q.head, memory_order_relaxed);
+    struct Slot *slot;
+
+    for (;;) {
+        slot = &q.slots[pos & (RSYSLOG_QUEUE_SLOTS - 1)];
+        unsigned int seq =
+            atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &q.head, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1; /* full, the shipper hasn't freed this one yet */
+        } else {
+            pos = atomic_load_explicit(&q.head, memory_order_relaxed);
+        }
+    }
+    slot->priority = priority;
+    slot->sequence_id = sequence_id;
+    slot->when = when;
+    slot->len = len;
+    memcpy(slot->text, text, len);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+static void note_depth(void) {
+    unsigned int depth = atomic_load_explicit(&q.head, memory_order_relaxed) -
+                         atomic_load_explicit(&q.tail, memory_order_relaxed);
+    unsigned int max = atomic_load_explicit(&q.max_depth, memory_order_relaxed);
+    while (depth > max && !atomic_compare_exchange_weak_explicit(
+                              &q.max_depth, &max, depth,
+                              memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+int rsyslog_queue_push(int priority, const char *msg, size_t len) {
+    if (!atomic_load_explicit(&q.running, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&q.dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+    while (len > 0 && (msg[len - 1] == '\n' || msg[len - 1] == '\r')) {
+        len--;
+    }
+    time_t when = time(NULL);
+    while (len > 0) {
+        size_t n = len < RSYSLOG_SLOT_TEXT ? len : RSYSLOG_SLOT_TEXT;
+        /* 1 to 2^31 - 1 and around again, like RFC 5424 asks */
+        uint32_t id =
+            atomic_fetch_add_explicit(&q.next_id, 1, memory_order_relaxed);
+        id = id % 2147483647u + 1;
+        if (push_slot(priority, when, id, msg, n) < 0) {
+            atomic_fetch_add_explicit(&q.dropped, 1, memory_order_relaxed);
+            return -1;
+        }
+        atomic_fetch_add_explicit(&q.queued, 1, memory_order_relaxed);
+        msg += n;
+        len -= n;
+    }
+    note_depth();
+    return 0;
+}
+
+/* Header for a slot's message, without the octet count */
+static int format_header(const struct Slot *slot, char *hdr, size_t size) {
+    struct tm tm_info;
+    int n;
+
+    if (stream_transport(q.transport)) {
+        /* RFC 3164 like rsyslog_send_tcp */
+        localtime_r(&slot->when, &tm_info);
+        n = snprintf(hdr, size, "<%d> ", slot->priority);
+        n += strftime(hdr + n, size - n, "%b %d %H:%M:%S WIIU: ", &tm_info);
+        return n;
+    }
+    gmtime_r(&slot->when, &tm_info);
+    n = snprintf(hdr, size, "<%d>1 ", slot->priority);
+    n += strftime(hdr + n, size - n, "%Y-%m-%dT%H:%M:%SZ", &tm_info);
+    n += snprintf(hdr + n, size - n, " WIIU - - - [meta sequenceId=\"%u\"] ",
+                  (unsigned int)slot->sequence_id);
+    return n;
+}
+
+/* Move the oldest queued message into the batch.  Messages are newline
+   terminated, the separator on a persistent TCP connection and in a plain
+   UDP datagram, or "<length> " prefixed for RSYSLOG_UDP_OCTET.
+   1 moved, 0 ring empty, -1 batch full */
+static int pop_into_batch(void) {
+    unsigned int tail = atomic_load_explicit(&q.tail, memory_order_relaxed);
+    struct Slot *slot = &q.slots[tail & (RSYSLOG_QUEUE_SLOTS - 1)];
+    char hdr[RSYSLOG_HEADER_MAX];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+        return 0;
+    }
+    if (q.batch_len + RSYSLOG_HEADER_MAX + slot->len + 1 > q.batch_max) {
+        return -1;
+    }
+    char *p = q.batch + q.batch_len;
+    int hlen = format_header(slot, hdr, sizeof(hdr));
+    int n = 0;
+    if (q.transport == RSYSLOG_UDP_OCTET) {
+        n = sprintf(p, "%u ", (unsigned int)(hlen + slot->len));
+    }
+    memcpy(p + n, hdr, hlen);
+    memcpy(p + n + hlen, slot->text, slot->len);
+    n += hlen + slot->len;
+    if (q.transport != RSYSLOG_UDP_OCTET) {
+        p[n++] = '\n';
+    }
+    q.batch_len += n;
+    q.batch_msgs++;
+
+    atomic_store_explicit(&slot->seq, tail + RSYSLOG_QUEUE_SLOTS,
+                          memory_order_release);
+    atomic_store_explicit(&q.tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+/* For UDP, connect only sets where send() goes */
+static int connect_server(uint32_t server) {
+    int type = stream_transport(q.transport) ? SOCK_STREAM : SOCK_DGRAM;
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(q.port);
+    addr.sin_addr.s_addr = server;
+    int sockfd = socket(AF_INET, type, 0);
+    if (sockfd < 0) {
+        return -1;
+    }
+    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static void sleep_ms(int ms) {
+    if (!atomic_load(&q.running)) {
+        /* stopping, don't sleep past the flush deadline */
+        uint64_t now = now_ms();
+        if (now >= q.deadline_ms) return;
+        if (now + ms > q.deadline_ms) ms = (int)(q.deadline_ms - now);
+    }
+    usleep(ms * 1000);
+}
+
+static void compress_batch(void) {
+    size_t n = 0;
+
+    if (q.new_stream) {
+        lzlog_reset(&q.lz);
+        memcpy(q.wire, LZLOG_MAGIC, LZLOG_MAGIC_LEN);
+        n = LZLOG_MAGIC_LEN;
+        q.new_stream = 0;
+    }
+    q.wire_len = n + lzlog_compress_frame(&q.lz, q.batch, q.batch_len,
+                                          q.wire + n);
+}
+
+static void *shipper_thread(void *arg) {
+    int sockfd = -1;
+    uint32_t connected_to = 0;
+    int connects = 0;
+    int backoff_ms = RSYSLOG_BACKOFF_MIN_MS;
+    int lz = q.transport == RSYSLOG_TCP_LZ;
+
+    (void)arg;
+    for (;;) {
+        int stopping = !atomic_load(&q.running);
+        if (stopping && now_ms() >= q.deadline_ms) {
+            break;
+        }
+        uint32_t server = atomic_load(&q.server);
+        if (server == 0) {
+            /* nowhere to send yet, the ring holds on to the messages */
+            if (stopping) break;
+            usleep(RSYSLOG_IDLE_US);
+            continue;
+        }
+        if (sockfd >= 0 && server != connected_to) {
+            /* moved to another server, the batch goes there */
+            close(sockfd);
+            sockfd = -1;
+            q.batch_off = 0;
+        }
+        /* a compressed frame goes out as it is */
+        while ((!lz || q.wire_len == 0) && pop_into_batch() > 0) {
+        }
+        if (q.batch_len == 0) {
+            if (stopping) break; /* flushed */
+            usleep(RSYSLOG_IDLE_US);
+            continue;
+        }
+
+        if (sockfd < 0) {
+            if ((sockfd = connect_server(server)) < 0) {
+                sleep_ms(backoff_ms);
+                backoff_ms *= 2;
+                if (backoff_ms > RSYSLOG_BACKOFF_MAX_MS) {
+                    backoff_ms = RSYSLOG_BACKOFF_MAX_MS;
+                }
+                continue;
+            }
+            if (connects++ > 0) {
+                atomic_fetch_add(&q.reconnects, 1);
+            }
+            connected_to = server;
+            backoff_ms = RSYSLOG_BACKOFF_MIN_MS;
+            if (lz) {
+                /* the sink threw away any frame cut off with the old
+                   connection, the whole batch goes again */
+                q.new_stream = 1;
+                q.wire_len = q.batch_off = 0;
+            } else {
+                /* the old connection may have stopped mid-line, start the
+                   new one at that line's start, not half a message */
+                while (q.batch_off > 0 && q.batch[q.batch_off - 1] != '\n') {
+                    q.batch_off--;
+                }
+            }
+        }
+        if (lz && q.wire_len == 0) {
+            compress_batch();
+        }
+        const char *out = lz ? (const char *)q.wire : q.batch;
+        size_t out_len = lz ? q.wire_len : q.batch_len;
+
+        /* one send for everything in the batch.  If the connection drops
+           halfway, the rest goes out on the next one, from the line that
+           was cut off */
+        ssize_t n = send(sockfd, out + q.batch_off, out_len - q.batch_off,
+                         MSG_NOSIGNAL);
+        if (n < 0 && !stream_transport(q.transport)) {
+            /* nobody listening (ICMP port unreachable) or no buffer space,
+               the datagram is gone */
+            atomic_fetch_add(&q.dropped, q.batch_msgs);
+            q.batch_len = q.batch_off = 0;
+            q.batch_msgs = 0;
+            continue;
+        }
+        if (n < 0) {
+            if (errno != EINTR) {
+                close(sockfd);
+                sockfd = -1;
+            }
+            continue;
+        }
+        q.batch_off += n;
+        if (q.batch_off == out_len) {
+            atomic_fetch_add(&q.sent, q.batch_msgs);
+            atomic_fetch_add(&q.batches, 1);
+            atomic_fetch_add(&q.bytes, q.batch_len);
+            atomic_fetch_add(&q.wire_bytes, out_len);
+            q.batch_len = q.batch_off = q.wire_len = 0;
+            q.batch_msgs = 0;
+        }
+    }
+
+    if (sockfd >= 0) {
+        close(sockfd);
+    }
+    /* whatever didn't make it before the deadline */
+    unsigned int left = atomic_load(&q.head) - atomic_load(&q.tail);
+    atomic_fetch_add(&q.dropped, left + q.batch_msgs);
+    return NULL;
+}
+
+int rsyslog_queue_start(const char *server_ip, int port) {
+    return rsyslog_queue_start_transport(server_ip, port, RSYSLOG_TCP);
+}
+
+int rsyslog_queue_start_transport(const char *server_ip, int port,
+                                  int transport) {
+    if (q.started) {
+        return -1;
+    }
+    q.transport = transport;
+    q.batch_max = stream_transport(transport) ? sizeof(q.batch)
+                                              : RSYSLOG_UDP_PAYLOAD;
+    q.port = port;
+    atomic_store(&q.server, 0);
+    if (server_ip != NULL && rsyslog_queue_set_server(server_ip) != 0) {
+        return -2;
+    }
+    for (unsigned int i = 0; i < RSYSLOG_QUEUE_SLOTS; i++) {
+        atomic_init(&q.slots[i].seq, i);
+    }
+    atomic_store(&q.head, 0);
+    atomic_store(&q.tail, 0);
+    atomic_store(&q.next_id, 0);
+    atomic_store(&q.queued, 0);
+    atomic_store(&q.sent, 0);
+    atomic_store(&q.dropped, 0);
+    atomic_store(&q.batches, 0);
+    atomic_store(&q.reconnects, 0);
+    atomic_store(&q.max_depth, 0);
+    atomic_store(&q.bytes, 0);
+    atomic_store(&q.wire_bytes, 0);
+    q.batch_len = q.batch_off = q.wire_len = 0;
+    q.batch_msgs = 0;
+    q.deadline_ms = 0;
+    atomic_store(&q.running, 1);
+    if (pthread_create(&q.thread, NULL, shipper_thread, NULL) != 0) {
+        atomic_store(&q.running, 0);
+        return -3;
+    }
+    q.started = 1;
+    return 0;
+}
+
+int rsyslog_queue_set_server(const char *server_ip) {
+    struct in_addr addr;
+
+    if (inet_pton(AF_INET, server_ip, &addr) <= 0 || addr.s_addr == 0) {
+        return -2;
+    }
+    atomic_store(&q.server, addr.s_addr);
+    return 0;
+}
+
+void rsyslog_queue_stop(int flush_ms) {
+    if (!q.started) {
+        return;
+    }
+    q.deadline_ms = now_ms() + (flush_ms > 0 ? flush_ms : 0);
+    atomic_store(&q.running, 0);
+    pthread_join(q.thread, NULL);
+    q.started = 0;
+}
+
+void rsyslog_queue_stats(struct RsyslogQueueStats *stats) {
+    stats->queued = atomic_load(&q.queued);
+    stats->sent = atomic_load(&q.sent);
+    stats->dropped = atomic_load(&q.dropped);
+    stats->batches = atomic_load(&q.batches);
+    stats->reconnects = atomic_load(&q.reconnects);
+    stats->depth = atomic_load(&q.head) - atomic_load(&q.tail);
+    stats->max_depth = atomic_load(&q.max_depth);
+    stats->bytes = atomic_load(&q.bytes);
+    stats->wire_bytes = atomic_load(&q.wire_bytes);
+}
@@ -0,0 +1,82 @@
+#ifndef RSYSLOGQ_H
+#define RSYSLOGQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Asynchronous syslog shipper.  rsyslog_send_tcp connects, sends one
+   message and closes; fine for a test, but stdout goes through it on every
+   write, so every printf in a decode loop paid for a TCP handshake.
+
+   Here callers only copy the message into a lock-free ring (any number of
+   threads, never blocks, drops when full) and one background thread keeps
+   a single connection open, packs whatever is queued into one send, and
+   reconnects with backoff when the server goes away.
+
+     rsyslog_queue_start("192.168.0.67", 9514);
+     rsyslog_queue_push(14, msg, strlen(msg));   // from any thread
+     ...
+     rsyslog_queue_stop(500);                    // flush for up to 500 ms
+
+   rsyslog_queue_start_transport picks UDP instead.  Nothing waits on the
+   server then, and lines are lost rather than late: RFC 5424 messages, each
+   with a [meta sequenceId="N"] so the receiver can count the gaps, packed
+   several to a datagram up to RSYSLOG_UDP_PAYLOAD.  Plain UDP separates
+   them with newlines, RSYSLOG_UDP_OCTET prefixes each with its length
+   (RFC 6587 octet counting) so a message may contain newlines.  Note that
+   rsyslogd's imudp takes a whole datagram as one message.
+
+   RSYSLOG_TCP_LZ is the TCP stream with each batch compressed (lzlog.h),
+   for when verbose logging backs up on the Wi-Fi.  log_sink reads it (it
+   tells from the first bytes), rsyslogd doesn't.
+*/
+
+/* Ring size, a power of 2.  Each slot holds RSYSLOG_SLOT_TEXT bytes, longer
+   messages take several slots and arrive as several lines. */
+#define RSYSLOG_QUEUE_SLOTS 512
+#define RSYSLOG_SLOT_TEXT 240
+
+/* 1500 byte ethernet MTU less the IP and UDP headers */
+#define RSYSLOG_UDP_PAYLOAD 1472
+
+#define RSYSLOG_TCP 0       /* RFC 3164 lines, like rsyslog_send_tcp */
+#define RSYSLOG_UDP 1       /* RFC 5424, newline separated */
+#define RSYSLOG_UDP_OCTET 2 /* RFC 5424, octet counted */
+#define RSYSLOG_TCP_LZ 3    /* RFC 3164 lines, lzlog frames, for log_sink */
+
+struct RsyslogQueueStats {
+    uint32_t queued;     /* messages pushed */
+    uint32_t sent;       /* messages written to the socket */
+    uint32_t dropped;    /* ring full, stopped, or a failed UDP send */
+    uint32_t batches;    /* send() calls (datagrams) that carried messages */
+    uint32_t reconnects; /* connections made after the first */
+    uint32_t depth;      /* in the ring right now */
+    uint32_t max_depth;
+    uint32_t bytes;      /* batches sent, before compression */
+    uint32_t wire_bytes; /* the same on the wire */
+};
+
+/* Start the shipper thread, over TCP.  server_ip can be NULL when it isn't
+   known yet, messages wait in the ring until rsyslog_queue_set_server.
+   0 ok, <0 bad address / no thread */
+int rsyslog_queue_start(const char *server_ip, int port);
+
+/* Same, transport is one of RSYSLOG_TCP, RSYSLOG_UDP, RSYSLOG_UDP_OCTET,
+   RSYSLOG_TCP_LZ */
+int rsyslog_queue_start_transport(const char *server_ip, int port,
+                                  int transport);
+
+/* Where to send from now on, any thread.  The first call lets whatever
+   queued up go out.  0 ok, -2 bad address */
+int rsyslog_queue_set_server(const char *server_ip);
+
+/* Queue one message (no trailing newline needed).  Never blocks.
+   0 queued, -1 dropped */
+int rsyslog_queue_push(int priority, const char *msg, size_t len);
+
+/* Ship what's queued, waiting at most flush_ms, then stop the thread */
+void rsyslog_queue_stop(int flush_ms);
+
+void rsyslog_queue_stats(struct RsyslogQueueStats *stats);
+
+#endif  // RSYSLOGQ_H
@@ -0,0 +1,198 @@
+#include "telemetry.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __WIIU__
+#include <coreinit/time.h>
+#endif
+
+#include "rsyslogq.h"
+
+/* a record line, short enough for one ring slot */
+#define TELEMETRY_LINE (RSYSLOG_SLOT_TEXT - 16)
+
+atomic_uint telemetry_values[TELEMETRY_MAX];
+
+static struct {
+    pthread_mutex_t lock; /* the names, and stop for the wait */
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    int stop;
+    int interval_ms;
+    int count;
+    int schema_sent; /* metrics in the last schema sent */
+    char kind[TELEMETRY_MAX];
+    char name[TELEMETRY_MAX][TELEMETRY_NAME];
+    uint32_t seq;
+    uint32_t start_ms;
+} t = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static uint32_t telemetry_ms(void) {
+#ifdef __WIIU__
+    return (uint32_t)OSTicksToMilliseconds(OSGetSystemTime());
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000u + (uint32_t)(ts.tv_nsec / 1000000);
+#endif
+}
+
+static int add_metric(const char *name, char kind) {
+    int id = -1;
+
+    pthread_mutex_lock(&t.lock);
+    for (int i = 0; i < t.count; i++) {
+        if (strncmp(t.name[i], name, TELEMETRY_NAME - 1) == 0) {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0 && t.count < TELEMETRY_MAX) {
+        id = t.count;
+        t.kind[id] = kind;
+        snprintf(t.name[id], TELEMETRY_NAME, "%s", name);
+        /* one word on the wire */
+        for (char *p = t.name[id]; *p; p++) {
+            if (*p == ' ') *p = '_';
+        }
+        atomic_store_explicit(&telemetry_values[id], 0, memory_order_relaxed);
+        t.count++;
+    }
+    pthread_mutex_unlock(&t.lock);
+    return id;
+}
+
+int telemetry_counter(const char *name) { return add_metric(name, 'c'); }
+
+int telemetry_gauge(const char *name) { return add_metric(name, 'g'); }
+
+static void push_line(const char *line, int len) {
+    rsyslog_queue_push(TELEMETRY_PRIORITY, line, len);
+}
+
+static void send_schema(int count) {
+    char line[TELEMETRY_LINE];
+
+    for (int i = 0; i < count; i++) {
+        int len = snprintf(line, sizeof(line), "@tm s %d %c %s", i,
+                           t.kind[i], t.name[i]);
+        push_line(line, len);
+    }
+}
+
+static void sample(int count) {
+    char line[TELEMETRY_LINE];
+    uint32_t ms = telemetry_ms() - t.start_ms;
+    int first = 0;
+
+    t.seq++;
+    while (first < count) {
+        int len = snprintf(line, sizeof(line), "@tm d %u %u %d",
+                           (unsigned int)t.seq, (unsigned int)ms, first);
+        int i = first;
+        /* a value is 11 characters at most, with the space */
+        for (; i < count && len + 12 < (int)sizeof(line); i++) {
+            uint32_t v = atomic_load_explicit(&telemetry_values[i],
+                                              memory_order_relaxed);
+            if (t.kind[i] == 'g') {
+                len += snprintf(line + len, sizeof(line) - len, " %d",
+                                (int)(int32_t)v);
+            } else {
+                len += snprintf(line + len, sizeof(line) - len, " %u",
+                                (unsigned int)v);
+            }
+        }
+        push_line(line, len);
+        first = i;
+    }
+}
+
+/* 1 when it's time to stop, waits until the absolute time due */
+static int wait_until(const struct timespec *due) {
+    pthread_mutex_lock(&t.lock);
+    while (!t.stop &&
+           pthread_cond_timedwait(&t.wake, &t.lock, due) == 0) {
+    }
+    int stop = t.stop;
+    pthread_mutex_unlock(&t.lock);
+    return stop;
+}
+
+static void *sampler_thread(void *arg) {
+    struct timespec due;
+    uint32_t schema_ms = 0;
+    int stop = 0;
+
+    (void)arg;
+    clock_gettime(CLOCK_REALTIME, &due);
+    while (!stop) {
+        pthread_mutex_lock(&t.lock);
+        int count = t.count;
+        pthread_mutex_unlock(&t.lock);
+
+        uint32_t now = telemetry_ms();
+        if (count != t.schema_sent ||
+            now - schema_ms >= TELEMETRY_SCHEMA_S * 1000u) {
+            send_schema(count);
+            t.schema_sent = count;
+            schema_ms = now;
+        }
+        sample(count);
+
+        /* a fixed rate, a late sample doesn't push the rest back.  After
+           a long stall (the app in the background) start over from now
+           rather than catch up */
+        struct timespec now_ts;
+        clock_gettime(CLOCK_REALTIME, &now_ts);
+        if (now_ts.tv_sec > due.tv_sec + 1) {
+            due = now_ts;
+        }
+        due.tv_nsec += (long)t.interval_ms * 1000000;
+        while (due.tv_nsec >= 1000000000) {
+            due.tv_sec++;
+            due.tv_nsec -= 1000000000;
+        }
+        stop = wait_until(&due);
+    }
+    /* the last values, so the totals add up */
+    pthread_mutex_lock(&t.lock);
+    int count = t.count;
+    pthread_mutex_unlock(&t.lock);
+    sample(count);
+    return NULL;
+}
+
+int telemetry_start(int hz) {
+    if (t.running || hz <= 0) {
+        return -1;
+    }
+    t.interval_ms = hz >= 1000 ? 1 : 1000 / hz;
+    t.stop = 0;
+    t.seq = 0;
+    t.schema_sent = -1;
+    t.start_ms = telemetry_ms();
+    if (pthread_create(&t.thread, NULL, sampler_thread, NULL) != 0) {
+        return -1;
+    }
+    t.running = 1;
+    return 0;
+}
+
+void telemetry_stop(void) {
+    if (!t.running) {
+        return;
+    }
+    pthread_mutex_lock(&t.lock);
+    t.stop = 1;
+    pthread_cond_signal(&t.wake);
+    pthread_mutex_unlock(&t.lock);
+    pthread_join(t.thread, NULL);
+    t.running = 0;
+}
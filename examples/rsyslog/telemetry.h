@@ -0,0 +1,71 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Counters and gauges for the players, sampled by a background thread at
+   a fixed rate and sent over the syslog shipper as compact records, so a
+   stutter shows up as numbers next to the log lines.
+
+     static int tm_decoded, tm_vq;
+     tm_decoded = telemetry_counter("decoded");
+     tm_vq = telemetry_gauge("vq_pkts");
+     telemetry_start(4);                        // 4 samples a second
+     ...
+     telemetry_add(tm_decoded, 1);              // any thread, an atomic
+     telemetry_set(tm_vq, is->videoq.nb_packets);
+     ...
+     telemetry_stop();
+
+   Counters only go up, the host turns them into a rate.  Gauges are the
+   last value set.  Both are 32 bit, so scale gauges to whole numbers (ms,
+   percent).  Registering a name again returns the same id, and an id of
+   -1 (table full) is ignored by add and set.
+
+   Records are lines for rsyslog_queue_push, priority TELEMETRY_PRIORITY:
+
+     @tm s <index> <c|g> <name>                 every metric, at the start,
+                                                when one is added, and every
+                                                TELEMETRY_SCHEMA_S
+     @tm d <seq> <ms> <first> <value> ...       a sample, values from index
+                                                <first> on, split over lines
+                                                to fit a ring slot
+
+   ms is the time since telemetry_start, counters are totals, so a lost
+   line (UDP) only costs that sample.  tools/telemetry_view.c reads them
+   back out of the log and shows a rolling table and CSV.
+*/
+
+#define TELEMETRY_MAX 32
+#define TELEMETRY_NAME 24
+#define TELEMETRY_PRIORITY 134 /* local0.info */
+#define TELEMETRY_SCHEMA_S 10
+
+extern atomic_uint telemetry_values[TELEMETRY_MAX];
+
+/* Register, from any thread.  The id, or -1 when the table is full */
+int telemetry_counter(const char *name);
+int telemetry_gauge(const char *name);
+
+static inline void telemetry_add(int id, uint32_t n) {
+    if (id >= 0) {
+        atomic_fetch_add_explicit(&telemetry_values[id], n,
+                                  memory_order_relaxed);
+    }
+}
+
+static inline void telemetry_set(int id, int32_t value) {
+    if (id >= 0) {
+        atomic_store_explicit(&telemetry_values[id], (uint32_t)value,
+                              memory_order_relaxed);
+    }
+}
+
+/* Start the sampler, hz samples a second.  0 ok, -1 running / no thread */
+int telemetry_start(int hz);
+
+/* Take a last sample and stop the sampler */
+void telemetry_stop(void);
+
+#endif  // TELEMETRY_H
@@ -0,0 +1,884 @@
+/* Log sink, a native stand-in for the rsyslogd container plus
+   udp_acknowledge_svc.
+
+   ./log_sink [-p port] [-d dir] [-n] [-q]
+
+     -p  syslog port, TCP and UDP (9514).  Discovery is answered on port+1
+     -d  where the files go (logs)
+     -n  don't answer discovery (udp_acknowledge_svc is running)
+     -q  no status lines, just the summary when it stops
+
+   One thread, one epoll set: the TCP listener, the UDP socket, the
+   discovery socket and every connection.  Per connection, a buffer of
+   what's been read; per UDP datagram, any number of messages.  Both
+   framings are taken on both, a message starting with a digit is octet
+   counted (RFC 6587 "<length> <msg>"), anything else ends at a newline.
+
+   Every client gets a file, dir/<ip>/<start time>-<tcp|udp>-<port>.log,
+   so each device has a directory and each run of the app (the shipper's
+   connection, or its UDP socket) a file.  A TCP file is closed with the
+   connection, a UDP one after SINK_UDP_IDLE_S quiet.  Files are written
+   through stdio with a SINK_FILE_BUF buffer and flushed once a second,
+   so tail -f lags by a second at most.
+
+   Lines are "TIMESTAMP HOSTNAME MSG" for RFC 5424, and the receive time
+   followed by everything after the <PRI> for anything else (RFC 3164
+   "Apr 28 17:28:38 WIIU: ...", or plain text).  Gaps in [meta
+   sequenceId] are counted as lost.  5424 timestamps with a fraction
+   (the load generator's) are timed, now less the timestamp when the line
+   is in the file buffer, for the latency in the summary.
+
+   A connection that starts with LZLOG_MAGIC is the shipper's
+   RSYSLOG_TCP_LZ: lzlog frames, each decoded as it arrives and framed as
+   above.  A bad frame closes the connection.
+
+   SIGINT / SIGTERM closes the files and prints
+     summary: N messages in T s, R msgs/s, latency p50 A us p99 B us ...
+*/
+#define _GNU_SOURCE  // recvmmsg, memmem
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lzlog.h"
+
+#define SINK_PORT 9514
+#define SINK_MAX_SESSIONS 1024
+#define SINK_HASH 2048         /* UDP sources, a power of 2 */
+#define SINK_CONN_BUF 65536    /* per connection, longest frame */
+/* zbuf, the longest lzlog frame, and at least what the first read into
+   buf can bring in behind the magic */
+#define SINK_LZ_FRAME (LZLOG_HEADER + LZLOG_BOUND(LZLOG_BLOCK_MAX))
+#define SINK_LZ_BUF \
+    (SINK_CONN_BUF > SINK_LZ_FRAME ? SINK_CONN_BUF : SINK_LZ_FRAME)
+#define SINK_FILE_BUF 16384    /* stdio buffer per file */
+#define SINK_UDP_BATCH 32      /* datagrams per recvmmsg */
+#define SINK_UDP_MAX 9216      /* longest datagram kept, more is cut */
+#define SINK_UDP_IDLE_S 30
+#define SINK_STATUS_S 10
+
+/* epoll tags below SESSION_TAG, sessions are SESSION_TAG + index */
+#define TAG_LISTEN 0
+#define TAG_UDP 1
+#define TAG_DISCOVER 2
+#define SESSION_TAG 16
+
+/* Latency histogram, microseconds.  Exact below 256, then 128 buckets per
+   power of 2 (under 1% off) */
+#define LAT_LINEAR 256
+#define LAT_BUCKETS (LAT_LINEAR + 34 * 128)
+
+struct Session {
+    int used;
+    int tcp;
+    int fd;           /* the connection, -1 for UDP */
+    uint32_t ip;      /* network order */
+    uint16_t port;    /* network order */
+    int hash_next;    /* UDP chain */
+    FILE *fp;
+    time_t last_active;
+    long messages;
+    uint32_t last_id;
+    int have_id;
+    char *buf;        /* TCP, what's read and not yet framed */
+    size_t kept;
+    size_t skip;      /* TCP, rest of a frame too long to keep */
+    int sniffed;      /* TCP, the first bytes were looked at */
+    struct LzlogStream *lz; /* RSYSLOG_TCP_LZ, and its frames */
+    uint8_t *zbuf;
+    size_t zkept;
+};
+
+static struct {
+    const char *dir;
+    int quiet;
+    int epfd;
+    struct Session sessions[SINK_MAX_SESSIONS];
+    int hash[SINK_HASH];
+    int open_sessions;
+    long total_sessions;
+    long messages;
+    long bytes;
+    long lz_bytes;    /* compressed, as they came in */
+    long lz_errors;
+    long lost;
+    long refused;     /* no free session */
+    long file_errors;
+    double first;     /* monotonic, first and last message */
+    double last;
+    uint32_t latency[LAT_BUCKETS];
+    long timed;
+    long max_latency;
+    long early;       /* timestamp ahead of our clock */
+    time_t now_s;     /* receive time, for the untimed lines */
+    char now_text[32];
+    char minute_key[17];  /* "YYYY-MM-DDTHH:MM" of minute_epoch */
+    time_t minute_epoch;
+} sink = {.dir = "logs"};
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int lat_bucket(uint64_t us) {
+    if (us < LAT_LINEAR) {
+        return (int)us;
+    }
+    int e = 63 - __builtin_clzll(us);
+    int b = LAT_LINEAR + (e - 8) * 128 + (int)((us >> (e - 7)) & 127);
+    return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+static long lat_value(int b) {
+    if (b < LAT_LINEAR) {
+        return b;
+    }
+    int e = (b - LAT_LINEAR) / 128 + 8;
+    return (long)(128 + (b - LAT_LINEAR) % 128) << (e - 7);
+}
+
+static long lat_percentile(double p) {
+    long want = (long)(sink.timed * p);
+    long seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        seen += sink.latency[b];
+        if (seen > want) {
+            return lat_value(b);
+        }
+    }
+    return 0;
+}
+
+/* "2026-10-17T09:12:03.123456Z" to microseconds since 1970, or -1 when
+   there is no fraction.  timegm once a minute */
+static int64_t timestamp_us(const char *ts, size_t len) {
+    if (len < 21 || ts[10] != 'T' || ts[19] != '.') {
+        return -1;
+    }
+    if (memcmp(ts, sink.minute_key, 16) != 0) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (sscanf(ts, "%4d-%2d-%2dT%2d:%2d", &tm.tm_year, &tm.tm_mon,
+                   &tm.tm_mday, &tm.tm_hour, &tm.tm_min) != 5) {
+            return -1;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        sink.minute_epoch = timegm(&tm);
+        memcpy(sink.minute_key, ts, 16);
+    }
+    int64_t us = ((int64_t)sink.minute_epoch + (ts[17] - '0') * 10 +
+                  (ts[18] - '0')) * 1000000;
+    int64_t frac = 0;
+    int digits = 0;
+    size_t i = 20;
+    for (; i < len && isdigit((unsigned char)ts[i]); i++) {
+        if (digits < 6) {
+            frac = frac * 10 + (ts[i] - '0');
+            digits++;
+        }
+    }
+    for (; digits < 6; digits++) {
+        frac *= 10;
+    }
+    us += frac;
+    /* +hh:mm / -hh:mm, Z is UTC already */
+    if (i + 6 <= len && (ts[i] == '+' || ts[i] == '-')) {
+        int64_t off = ((ts[i + 1] - '0') * 10 + (ts[i + 2] - '0')) * 60 +
+                      (ts[i + 4] - '0') * 10 + (ts[i + 5] - '0');
+        us -= (ts[i] == '+' ? 1 : -1) * off * 60 * 1000000;
+    }
+    return us;
+}
+
+static void record_latency(int64_t sent_us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - sent_us;
+    if (us < 0) {
+        sink.early++;
+        us = 0;
+    }
+    sink.latency[lat_bucket((uint64_t)us)]++;
+    if (us > sink.max_latency) {
+        sink.max_latency = us;
+    }
+    sink.timed++;
+}
+
+/* Next space separated field of a 5424 header */
+static const char *field(const char **p, const char *end, size_t *len) {
+    const char *start = *p;
+    const char *sp = memchr(start, ' ', end - start);
+    if (sp == NULL) {
+        return NULL;
+    }
+    *len = sp - start;
+    *p = sp + 1;
+    return start;
+}
+
+/* Skip the structured data ("-" or one or more [...]), the sequence id
+   is kept if there is one */
+static const char *skip_sd(const char *p, const char *end, long *id) {
+    if (p < end && *p == '-') {
+        return p + 1;
+    }
+    while (p < end && *p == '[') {
+        const char *start = p;
+        int quoted = 0;
+        for (p++; p < end; p++) {
+            if (*p == '\\') {
+                p++;
+            } else if (*p == '"') {
+                quoted = !quoted;
+            } else if (*p == ']' && !quoted) {
+                break;
+            }
+        }
+        const char *sid = memmem(start, p - start, "sequenceId=\"", 12);
+        if (sid != NULL) {
+            *id = strtol(sid + 12, NULL, 10);
+        }
+        if (p < end) {
+            p++;
+        }
+    }
+    return p;
+}
+
+static void count_id(struct Session *s, long id) {
+    if (id < 0) {
+        return;
+    }
+    if (s->have_id && (uint32_t)id > s->last_id + 1) {
+        sink.lost += (uint32_t)id - s->last_id - 1;
+    }
+    if (!s->have_id || (uint32_t)id > s->last_id) {
+        s->last_id = (uint32_t)id;
+    }
+    s->have_id = 1;
+}
+
+static void receive_time(void) {
+    time_t t = time(NULL);
+    if (t != sink.now_s) {
+        struct tm tm;
+        sink.now_s = t;
+        localtime_r(&t, &tm);
+        strftime(sink.now_text, sizeof(sink.now_text), "%Y-%m-%dT%H:%M:%S%z",
+                 &tm);
+    }
+}
+
+/* One message, into the session's file */
+static void ingest(struct Session *s, const char *m, size_t len) {
+    const char *end = m + len;
+    const char *p = m;
+
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == 0)) {
+        end--;
+    }
+    if (end == p) {
+        return;
+    }
+    if (*p == '<') {
+        const char *gt = memchr(p, '>', end - p < 6 ? end - p : 6);
+        if (gt != NULL) {
+            p = gt + 1;
+        }
+    }
+    sink.messages++;
+    sink.bytes += len;
+    s->messages++;
+    s->last_active = sink.now_s;
+    sink.last = now_sec();
+    if (sink.first == 0) {
+        sink.first = sink.last;
+    }
+
+    if (end - p > 2 && p[0] == '1' && p[1] == ' ') {
+        /* RFC 5424: VERSION TIMESTAMP HOSTNAME APP PROCID MSGID SD MSG */
+        const char *q = p + 2;
+        size_t ts_len, host_len, skip_len;
+        const char *ts = field(&q, end, &ts_len);
+        const char *host = ts ? field(&q, end, &host_len) : NULL;
+        int ok = host != NULL;
+        for (int i = 0; ok && i < 3; i++) {
+            ok = field(&q, end, &skip_len) != NULL;
+        }
+        if (ok) {
+            long id = -1;
+            q = skip_sd(q, end, &id);
+            if (q < end && *q == ' ') {
+                q++;
+            }
+            count_id(s, id);
+            if (s->fp != NULL) {
+                fprintf(s->fp, "%.*s %.*s %.*s\n", (int)ts_len, ts,
+                        (int)host_len, host, (int)(end - q), q);
+            }
+            int64_t sent = timestamp_us(ts, ts_len);
+            if (sent >= 0) {
+                record_latency(sent);
+            }
+            return;
+        }
+    }
+    if (*p == ' ') {
+        p++;
+    }
+    if (s->fp != NULL) {
+        fprintf(s->fp, "%s %.*s\n", sink.now_text, (int)(end - p), p);
+    }
+}
+
+/* Messages in a datagram, octet counted or newline separated */
+static void ingest_datagram(struct Session *s, const char *buf, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n;
+        if (isdigit((unsigned char)buf[pos])) {
+            char *sp;
+            n = strtoul(buf + pos, &sp, 10);
+            if (sp >= buf + len || *sp != ' ') {
+                n = len - pos;  /* not a count after all */
+            } else {
+                pos = sp - buf + 1;
+                if (n > len - pos) n = len - pos;
+            }
+            ingest(s, buf + pos, n);
+            pos += n;
+        } else {
+            const char *nl = memchr(buf + pos, '\n', len - pos);
+            n = nl ? (size_t)(nl - (buf + pos)) : len - pos;
+            ingest(s, buf + pos, n);
+            pos += n + 1;
+        }
+    }
+}
+
+/* Whole frames out of a connection's buffer, the rest stays */
+static void ingest_stream(struct Session *s) {
+    char *buf = s->buf;
+    size_t len = s->kept;
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (isdigit((unsigned char)buf[pos])) {
+            const char *sp = memchr(buf + pos, ' ', len - pos);
+            if (sp == NULL) {
+                if (len - pos > 10) {
+                    pos = len;  /* digits and no space, junk */
+                }
+                break;
+            }
+            size_t n = strtoul(buf + pos, NULL, 10);
+            size_t start = sp - buf + 1;
+            if (n > len - start) {
+                if (pos > 0 || len < SINK_CONN_BUF) {
+                    break;  /* more to come */
+                }
+                /* longer than the buffer, keep what fits */
+                ingest(s, buf + start, len - start);
+                s->skip = n - (len - start);
+                pos = len;
+                break;
+            }
+            ingest(s, buf + start, n);
+            pos = start + n;
+        } else {
+            const char *nl = memchr(buf + pos, '\n', len - pos);
+            if (nl == NULL) {
+                if (pos == 0 && len == SINK_CONN_BUF) {
+                    ingest(s, buf, len);  /* a line too long, cut it */
+                    pos = len;
+                }
+                break;
+            }
+            ingest(s, buf + pos, nl - (buf + pos));
+            pos = nl - buf + 1;
+        }
+    }
+    s->kept = len - pos;
+    memmove(buf, buf + pos, s->kept);
+}
+
+static uint32_t hash_of(uint32_t ip, uint16_t port) {
+    uint32_t h = (ip ^ ((uint32_t)port << 16) ^ port) * 2654435761u;
+    return h >> 21 & (SINK_HASH - 1);
+}
+
+static struct Session *open_session(int tcp, int fd,
+                                    const struct sockaddr_in *from) {
+    char ip[INET_ADDRSTRLEN];
+    char path[512];
+    char when[32];
+    struct tm tm;
+    int i;
+
+    for (i = 0; i < SINK_MAX_SESSIONS && sink.sessions[i].used; i++) {
+    }
+    if (i == SINK_MAX_SESSIONS) {
+        sink.refused++;
+        return NULL;
+    }
+    struct Session *s = &sink.sessions[i];
+    memset(s, 0, sizeof(*s));
+    s->used = 1;
+    s->tcp = tcp;
+    s->fd = fd;
+    s->ip = from->sin_addr.s_addr;
+    s->port = from->sin_port;
+    s->hash_next = -1;
+    s->last_active = sink.now_s;
+    if (tcp && (s->buf = malloc(SINK_CONN_BUF)) == NULL) {
+        s->used = 0;
+        sink.refused++;
+        return NULL;
+    }
+
+    inet_ntop(AF_INET, &from->sin_addr, ip, sizeof(ip));
+    snprintf(path, sizeof(path), "%s/%s", sink.dir, ip);
+    mkdir(path, 0755);
+    localtime_r(&sink.now_s, &tm);
+    strftime(when, sizeof(when), "%Y%m%d-%H%M%S", &tm);
+    snprintf(path, sizeof(path), "%s/%s/%s-%s-%u.log", sink.dir, ip, when,
+             tcp ? "tcp" : "udp", ntohs(from->sin_port));
+    s->fp = fopen(path, "a");
+    if (s->fp == NULL) {
+        sink.file_errors++;
+        if (sink.file_errors == 1) {
+            perror(path);
+        }
+    } else {
+        setvbuf(s->fp, NULL, _IOFBF, SINK_FILE_BUF);
+    }
+    if (!tcp) {
+        uint32_t h = hash_of(s->ip, s->port);
+        s->hash_next = sink.hash[h];
+        sink.hash[h] = i;
+    }
+    sink.open_sessions++;
+    sink.total_sessions++;
+    if (!sink.quiet) {
+        printf("%s open  %s\n", sink.now_text, path);
+    }
+    return s;
+}
+
+static void close_session(struct Session *s) {
+    int index = (int)(s - sink.sessions);
+    char ip[INET_ADDRSTRLEN];
+
+    if (!s->tcp) {
+        int *link = &sink.hash[hash_of(s->ip, s->port)];
+        while (*link != index) {
+            link = &sink.sessions[*link].hash_next;
+        }
+        *link = s->hash_next;
+    } else {
+        close(s->fd);  /* leaves the epoll set too */
+        free(s->buf);
+        free(s->lz);
+        free(s->zbuf);
+    }
+    if (s->fp != NULL) {
+        fclose(s->fp);
+    }
+    if (!sink.quiet) {
+        inet_ntop(AF_INET, &s->ip, ip, sizeof(ip));
+        printf("%s close %s %s:%u, %ld messages\n", sink.now_text,
+               s->tcp ? "tcp" : "udp", ip, ntohs(s->port), s->messages);
+    }
+    s->used = 0;
+    sink.open_sessions--;
+}
+
+static struct Session *udp_session(const struct sockaddr_in *from) {
+    int i = sink.hash[hash_of(from->sin_addr.s_addr, from->sin_port)];
+    for (; i >= 0; i = sink.sessions[i].hash_next) {
+        struct Session *s = &sink.sessions[i];
+        if (s->ip == from->sin_addr.s_addr && s->port == from->sin_port) {
+            return s;
+        }
+    }
+    return open_session(0, -1, from);
+}
+
+static void accept_clients(int listen_fd) {
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int fd = accept4(listen_fd, (struct sockaddr *)&from, &from_len,
+                         SOCK_NONBLOCK);
+        if (fd < 0) {
+            return;  /* EAGAIN, all taken */
+        }
+        struct Session *s = open_session(1, fd, &from);
+        if (s == NULL) {
+            close(fd);
+            continue;
+        }
+        struct epoll_event ev = {.events = EPOLLIN};
+        ev.data.u64 = SESSION_TAG + (s - sink.sessions);
+        epoll_ctl(sink.epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+/* got bytes just added at s->buf + s->kept */
+static void add_stream(struct Session *s, size_t got) {
+    if (s->skip > 0) {
+        size_t drop = got < s->skip ? got : s->skip;
+        s->skip -= drop;
+        got -= drop;
+        memmove(s->buf + s->kept, s->buf + s->kept + drop, got);
+    }
+    s->kept += got;
+    ingest_stream(s);
+}
+
+/* Decoded text, a buffer full at a time */
+static void add_text(struct Session *s, const char *text, size_t len) {
+    while (len > 0) {
+        size_t n = SINK_CONN_BUF - s->kept;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s->buf + s->kept, text, n);
+        add_stream(s, n);
+        text += n;
+        len -= n;
+    }
+}
+
+/* Every whole frame in zbuf.  0 ok, -1 the stream is bad, -2 a frame
+   header says *frame_len bytes, more than zbuf holds */
+static int decode_frames(struct Session *s, size_t *frame_len) {
+    size_t pos = 0;
+
+    for (;;) {
+        size_t payload_len, raw_len;
+        int stored;
+        int h = lzlog_frame_header(s->zbuf + pos, s->zkept - pos,
+                                   &payload_len, &raw_len, &stored);
+        if (h > 0 && h + payload_len > SINK_LZ_BUF) {
+            /* would never fit, recv would get 0 bytes and look like EOF */
+            *frame_len = h + payload_len;
+            return -2;
+        }
+        if (h == 0 || (h > 0 && s->zkept - pos - h < payload_len)) {
+            break;
+        }
+        const char *text =
+            h < 0 ? NULL
+                  : lzlog_decompress_frame(s->lz, s->zbuf + pos + h,
+                                           payload_len, raw_len, stored);
+        if (text == NULL) {
+            return -1;
+        }
+        add_text(s, text, raw_len);
+        pos += h + payload_len;
+    }
+    s->zkept -= pos;
+    memmove(s->zbuf, s->zbuf + pos, s->zkept);
+    return 0;
+}
+
+/* The first bytes of a connection.  An lzlog stream moves what came after
+   the magic to zbuf.  0 go on, 1 wait for more, -1 no memory */
+static int sniff(struct Session *s) {
+    size_t n = s->kept < LZLOG_MAGIC_LEN ? s->kept : LZLOG_MAGIC_LEN;
+
+    if (memcmp(s->buf, LZLOG_MAGIC, n) != 0) {
+        s->sniffed = 1;  /* plain text */
+        return 0;
+    }
+    if (n < LZLOG_MAGIC_LEN) {
+        return 1;
+    }
+    s->sniffed = 1;
+    s->lz = malloc(sizeof(*s->lz));
+    s->zbuf = malloc(SINK_LZ_BUF);
+    if (s->lz == NULL || s->zbuf == NULL) {
+        return -1;
+    }
+    lzlog_reset(s->lz);
+    s->zkept = s->kept - LZLOG_MAGIC_LEN;
+    memcpy(s->zbuf, s->buf + LZLOG_MAGIC_LEN, s->zkept);
+    sink.lz_bytes += s->kept;
+    s->kept = 0;
+    return 0;
+}
+
+static void read_client(struct Session *s) {
+    ssize_t n;
+    if (s->lz != NULL) {
+        n = recv(s->fd, s->zbuf + s->zkept, SINK_LZ_BUF - s->zkept, 0);
+    } else {
+        n = recv(s->fd, s->buf + s->kept, SINK_CONN_BUF - s->kept, 0);
+    }
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            return;
+        }
+        if (s->kept > 0) {
+            ingest(s, s->buf, s->kept);  /* a last line with no newline */
+        }
+        close_session(s);
+        return;
+    }
+    if (s->lz == NULL) {
+        if (s->sniffed) {
+            add_stream(s, n);
+            return;
+        }
+        s->kept += n;
+        int r = sniff(s);
+        if (r > 0) {
+            return;
+        }
+        if (r < 0) {
+            close_session(s);
+            return;
+        }
+        if (s->lz == NULL) {
+            size_t got = s->kept;
+            s->kept = 0;
+            add_stream(s, got);
+            return;
+        }
+    } else {
+        s->zkept += n;
+        sink.lz_bytes += n;
+    }
+    size_t frame_len = 0;
+    int r = decode_frames(s, &frame_len);
+    if (r < 0) {
+        sink.lz_errors++;
+        if (!sink.quiet && r == -2) {
+            printf("%s lzlog frame of %zu bytes, over %d, closing\n",
+                   sink.now_text, frame_len, (int)SINK_LZ_BUF);
+        } else if (!sink.quiet) {
+            printf("%s bad lzlog frame, closing\n", sink.now_text);
+        }
+        close_session(s);
+    }
+}
+
+static void read_datagrams(int fd) {
+    static char bufs[SINK_UDP_BATCH][SINK_UDP_MAX];
+    static struct sockaddr_in from[SINK_UDP_BATCH];
+    struct mmsghdr msgs[SINK_UDP_BATCH];
+    struct iovec iov[SINK_UDP_BATCH];
+
+    for (int i = 0; i < SINK_UDP_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = SINK_UDP_MAX;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+    int n = recvmmsg(fd, msgs, SINK_UDP_BATCH, MSG_DONTWAIT, NULL);
+    for (int i = 0; i < n; i++) {
+        struct Session *s = udp_session(&from[i]);
+        if (s != NULL) {
+            ingest_datagram(s, bufs[i], msgs[i].msg_len);
+        }
+    }
+}
+
+/* Same answer as server_acknowledge, the address is the packet's source */
+static void answer_discovery(int fd) {
+    const char *response =
+        "Hello, Broadcasting Client! My IP is in this packet";
+    char buf[1024];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+
+    while (recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT,
+                    (struct sockaddr *)&from, &from_len) >= 0) {
+        sendto(fd, response, strlen(response), 0, (struct sockaddr *)&from,
+               from_len);
+        if (!sink.quiet) {
+            printf("%s discovery from %s\n", sink.now_text,
+                   inet_ntoa(from.sin_addr));
+        }
+        from_len = sizeof(from);
+    }
+}
+
+static int open_socket(int type, int port, int options) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int rcvbuf = 8 << 20;
+    int fd = socket(AF_INET, type | SOCK_NONBLOCK, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (options) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        (type == SOCK_STREAM && listen(fd, 128) < 0)) {
+        close(fd);
+        return -1;
+    }
+    struct epoll_event ev = {.events = EPOLLIN};
+    ev.data.u64 = type == SOCK_STREAM ? TAG_LISTEN
+                  : options           ? TAG_UDP
+                                      : TAG_DISCOVER;
+    epoll_ctl(sink.epfd, EPOLL_CTL_ADD, fd, &ev);
+    return fd;
+}
+
+/* Once a second: flush, close quiet UDP sources, maybe a status line */
+static void housekeeping(long *status_messages, time_t *status_at) {
+    for (int i = 0; i < SINK_MAX_SESSIONS; i++) {
+        struct Session *s = &sink.sessions[i];
+        if (!s->used) {
+            continue;
+        }
+        if (!s->tcp && sink.now_s - s->last_active >= SINK_UDP_IDLE_S) {
+            close_session(s);
+        } else if (s->fp != NULL) {
+            fflush(s->fp);
+        }
+    }
+    if (sink.now_s - *status_at >= SINK_STATUS_S) {
+        if (!sink.quiet && sink.messages != *status_messages) {
+            printf("%s %.0f msgs/s, %d open, lost %ld\n", sink.now_text,
+                   (double)(sink.messages - *status_messages) /
+                       (sink.now_s - *status_at),
+                   sink.open_sessions, sink.lost);
+        }
+        *status_messages = sink.messages;
+        *status_at = sink.now_s;
+    }
+    fflush(stdout);
+}
+
+static void summary(void) {
+    double span = sink.last - sink.first;
+    printf("summary: %ld messages in %.2f s, %.0f msgs/s, latency p50 %ld us "
+           "p99 %ld us max %ld us (%ld timed), lost %ld, sessions %ld, "
+           "%.1f MB\n",
+           sink.messages, span,
+           span > 0 ? sink.messages / span : (double)sink.messages,
+           lat_percentile(0.50), lat_percentile(0.99), sink.max_latency,
+           sink.timed, sink.lost, sink.total_sessions, sink.bytes / 1e6);
+    if (sink.lz_bytes > 0) {
+        printf("compressed: %.1f MB in, %ld bad streams\n",
+               sink.lz_bytes / 1e6, sink.lz_errors);
+    }
+    if (sink.refused || sink.file_errors || sink.early) {
+        printf("refused %ld sessions, %ld files failed, %ld timestamps "
+               "ahead of this clock\n",
+               sink.refused, sink.file_errors, sink.early);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    struct epoll_event events[64];
+    int port = SINK_PORT;
+    int discovery = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:d:nq")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'd': sink.dir = optarg; break;
+            case 'n': discovery = 0; break;
+            case 'q': sink.quiet = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-d dir] [-n] [-q]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;  /* no SA_RESTART, epoll_wait returns */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(sink.hash, -1, sizeof(sink.hash));
+    mkdir(sink.dir, 0755);
+    sink.epfd = epoll_create1(0);
+    int listen_fd = open_socket(SOCK_STREAM, port, 0);
+    int udp_fd = open_socket(SOCK_DGRAM, port, 1);
+    int discover_fd = discovery ? open_socket(SOCK_DGRAM, port + 1, 0) : -2;
+    if (listen_fd < 0 || udp_fd < 0 || discover_fd == -1) {
+        perror("log_sink: bind");
+        return 1;
+    }
+    receive_time();
+    printf("listening on %d tcp/udp%s, writing to %s\n", port,
+           discovery ? ", discovery on +1" : "", sink.dir);
+    fflush(stdout);
+
+    long status_messages = 0;
+    time_t status_at = sink.now_s;
+    time_t housekeeping_at = sink.now_s;
+    while (!stopping) {
+        int n = epoll_wait(sink.epfd, events, 64, 1000);
+        receive_time();
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == TAG_LISTEN) {
+                accept_clients(listen_fd);
+            } else if (tag == TAG_UDP) {
+                read_datagrams(udp_fd);
+            } else if (tag == TAG_DISCOVER) {
+                answer_discovery(discover_fd);
+            } else if (sink.sessions[tag - SESSION_TAG].used &&
+                       sink.sessions[tag - SESSION_TAG].tcp) {
+                /* used: not closed earlier in this batch */
+                read_client(&sink.sessions[tag - SESSION_TAG]);
+            }
+        }
+        if (sink.now_s != housekeeping_at) {
+            housekeeping_at = sink.now_s;
+            housekeeping(&status_messages, &status_at);
+        }
+    }
+
+    for (int i = 0; i < SINK_MAX_SESSIONS; i++) {
+        if (sink.sessions[i].used) {
+            close_session(&sink.sessions[i]);
+        }
+    }
+    summary();
+    return 0;
+}
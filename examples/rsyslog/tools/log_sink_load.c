@@ -0,0 +1,263 @@
+/* Load generator for log_sink.
+
+   ./log_sink_load [seconds] [clients]
+
+   Starts ./log_sink as a child on a spare port (pinned to CPU 0, its one
+   core), and for each transport has client threads send RFC 5424
+   messages at it for the given time, packed like the shipper does: TCP
+   writes of up to 16 KB, UDP datagrams of up to 1472 bytes, newline
+   separated or octet counted.
+
+   First flat out, for the rate the sink sustains, then paced at half
+   that, for the latency under load.  Timestamps carry microseconds, the
+   sink times each message from its timestamp to the line being in the
+   file buffer (same host, same clock) and reports p50 / p99.  Flat out
+   over TCP that's mostly the time spent waiting in socket buffers.
+   Lost is sent less received.
+*/
+#define _GNU_SOURCE  // CPU_SET
+#include <arpa/inet.h>
+#include <ftw.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsyslogq.h"
+
+#define TCP_WRITE 16384
+#define MAX_CLIENTS 64
+
+struct Client {
+    int id;
+    int transport;
+    double rate;  /* messages a second, 0 flat out */
+    long sent;
+};
+
+struct Result {
+    long received;
+    double msgs_per_sec;
+    long p50_us;
+    long p99_us;
+};
+
+static const char *names[] = {"tcp", "udp", "udp-octet"};
+static double seconds = 3;
+static int clients = 4;
+static int port;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One message at p, timestamped now.  Returns its length */
+static int format_message(char *p, size_t size, int transport, int client,
+                          long id) {
+    static __thread time_t second;
+    static __thread char date[24];
+    struct timespec ts;
+    char msg[256];
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (ts.tv_sec != second) {
+        struct tm tm;
+        second = ts.tv_sec;
+        gmtime_r(&second, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+    }
+    int len = snprintf(msg, sizeof(msg),
+                       "<14>1 %s.%06ldZ LOADGEN sink-load %d - [meta "
+                       "sequenceId=\"%ld\"] client %d message %ld, some "
+                       "text to make it a typical log line",
+                       date, ts.tv_nsec / 1000, client, id, client, id);
+    if (transport == RSYSLOG_UDP_OCTET) {
+        return snprintf(p, size, "%d %s", len, msg);
+    }
+    return snprintf(p, size, "%s\n", msg);
+}
+
+static void *client(void *arg) {
+    struct Client *c = arg;
+    int udp = c->transport != RSYSLOG_TCP;
+    size_t max = udp ? RSYSLOG_UDP_PAYLOAD : TCP_WRITE;
+    struct sockaddr_in addr;
+    char buf[TCP_WRITE];
+    char msg[320];
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("client connect");
+        close(fd);
+        return NULL;
+    }
+
+    /* paced: every millisecond, send what's due by then */
+    double start = now_sec();
+    double end = start + seconds;
+    long id = 1;
+    for (double t = start; t < end; t = now_sec()) {
+        long due = c->rate > 0 ? (long)((t - start) * c->rate) + 1 : -1;
+        do {
+            size_t len = 0;
+            while (due < 0 || id <= due) {
+                int n = format_message(msg, sizeof(msg), c->transport,
+                                       c->id, id);
+                if (len + n > max) {
+                    break;
+                }
+                memcpy(buf + len, msg, n);
+                len += n;
+                id++;
+            }
+            /* blocking, a full TCP window waits here.  A datagram goes
+               in one send, or not at all */
+            for (size_t off = 0; off < len;) {
+                ssize_t n = send(fd, buf + off, len - off, 0);
+                if (n <= 0 || udp) {
+                    break;
+                }
+                off += n;
+            }
+        } while (id <= due);
+        if (c->rate > 0) {
+            usleep(1000);
+        }
+    }
+    c->sent = id - 1;
+    close(fd);
+    return NULL;
+}
+
+/* Start ./log_sink, wait for its listening line */
+static pid_t start_sink(const char *dir, FILE **out) {
+    int pipe_fds[2];
+    char port_arg[16];
+    char line[256];
+
+    if (pipe(pipe_fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+    pid_t pid = fork();
+    if (pid == 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(0, &cpus);
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        execl("./log_sink", "log_sink", "-q", "-n", "-p", port_arg, "-d",
+              dir, (char *)NULL);
+        perror("./log_sink");
+        _exit(1);
+    }
+    close(pipe_fds[1]);
+    *out = fdopen(pipe_fds[0], "r");
+    if (fgets(line, sizeof(line), *out) == NULL ||
+        strncmp(line, "listening", 9) != 0) {
+        fprintf(stderr, "log_sink didn't start\n");
+        exit(1);
+    }
+    return pid;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static long run(int transport, double total_rate, struct Result *r) {
+    char dir[] = "/tmp/log_sink_load.XXXXXX";
+    struct Client c[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    char line[512];
+    FILE *out;
+    long sent = 0;
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    pid_t pid = start_sink(dir, &out);
+    for (int i = 0; i < clients; i++) {
+        c[i].id = i;
+        c[i].transport = transport;
+        c[i].rate = total_rate / clients;
+        c[i].sent = 0;
+        pthread_create(&threads[i], NULL, client, &c[i]);
+    }
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        sent += c[i].sent;
+    }
+    /* let it drain the socket buffers */
+    usleep(1000000);
+    kill(pid, SIGTERM);
+
+    memset(r, 0, sizeof(*r));
+    while (fgets(line, sizeof(line), out) != NULL) {
+        double span;
+        sscanf(line,
+               "summary: %ld messages in %lf s, %lf msgs/s, latency p50 %ld "
+               "us p99 %ld us",
+               &r->received, &span, &r->msgs_per_sec, &r->p50_us,
+               &r->p99_us);
+    }
+    fclose(out);
+    waitpid(pid, NULL, 0);
+    nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return sent;
+}
+
+static void print_row(int transport, const char *load, long sent,
+                      const struct Result *r) {
+    printf("%-10s %-9s %9ld %9ld %9.0f %7ld %8ld %8ld\n", names[transport],
+           load, sent, r->received, r->msgs_per_sec, sent - r->received,
+           r->p50_us, r->p99_us);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    struct Result r;
+
+    if (argc > 1) seconds = atof(argv[1]);
+    if (argc > 2) clients = atoi(argv[2]);
+    if (clients < 1 || clients > MAX_CLIENTS) {
+        fprintf(stderr, "1 to %d clients\n", MAX_CLIENTS);
+        return 1;
+    }
+    port = 20000 + getpid() % 20000;
+
+    printf("%d clients, %.0f s a run, sink on one core\n", clients, seconds);
+    printf("transport  load           sent  received    msgs/s    lost "
+           "  p50 us   p99 us\n");
+    for (int t = RSYSLOG_TCP; t <= RSYSLOG_UDP_OCTET; t++) {
+        long sent = run(t, 0, &r);
+        print_row(t, "flat out", sent, &r);
+        double half = r.msgs_per_sec / 2;
+        sent = run(t, half, &r);
+        char load[16];
+        snprintf(load, sizeof(load), "%.0fk/s", half / 1000);
+        print_row(t, load, sent, &r);
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+/* Shows the telemetry.c records in a log as a rolling table, and saves
+   them as CSV.
+
+   ./telemetry_view [-c out.csv] [-r rows] [log file]
+
+     tail -F logs/192.168.0.12/2026*.log | ./telemetry_view -c run.csv
+     ./telemetry_view -c run.csv logs/192.168.0.12/20261017-091203-tcp-50122.log
+
+   Reads stdin when there's no file.  Anything with "@tm " in it is a
+   record (log_sink and rsyslogd lines both work), the rest is skipped, so
+   give it one device's log.  Counters show as a rate a second, from the
+   totals in two samples, gauges as they are.  The header is repeated
+   every rows lines (20), and when a metric is added.
+
+   CSV: t_s,seq then a column per metric, a new header line when the
+   metrics change.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+struct Metric {
+    char kind;  /* 'c', 'g', 0 not seen in a schema yet */
+    char name[TELEMETRY_NAME];
+    int width;
+};
+
+static struct Metric metrics[TELEMETRY_MAX];
+static int count;          /* metrics in the schema */
+static int header_count = -1;
+static int csv_count = -1;
+static int rows_per_header = 20;
+static int rows;
+static FILE *csv;
+
+/* The sample being put together, and the one before it for the rates */
+static struct Sample {
+    uint32_t seq;
+    uint32_t ms;
+    int have[TELEMETRY_MAX];
+    uint32_t value[TELEMETRY_MAX];
+} cur, prev;
+static int cur_open;
+static int have_prev;
+static long samples;
+static long lost;
+
+static void print_header(void) {
+    printf("%9s", "t s");
+    for (int i = 0; i < count; i++) {
+        printf(" %*s", metrics[i].width, metrics[i].name);
+    }
+    printf("\n");
+    header_count = count;
+    rows = 0;
+}
+
+static void csv_header(void) {
+    fprintf(csv, "t_s,seq");
+    for (int i = 0; i < count; i++) {
+        fprintf(csv, ",%s", metrics[i].name);
+    }
+    fprintf(csv, "\n");
+    csv_count = count;
+}
+
+/* A counter's rate over the last interval, 0 when there's no interval */
+static int rate(int i, double *out) {
+    if (!have_prev || !prev.have[i] || cur.ms == prev.ms) {
+        return 0;
+    }
+    *out = (uint32_t)(cur.value[i] - prev.value[i]) * 1000.0 /
+           (uint32_t)(cur.ms - prev.ms);
+    return 1;
+}
+
+static void emit(void) {
+    char text[32];
+
+    if (!cur_open) {
+        return;
+    }
+    if (header_count != count || rows == rows_per_header) {
+        print_header();
+    }
+    if (csv != NULL && csv_count != count) {
+        csv_header();
+    }
+    printf("%9.2f", cur.ms / 1000.0);
+    if (csv != NULL) {
+        fprintf(csv, "%.3f,%u", cur.ms / 1000.0, (unsigned int)cur.seq);
+    }
+    for (int i = 0; i < count; i++) {
+        double r;
+        text[0] = '\0';
+        if (!cur.have[i]) {
+            /* its line was lost */
+        } else if (metrics[i].kind == 'c') {
+            if (rate(i, &r)) {
+                snprintf(text, sizeof(text), r < 100 ? "%.1f" : "%.0f", r);
+            }
+        } else {
+            snprintf(text, sizeof(text), "%d", (int)(int32_t)cur.value[i]);
+        }
+        printf(" %*s", metrics[i].width, text[0] ? text : "-");
+        if (csv != NULL) {
+            fprintf(csv, ",%s", text);
+        }
+    }
+    printf("\n");
+    if (csv != NULL) {
+        fprintf(csv, "\n");
+    }
+    fflush(stdout);
+    rows++;
+    samples++;
+    prev = cur;
+    have_prev = 1;
+    cur_open = 0;
+}
+
+static void schema(const char *p) {
+    int index;
+    char kind;
+    char name[TELEMETRY_NAME];
+
+    if (sscanf(p, "%d %c %23s", &index, &kind, name) != 3 || index < 0 ||
+        index >= TELEMETRY_MAX) {
+        return;
+    }
+    struct Metric *m = &metrics[index];
+    if (m->kind != kind || strcmp(m->name, name) != 0) {
+        m->kind = kind;
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        m->width = strlen(name) > 8 ? (int)strlen(name) : 8;
+        header_count = -1;
+    }
+    if (index >= count) {
+        count = index + 1;
+    }
+}
+
+static void data(char *p) {
+    unsigned int seq, ms;
+    int first, n;
+
+    if (sscanf(p, "%u %u %d%n", &seq, &ms, &first, &n) != 3 || first < 0) {
+        return;
+    }
+    if (cur_open && seq != cur.seq) {
+        emit();  /* the rest of that sample was lost */
+    }
+    if (!cur_open) {
+        if (have_prev && seq <= prev.seq) {
+            have_prev = 0;  /* the app started over */
+        }
+        if (have_prev && seq > prev.seq + 1) {
+            lost += seq - prev.seq - 1;
+        }
+        memset(&cur, 0, sizeof(cur));
+        cur.seq = seq;
+        cur.ms = ms;
+        cur_open = 1;
+    }
+    p += n;
+    int i = first;
+    for (; i < TELEMETRY_MAX; i++) {
+        char *end;
+        long long v = strtoll(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        cur.value[i] = (uint32_t)v;
+        cur.have[i] = 1;
+        p = end;
+    }
+    /* each metric is in, no need to wait for the next sample */
+    if (count > 0 && i >= count) {
+        emit();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    char line[4096];
+    FILE *in = stdin;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:")) != -1) {
+        switch (opt) {
+            case 'c':
+                csv = fopen(optarg, "w");
+                if (csv == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'r': rows_per_header = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-c out.csv] [-r rows] [log]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *p = strstr(line, "@tm ");
+        if (p == NULL) {
+            continue;
+        }
+        if (p[4] == 's' && p[5] == ' ') {
+            schema(p + 6);
+        } else if (p[4] == 'd' && p[5] == ' ') {
+            data(p + 6);
+        }
+    }
+    emit();
+    if (csv != NULL) {
+        fclose(csv);
+    }
+    fprintf(stderr, "%ld samples, %ld lost\n", samples, lost);
+    return 0;
+}
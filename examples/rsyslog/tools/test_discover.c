@@ -0,0 +1,150 @@
+/* Discovery in the background while the app logs from the start.
+
+   ./test_discover [ack delay ms]
+
+   Starts the shipper with no server and discovery on a test port, logs
+   right away, and brings up server_acknowledge (the udp_acknowledge_svc
+   code) after a delay.  Twice: once with no cache file, found by
+   broadcast, and once with the file the first run wrote, found by the
+   unicast probe.  Every line, the ones from before the server was found
+   too, has to reach the receiver.  Broadcasts need an interface that
+   loops them back to the local service (most do).
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "announce.h"
+#include "discover.h"
+#include "rsyslogq.h"
+
+#define ACK_PORT 19515
+#define LINES 200
+#define CACHE_PATH "test_discover_cache.txt"
+
+static int ack_delay_ms = 1500;
+static atomic_int found_yet;
+static double found_at;
+static char found_ip[INET_ADDRSTRLEN];
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *ack_service(void *arg) {
+    (void)arg;
+    usleep(ack_delay_ms * 1000);
+    server_acknowledge(ACK_PORT); /* never returns */
+    return NULL;
+}
+
+static void found(const char *ip) {
+    found_at = now_sec();
+    snprintf(found_ip, sizeof(found_ip), "%s", ip);
+    /* the test server is local, whatever address answered */
+    rsyslog_queue_set_server("127.0.0.1");
+    atomic_store(&found_yet, 1);
+}
+
+/* Counts lines until the connection is quiet for a second */
+static void *receiver(void *arg) {
+    int listen_fd = (int)(long)arg;
+    static char buf[65536];
+    long lines = 0;
+
+    /* no connection at all when discovery failed */
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, ack_delay_ms + 10000) <= 0) {
+        return (void *)0L;
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    pfd.fd = fd;
+    while (poll(&pfd, 1, 1000) > 0) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++) {
+            lines += buf[i] == '\n';
+        }
+    }
+    close(fd);
+    return (void *)lines;
+}
+
+static int run(const char *name) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    struct RsyslogQueueStats stats;
+    pthread_t rx;
+    char msg[64];
+    void *received;
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    pthread_create(&rx, NULL, receiver, (void *)(long)listen_fd);
+
+    found_at = 0;
+    atomic_store(&found_yet, 0);
+    double t0 = now_sec();
+    rsyslog_queue_start(NULL, ntohs(addr.sin_port));
+    discover_start(ACK_PORT, CACHE_PATH, found);
+    double startup = now_sec() - t0;
+
+    /* a line every 10 ms, then give discovery the time it needs */
+    for (int i = 0; i < LINES; i++) {
+        int len = snprintf(msg, sizeof(msg), "%s line %d", name, i);
+        rsyslog_queue_push(14, msg, len);
+        usleep(10000);
+    }
+    while (!atomic_load(&found_yet) &&
+           now_sec() - t0 < ack_delay_ms / 1e3 + 10) {
+        usleep(10000);
+    }
+    discover_stop();
+    rsyslog_queue_stop(2000);
+    rsyslog_queue_stats(&stats);
+    pthread_join(rx, &received);
+    close(listen_fd);
+
+    fprintf(stderr,
+            "%-9s startup %.3f ms, found %s after %.2f s, sent %u of %d, "
+            "received %ld\n",
+            name, startup * 1e3, found_at ? found_ip : "nothing",
+            found_at ? found_at - t0 : 0.0, stats.sent, LINES,
+            (long)received);
+    return found_at > 0 && (long)received == LINES ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t ack;
+
+    if (argc > 1) ack_delay_ms = atoi(argv[1]);
+    /* the service prints every request, results go to stderr */
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+    remove(CACHE_PATH);
+    pthread_create(&ack, NULL, ack_service, NULL);
+
+    /* the service stays up, so the second run finds it at once */
+    int failed = run("broadcast");
+    failed |= run("cached");
+    fprintf(stderr, "%s\n", failed ? "FAILED" : "ok");
+    remove(CACHE_PATH);
+    return failed;
+}
@@ -0,0 +1,236 @@
+/* Several threads printf to a redirected stdout at once, and every line
+   has to arrive whole, from one thread, in order.
+
+   ./test_linebuf [threads] [lines per thread] [raw]
+
+   stdout is swapped for an unbuffered stream that calls linebuf_write, the
+   way init_stdout points the WiiU devoptab at it, and the shipper sends to
+   a receiver thread on loopback.  Each line is printed in random pieces,
+   some are longer than a ring slot (they arrive in RSYSLOG_SLOT_TEXT
+   chunks), and each thread's last line has no newline, it's sent when the
+   thread exits.  Lines only use their thread's two letters, so the
+   receiver can tell whose a message is and check it against what that
+   thread printed.
+
+   With "raw" each write is pushed as it comes, like write_msg_to_syslog
+   used to, to see the broken lines that gives.
+*/
+#define _GNU_SOURCE  // fopencookie
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "linebuf.h"
+#include "rsyslogq.h"
+
+#define MAX_THREADS 26
+#define LINE_MAX_LEN 1000
+/* a raw write of a line can be cut into one more piece than the line */
+#define SLOTS_PER_LINE (LINE_MAX_LEN / RSYSLOG_SLOT_TEXT + 4)
+
+static int threads = 8;
+static int lines = 20000;
+static int raw;
+
+/* what the receiver found, per thread: the line and offset it expects next */
+static struct {
+    int line;
+    size_t offset;
+    int broken; /* the current line had a bad piece */
+    long whole; /* lines that arrived intact */
+    long messages;
+    long bad;
+} got[MAX_THREADS];
+static long foreign; /* messages that aren't any thread's */
+
+/* Line i of thread t: its number in binary, upper / lower case, then
+   filler, 20 to LINE_MAX_LEN - 1 bytes */
+static size_t make_line(int t, int i, char *out) {
+    size_t len = 20 + (size_t)i * 7919 % (LINE_MAX_LEN - 20);
+    for (size_t k = 0; k < len; k++) {
+        int upper = k < 20 ? (i >> k) & 1 : k % 7 == 0;
+        out[k] = (upper ? 'A' : 'a') + t;
+    }
+    return len;
+}
+
+static void check_message(const char *msg, size_t len) {
+    char line[LINE_MAX_LEN];
+
+    int t = len > 0 ? tolower((unsigned char)msg[0]) - 'a' : -1;
+    if (t < 0 || t >= threads) {
+        foreign++;
+        return;
+    }
+    got[t].messages++;
+    if (got[t].line >= lines) {
+        got[t].bad++;
+        return;
+    }
+    size_t line_len = make_line(t, got[t].line, line);
+    size_t want = line_len - got[t].offset;
+    if (want > RSYSLOG_SLOT_TEXT) want = RSYSLOG_SLOT_TEXT;
+    if (len != want || memcmp(msg, line + got[t].offset, len) != 0) {
+        got[t].bad++;
+        got[t].broken = 1;
+        /* resync on the next line, one bad line shouldn't fail the rest */
+        got[t].offset = line_len;
+    } else {
+        got[t].offset += len;
+    }
+    if (got[t].offset >= line_len) {
+        got[t].whole += !got[t].broken;
+        got[t].line++;
+        got[t].offset = 0;
+        got[t].broken = 0;
+    }
+}
+
+/* Reads the shipper's connection until it goes quiet for two seconds */
+static void *receiver(void *arg) {
+    int listen_fd = (int)(long)arg;
+    static char buf[65536];
+    size_t kept = 0;
+
+    int fd = accept(listen_fd, NULL, NULL);
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, 2000) > 0) {
+        ssize_t n = recv(fd, buf + kept, sizeof(buf) - kept, 0);
+        if (n <= 0) break;
+        size_t len = kept + n, start = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (buf[i] != '\n') continue;
+            /* "<14> Oct 17 10:20:30 WIIU: text" */
+            const char *text = memmem(buf + start, i - start, "WIIU: ", 6);
+            if (text != NULL) {
+                text += 6;
+                check_message(text, buf + i - text);
+            } else {
+                foreign++;
+            }
+            start = i + 1;
+        }
+        kept = len - start;
+        memmove(buf, buf + start, kept);
+    }
+    close(fd);
+    return NULL;
+}
+
+static ssize_t cookie_write(void *cookie, const char *ptr, size_t len) {
+    (void)cookie;
+    if (raw) {
+        rsyslog_queue_push(14, ptr, len);
+        return len;
+    }
+    return linebuf_write(LINEBUF_STDOUT, ptr, len);
+}
+
+static void *writer(void *arg) {
+    int t = (int)(long)arg;
+    unsigned int seed = t + 1;
+    char line[LINE_MAX_LEN + 1];
+    struct RsyslogQueueStats stats;
+
+    for (int i = 0; i < lines; i++) {
+        size_t len = make_line(t, i, line);
+        int last = i == lines - 1;
+        if (!last) line[len++] = '\n';
+
+        /* room for a whole line from every thread, so nothing is dropped */
+        for (;;) {
+            rsyslog_queue_stats(&stats);
+            if (stats.depth + threads * SLOTS_PER_LINE <= RSYSLOG_QUEUE_SLOTS) {
+                break;
+            }
+            usleep(100);
+        }
+        /* in 1 to 4 printf calls, cut anywhere */
+        size_t pos = 0;
+        int pieces = 1 + rand_r(&seed) % 4;
+        for (int p = 0; p < pieces && pos < len; p++) {
+            size_t n = p == pieces - 1 ? len - pos
+                                       : rand_r(&seed) % (len - pos + 1);
+            printf("%.*s", (int)n, line + pos);
+            pos += n;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t tids[MAX_THREADS], rx;
+    struct RsyslogQueueStats stats;
+    cookie_io_functions_t io = {NULL, cookie_write, NULL, NULL};
+    FILE *console = stdout;
+
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) lines = atoi(argv[2]);
+    raw = argc > 3 && strcmp(argv[3], "raw") == 0;
+    if (threads < 1 || threads > MAX_THREADS || lines < 1) {
+        fprintf(stderr, "usage: %s [1..26 threads] [lines] [raw]\n",
+                argv[0]);
+        return 1;
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    pthread_create(&rx, NULL, receiver, (void *)(long)listen_fd);
+    rsyslog_queue_start("127.0.0.1", ntohs(addr.sin_port));
+
+    stdout = fopencookie(NULL, "w", io);
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, writer, (void *)i);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fclose(stdout);
+    stdout = console;
+    linebuf_flush_all();
+    rsyslog_queue_stop(5000);
+    rsyslog_queue_stats(&stats);
+    pthread_join(rx, NULL);
+    close(listen_fd);
+
+    long messages = 0, bad = 0, whole = 0;
+    for (int t = 0; t < threads; t++) {
+        messages += got[t].messages;
+        bad += got[t].bad;
+        whole += got[t].whole;
+    }
+    double secs = t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d threads x %d lines in %.2f s, %.0f lines/s%s\n", threads, lines,
+           secs, threads * lines / secs, raw ? ", raw writes" : "");
+    printf("messages %ld (queued %u, dropped %u), lines intact %ld of %ld, "
+           "bad %ld, foreign %ld\n",
+           messages, stats.queued, stats.dropped, whole,
+           (long)threads * lines, bad, foreign);
+    int ok = bad == 0 && foreign == 0 && whole == (long)threads * lines &&
+             stats.dropped == 0;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
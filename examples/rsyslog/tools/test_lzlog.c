@@ -0,0 +1,300 @@
+/* lzlog on a log: how small it gets and what it costs a MB.
+
+   ./test_lzlog [-w out.log] [-s seconds] [capture]
+
+   The capture is what log_sink or rsyslogd wrote for a run of the app
+   (logs/<ip>/...log), one line a message.  Lines get a "<14> " back in
+   front, close to what the shipper sent, and are packed into batches the
+   way the shipper does (whole lines up to the batch size),
+   then each batch size is compressed as one stream (history across
+   batches), and once with a new stream every batch to show what the
+   history is worth.  Every stream is decompressed and compared.
+
+   With no capture it makes one: a verbose ffplay run of -s seconds (60),
+   30 fps video and 47 audio callbacks a second, with the trace lines
+   ffplay.c prints for each (RLOG_HOT with the rate limit off), h264 debug
+   av_log lines, the status line and the telemetry records.  -w saves it,
+   to compare with lz4 / gzip on the same bytes.
+
+   CPU is this thread's, the best of several runs, in ms per MB of log.
+*/
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lzlog.h"
+
+#define RUNS 5
+
+static char *text;
+static size_t text_len, text_size;
+static size_t *line_end; /* a batch ends at a line */
+static size_t lines, lines_size;
+static uint32_t rng = 12345;
+
+static uint32_t rnd(uint32_t n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng % n;
+}
+
+static void add_line(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+static void add_line(const char *fmt, ...) {
+    char line[512];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+        n--;
+    }
+    if (text_len + n + 1 > text_size) {
+        text_size = text_size ? text_size * 2 : 1 << 20;
+        text = realloc(text, text_size);
+    }
+    if (lines == lines_size) {
+        lines_size = lines_size ? lines_size * 2 : 1 << 16;
+        line_end = realloc(line_end, lines_size * sizeof(*line_end));
+    }
+    memcpy(text + text_len, line, n);
+    text_len += n;
+    text[text_len++] = '\n';
+    line_end[lines++] = text_len;
+}
+
+/* The header's time, from seconds into the run */
+static const char *stamp(double t) {
+    static char buf[40];
+    int s = 3 + (int)t;
+    snprintf(buf, sizeof(buf), "<14> Oct 17 09:%02d:%02d WIIU: ",
+             12 + s / 60 % 48, s % 60);
+    return buf;
+}
+
+static void make_capture(double seconds) {
+    const int read_tid = 3, video_tid = 5;
+    double vnext = 0, anext = 0, snext = 0, tnext = 0;
+    unsigned int decoded = 0, shown = 0, drops = 0, tm_seq = 0;
+    double drift = 0;
+
+    while (vnext < seconds || anext < seconds) {
+        if (anext <= vnext) {
+            const char *h = stamp(anext);
+            add_line("%ssdl_audio_callback start T%d", h, read_tid);
+            add_line("%s p packet_queue_get()", h);
+            add_line("%s p packet_queue_get retrieved a packet", h);
+            add_line("%saudio_thread got_frame() T%d", h, read_tid);
+            add_line("%saudio_thread av_buffersrc_add_frame %d()", h, 0);
+            add_line("%sframe_queue_peek_writeable()", h);
+            add_line("%sframe_queue_push()", h);
+            add_line("%s p SDL_CondSignal", h);
+            anext += 1024 / 48000.0;
+            continue;
+        }
+        const char *h = stamp(vnext);
+        int slice = rnd(30) == 0 ? 5 : 1;
+        add_line("%s p packet_queue_get()", h);
+        add_line("%s p packet_queue_get retrieved a packet", h);
+        add_line("%s[h264 @ 0x10b4c2a0] nal_unit_type: %d(%s), "
+                 "nal_ref_idc: %d",
+                 h, slice,
+                 slice == 5 ? "Coded slice of an IDR picture"
+                            : "Coded slice of a non-IDR picture",
+                 slice == 5 ? 3 : (int)rnd(3));
+        add_line("%s[h264 @ 0x10b4c2a0] Frame num gap %d %d", h,
+                 (int)rnd(16), (int)rnd(16));
+        add_line("%sdecoder_decode_frame() AVMEDIA_TYPE_VIDEO "
+                 "avcodec_recieve_frame() %s, t%d",
+                 h, "h264", video_tid);
+        add_line("%sget_video_frame() start T%d", h, read_tid);
+        add_line("%svideo_thread() av_buffersrc_add_frame %d ", h, 0);
+        add_line("%sframe_queue_peek_writeable()", h);
+        add_line("%sframe_queue_push()", h);
+        add_line("%svideo refresh, frame_queue_nb_remaining >0 T%d", h,
+                 read_tid);
+        add_line("%scalculate_display_rect()", h);
+        add_line("%svideo_display", h);
+        add_line("%svideo_refresh display: %d %d %d %d T%d", h, 0, 1, 1,
+                 (int)rnd(2), read_tid);
+        add_line("%s p SDL_CondSignal", h);
+        decoded++;
+        if (rnd(200) == 0) {
+            drops++;
+        } else {
+            shown++;
+        }
+        drift += (rnd(21) - 10) / 10000.0;
+        if (vnext >= snext) {
+            add_line("%s%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB \r",
+                     h, vnext, "A-V", drift, drops, 40 + (int)rnd(24),
+                     300 + (int)rnd(200), 0);
+            snext += 0.03;
+        }
+        if (vnext >= tnext) {
+            add_line("%s@tm d %u %u 0 %u %u %u %d %d %d %d %d", h, ++tm_seq,
+                     (unsigned int)(vnext * 1000), decoded, shown, drops,
+                     12 + (int)rnd(8), 20 + (int)rnd(30), 2 + (int)rnd(2),
+                     60 + (int)rnd(30), (int)(drift * 1000));
+            tnext += 0.25;
+        }
+        vnext += 1 / 30.0;
+    }
+}
+
+static int load_capture(const char *path) {
+    char line[4096];
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        add_line("<14> %s", line);
+    }
+    fclose(f);
+    return 0;
+}
+
+static double cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Batch boundaries: whole lines, up to batch bytes */
+static size_t make_batches(size_t batch, size_t *ends) {
+    size_t n = 0, start = 0;
+
+    for (size_t i = 0; i < lines; i++) {
+        if (line_end[i] - start > batch && i > 0 &&
+            line_end[i - 1] > start) {
+            start = ends[n++] = line_end[i - 1];
+        }
+    }
+    ends[n++] = text_len;
+    return n;
+}
+
+static void run(size_t batch, int history, uint8_t *wire, char *back,
+                size_t *ends) {
+    static struct LzlogStream z;
+    size_t batches = make_batches(batch, ends);
+    size_t wire_len = 0;
+    double best_c = 1e9, best_d = 1e9;
+
+    for (int r = 0; r < RUNS; r++) {
+        double t0 = cpu_sec();
+        size_t start = 0;
+        wire_len = 0;
+        lzlog_reset(&z);
+        for (size_t b = 0; b < batches; b++) {
+            if (!history) {
+                lzlog_reset(&z);
+            }
+            wire_len += lzlog_compress_frame(&z, text + start,
+                                             ends[b] - start,
+                                             wire + wire_len);
+            start = ends[b];
+        }
+        double t1 = cpu_sec();
+        size_t pos = 0, out = 0;
+        lzlog_reset(&z);
+        while (pos < wire_len) {
+            size_t payload_len, raw_len;
+            int stored;
+            int h = lzlog_frame_header(wire + pos, wire_len - pos,
+                                       &payload_len, &raw_len, &stored);
+            if (!history) {
+                lzlog_reset(&z);
+            }
+            const char *p =
+                h <= 0 ? NULL
+                       : lzlog_decompress_frame(&z, wire + pos + h,
+                                                payload_len, raw_len, stored);
+            if (p == NULL) {
+                fprintf(stderr, "batch %zu: bad frame\n", batch);
+                exit(1);
+            }
+            memcpy(back + out, p, raw_len);
+            out += raw_len;
+            pos += h + payload_len;
+        }
+        double t2 = cpu_sec();
+        if (out != text_len || memcmp(back, text, text_len) != 0) {
+            fprintf(stderr, "batch %zu: round trip differs\n", batch);
+            exit(1);
+        }
+        if (t1 - t0 < best_c) best_c = t1 - t0;
+        if (t2 - t1 < best_d) best_d = t2 - t1;
+    }
+    double mb = text_len / 1e6;
+    printf("%6zu %-7s %7zu %10zu %6.2f %8.2f %8.2f %7.0f\n", batch,
+           history ? "stream" : "each", batches, wire_len,
+           (double)text_len / wire_len, best_c * 1e3 / mb,
+           best_d * 1e3 / mb, mb / best_c);
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = {1024, 4096, 8192, LZLOG_BLOCK_MAX};
+    const char *save = NULL;
+    double seconds = 60;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:s:")) != -1) {
+        switch (opt) {
+            case 'w': save = optarg; break;
+            case 's': seconds = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-w out.log] [-s seconds] "
+                        "[capture]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        if (load_capture(argv[optind]) < 0) {
+            return 1;
+        }
+    } else {
+        make_capture(seconds);
+    }
+    if (text_len == 0) {
+        fprintf(stderr, "empty capture\n");
+        return 1;
+    }
+    if (save != NULL) {
+        FILE *f = fopen(save, "w");
+        if (f == NULL || fwrite(text, 1, text_len, f) != text_len) {
+            perror(save);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    uint8_t *wire = malloc(LZLOG_BOUND(text_len) + lines * LZLOG_BOUND(0));
+    char *back = malloc(text_len);
+    size_t *ends = malloc((text_len / 512 + lines + 1) * sizeof(*ends));
+    printf("%s: %zu lines, %.2f MB\n",
+           optind < argc ? argv[optind] : "ffplay stand-in", lines,
+           text_len / 1e6);
+    printf("%6s %-7s %7s %10s %6s %8s %8s %7s\n", "batch", "history",
+           "frames", "wire", "ratio", "comp ms", "dec ms", "MB/s");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i], 1, wire, back, ends);
+    }
+    run(8192, 0, wire, back, ends);
+    printf("ms are CPU ms per MB of log, MB/s compressing\n");
+    free(wire);
+    free(back);
+    free(ends);
+    free(line_end);
+    free(text);
+    return 0;
+}
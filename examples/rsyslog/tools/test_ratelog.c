@@ -0,0 +1,119 @@
+/* RLOG_RATE / RLOG_EVERY from several threads: what a held back call
+   costs, and that every call is either printed or counted.
+
+   ./test_ratelog [threads] [calls per thread]
+
+   stdout is swapped for a stream that counts lines and adds up the
+   "repeated N times" ones, after rlog_report the two have to cover every
+   call.
+*/
+#define _GNU_SOURCE  // fopencookie
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ratelog.h"
+
+static int threads = 4;
+static long calls = 2000000;
+static double secs[64];
+
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+static long printed_rate, printed_every, repeated;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the calling thread's CPU time, so threads sharing a core don't count
+   each other */
+static double thread_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ssize_t count_write(void *cookie, const char *ptr, size_t len) {
+    const char *rep;
+    (void)cookie;
+
+    /* one line per write, see print_line */
+    pthread_mutex_lock(&count_lock);
+    if ((rep = strstr(ptr, "\" repeated ")) != NULL &&
+        (size_t)(rep - ptr) < len) {
+        repeated += atol(rep + 11);
+    } else if (strncmp(ptr, "rate ", 5) == 0) {
+        printed_rate++;
+    } else if (strncmp(ptr, "every ", 6) == 0) {
+        printed_every++;
+    }
+    pthread_mutex_unlock(&count_lock);
+    return len;
+}
+
+static void *worker(void *arg) {
+    int id = (int)(long)arg;
+
+    double t0 = thread_sec();
+    for (long i = 0; i < calls; i++) {
+        RLOG_RATE(RLOG_DEBUG, 10, 5, "rate T%d call %ld", id, i);
+    }
+    secs[id] = thread_sec() - t0;
+    for (long i = 0; i < calls; i++) {
+        RLOG_EVERY(RLOG_DEBUG, 100000, "every T%d call %ld", id, i);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t tids[64];
+    cookie_io_functions_t io = {NULL, count_write, NULL, NULL};
+    FILE *console = stdout;
+    char dummy[128];
+
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) calls = atol(argv[2]);
+    if (threads < 1 || threads > 64 || calls < 1) {
+        fprintf(stderr, "usage: %s [1..64 threads] [calls]\n", argv[0]);
+        return 1;
+    }
+
+    /* what printing it would have cost */
+    double t0 = thread_sec();
+    for (long i = 0; i < 100000; i++) {
+        snprintf(dummy, sizeof(dummy), "rate T%d call %ld", 0, i);
+    }
+    double snprintf_ns = (thread_sec() - t0) * 1e9 / 100000;
+
+    stdout = fopencookie(NULL, "w", io);
+    setvbuf(stdout, NULL, _IOLBF, 1024);
+    double wall0 = now_sec();
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, worker, (void *)i);
+    }
+    double total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        total += secs[i];
+    }
+    double wall = now_sec() - wall0;
+    rlog_report();
+    fclose(stdout);
+    stdout = console;
+
+    long all = threads * calls;
+    long every_want = (all + 99999) / 100000; /* one count per site */
+    printf("%d threads x %ld calls, %.2f s\n", threads, calls, wall);
+    printf("RLOG_RATE: %6.1f ns / call (snprintf alone %.1f ns)\n",
+           total * 1e9 / all, snprintf_ns);
+    printf("printed %ld, repeated %ld, sum %ld of %ld\n", printed_rate,
+           repeated, printed_rate + repeated, all);
+    printf("RLOG_EVERY printed %ld of %ld\n", printed_every, every_want);
+    int ok = printed_rate + repeated == all && printed_every == every_want;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/* Push messages through the async shipper from several threads, compare
+   the cost per call with rsyslog_send_tcp, and check what arrives.
+
+   ./test_rsyslogq [threads] [messages per thread] [burst]
+
+Each thread pushes burst messages (default 10) and sleeps 1 ms, like a
+decode loop logging.  A big burst overruns the ring and shows up as drops,
+which fails the test.
+
+   A receiver thread listens on loopback.  Every "thread T message M" line
+   has to arrive once and whole, with sent == queued and nothing dropped,
+   or it exits 1.
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsyslog.h"
+#include "rsyslogq.h"
+
+#define MAX_CONNS 8
+
+static int messages = 10000;
+static int threads = 4;
+static int burst = 10;
+static double push_secs[64]; /* time spent inside push, per thread */
+static atomic_int stopped;   /* the shipper has flushed and closed */
+
+struct Received {
+    unsigned char *seen; /* threads x messages, times each arrived */
+    long lines;
+    long sync;      /* rsyslog_send_tcp's, one per connection */
+    long malformed; /* cut off, or not one of ours */
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer(void *arg) {
+    char msg[128];
+    int id = (int)(long)arg;
+    for (int i = 0; i < messages; i++) {
+        int len = snprintf(msg, sizeof(msg), "thread %d message %d\n", id, i);
+        double t0 = now_sec();
+        rsyslog_queue_push(14, msg, len);
+        push_secs[id] += now_sec() - t0;
+        if (i % burst == burst - 1) usleep(1000);
+    }
+    return NULL;
+}
+
+/* "<14>Oct 17 09:12:03 host app: thread 1 message 42" */
+static void check_line(struct Received *r, const char *line) {
+    const char *p = strstr(line, "thread ");
+    int id, i, end = 0;
+
+    r->lines++;
+    if (p == NULL && strstr(line, "rsyslog_send_tcp") != NULL) {
+        r->sync++;
+        return;
+    }
+    if (p == NULL || sscanf(p, "thread %d message %d%n", &id, &i, &end) != 2 ||
+        p[end] != '\0' || id < 0 || id >= threads || i < 0 ||
+        i >= messages) {
+        r->malformed++;
+        return;
+    }
+    r->seen[(size_t)id * messages + i]++;
+}
+
+/* Whole lines at the front of buf, keep the rest.  At the end of a
+   connection what's left is a message too (rsyslog_send_tcp has no
+   newline) */
+static void take_lines(struct Received *r, char *buf, size_t *kept,
+                       int closed) {
+    size_t pos = 0;
+    for (char *nl; (nl = memchr(buf + pos, '\n', *kept - pos)) != NULL;
+         pos = nl - buf + 1) {
+        *nl = '\0';
+        check_line(r, buf + pos);
+    }
+    *kept -= pos;
+    memmove(buf, buf + pos, *kept);
+    if (closed && *kept > 0) {
+        buf[*kept] = '\0';
+        check_line(r, buf);
+        *kept = 0;
+    }
+}
+
+/* Every connection until the shipper is stopped and they're all closed */
+static void *receiver(void *arg) {
+    int listen_fd = (int)(long)arg;
+    static struct Received r;
+    static char bufs[MAX_CONNS][8192];
+    size_t kept[MAX_CONNS];
+    struct pollfd pfd[MAX_CONNS + 1];
+    int conns = 0;
+
+    r.seen = calloc((size_t)threads * messages, 1);
+    pfd[0].fd = listen_fd;
+    pfd[0].events = POLLIN;
+    for (;;) {
+        int ready = poll(pfd, conns + 1, 1000);
+        if (ready <= 0) {
+            /* a quiet second after the stop, everything's in */
+            if (atomic_load(&stopped)) break;
+            continue;
+        }
+        if ((pfd[0].revents & POLLIN) && conns < MAX_CONNS) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                pfd[conns + 1].fd = fd;
+                pfd[conns + 1].events = POLLIN;
+                pfd[conns + 1].revents = 0;
+                kept[conns] = 0;
+                conns++;
+            }
+        }
+        for (int c = 0; c < conns; c++) {
+            if (!(pfd[c + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            ssize_t n = recv(pfd[c + 1].fd, bufs[c] + kept[c],
+                             sizeof(bufs[c]) - 1 - kept[c], 0);
+            if (n > 0) {
+                kept[c] += n;
+                take_lines(&r, bufs[c], &kept[c], 0);
+                continue;
+            }
+            take_lines(&r, bufs[c], &kept[c], 1);
+            close(pfd[c + 1].fd);
+            /* the last one moves into its place */
+            conns--;
+            pfd[c + 1] = pfd[conns + 1];
+            memcpy(bufs[c], bufs[conns], kept[conns]);
+            kept[c] = kept[conns];
+            c--;
+        }
+    }
+    for (int c = 0; c < conns; c++) {
+        close(pfd[c + 1].fd);
+    }
+    return &r;
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t rx, tids[64];
+    struct RsyslogQueueStats stats;
+    void *result;
+
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) messages = atoi(argv[2]);
+    if (argc > 3) burst = atoi(argv[3]);
+    if (threads < 1 || threads > 64 || messages < 1 || burst < 1) {
+        fprintf(stderr, "usage: %s [1..64 threads] [messages] [burst]\n",
+                argv[0]);
+        return 1;
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 64) < 0) {
+        perror("listen");
+        return 1;
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    int port = ntohs(addr.sin_port);
+    pthread_create(&rx, NULL, receiver, (void *)(long)listen_fd);
+
+    /* the old way, one connection per message */
+    double t0 = now_sec();
+    int sync_msgs = 200;
+    for (int i = 0; i < sync_msgs; i++) {
+        if (rsyslog_send_tcp("127.0.0.1", port, 14, "rsyslog_send_tcp") !=
+            0) {
+            sync_msgs = i;
+            break;
+        }
+    }
+    double sync_secs = now_sec() - t0;
+    if (sync_msgs > 0) {
+        printf("rsyslog_send_tcp:   %8.1f us / message\n",
+               sync_secs * 1e6 / sync_msgs);
+    }
+
+    if (rsyslog_queue_start("127.0.0.1", port) != 0) {
+        fprintf(stderr, "rsyslog_queue_start failed\n");
+        return 1;
+    }
+    t0 = now_sec();
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, producer, (void *)i);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double push_total = 0;
+    for (int i = 0; i < threads; i++) {
+        push_total += push_secs[i];
+    }
+    rsyslog_queue_stop(5000);
+    double total_secs = now_sec() - t0;
+    atomic_store(&stopped, 1);
+    pthread_join(rx, &result);
+    close(listen_fd);
+
+    rsyslog_queue_stats(&stats);
+    printf("rsyslog_queue_push: %8.3f us / message, %d threads\n",
+           push_total * 1e6 / ((double)threads * messages), threads);
+    printf("queued %u sent %u dropped %u in %u batches (%.1f / send), "
+           "%u reconnects, max depth %u, %.0f messages/s shipped\n",
+           stats.queued, stats.sent, stats.dropped, stats.batches,
+           stats.batches ? (double)stats.sent / stats.batches : 0.0,
+           stats.reconnects, stats.max_depth, stats.sent / total_secs);
+
+    struct Received *r = result;
+    long missing = 0, twice = 0;
+    for (size_t i = 0; i < (size_t)threads * messages; i++) {
+        if (r->seen[i] == 0) missing++;
+        if (r->seen[i] > 1) twice++;
+    }
+    printf("received %ld lines (%ld rsyslog_send_tcp), %ld missing, "
+           "%ld twice, %ld malformed\n",
+           r->lines, r->sync, missing, twice, r->malformed);
+    free(r->seen);
+    int ok = stats.queued == (unsigned int)threads * messages &&
+             stats.sent == stats.queued && stats.dropped == 0 &&
+             r->sync == sync_msgs && missing == 0 && twice == 0 &&
+             r->malformed == 0;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
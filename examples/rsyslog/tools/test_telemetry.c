@@ -0,0 +1,200 @@
+/* Telemetry through the shipper, and what a telemetry_add costs.
+
+   ./test_telemetry [seconds] [log file]
+
+   Worker threads count "events" and set a "depth" gauge as fast as they
+   can, the sampler runs at 20 Hz and the shipper sends to a receiver
+   thread on loopback.  The receiver parses the records, and the last
+   sample's "events" total has to match what the workers added, with a
+   sample for every 50 ms.  The log file, if given, keeps what arrived for
+   ./telemetry_view.
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsyslogq.h"
+#include "telemetry.h"
+
+#define WORKERS 4
+#define HZ 20
+
+static double seconds = 1.0;
+static FILE *log_file;
+static atomic_int working;
+static int tm_events, tm_depth, tm_late;
+
+struct Received {
+    long schema;
+    long samples;
+    long lines;
+    unsigned long last_seq;
+    unsigned long events; /* the last sample's total */
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg) {
+    long *adds = arg;
+    long n = 0;
+    double cpu = cpu_sec();
+
+    while (atomic_load_explicit(&working, memory_order_relaxed)) {
+        for (int i = 0; i < 1000; i++) {
+            telemetry_add(tm_events, 1);
+            telemetry_set(tm_depth, i);
+        }
+        n += 1000;
+    }
+    adds[0] = n;
+    adds[1] = (long)((cpu_sec() - cpu) * 1e9);
+    return NULL;
+}
+
+/* "@tm d <seq> <ms> <first> <values>", events is index 0 */
+static void parse(struct Received *r, const char *line) {
+    const char *p = strstr(line, "@tm ");
+    unsigned long seq, ms, events;
+    int first;
+
+    if (p == NULL) {
+        return;
+    }
+    r->lines++;
+    if (p[4] == 's') {
+        r->schema++;
+    } else if (sscanf(p + 6, "%lu %lu %d %lu", &seq, &ms, &first,
+                      &events) == 4 &&
+               first == 0) {
+        r->samples++;
+        r->last_seq = seq;
+        r->events = events;
+    }
+}
+
+/* Lines until the connection is quiet for a second */
+static void *receiver(void *arg) {
+    int listen_fd = (int)(long)arg;
+    static struct Received r;
+    static char buf[65536];
+    size_t kept = 0;
+
+    int fd = accept(listen_fd, NULL, NULL);
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, 1000) > 0) {
+        ssize_t n = recv(fd, buf + kept, sizeof(buf) - 1 - kept, 0);
+        if (n <= 0) break;
+        size_t len = kept + n;
+        size_t pos = 0;
+        for (char *nl; (nl = memchr(buf + pos, '\n', len - pos)) != NULL;
+             pos = nl - buf + 1) {
+            *nl = '\0';
+            parse(&r, buf + pos);
+            if (log_file != NULL) {
+                fprintf(log_file, "%s\n", buf + pos);
+            }
+        }
+        kept = len - pos;
+        memmove(buf, buf + pos, kept);
+    }
+    close(fd);
+    return &r;
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t rx, workers[WORKERS];
+    long adds[WORKERS][2];
+    struct RsyslogQueueStats stats;
+    void *result;
+
+    if (argc > 1) seconds = atof(argv[1]);
+    if (argc > 2 && (log_file = fopen(argv[2], "w")) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    pthread_create(&rx, NULL, receiver, (void *)(long)listen_fd);
+    rsyslog_queue_start("127.0.0.1", ntohs(addr.sin_port));
+
+    tm_events = telemetry_counter("events");
+    tm_depth = telemetry_gauge("depth");
+    /* the same name gives the same id */
+    if (telemetry_counter("events") != tm_events) {
+        fprintf(stderr, "events registered twice\n");
+        return 1;
+    }
+    telemetry_start(HZ);
+
+    double t0 = now_sec();
+    atomic_store(&working, 1);
+    for (int i = 0; i < WORKERS; i++) {
+        pthread_create(&workers[i], NULL, worker, adds[i]);
+    }
+    /* a metric added while it runs gets a schema of its own */
+    usleep((useconds_t)(seconds * 5e5));
+    tm_late = telemetry_gauge("added late");
+    telemetry_set(tm_late, -5);
+    usleep((useconds_t)(seconds * 5e5));
+    atomic_store(&working, 0);
+    long total = 0, cpu_ns = 0;
+    for (int i = 0; i < WORKERS; i++) {
+        pthread_join(workers[i], NULL);
+        total += adds[i][0];
+        cpu_ns += adds[i][1];
+    }
+    telemetry_stop();
+    double elapsed = now_sec() - t0;
+    rsyslog_queue_stop(1000);
+    rsyslog_queue_stats(&stats);
+    pthread_join(rx, &result);
+    close(listen_fd);
+    if (log_file != NULL) {
+        fclose(log_file);
+    }
+
+    struct Received *r = result;
+    long expected = (long)(elapsed * HZ);
+    printf("%d workers, %.2f s: %ld adds (%.1f ns a call), "
+           "last total %lu\n",
+           WORKERS, elapsed, total, (double)cpu_ns / total / 2, r->events);
+    printf("%ld samples (about %ld at %d Hz), %ld schema lines, %ld lines, "
+           "dropped %u\n",
+           r->samples, expected, HZ, r->schema, r->lines, stats.dropped);
+    int ok = r->events == (uint32_t)total &&
+             r->last_seq == (unsigned long)r->samples &&
+             r->samples >= expected - 2 && r->samples <= expected + 2 &&
+             r->schema == 5;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/* Cost of a TRACE call against the snprintf it replaces, and a round trip
+   check for trace_decode.
+
+   ./test_trace [trace file] [threads] [events per thread]
+
+   Every thread logs the same mix of formats twice, once through snprintf
+   into a buffer and once through TRACE.  Then it runs ./trace_decode on the
+   file (make builds it too) and every decoded message has to be one of the
+   snprintf texts, each of them once.  Exits 1 when they don't match.
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+static int events = 100000;
+static double printf_secs[64];
+static double trace_secs[64];
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the formats ffplay / playvid use, a few others for coverage.  With
+   text != NULL it's snprintf, otherwise TRACE */
+static void log_one(char *text, size_t size, int id, long i) {
+    static const char *names[] = {"yuv420p", "nv12", "rgb24"};
+    const char *name = names[i % 3];
+    double pts = i / 29.97;
+    size_t bytes = (size_t)i * 1382400;
+
+    switch (i % 4) {
+        case 0:
+            if (text) {
+                snprintf(text, size, "upload_texture() switch %d T%d",
+                         (int)(i % 7), id);
+            } else {
+                TRACE("upload_texture() switch %d T%d", (int)(i % 7), id);
+            }
+            break;
+        case 1:
+            if (text) {
+                snprintf(text, size, "RenderPresent %ld", i);
+            } else {
+                TRACE("RenderPresent %ld", i);
+            }
+            break;
+        case 2:
+            if (text) {
+                snprintf(text, size, "T%d frame %s pts %8.3f %zu bytes", id,
+                         name, pts, bytes);
+            } else {
+                TRACE("T%d frame %s pts %8.3f %zu bytes", id, name, pts,
+                      bytes);
+            }
+            break;
+        default:
+            if (text) {
+                snprintf(text, size, "T%d [%-*s] %05.1f%% %#x %c %llu", id, 8,
+                         name, 12.5, (unsigned)i, 'a' + (int)(i % 26),
+                         (unsigned long long)i << 33);
+            } else {
+                TRACE("T%d [%-*s] %05.1f%% %#x %c %llu", id, 8, name, 12.5,
+                      (unsigned)i, 'a' + (int)(i % 26),
+                      (unsigned long long)i << 33);
+            }
+            break;
+    }
+}
+
+static void *producer(void *arg) {
+    int id = (int)(long)arg;
+    char text[256];
+
+    double t0 = now_sec();
+    for (long i = 0; i < events; i++) {
+        log_one(text, sizeof(text), id, i);
+    }
+    double t1 = now_sec();
+    for (long i = 0; i < events; i++) {
+        log_one(NULL, 0, id, i);
+    }
+    trace_flush();
+    double t2 = now_sec();
+    printf_secs[id] = t1 - t0;
+    trace_secs[id] = t2 - t1;
+    return NULL;
+}
+
+static int by_text(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* trace_decode's lines against the snprintf text of every event, both
+   sorted (threads come out in runs).  Mismatches, -1 if it didn't run */
+static long check_decode(const char *path, int threads) {
+    size_t total = (size_t)threads * events;
+    char **want = malloc(total * sizeof(*want));
+    char **got = malloc(total * sizeof(*got));
+    size_t ngot = 0;
+    long bad = 0;
+    char text[1200];
+
+    for (int id = 0; id < threads; id++) {
+        for (long i = 0; i < events; i++) {
+            log_one(text, sizeof(text), id, i);
+            want[(size_t)id * events + i] = strdup(text);
+        }
+    }
+    snprintf(text, sizeof(text), "./trace_decode %s", path);
+    FILE *fp = popen(text, "r");
+    if (fp == NULL) {
+        perror("./trace_decode");
+        return -1;
+    }
+    /* "    0.000123 T1  message" */
+    while (fgets(text, sizeof(text), fp) != NULL) {
+        char *msg = strchr(text, 'T');
+        text[strcspn(text, "\n")] = '\0';
+        if (msg == NULL) {
+            bad++;
+            continue;
+        }
+        msg += 1 + strspn(msg + 1, "0123456789");
+        msg += strspn(msg, " ");
+        if (ngot == total) {
+            bad++; /* more events than went in */
+            continue;
+        }
+        got[ngot++] = strdup(msg);
+    }
+    if (pclose(fp) != 0) {
+        fprintf(stderr, "./trace_decode failed\n");
+        return -1;
+    }
+
+    qsort(want, total, sizeof(*want), by_text);
+    qsort(got, ngot, sizeof(*got), by_text);
+    for (size_t i = 0, j = 0; i < total || j < ngot;) {
+        int c = i == total ? 1 : j == ngot ? -1 : strcmp(want[i], got[j]);
+        if (c != 0 && bad++ < 5) {
+            fprintf(stderr, "%s: %s\n", c < 0 ? "missing" : "unexpected",
+                    c < 0 ? want[i] : got[j]);
+        }
+        if (c <= 0) free(want[i++]);
+        if (c >= 0) free(got[j++]);
+    }
+    free(want);
+    free(got);
+    return bad;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "test_trace.trc";
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    pthread_t tids[64];
+
+    if (argc > 3) events = atoi(argv[3]);
+    if (threads < 1 || threads > 64 || events < 1) {
+        fprintf(stderr, "usage: %s [trace file] [1..64 threads] [events]\n",
+                argv[0]);
+        return 1;
+    }
+    if (trace_open_file(path) != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, producer, (void *)i);
+    }
+    double printf_total = 0, trace_total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        printf_total += printf_secs[i];
+        trace_total += trace_secs[i];
+    }
+    trace_close();
+
+    double calls = (double)threads * events;
+    printf("snprintf: %8.1f ns / call\n", printf_total * 1e9 / calls);
+    printf("TRACE:    %8.1f ns / call, %d threads\n",
+           trace_total * 1e9 / calls, threads);
+
+    long bad = check_decode(path, threads);
+    if (bad != 0) {
+        printf("round trip FAILED (%ld)\n", bad);
+        return 1;
+    }
+    printf("round trip ok, %.0f events\n", calls);
+    return 0;
+}
@@ -0,0 +1,344 @@
+/* Loopback throughput of the syslog transports.
+
+   ./test_transport [messages] [threads]
+
+   For each transport a child process listens on 127.0.0.1 and counts what
+   arrives, and this process sends messages through it:
+
+     connect   rsyslog_send_tcp, a connection per message (fewer messages,
+               it's slow)
+     tcp       the shipper, one persistent TCP connection
+     udp       the shipper, RFC 5424, newline separated, packed datagrams
+     udp-octet the same, octet counted
+     tcp-lz    the tcp stream, each batch compressed (lzlog.h), the
+               receiver decodes it
+
+   Producer threads wait for room in the shipper's ring before a push (a
+   failed push still uses up a sequence id, it's a drop), so every message
+   is sent once.  CPU is this process only (producers and the shipper),
+   the receiver is the child.  UDP loss shows up as gaps in the sequence
+   ids.  wire B is what the receiver read, per message.
+*/
+#define _GNU_SOURCE  // memmem
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lzlog.h"
+#include "rsyslog.h"
+#include "rsyslogq.h"
+
+#define MODE_CONNECT -1
+
+struct Received {
+    long messages;
+    long with_id;
+    long max_id;
+    long bytes;
+    long datagrams;
+};
+
+static int messages = 200000;
+static int threads = 2;
+static long full_waits[64];
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_sec(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void count_message(struct Received *r, const char *msg, size_t len) {
+    const char *id = memmem(msg, len, "sequenceId=\"", 12);
+    r->messages++;
+    if (id != NULL) {
+        long v = atol(id + 12);
+        r->with_id++;
+        if (v > r->max_id) r->max_id = v;
+    }
+}
+
+/* Split a datagram (or a chunk of the TCP stream, lines only) */
+static void count_buffer(struct Received *r, const char *buf, size_t len,
+                         int octet) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n;
+        if (octet) {
+            char *end;
+            n = strtoul(buf + pos, &end, 10);
+            pos = end - buf + 1;
+            if (pos + n > len) n = len - pos;
+        } else {
+            const char *nl = memchr(buf + pos, '\n', len - pos);
+            n = nl ? (size_t)(nl - (buf + pos)) : len - pos;
+        }
+        count_message(r, buf + pos, n);
+        pos += n + (octet ? 0 : 1);
+    }
+}
+
+/* Count the whole lines at the front of buf, keep the rest */
+static void count_lines(struct Received *r, char *buf, size_t *kept) {
+    size_t whole = *kept;
+    while (whole > 0 && buf[whole - 1] != '\n') whole--;
+    count_buffer(r, buf, whole, 0);
+    *kept -= whole;
+    memmove(buf, buf + whole, *kept);
+}
+
+/* RSYSLOG_TCP_LZ: the first frame in z, if it's all there, appended to
+   buf.  1 a frame, 0 need more, -1 a bad frame */
+static int decode(struct LzlogStream *lz, uint8_t *z, size_t *zkept,
+                  char *buf, size_t *kept, size_t size) {
+    size_t payload_len, raw_len;
+    int stored;
+    int h = lzlog_frame_header(z, *zkept, &payload_len, &raw_len, &stored);
+
+    if (h == 0 || (h > 0 && *zkept - h < payload_len)) {
+        return 0;
+    }
+    const char *text =
+        h < 0 ? NULL
+              : lzlog_decompress_frame(lz, z + h, payload_len, raw_len,
+                                       stored);
+    if (text == NULL || *kept + raw_len > size) {
+        return -1;
+    }
+    memcpy(buf + *kept, text, raw_len);
+    *kept += raw_len;
+    *zkept -= h + payload_len;
+    memmove(z, z + h + payload_len, *zkept);
+    return 1;
+}
+
+/* Child: count until three seconds pass with nothing new (a SYN dropped
+   on a full backlog is retried after a second) */
+static void receive(int fd, int mode, int result_fd) {
+    struct Received r;
+    static char buf[65536];
+    size_t kept = 0;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int conn = -1;
+    static struct LzlogStream lz;
+    static uint8_t z[LZLOG_BOUND(LZLOG_BLOCK_MAX)];
+    size_t zkept = 0;
+    int magic = 0; /* tcp-lz, the magic is still to come */
+
+    memset(&r, 0, sizeof(r));
+    for (;;) {
+        int timeout = r.messages > 0 ? 3000 : 10000;
+        if (poll(&pfd, 1, timeout) <= 0) break;
+        if (mode == RSYSLOG_UDP || mode == RSYSLOG_UDP_OCTET) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) continue;
+            r.datagrams++;
+            r.bytes += n;
+            count_buffer(&r, buf, n, mode == RSYSLOG_UDP_OCTET);
+            continue;
+        }
+        if (pfd.fd == fd) {
+            /* listening socket, take the connection */
+            if (conn >= 0) close(conn);
+            conn = accept(fd, NULL, NULL);
+            if (mode == MODE_CONNECT) {
+                /* one message per connection, no newline */
+                ssize_t n = recv(conn, buf, sizeof(buf), MSG_WAITALL);
+                if (n > 0) {
+                    r.bytes += n;
+                    count_message(&r, buf, n);
+                }
+                close(conn);
+                conn = -1;
+            } else {
+                pfd.fd = conn;
+                lzlog_reset(&lz);
+                zkept = 0;
+                magic = 1;
+            }
+            continue;
+        }
+        ssize_t n;
+        if (mode == RSYSLOG_TCP_LZ) {
+            n = recv(conn, z + zkept, sizeof(z) - zkept, 0);
+        } else {
+            n = recv(conn, buf + kept, sizeof(buf) - kept, 0);
+        }
+        if (n <= 0) {
+            /* the shipper closed, maybe a reconnect */
+            close(conn);
+            conn = -1;
+            kept = 0;
+            pfd.fd = fd;
+            continue;
+        }
+        r.bytes += n;
+        if (mode == RSYSLOG_TCP_LZ) {
+            /* the magic first, then frames */
+            zkept += n;
+            if (magic && zkept >= LZLOG_MAGIC_LEN) {
+                if (memcmp(z, LZLOG_MAGIC, LZLOG_MAGIC_LEN) != 0) break;
+                magic = 0;
+                zkept -= LZLOG_MAGIC_LEN;
+                memmove(z, z + LZLOG_MAGIC_LEN, zkept);
+            }
+            int d = 0;
+            while (!magic && (d = decode(&lz, z, &zkept, buf, &kept,
+                                         sizeof(buf))) > 0) {
+                count_lines(&r, buf, &kept);
+            }
+            if (d < 0) {
+                fprintf(stderr, "tcp-lz: bad frame\n");
+                break;
+            }
+            continue;
+        }
+        /* whole lines only, keep the rest for the next read */
+        kept += n;
+        count_lines(&r, buf, &kept);
+    }
+    if (write(result_fd, &r, sizeof(r)) != sizeof(r)) {
+        perror("write");
+    }
+}
+
+/* Fork the receiver, returns its port */
+static int start_receiver(int mode, pid_t *pid, int *result_fd) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int pipe_fds[2];
+    int udp = mode == RSYSLOG_UDP || mode == RSYSLOG_UDP_OCTET;
+    int fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    int rcvbuf = 8 << 20;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        (!udp && listen(fd, 128) < 0) || pipe(pipe_fds) < 0) {
+        perror("receiver");
+        exit(1);
+    }
+    getsockname(fd, (struct sockaddr *)&addr, &addr_len);
+    *pid = fork();
+    if (*pid == 0) {
+        close(pipe_fds[0]);
+        receive(fd, mode, pipe_fds[1]);
+        _exit(0);
+    }
+    close(fd);
+    close(pipe_fds[1]);
+    *result_fd = pipe_fds[0];
+    return ntohs(addr.sin_port);
+}
+
+static void *producer(void *arg) {
+    int id = (int)(long)arg;
+    char msg[128];
+    struct RsyslogQueueStats stats;
+
+    for (int i = 0; i < messages / threads; i++) {
+        int len = snprintf(msg, sizeof(msg),
+                           "thread %d message %d, some text to make it a "
+                           "typical log line",
+                           id, i);
+        /* leave a slot per producer so the push can't fail */
+        for (;;) {
+            rsyslog_queue_stats(&stats);
+            if (stats.depth + threads <= RSYSLOG_QUEUE_SLOTS) break;
+            full_waits[id]++;
+            usleep(100);
+        }
+        rsyslog_queue_push(14, msg, len);
+    }
+    return NULL;
+}
+
+static void run(const char *name, int mode) {
+    struct RsyslogQueueStats stats;
+    struct Received r;
+    pthread_t tids[64];
+    pid_t pid;
+    int result_fd;
+    int port = start_receiver(mode, &pid, &result_fd);
+    int count = messages;
+    long waits = 0;
+
+    memset(&stats, 0, sizeof(stats));
+    double cpu0 = cpu_sec();
+    double t0 = now_sec();
+    if (mode == MODE_CONNECT) {
+        count = messages / 100 < 1000 ? messages / 100 : 1000;
+        for (int i = 0; i < count; i++) {
+            rsyslog_send_tcp("127.0.0.1", port, 14, "a connection per message");
+        }
+        stats.queued = stats.sent = count;
+    } else {
+        rsyslog_queue_start_transport("127.0.0.1", port, mode);
+        memset(full_waits, 0, sizeof(full_waits));
+        for (long i = 0; i < threads; i++) {
+            pthread_create(&tids[i], NULL, producer, (void *)i);
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+            waits += full_waits[i];
+        }
+        rsyslog_queue_stop(10000);
+        rsyslog_queue_stats(&stats);
+        count = messages / threads * threads;
+    }
+    double secs = now_sec() - t0;
+    double cpu = cpu_sec() - cpu0;
+
+    memset(&r, 0, sizeof(r));
+    if (read(result_fd, &r, sizeof(r)) != sizeof(r)) {
+        fprintf(stderr, "%s: no result from the receiver\n", name);
+    }
+    close(result_fd);
+    waitpid(pid, NULL, 0);
+
+    /* ids are 1..n, so what's missing below the highest one was lost */
+    long lost = r.with_id > 0 ? r.max_id - r.with_id : count - r.messages;
+    printf("%-9s %8d %10.0f %8ld %7ld %8.1f %7.2f %8.1f %6.1f %7.1f\n", name,
+           count, count / secs, r.messages, lost, cpu * 1e3,
+           cpu * 1e6 / count,
+           stats.batches ? (double)stats.sent / stats.batches : 1.0,
+           (double)waits / count,
+           r.messages ? (double)r.bytes / r.messages : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) messages = atoi(argv[1]);
+    if (argc > 2) threads = atoi(argv[2]);
+    if (messages < threads || threads < 1 || threads > 64) {
+        fprintf(stderr, "usage: %s [messages] [1..64 threads]\n", argv[0]);
+        return 1;
+    }
+    printf("%d messages, %d producer threads, loopback\n", messages, threads);
+    printf("%-9s %8s %10s %8s %7s %8s %7s %8s %6s %7s\n", "transport",
+           "sent", "msgs/s", "received", "lost", "cpu ms", "us/msg",
+           "msg/send", "waits", "wire B");
+    run("connect", MODE_CONNECT);
+    run("tcp", RSYSLOG_TCP);
+    run("udp", RSYSLOG_UDP);
+    run("udp-octet", RSYSLOG_UDP_OCTET);
+    run("tcp-lz", RSYSLOG_TCP_LZ);
+    return 0;
+}
@@ -0,0 +1,337 @@
+/* Turn trace packets (trace.c) back into text.
+
+   ./trace_decode [-s] [file]
+
+   file is either a binary dump from trace_open_file, or a syslog file with
+   the "TRC1 <base64>" lines trace_open_syslog sends (the rest of the file
+   is skipped).  Reads stdin without one, so
+
+   docker exec rsyslogd-wiiu-9514 cat /var/log/remote/... | ./trace_decode
+
+   Each event prints as seconds since the first event, the thread, and the
+   formatted message.  Packets come out in flush order, so threads show up
+   in runs; -s sorts everything by time first.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+struct Format {
+    uint16_t len;
+    char *text;
+};
+
+struct Line {
+    uint64_t ticks;
+    char *text;
+};
+
+static struct Format formats[65536];
+static int32_t last_seq[65536];
+static uint64_t ticks_per_sec = 1000000000ULL;
+static uint64_t first_ticks;
+static uint64_t last_ticks;
+static int have_first;
+static int sort_lines;
+static struct Line *lines;
+static size_t nlines, lines_cap;
+static long events, lost, unknown;
+
+struct Reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    int swap;
+};
+
+static int take_bytes(struct Reader *r, void *out, size_t n) {
+    if ((size_t)(r->end - r->p) < n) return -1;
+    memcpy(out, r->p, n);
+    r->p += n;
+    return 0;
+}
+
+/* a number, in the writer's byte order */
+static int take(struct Reader *r, void *out, size_t n) {
+    if (take_bytes(r, out, n) < 0) return -1;
+    if (r->swap) {
+        uint8_t *b = out;
+        for (size_t i = 0; i < n / 2; i++) {
+            uint8_t c = b[i];
+            b[i] = b[n - 1 - i];
+            b[n - 1 - i] = c;
+        }
+    }
+    return 0;
+}
+
+static void output(uint64_t ticks, uint16_t thread, const char *msg) {
+    char text[1200];
+
+    if (!have_first) {
+        first_ticks = ticks;
+        have_first = 1;
+    }
+    last_ticks = ticks;
+    double secs = (double)(int64_t)(ticks - first_ticks) / ticks_per_sec;
+    snprintf(text, sizeof(text), "%12.6f T%-2u %s", secs, thread, msg);
+    if (!sort_lines) {
+        puts(text);
+        return;
+    }
+    if (nlines == lines_cap) {
+        lines_cap = lines_cap ? lines_cap * 2 : 4096;
+        lines = realloc(lines, lines_cap * sizeof(*lines));
+        if (lines == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    lines[nlines].ticks = ticks;
+    lines[nlines].text = strdup(text);
+    nlines++;
+}
+
+/* the * widths / precisions go ahead of the value */
+#define PRINT_VALUE(v)                                                   \
+    (c->stars == 2   ? snprintf(out, size, spec, stars[0], stars[1], v) \
+     : c->stars == 1 ? snprintf(out, size, spec, stars[0], v)           \
+                     : snprintf(out, size, spec, v))
+
+/* printf one conversion, with the value from the record */
+static int format_conv(char *out, size_t size, const char *fmt,
+                       const struct TraceConv *c, const int *stars,
+                       struct Reader *r) {
+    char spec[48];
+    size_t flags = c->mod - c->start; /* %, flags, width, precision */
+    int32_t i32;
+    int64_t i64;
+    double d;
+    uint8_t slen;
+    char str[256];
+
+    if (flags > sizeof(spec) - 8) return -1;
+    memcpy(spec, fmt + c->start, flags);
+    char *s = spec + flags;
+    switch (c->kind) {
+        case 'i':
+            if (take(r, &i32, 4) < 0) return -1;
+            /* keep h / hh, they change what's printed */
+            if (fmt[c->mod] == 'h') {
+                memcpy(s, fmt + c->mod, c->conv - c->mod);
+                s += c->conv - c->mod;
+            }
+            *s++ = fmt[c->conv];
+            *s = '\0';
+            return PRINT_VALUE(i32);
+        case 'd':
+        case 'D':
+            if (take(r, &d, 8) < 0) return -1;
+            *s++ = fmt[c->conv];
+            *s = '\0';
+            return PRINT_VALUE(d);
+        case 's':
+            if (take_bytes(r, &slen, 1) < 0 || take_bytes(r, str, slen) < 0) {
+                return -1;
+            }
+            str[slen] = '\0';
+            *s++ = 's';
+            *s = '\0';
+            return PRINT_VALUE(str);
+        case 'n':
+            return 0;
+        case 0:
+            return snprintf(out, size, "%%");
+        case 'p':
+            if (take(r, &i64, 8) < 0) return -1;
+            return snprintf(out, size, "0x%llx", (unsigned long long)i64);
+        default: /* 8 byte integers */
+            if (take(r, &i64, 8) < 0) return -1;
+            *s++ = 'l';
+            *s++ = 'l';
+            *s++ = fmt[c->conv];
+            *s = '\0';
+            return PRINT_VALUE((long long)i64);
+    }
+}
+
+/* One event, after its id.  -1 if the record doesn't add up, the rest of
+   the packet can't be trusted then */
+static int decode_event(uint16_t id, uint16_t thread, struct Reader *r) {
+    const struct Format *f = &formats[id];
+    char msg[1024];
+    size_t n = 0, pos = 0, text = 0;
+    struct TraceConv c;
+    uint64_t ticks;
+
+    if (take(r, &ticks, 8) < 0) return -1;
+    if (f->text == NULL) {
+        unknown++;
+        return -1; /* format not seen, can't tell how long the record is */
+    }
+    while (trace_next_conv(f->text, f->len, &pos, &c)) {
+        int stars[2] = {0, 0};
+        for (int i = 0; i < c.stars; i++) {
+            int32_t v;
+            if (take(r, &v, 4) < 0) return -1;
+            stars[i] = v;
+        }
+        size_t lit = c.start - text;
+        if (lit > sizeof(msg) - 1 - n) lit = sizeof(msg) - 1 - n;
+        memcpy(msg + n, f->text + text, lit);
+        n += lit;
+        int w = format_conv(msg + n, sizeof(msg) - n, f->text, &c, stars, r);
+        if (w < 0) return -1;
+        n += (size_t)w < sizeof(msg) - n ? (size_t)w : sizeof(msg) - 1 - n;
+        text = pos;
+    }
+    size_t lit = f->len - text;
+    if (lit > sizeof(msg) - 1 - n) lit = sizeof(msg) - 1 - n;
+    memcpy(msg + n, f->text + text, lit);
+    msg[n + lit] = '\0';
+    events++;
+    output(ticks, thread, msg);
+    return 0;
+}
+
+static void decode_packet(const uint8_t *packet, size_t size) {
+    const uint16_t one = 1;
+    struct Reader r = {packet + 2, packet + size, 0};
+    uint16_t thread, seq, len;
+
+    if (size < TRACE_PACKET_HEADER || packet[0] != 'T') return;
+    r.swap = packet[1] != (*(const uint8_t *)&one ? 'l' : 'b');
+    take(&r, &thread, 2);
+    take(&r, &seq, 2);
+    take(&r, &len, 2);
+    if (len > size) return;
+    r.end = packet + len;
+
+    if (last_seq[thread] >= 0 && seq != (uint16_t)(last_seq[thread] + 1)) {
+        int gap = (uint16_t)(seq - last_seq[thread] - 1);
+        char msg[64];
+        snprintf(msg, sizeof(msg), "--- %d packets lost", gap);
+        lost += gap;
+        if (have_first) output(last_ticks, thread, msg);
+    }
+    last_seq[thread] = seq;
+
+    while (r.p < r.end) {
+        uint16_t id;
+        take(&r, &id, 2);
+        if (id == TRACE_ID_FORMAT) {
+            uint16_t fid, flen;
+            if (take(&r, &fid, 2) < 0 || take(&r, &flen, 2) < 0 ||
+                r.end - r.p < flen) {
+                return;
+            }
+            free(formats[fid].text);
+            formats[fid].text = malloc(flen + 1);
+            if (formats[fid].text == NULL) return;
+            memcpy(formats[fid].text, r.p, flen);
+            formats[fid].text[flen] = '\0';
+            formats[fid].len = flen;
+            r.p += flen;
+        } else if (id == TRACE_ID_CLOCK) {
+            if (take(&r, &ticks_per_sec, 8) < 0 || ticks_per_sec == 0) {
+                ticks_per_sec = 1000000000ULL;
+                return;
+            }
+        } else if (decode_event(id, thread, &r) < 0) {
+            return;
+        }
+    }
+}
+
+static int b64_value(int c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static void decode_syslog(FILE *fp) {
+    char line[4096];
+    uint8_t packet[TRACE_PACKET_BYTES + 3];
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        const char *p = strstr(line, "TRC1 ");
+        if (p == NULL) continue;
+        size_t n = 0;
+        uint32_t v = 0;
+        int bits = 0;
+        for (p += 5; b64_value(*p) >= 0 && n < sizeof(packet); p++) {
+            v = (v << 6) | b64_value(*p);
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                packet[n++] = (v >> bits) & 0xff;
+            }
+        }
+        decode_packet(packet, n);
+    }
+}
+
+static void decode_binary(FILE *fp) {
+    uint8_t packet[TRACE_PACKET_BYTES];
+
+    while (fread(packet, 1, TRACE_PACKET_HEADER, fp) == TRACE_PACKET_HEADER) {
+        uint16_t len;
+        memcpy(&len, packet + 6, 2);
+        if (packet[1] == 'b') len = (len >> 8) | (len << 8);
+        if (packet[0] != 'T' || len < TRACE_PACKET_HEADER ||
+            len > TRACE_PACKET_BYTES) {
+            fprintf(stderr, "not a trace packet, giving up\n");
+            return;
+        }
+        if (fread(packet + TRACE_PACKET_HEADER, 1, len - TRACE_PACKET_HEADER,
+                  fp) != (size_t)len - TRACE_PACKET_HEADER) {
+            break;
+        }
+        decode_packet(packet, len);
+    }
+}
+
+static int by_ticks(const void *a, const void *b) {
+    const struct Line *x = a, *y = b;
+    return x->ticks < y->ticks ? -1 : x->ticks > y->ticks;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *fp = stdin;
+    int argi = 1;
+
+    if (argi < argc && strcmp(argv[argi], "-s") == 0) {
+        sort_lines = 1;
+        argi++;
+    }
+    if (argi < argc && (fp = fopen(argv[argi], "rb")) == NULL) {
+        fprintf(stderr, "usage: %s [-s] [trace file | syslog file]\n",
+                argv[0]);
+        return 1;
+    }
+    memset(last_seq, 0xff, sizeof(last_seq));
+
+    /* packets start with a T, syslog lines with a date or a <priority> */
+    int c = getc(fp);
+    ungetc(c, fp);
+    if (c == 'T') {
+        decode_binary(fp);
+    } else {
+        decode_syslog(fp);
+    }
+
+    if (sort_lines) {
+        qsort(lines, nlines, sizeof(*lines), by_ticks);
+        for (size_t i = 0; i < nlines; i++) {
+            puts(lines[i].text);
+        }
+    }
+    fprintf(stderr, "%ld events, %ld packets lost, %ld unknown formats\n",
+            events, lost, unknown);
+    return 0;
+}
@@ -0,0 +1,537 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __WIIU__
+#include <coreinit/systeminfo.h>
+#include <coreinit/time.h>
+#endif
+
+#include "rsyslogq.h"
+
+/* syslog priority of the TRC1 lines, user.debug */
+#define TRACE_SYSLOG_PRIORITY 15
+#define TRACE_PAYLOAD (TRACE_PACKET_BYTES - TRACE_PACKET_HEADER)
+
+struct TraceFormat {
+    char kinds[TRACE_MAX_ARGS + 1];
+    int nargs;
+    int str_max;    /* per %s, so a record always fits a packet */
+    int max_record; /* bytes, strings at str_max */
+    uint16_t len;
+    char text[TRACE_FORMAT_MAX];
+};
+
+/* Packets a thread fills.  Only its thread touches it, until flush_buffer
+   hands the full ones to the sink under the lock. */
+struct TraceBuffer {
+    uint16_t thread;
+    uint16_t seq;
+    int slot; /* in buffers[] */
+    int npackets; /* complete ones */
+    int len;      /* current packet, header included */
+    uint64_t first_ticks;
+    uint8_t packets[TRACE_PACKETS][TRACE_PACKET_BYTES];
+};
+
+atomic_int trace_enabled;
+
+static struct {
+    pthread_mutex_t lock; /* sink, formats, buffers[] */
+    pthread_once_t once;
+    pthread_key_t key;
+    FILE *fp;
+    int syslog;
+    uint64_t ticks_per_sec;
+
+    struct TraceFormat formats[TRACE_MAX_FORMATS]; /* [0] unused */
+    unsigned int nformats;
+    unsigned int formats_sent; /* in the current sink */
+    int clock_sent;
+
+    struct TraceBuffer *buffers[TRACE_MAX_THREADS];
+    uint16_t next_thread;
+    uint16_t format_seq; /* packets of thread 0, formats and the clock */
+} t = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+};
+
+static uint64_t trace_ticks(void) {
+#ifdef __WIIU__
+    return (uint64_t)OSGetSystemTime();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t trace_ticks_per_sec(void) {
+#ifdef __WIIU__
+    return (uint64_t)OSTimerClockSpeed;
+#else
+    return 1000000000ULL;
+#endif
+}
+
+int trace_kind_size(char kind) {
+    switch (kind) {
+        case 'i':
+            return 4;
+        case 's':
+            return -1;
+        case 'n':
+        case 0:
+            return 0;
+        default:
+            return 8;
+    }
+}
+
+int trace_next_conv(const char *fmt, size_t len, size_t *pos,
+                    struct TraceConv *conv) {
+    size_t i = *pos;
+
+    for (;;) {
+        while (i < len && fmt[i] != '%') i++;
+        if (i + 1 >= len) {
+            return 0;
+        }
+        memset(conv, 0, sizeof(*conv));
+        conv->start = i++;
+        if (fmt[i] == '%') {
+            conv->mod = conv->conv = i;
+            *pos = i + 1;
+            return 1;
+        }
+        while (i < len && strchr("-+ #0", fmt[i])) i++;
+        /* width, then precision */
+        for (int part = 0; part < 2 && i < len; part++) {
+            if (part == 1) {
+                if (fmt[i] != '.') break;
+                i++;
+            }
+            if (i < len && fmt[i] == '*') {
+                conv->stars++;
+                i++;
+            } else {
+                while (i < len && fmt[i] >= '0' && fmt[i] <= '9') i++;
+            }
+        }
+        conv->mod = i;
+        while (i < len && strchr("hlqjztL", fmt[i])) i++;
+        if (i >= len) {
+            return 0;
+        }
+        conv->conv = i;
+
+        const char *m = fmt + conv->mod;
+        int mods = (int)(i - conv->mod);
+        int is_signed = fmt[i] == 'd' || fmt[i] == 'i';
+        switch (fmt[i]) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (mods == 0 || m[0] == 'h') {
+                    conv->kind = 'i';
+                } else if (m[0] == 'z') {
+                    conv->kind = is_signed ? 'Z' : 'z';
+                } else if (m[0] == 't') {
+                    conv->kind = is_signed ? 't' : 'T';
+                } else if (mods == 1 && m[0] == 'l') {
+                    conv->kind = is_signed ? 'l' : 'L';
+                } else {
+                    conv->kind = 'q'; /* ll, q, j */
+                }
+                break;
+            case 'c':
+                conv->kind = 'i';
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                conv->kind = mods && m[0] == 'L' ? 'D' : 'd';
+                break;
+            case 's':
+                conv->kind = mods ? 'p' : 's'; /* %ls, just the pointer */
+                break;
+            case 'p':
+                conv->kind = 'p';
+                break;
+            case 'n':
+                conv->kind = 'n';
+                break;
+            default:
+                /* not a conversion we know, print it as text */
+                continue;
+        }
+        *pos = i + 1;
+        return 1;
+    }
+}
+
+/* kinds, in argument order, stars included */
+static int parse_format(struct TraceFormat *f) {
+    struct TraceConv conv;
+    size_t pos = 0;
+    int fixed = 2 + 8, nstr = 0;
+
+    f->nargs = 0;
+    while (trace_next_conv(f->text, f->len, &pos, &conv)) {
+        if (conv.kind == 0) continue;
+        if (f->nargs + conv.stars + 1 > TRACE_MAX_ARGS) {
+            return -1;
+        }
+        for (int i = 0; i < conv.stars; i++) {
+            f->kinds[f->nargs++] = 'i';
+            fixed += 4;
+        }
+        f->kinds[f->nargs++] = conv.kind;
+        if (conv.kind == 's') {
+            nstr++;
+            fixed += 1;
+        } else {
+            fixed += trace_kind_size(conv.kind);
+        }
+    }
+    f->kinds[f->nargs] = '\0';
+    f->str_max = TRACE_STR_MAX;
+    if (nstr > 0 && fixed + nstr * TRACE_STR_MAX > TRACE_PAYLOAD) {
+        f->str_max = (TRACE_PAYLOAD - fixed) / nstr;
+    }
+    f->max_record = fixed + nstr * f->str_max;
+    return 0;
+}
+
+static void put16(uint8_t *p, uint16_t v) { memcpy(p, &v, 2); }
+
+/* Give a packet to the sink, lock held */
+static void emit_packet(uint8_t *packet, uint16_t thread, uint16_t seq,
+                        int len) {
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint16_t one = 1;
+
+    packet[0] = 'T';
+    packet[1] = *(const uint8_t *)&one ? 'l' : 'b';
+    put16(packet + 2, thread);
+    put16(packet + 4, seq);
+    put16(packet + 6, (uint16_t)len);
+    if (t.fp != NULL) {
+        fwrite(packet, 1, len, t.fp);
+        return;
+    }
+    if (!t.syslog) {
+        return;
+    }
+    char line[8 + (TRACE_PACKET_BYTES + 2) / 3 * 4];
+    int n = snprintf(line, sizeof(line), "TRC1 ");
+    for (int i = 0; i < len; i += 3) {
+        uint32_t v = packet[i] << 16;
+        if (i + 1 < len) v |= packet[i + 1] << 8;
+        if (i + 2 < len) v |= packet[i + 2];
+        line[n++] = b64[(v >> 18) & 63];
+        line[n++] = b64[(v >> 12) & 63];
+        line[n++] = i + 1 < len ? b64[(v >> 6) & 63] : '=';
+        line[n++] = i + 2 < len ? b64[v & 63] : '=';
+    }
+    rsyslog_queue_push(TRACE_SYSLOG_PRIORITY, line, n);
+}
+
+/* The clock and any formats registered since the last flush, ahead of the
+   events that use them, lock held */
+static void emit_formats(void) {
+    uint8_t packet[TRACE_PACKET_BYTES];
+    int len = TRACE_PACKET_HEADER;
+
+    if (!t.clock_sent) {
+        put16(packet + len, TRACE_ID_CLOCK);
+        memcpy(packet + len + 2, &t.ticks_per_sec, 8);
+        len += 10;
+        t.clock_sent = 1;
+    }
+    while (t.formats_sent < t.nformats) {
+        unsigned int id = t.formats_sent + 1;
+        struct TraceFormat *f = &t.formats[id];
+        if (len + 6 + f->len > TRACE_PACKET_BYTES) {
+            emit_packet(packet, 0, t.format_seq++, len);
+            len = TRACE_PACKET_HEADER;
+        }
+        put16(packet + len, TRACE_ID_FORMAT);
+        put16(packet + len + 2, (uint16_t)id);
+        put16(packet + len + 4, f->len);
+        memcpy(packet + len + 6, f->text, f->len);
+        len += 6 + f->len;
+        t.formats_sent = id;
+    }
+    if (len > TRACE_PACKET_HEADER) {
+        emit_packet(packet, 0, t.format_seq++, len);
+    }
+}
+
+static void close_packet(struct TraceBuffer *tb) {
+    if (tb->len > TRACE_PACKET_HEADER) {
+        tb->npackets++;
+        tb->len = TRACE_PACKET_HEADER;
+    }
+}
+
+/* lock held */
+static void flush_locked(struct TraceBuffer *tb) {
+    close_packet(tb);
+    if (tb->npackets == 0) {
+        return;
+    }
+    emit_formats();
+    for (int i = 0; i < tb->npackets; i++) {
+        /* the rest of the header is filled in here, len is kept up to date
+           while the packet fills */
+        uint16_t len;
+        memcpy(&len, tb->packets[i] + 6, 2);
+        emit_packet(tb->packets[i], tb->thread, tb->seq++, len);
+    }
+    tb->npackets = 0;
+}
+
+static void flush_buffer(struct TraceBuffer *tb) {
+    pthread_mutex_lock(&t.lock);
+    flush_locked(tb);
+    pthread_mutex_unlock(&t.lock);
+}
+
+static void thread_exit(void *arg) {
+    struct TraceBuffer *tb = arg;
+
+    pthread_mutex_lock(&t.lock);
+    flush_locked(tb);
+    t.buffers[tb->slot] = NULL;
+    pthread_mutex_unlock(&t.lock);
+    free(tb);
+}
+
+static void make_key(void) { pthread_key_create(&t.key, thread_exit); }
+
+static struct TraceBuffer *get_buffer(void) {
+    struct TraceBuffer *tb = pthread_getspecific(t.key);
+    if (tb != NULL) {
+        return tb;
+    }
+    tb = calloc(1, sizeof(*tb));
+    if (tb == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&t.lock);
+    tb->slot = -1;
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        if (t.buffers[i] == NULL) {
+            t.buffers[i] = tb;
+            tb->slot = i;
+            tb->thread = ++t.next_thread;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&t.lock);
+    if (tb->slot < 0) {
+        free(tb); /* too many threads, this one doesn't trace */
+        return NULL;
+    }
+    tb->len = TRACE_PACKET_HEADER;
+    pthread_setspecific(t.key, tb);
+    return tb;
+}
+
+static unsigned int register_format(atomic_uint *idp, const char *fmt) {
+    unsigned int id;
+
+    pthread_mutex_lock(&t.lock);
+    id = atomic_load_explicit(idp, memory_order_relaxed);
+    if (id == 0 && t.nformats + 1 < TRACE_MAX_FORMATS) {
+        struct TraceFormat *f = &t.formats[t.nformats + 1];
+        size_t len = strlen(fmt);
+        /* trailing newlines are the printf habit, the decoder adds one */
+        while (len > 0 && fmt[len - 1] == '\n') len--;
+        f->len = len < TRACE_FORMAT_MAX ? len : TRACE_FORMAT_MAX;
+        memcpy(f->text, fmt, f->len);
+        if (parse_format(f) == 0) {
+            id = ++t.nformats;
+            atomic_store_explicit(idp, id, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&t.lock);
+    return id;
+}
+
+void trace_event(atomic_uint *idp, const char *fmt, ...) {
+    struct TraceBuffer *tb;
+    va_list ap;
+
+    unsigned int id = atomic_load_explicit(idp, memory_order_acquire);
+    if (id == 0 && (id = register_format(idp, fmt)) == 0) {
+        return;
+    }
+    if ((tb = get_buffer()) == NULL) {
+        return;
+    }
+    const struct TraceFormat *f = &t.formats[id];
+    uint64_t now = trace_ticks();
+
+    if (tb->len + f->max_record > TRACE_PACKET_BYTES) {
+        close_packet(tb);
+        if (tb->npackets == TRACE_PACKETS) {
+            flush_buffer(tb);
+        }
+    }
+    if (tb->npackets == 0 && tb->len == TRACE_PACKET_HEADER) {
+        tb->first_ticks = now;
+    }
+
+    uint8_t *start = tb->packets[tb->npackets];
+    uint8_t *p = start + tb->len;
+    uint16_t id16 = (uint16_t)id;
+    memcpy(p, &id16, 2);
+    memcpy(p + 2, &now, 8);
+    p += 10;
+
+    va_start(ap, fmt);
+    for (int i = 0; i < f->nargs; i++) {
+        int32_t i32;
+        int64_t i64;
+        double d;
+        switch (f->kinds[i]) {
+            case 'i':
+                i32 = va_arg(ap, int);
+                memcpy(p, &i32, 4);
+                p += 4;
+                break;
+            case 'l':
+                i64 = va_arg(ap, long);
+                goto put64;
+            case 'L':
+                i64 = (int64_t)va_arg(ap, unsigned long);
+                goto put64;
+            case 'q':
+                i64 = va_arg(ap, long long);
+                goto put64;
+            case 'z':
+                i64 = (int64_t)va_arg(ap, size_t);
+                goto put64;
+            case 'Z':
+            case 't':
+                /* %zd, same size as size_t */
+                i64 = va_arg(ap, ptrdiff_t);
+                goto put64;
+            case 'T':
+                i64 = (int64_t)(size_t)va_arg(ap, ptrdiff_t);
+                goto put64;
+            case 'p':
+                i64 = (int64_t)(uintptr_t)va_arg(ap, void *);
+            put64:
+                memcpy(p, &i64, 8);
+                p += 8;
+                break;
+            case 'd':
+                d = va_arg(ap, double);
+                memcpy(p, &d, 8);
+                p += 8;
+                break;
+            case 'D':
+                d = (double)va_arg(ap, long double);
+                memcpy(p, &d, 8);
+                p += 8;
+                break;
+            case 's': {
+                const char *s = va_arg(ap, const char *);
+                size_t n = 0;
+                if (s == NULL) s = "(null)";
+                while (n < (size_t)f->str_max && s[n]) n++;
+                *p++ = (uint8_t)n;
+                memcpy(p, s, n);
+                p += n;
+                break;
+            }
+            case 'n':
+                (void)va_arg(ap, void *);
+                break;
+        }
+    }
+    va_end(ap);
+    tb->len = (int)(p - start);
+    put16(start + 6, (uint16_t)tb->len);
+
+    /* a thread that logs rarely still shows up within about a second */
+    if (now - tb->first_ticks > trace_ticks_per_sec()) {
+        flush_buffer(tb);
+    }
+}
+
+void trace_flush(void) {
+    if (!atomic_load(&trace_enabled)) {
+        return;
+    }
+    struct TraceBuffer *tb = pthread_getspecific(t.key);
+    if (tb != NULL) {
+        flush_buffer(tb);
+    }
+}
+
+static int trace_open(FILE *fp, int syslog) {
+    pthread_once(&t.once, make_key);
+    pthread_mutex_lock(&t.lock);
+    if (t.fp != NULL || t.syslog) {
+        pthread_mutex_unlock(&t.lock);
+        return -2;
+    }
+    t.fp = fp;
+    t.syslog = syslog;
+    t.ticks_per_sec = trace_ticks_per_sec();
+    /* a new sink hasn't seen any formats */
+    t.formats_sent = 0;
+    t.clock_sent = 0;
+    pthread_mutex_unlock(&t.lock);
+    atomic_store(&trace_enabled, 1);
+    return 0;
+}
+
+int trace_open_file(const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    int ret = trace_open(fp, 0);
+    if (ret < 0) {
+        fclose(fp);
+    }
+    return ret;
+}
+
+int trace_open_syslog(void) { return trace_open(NULL, 1); }
+
+void trace_close(void) {
+    pthread_once(&t.once, make_key);
+    atomic_store(&trace_enabled, 0);
+    pthread_mutex_lock(&t.lock);
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        if (t.buffers[i] != NULL) {
+            flush_locked(t.buffers[i]);
+        }
+    }
+    if (t.fp != NULL) {
+        fclose(t.fp);
+        t.fp = NULL;
+    }
+    t.syslog = 0;
+    pthread_mutex_unlock(&t.lock);
+}
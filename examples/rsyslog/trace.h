@@ -0,0 +1,113 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary trace log, printf without the printf.  A TRACE call copies a
+   format id, a timestamp and the raw arguments into a per-thread buffer,
+   no snprintf, no strftime, no lock.  Full buffers (or ones older than a
+   second) go out as packets, to a file or over the rsyslog shipper, and
+   tools/trace_decode turns them back into text on the host.
+
+     trace_open_syslog();    // after init_rsyslogger, or trace_open_file
+     ...
+     TRACE("upload_texture() switch %d", sdl_pix_fmt);
+     ...
+     trace_flush();          // before a thread exits
+     trace_close();
+
+   The format string is sent once, the first time a call site runs.
+   Supported conversions are the usual d i u x o c e f g s p with the
+   h hh l ll z j t length modifiers and * widths.  %s copies at most
+   TRACE_STR_MAX bytes (less when a format has several), %n is ignored.
+
+   Stream layout, every field in the writer's byte order:
+
+     packet  'T', 'l' or 'b' (byte order), u16 thread, u16 seq, u16 len
+             then records, len bytes in total, at most TRACE_PACKET_BYTES
+     record  u16 id, u64 ticks, arguments
+               int 4 bytes, long / long long / size_t / pointer 8,
+               double 8, string u8 length + bytes
+             id 0, a format:  u16 0, u16 id, u16 length, format bytes
+             id 0xffff, the clock:  u16 0xffff, u64 ticks per second
+
+   The file sink writes packets back to back.  Over rsyslog each packet is
+   one "TRC1 <base64>" line, sized to fit a shipper slot.
+*/
+
+/* 172 bytes is 232 base64 characters, plus "TRC1 " that's one
+   RSYSLOG_SLOT_TEXT */
+#define TRACE_PACKET_BYTES 172
+#define TRACE_PACKET_HEADER 8
+/* packets buffered per thread before a flush */
+#define TRACE_PACKETS 16
+#define TRACE_MAX_ARGS 8
+#define TRACE_STR_MAX 32
+#define TRACE_FORMAT_MAX 140
+#define TRACE_MAX_FORMATS 1024
+#define TRACE_MAX_THREADS 32
+
+#define TRACE_ID_FORMAT 0
+#define TRACE_ID_CLOCK 0xffff
+
+/* One conversion in a format string, see trace_next_conv.  kind is what
+   goes in the record:
+     i  int and smaller, 4 bytes
+     l L  long, signed / unsigned, 8 bytes
+     q  long long and intmax_t, 8 bytes
+     z Z  size_t, unsigned / signed (%zd), 8 bytes
+     t T  ptrdiff_t, signed / unsigned, 8 bytes
+     d D  double / long double, both sent as a double, 8 bytes
+     s  string, u8 length + bytes
+     p  pointer, 8 bytes
+     n  %n, nothing stored
+     0  %%, no argument
+   Each * takes an int (kind i) before the value. */
+struct TraceConv {
+    size_t start; /* the '%' */
+    size_t mod;   /* length modifier, == conv when there's none */
+    size_t conv;  /* the conversion character */
+    int stars;
+    char kind;
+};
+
+extern atomic_int trace_enabled;
+
+#define TRACE(fmt, ...)                                        \
+    do {                                                       \
+        static atomic_uint trace_id_;                          \
+        if (atomic_load_explicit(&trace_enabled,               \
+                                 memory_order_relaxed)) {      \
+            trace_event(&trace_id_, fmt, ##__VA_ARGS__);       \
+        }                                                      \
+    } while (0)
+
+/* Binary packets to path.  0 ok, -1 can't open, -2 already open */
+int trace_open_file(const char *path);
+
+/* Packets as text lines through rsyslog_queue_push, the shipper must be
+   running (init_rsyslogger does that on the WiiU).  0 ok, -2 already open */
+int trace_open_syslog(void);
+
+/* Ship the calling thread's buffer now */
+void trace_flush(void);
+
+/* Flush every thread's buffer and close the sink.  Only call it once the
+   other tracing threads are done. */
+void trace_close(void);
+
+void trace_event(atomic_uint *id, const char *fmt, ...);
+
+/* Next conversion in fmt[*pos, len), moves *pos past it.  1 found, 0 no
+   more (a conversion cut off at len counts as text).  The decoder walks
+   formats with the same function, so both ends agree on the arguments. */
+int trace_next_conv(const char *fmt, size_t len, size_t *pos,
+                    struct TraceConv *conv);
+
+/* Bytes a kind takes in a record, -1 for a string (variable) */
+int trace_kind_size(char kind);
+
+#endif  // TRACE_H